@@ -17,7 +17,13 @@
 #include <math.h>
 #include <map>
 #include <set>
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <algorithm>
 #include "Element/Interpolation/Interpolation.h"
+#include "Element/Interpolation/MaxEnt/Newton.h"
+#include "Utils/Profiler/Profiler.h"
 
 using namespace std;
 
@@ -50,6 +56,15 @@ namespace Element
 	virtual ~Base();
         
 	void operator() (const vector_type &);
+
+	// as operator (), by a Newton solve warm-started from the current
+	// lambda, e.g. the one of the previous step or read(); falls back
+	// to operator () if the solve fails. The workspace is the caller's,
+	// one per thread, or a temporary one. Newton solves the plain dual,
+	// so with _M4EXTREME_VISCOUS_REGULARIZATION_ the 2D and 3D points
+	// go through operator () as well.
+	void Update(const vector_type &, Newton &);
+	void Update(const vector_type &);
         
         void  SetNodes(const nodeset_type *);
         const nodeset_type * GetNodes() const;
@@ -263,6 +278,70 @@ namespace Element
 	Jet<0> & operator = (const Jet<0> &);
       };
 
+      //////////////////////////////////////////////////////////////////////
+      // Class Base, inline members
+      //////////////////////////////////////////////////////////////////////
+
+      inline void Base::Update(const vector_type & qp, Newton & solver)
+      {
+	const unsigned int dim = qp.size();
+	if (_x == 0 || _Lambda == 0 || _JInv == 0 || _Lambda->size() != dim
+	    || _JInv->size1() != dim || _x->empty() || dim == 0 || dim > 3) {
+	  (*this)(qp);
+	  return;
+	}
+
+#if defined(_M4EXTREME_VISCOUS_REGULARIZATION_)
+	// operator () minimizes the regularized objective there
+	if (dim > 1) {
+	  (*this)(qp);
+	  return;
+	}
+#endif
+
+	solver.SetSize(dim, _x->size());
+	unsigned int a = 0;
+	for (nodeset_type::const_iterator pN = _x->begin(); pN != _x->end(); ++pN, ++a) {
+	  for (unsigned int d = 0; d < dim; ++d) solver.Offsets(d)[a] = qp[d] - pN->second[d];
+	}
+
+	double lambda[3];
+	for (unsigned int d = 0; d < dim; ++d) lambda[d] = (*_Lambda)[d];
+	_NNodes.resize(_x->size());
+	bool converged = solver.Solve(_Beta, lambda, &_NNodes[0], _JInv->begin());
+	M4EXTREME_PROFILE_COUNT(NEWTON_ITERATIONS, solver.GetIterations());
+	if (!converged) {
+	  // from scratch, the previous lambda may be far off
+	  for (unsigned int d = 0; d < dim; ++d) lambda[d] = 0.0;
+	  converged = solver.Solve(_Beta, lambda, &_NNodes[0], _JInv->begin());
+	  M4EXTREME_PROFILE_COUNT(NEWTON_ITERATIONS, solver.GetIterations());
+	  if (!converged) {
+	    (*this)(qp);
+	    return;
+	  }
+	}
+	for (unsigned int d = 0; d < dim; ++d) (*_Lambda)[d] = lambda[d];
+
+#ifndef NDEBUG
+	// the shape functions must be those of operator ()
+	const vector<double> N(_NNodes);
+	(*this)(qp);
+	double error = 0.0;
+	for (size_t a = 0; a < N.size(); ++a) error = max(error, fabs(N[a] - _NNodes[a]));
+	if (error > 1.0e-8) {
+	  cerr << "Newton and operator () disagree by " << error
+	       << " @Element::Interpolation::MaxEnt::Base::Update" << endl;
+	  assert(false);
+	}
+#endif
+      }
+
+      inline void Base::Update(const vector_type & qp)
+      {
+	Newton solver;
+	Update(qp, solver);
+      }
+
     }
 
   }
@@ -0,0 +1,265 @@
+// Newton.h: interface for the Newton class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+////////////////////////////////////////////////////////////////////////////
+
+
+#if !defined(ELEMENT_INTERPOLATION_MAXENT_NEWTON_H__INCLUDED_)
+#define ELEMENT_INTERPOLATION_MAXENT_NEWTON_H__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+namespace Element
+{
+  namespace Interpolation
+  {
+    namespace MaxEnt
+    {
+      //////////////////////////////////////////////////////////////////////
+      // Class Newton
+      //////////////////////////////////////////////////////////////////////
+      //
+      // Newton solve of the local max-ent multipliers at a point x,
+      //
+      //   lambda = argmin log Z,  Z = sum_a exp(-beta |dx_a|^2 + lambda . dx_a),
+      //
+      // dx_a = x - x_a, with a backtracking line search on log Z, which is
+      // convex. The offsets are packed component by component into
+      // contiguous arrays and -beta |dx_a|^2 is computed once, so that an
+      // iteration is three passes over the nodes without any lookup: the
+      // exponents, the exponentials (Exp, a branch-free kernel the
+      // compiler vectorizes) and the moments r = sum p_a dx_a and
+      // J = sum p_a dx_a dx_a^T - r r^T.
+      //
+      // Solve() starts from the lambda it is given, e.g. the converged one
+      // of the previous step, which is usually a couple of iterations
+      // away. The workspace is kept between calls; one object per thread.
+      //
+      class Newton
+      {
+      public:
+
+	Newton() : _dim(0), _n(0), _tolerance(1.0e-12), _maxit(50), _iterations(0) {}
+	virtual ~Newton() {}
+
+	// offsets dx_a = x - x_a, component d of node a at dx[d][a]
+	void SetSize(unsigned int dim, unsigned int n) {
+	  _dim = dim; _n = n;
+	  _dx.resize((size_t)dim * n);
+	  _g.resize(n); _f.resize(n); _e.resize(n); _et.resize(n);
+	}
+	double * Offsets(unsigned int d) { return &_dx[(size_t)d * _n]; }
+
+	// |r| <= tolerance * the rms node distance
+	void SetTolerance(double tolerance) { _tolerance = tolerance; }
+	void SetMaxIterations(unsigned int maxit) { _maxit = maxit; }
+	unsigned int GetIterations() const { return _iterations; }
+
+	// lambda is the initial guess on entry and the solution on return,
+	// p the shape functions and Jinv the inverse of J (column major);
+	// false if the iterations do not converge
+	bool Solve(double beta, double * lambda, double * p, double * Jinv) {
+	  switch (_dim) {
+	  case 1: return _solve<1>(beta, lambda, p, Jinv);
+	  case 2: return _solve<2>(beta, lambda, p, Jinv);
+	  case 3: return _solve<3>(beta, lambda, p, Jinv);
+	  default: return false;
+	  }
+	}
+
+	// y = exp(x), relative error below 1e-15; x is clamped to the
+	// range of the normalized doubles
+	static void Exp(unsigned int n, const double * x, double * y) {
+	  const double log2e = 1.4426950408889634, ln2hi = 6.93147180369123816490e-01,
+	    ln2lo = 1.90821492927058770002e-10, shift = 6755399441055744.0;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    double t = x[i];
+	    t = t < -708.0 ? -708.0 : (t > 709.0 ? 709.0 : t);
+	    // k = round(t / ln 2), kept in the low bits of m
+	    const double m = t * log2e + shift;
+	    const double k = m - shift;
+	    const double r = (t - k * ln2hi) - k * ln2lo;
+	    double q = 1.0 / 39916800.0;
+	    q = q * r + 1.0 / 3628800.0;
+	    q = q * r + 1.0 / 362880.0;
+	    q = q * r + 1.0 / 40320.0;
+	    q = q * r + 1.0 / 5040.0;
+	    q = q * r + 1.0 / 720.0;
+	    q = q * r + 1.0 / 120.0;
+	    q = q * r + 1.0 / 24.0;
+	    q = q * r + 1.0 / 6.0;
+	    q = q * r + 0.5;
+	    q = q * r + 1.0;
+	    q = q * r + 1.0;
+	    // 2^k from the bits of m
+	    unsigned long long b;
+	    memcpy(&b, &m, sizeof(double));
+	    b = (b + 1023ULL) << 52;
+	    double s;
+	    memcpy(&s, &b, sizeof(double));
+	    y[i] = q * s;
+	  }
+	}
+
+      private:
+
+	// log Z at lambda, e the exponentials scaled by exp(-fmax)
+	template<unsigned int D>
+	double _evaluate(const double * lambda, double * e, double & Z) {
+	  const unsigned int n = _n;
+	  const double * __restrict__ g = &_g[0];
+	  double * __restrict__ f = &_f[0];
+	  for (unsigned int a = 0; a < n; ++a) f[a] = g[a];
+	  for (unsigned int d = 0; d < D; ++d) {
+	    const double * __restrict__ dx = &_dx[(size_t)d * n];
+	    const double l = lambda[d];
+	    for (unsigned int a = 0; a < n; ++a) f[a] += l * dx[a];
+	  }
+	  double fmax = f[0];
+	  for (unsigned int a = 1; a < n; ++a) fmax = f[a] > fmax ? f[a] : fmax;
+	  for (unsigned int a = 0; a < n; ++a) f[a] -= fmax;
+	  Exp(n, f, e);
+	  Z = 0.0;
+	  for (unsigned int a = 0; a < n; ++a) Z += e[a];
+	  return log(Z) + fmax;
+	}
+
+	// r and J at the exponentials e
+	template<unsigned int D>
+	void _moments(const double * e, double Z, double * r, double * J) const {
+	  const unsigned int n = _n;
+	  const double zinv = 1.0 / Z;
+	  for (unsigned int d = 0; d < D; ++d) {
+	    const double * __restrict__ dx = &_dx[(size_t)d * n];
+	    double s = 0.0;
+	    for (unsigned int a = 0; a < n; ++a) s += e[a] * dx[a];
+	    r[d] = s * zinv;
+	    for (unsigned int c = 0; c <= d; ++c) {
+	      const double * __restrict__ dy = &_dx[(size_t)c * n];
+	      double t = 0.0;
+	      for (unsigned int a = 0; a < n; ++a) t += e[a] * dx[a] * dy[a];
+	      J[d + D * c] = J[c + D * d] = t * zinv;
+	    }
+	  }
+	  for (unsigned int d = 0; d < D; ++d)
+	    for (unsigned int c = 0; c < D; ++c) J[d + D * c] -= r[d] * r[c];
+	}
+
+	// inverse of a symmetric positive definite D x D matrix
+	template<unsigned int D>
+	static bool _invert(const double * J, double * Jinv) {
+	  if (D == 1) {
+	    if (!(J[0] > 0.0)) return false;
+	    Jinv[0] = 1.0 / J[0];
+	    return true;
+	  }
+	  if (D == 2) {
+	    const double det = J[0] * J[3] - J[1] * J[2];
+	    if (!(det > 1.0e-300)) return false;
+	    Jinv[0] = J[3] / det; Jinv[3] = J[0] / det;
+	    Jinv[1] = -J[1] / det; Jinv[2] = -J[2] / det;
+	    return true;
+	  }
+	  const double c00 = J[4] * J[8] - J[5] * J[7];
+	  const double c01 = J[5] * J[6] - J[3] * J[8];
+	  const double c02 = J[3] * J[7] - J[4] * J[6];
+	  const double det = J[0] * c00 + J[1] * c01 + J[2] * c02;
+	  if (!(det > 1.0e-300)) return false;
+	  const double inv = 1.0 / det;
+	  Jinv[0] = c00 * inv; Jinv[3] = c01 * inv; Jinv[6] = c02 * inv;
+	  Jinv[1] = (J[2] * J[7] - J[1] * J[8]) * inv;
+	  Jinv[4] = (J[0] * J[8] - J[2] * J[6]) * inv;
+	  Jinv[7] = (J[1] * J[6] - J[0] * J[7]) * inv;
+	  Jinv[2] = (J[1] * J[5] - J[2] * J[4]) * inv;
+	  Jinv[5] = (J[2] * J[3] - J[0] * J[5]) * inv;
+	  Jinv[8] = (J[0] * J[4] - J[1] * J[3]) * inv;
+	  return true;
+	}
+
+	template<unsigned int D>
+	bool _solve(double beta, double * lambda, double * p, double * Jinv) {
+	  const unsigned int n = _n;
+	  unsigned int a, d;
+	  _iterations = 0;
+	  if (n == 0) return false;
+
+	  // -beta |dx_a|^2, and the length scale of the tolerance
+	  double scale = 0.0;
+	  for (a = 0; a < n; ++a) _g[a] = 0.0;
+	  for (d = 0; d < D; ++d) {
+	    const double * dx = &_dx[(size_t)d * n];
+	    for (a = 0; a < n; ++a) _g[a] += dx[a] * dx[a];
+	  }
+	  for (a = 0; a < n; ++a) { scale += _g[a]; _g[a] *= -beta; }
+	  scale = sqrt(scale / n);
+	  for (d = 0; d < D; ++d) if (lambda[d] != lambda[d]) lambda[d] = 0.0;
+
+	  double r[D], J[D * D], step[D], trial[D], Z, Zt;
+	  double logZ = _evaluate<D>(lambda, &_e[0], Z);
+	  _moments<D>(&_e[0], Z, r, J);
+
+	  for (;;) {
+	    double rr = 0.0;
+	    for (d = 0; d < D; ++d) rr += r[d] * r[d];
+	    if (sqrt(rr) <= _tolerance * scale) break;
+	    if (_iterations == _maxit || !_invert<D>(J, Jinv)) return false;
+	    ++_iterations;
+
+	    double slope = 0.0, ss = 0.0, ll = 0.0;
+	    for (d = 0; d < D; ++d) {
+	      step[d] = 0.0;
+	      for (unsigned int c = 0; c < D; ++c) step[d] -= Jinv[d + D * c] * r[c];
+	      slope += r[d] * step[d];
+	      ss += step[d] * step[d];
+	      ll += lambda[d] * lambda[d];
+	    }
+	    // a step at the round-off of lambda, r is as small as it gets
+	    if (sqrt(ss) <= 1.0e-14 * (sqrt(ll) + 1.0 / scale)) break;
+
+	    // backtracking, Armijo condition on log Z up to its round-off
+	    const double noise = 1.0e-15 * (fabs(logZ) + 1.0);
+	    double t = 1.0, logZt;
+	    for (;;) {
+	      for (d = 0; d < D; ++d) trial[d] = lambda[d] + t * step[d];
+	      logZt = _evaluate<D>(trial, &_et[0], Zt);
+	      if (logZt <= logZ + 1.0e-4 * t * slope + noise) break;
+	      if (t < 1.0e-10) return false;
+	      t *= 0.5;
+	    }
+
+	    for (d = 0; d < D; ++d) lambda[d] = trial[d];
+	    logZ = logZt;
+	    Z = Zt;
+	    _e.swap(_et);
+	    _moments<D>(&_e[0], Z, r, J);
+	  }
+
+	  if (!_invert<D>(J, Jinv)) return false;
+	  const double zinv = 1.0 / Z;
+	  for (a = 0; a < n; ++a) p[a] = _e[a] * zinv;
+	  return true;
+	}
+
+	unsigned int _dim, _n;
+	double _tolerance;
+	unsigned int _maxit, _iterations;
+	vector<double> _dx, _g, _f, _e, _et;
+      };
+
+    }
+
+  }
+
+}
+
+#endif // !defined(ELEMENT_INTERPOLATION_MAXENT_NEWTON_H__INCLUDED_)
@@ -0,0 +1,336 @@
+// ShapeCache.h: interface for the ShapeCache class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(ELEMENT_MATERIALPOINT_SHAPECACHE_H__INCLUDED_)
+#define ELEMENT_MATERIALPOINT_SHAPECACHE_H__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include "./MaterialPoint.h"
+
+using namespace std;
+
+namespace Element
+{
+  namespace MaterialPoint
+  {
+    //////////////////////////////////////////////////////////////////////
+    // Class ShapeCache
+    //
+    // Lazy update of the material points of a body. For every material
+    // point the cache keeps the nodal configuration X and the gradients
+    // DN0 of its last shape function computation, and at each update
+    // measures the deformation of the support since then from
+    //
+    //   f = sum_a x_a (x) DN0_a,
+    //
+    // either as the Green-Lagrange strain |f^T f - I| / 2 (STRAIN, blind
+    // to rigid rotations) or as the relative change of the node offsets
+    // from the quadrature point (DISPLACEMENT). A material point past
+    // the tolerance is Reset, i.e. its shape functions are recomputed
+    // on the current configuration; the others keep N and are pushed
+    // forward as Data::Reset would move them,
+    //
+    //   QP = sum_a N_a x_a,  QW = QW0 det f,  DN_a = f^-T DN0_a,
+    //
+    // and the volume and centroid follow. Before a recomputation DN0 and
+    // QW0 are put back, so that Reset sees the whole deformation since
+    // the previous one and ends where the eager updates would. The
+    // checks of Reset on the
+    // principal stretches (tension, contact) are only made at a
+    // recomputation, so the tolerance must stay well below the critical
+    // strain of the model.
+    //
+    // Entries are kept by position in the vector of local states and
+    // checked against their Data, so after a renumbering or a migration
+    // the moved material points are simply recomputed once.
+    //////////////////////////////////////////////////////////////////////
+
+    class ShapeCache
+    {
+    public:
+
+      typedef Data::dof_type dof_type;
+      typedef Data::domain_type domain_type;
+
+      enum METRIC { STRAIN = 0, DISPLACEMENT = 1 };
+
+      ShapeCache(unsigned int dim, double tolerance, METRIC metric = STRAIN)
+	: _dim(dim), _tolerance(tolerance), _metric(metric),
+	  _resets(0), _pushforwards(0) {}
+      virtual ~ShapeCache() {}
+
+      void SetTolerance(double tolerance) { _tolerance = tolerance; }
+      double GetTolerance() const { return _tolerance; }
+      void SetMetric(METRIC metric) { _metric = metric; }
+      METRIC GetMetric() const { return _metric; }
+
+      unsigned int GetNumofResets() const { return _resets; }
+      unsigned int GetNumofPushForwards() const { return _pushforwards; }
+
+      // forget the cached configurations, the next update recomputes all
+      void Invalidate() { _points.clear(); }
+
+      // x the current positions of the nodes, e.g. embedded from the model
+      void Update(const vector<LocalState *> & LS, const domain_type & x) {
+	if (_points.size() != LS.size()) _points.resize(LS.size());
+	for (unsigned int i = 0; i < LS.size(); ++i) Update(i, *LS[i], x);
+	return;
+      }
+
+      // returns true if material point i was Reset, false if pushed forward
+      bool Update(unsigned int i, LocalState & LS, const domain_type & x) {
+	if (i >= _points.size()) _points.resize(i + 1);
+	_entry & e = _points[i];
+	Data * D = LS.GetData();
+	if (e.data == D && _pushForward(e, *D, x)) {
+	  _pushforwards++;
+	  return false;
+	}
+
+	// Reset takes the deformation since the last recomputation
+	if (e.data == D) _restore(e, *D);
+	LS.Reset(x);
+	_capture(e, *D, x);
+	_resets++;
+	return true;
+      }
+
+    private:
+
+      struct _entry {
+	_entry() : data(0) {}
+	const Data * data;
+	vector<unsigned int> offsets;
+	vector<dof_type *> dofs;
+	vector<double> X, DN0, QW0, QP0;
+      };
+
+      void _capture(_entry & e, const Data & D, const domain_type & x) {
+	const vector<Data::dshape_type> & DN = D.GetDN();
+	const vector<double> & QW = D.GetQW();
+	const vector<Data::vector_type> & QP = D.GetQP();
+	const unsigned int dim = _dim, nq = DN.size();
+	e.data = 0;
+	if (QW.size() != nq || QP.size() != nq) return;
+
+	e.offsets.assign(nq + 1, 0);
+	for (unsigned int q = 0; q < nq; ++q) e.offsets[q+1] = e.offsets[q] + DN[q].size();
+	const unsigned int nnz = e.offsets[nq];
+	e.dofs.resize(nnz);
+	e.X.resize((size_t)nnz * dim);
+	e.DN0.resize((size_t)nnz * dim);
+	e.QW0 = QW;
+	e.QP0.resize((size_t)nq * dim);
+
+	unsigned int k = 0;
+	for (unsigned int q = 0; q < nq; ++q) {
+	  for (unsigned int j = 0; j < dim; ++j) e.QP0[q*dim + j] = QP[q][j];
+	  for (Data::dshape_type::const_iterator pDN = DN[q].begin();
+	       pDN != DN[q].end(); ++pDN, ++k) {
+	    domain_type::const_iterator px = x.find(pDN->first);
+	    if (px == x.end()) return;
+	    e.dofs[k] = pDN->first;
+	    for (unsigned int j = 0; j < dim; ++j) {
+	      e.X[(size_t)k*dim + j] = px->second[j];
+	      e.DN0[(size_t)k*dim + j] = pDN->second[j];
+	    }
+	  }
+	}
+	e.data = &D;
+	return;
+      }
+
+      // back to the configuration of the last recomputation
+      void _restore(const _entry & e, Data & D) const {
+	vector<Data::dshape_type> & DN = D.GetDN();
+	vector<double> & QW = D.GetQW();
+	const unsigned int dim = _dim, nq = e.QW0.size();
+	if (DN.size() != nq || QW.size() != nq) return;
+	for (unsigned int q = 0; q < nq; ++q) {
+	  if (DN[q].size() != e.offsets[q+1] - e.offsets[q]) return;
+	}
+	for (unsigned int q = 0; q < nq; ++q) {
+	  unsigned int k = e.offsets[q];
+	  for (Data::dshape_type::iterator pDN = DN[q].begin();
+	       pDN != DN[q].end(); ++pDN, ++k) {
+	    if (pDN->first != e.dofs[k]) return;
+	  }
+	}
+	for (unsigned int q = 0; q < nq; ++q) {
+	  QW[q] = e.QW0[q];
+	  unsigned int k = e.offsets[q];
+	  for (Data::dshape_type::iterator pDN = DN[q].begin();
+	       pDN != DN[q].end(); ++pDN, ++k) {
+	    double * p = pDN->second.begin();
+	    for (unsigned int j = 0; j < dim; ++j) p[j] = e.DN0[(size_t)k*dim + j];
+	  }
+	}
+	return;
+      }
+
+      // false, and D untouched, if a material point must be recomputed
+      bool _pushForward(const _entry & e, Data & D, const domain_type & x) {
+	vector<Data::shape_type> & N = D.GetN();
+	vector<Data::dshape_type> & DN = D.GetDN();
+	const unsigned int dim = _dim, dd = dim * dim, nq = e.QW0.size();
+	if (N.size() != nq || DN.size() != nq || D.GetQW().size() != nq
+	    || D.GetQP().size() != nq) return false;
+
+	// positions of the supports and f of every quadrature point
+	_x.resize(e.X.size());
+	_f.resize((size_t)nq * dd);
+	_finv.resize((size_t)nq * dd);
+	_J.resize(nq);
+	_qp.resize((size_t)nq * dim);
+	for (unsigned int q = 0; q < nq; ++q) {
+	  if (N[q].size() != e.offsets[q+1] - e.offsets[q]
+	      || DN[q].size() != N[q].size()) return false;
+	  double * f = &_f[(size_t)q * dd];
+	  double * xq = &_qp[(size_t)q * dim];
+	  for (unsigned int j = 0; j < dd; ++j) f[j] = 0.0;
+	  for (unsigned int j = 0; j < dim; ++j) xq[j] = 0.0;
+
+	  unsigned int k = e.offsets[q];
+	  for (Data::shape_type::const_iterator pN = N[q].begin();
+	       pN != N[q].end(); ++pN, ++k) {
+	    if (pN->first != e.dofs[k]) return false;
+	    domain_type::const_iterator px = x.find(pN->first);
+	    if (px == x.end()) return false;
+	    double * xk = &_x[(size_t)k * dim];
+	    const double * DNk = &e.DN0[(size_t)k * dim];
+	    for (unsigned int i = 0; i < dim; ++i) {
+	      xk[i] = px->second[i];
+	      xq[i] += pN->second * xk[i];
+	      for (unsigned int j = 0; j < dim; ++j) f[i*dim + j] += xk[i] * DNk[j];
+	    }
+	  }
+
+	  if (_measure(e, q, f, xq) > _tolerance) return false;
+	  _J[q] = _invert(f, &_finv[(size_t)q * dd]);
+	  if (!(_J[q] > 0.0)) return false;
+	}
+
+	// all within the tolerance, move the material point
+	vector<double> & QW = D.GetQW();
+	vector<Data::vector_type> & QP = D.GetQP();
+	Data::vector_type & centroid = D.GetCentroid();
+	double volume = 0.0;
+	for (unsigned int j = 0; j < centroid.size(); ++j) centroid[j] = 0.0;
+	for (unsigned int q = 0; q < nq; ++q) {
+	  QW[q] = e.QW0[q] * _J[q];
+	  volume += QW[q];
+
+	  const double * finv = &_finv[(size_t)q * dd];
+	  for (unsigned int j = 0; j < dim; ++j) {
+	    QP[q][j] = _qp[(size_t)q*dim + j];
+	    if (j < centroid.size()) centroid[j] += QP[q][j] / nq;
+	  }
+
+	  unsigned int k = e.offsets[q];
+	  for (Data::dshape_type::iterator pDN = DN[q].begin();
+	       pDN != DN[q].end(); ++pDN, ++k) {
+	    const double * DNk = &e.DN0[(size_t)k * dim];
+	    double * p = pDN->second.begin();
+	    for (unsigned int j = 0; j < dim; ++j) {
+	      double s = 0.0;
+	      for (unsigned int i = 0; i < dim; ++i) s += finv[i*dim + j] * DNk[i];
+	      p[j] = s;
+	    }
+	  }
+	}
+	D.GetVolume() = volume;
+	return true;
+      }
+
+      double _measure(const _entry & e, unsigned int q,
+		      const double * f, const double * xq) const {
+	const unsigned int dim = _dim;
+	if (_metric == STRAIN) {
+	  double E2 = 0.0;
+	  for (unsigned int i = 0; i < dim; ++i) {
+	    for (unsigned int j = 0; j < dim; ++j) {
+	      double C = 0.0;
+	      for (unsigned int l = 0; l < dim; ++l) C += f[l*dim + i] * f[l*dim + j];
+	      const double E = 0.5 * (C - (i == j ? 1.0 : 0.0));
+	      E2 += E * E;
+	    }
+	  }
+	  return sqrt(E2);
+	}
+
+	// max |(x_a - xq) - (X_a - Xq)| / max |X_a - Xq|
+	const double * Xq = &e.QP0[(size_t)q * dim];
+	double du = 0.0, h = 0.0;
+	for (unsigned int k = e.offsets[q]; k < e.offsets[q+1]; ++k) {
+	  const double * xk = &_x[(size_t)k * dim];
+	  const double * Xk = &e.X[(size_t)k * dim];
+	  double u2 = 0.0, d2 = 0.0;
+	  for (unsigned int j = 0; j < dim; ++j) {
+	    const double d = Xk[j] - Xq[j];
+	    const double u = (xk[j] - xq[j]) - d;
+	    u2 += u * u;
+	    d2 += d * d;
+	  }
+	  if (u2 > du) du = u2;
+	  if (d2 > h) h = d2;
+	}
+	return h > 0.0 ? sqrt(du / h) : 0.0;
+      }
+
+      // inverse of f (row major), returns det f
+      double _invert(const double * f, double * finv) const {
+	if (_dim == 1) {
+	  if (f[0] != 0.0) finv[0] = 1.0 / f[0];
+	  return f[0];
+	}
+	if (_dim == 2) {
+	  const double det = f[0] * f[3] - f[1] * f[2];
+	  if (det == 0.0) return det;
+	  finv[0] = f[3] / det; finv[1] = -f[1] / det;
+	  finv[2] = -f[2] / det; finv[3] = f[0] / det;
+	  return det;
+	}
+	const double c0 = f[4] * f[8] - f[5] * f[7];
+	const double c1 = f[5] * f[6] - f[3] * f[8];
+	const double c2 = f[3] * f[7] - f[4] * f[6];
+	const double det = f[0] * c0 + f[1] * c1 + f[2] * c2;
+	if (det == 0.0) return det;
+	const double inv = 1.0 / det;
+	finv[0] = c0 * inv;
+	finv[1] = (f[2] * f[7] - f[1] * f[8]) * inv;
+	finv[2] = (f[1] * f[5] - f[2] * f[4]) * inv;
+	finv[3] = c1 * inv;
+	finv[4] = (f[0] * f[8] - f[2] * f[6]) * inv;
+	finv[5] = (f[2] * f[3] - f[0] * f[5]) * inv;
+	finv[6] = c2 * inv;
+	finv[7] = (f[1] * f[6] - f[0] * f[7]) * inv;
+	finv[8] = (f[0] * f[4] - f[1] * f[3]) * inv;
+	return det;
+      }
+
+    private:
+
+      unsigned int _dim;
+      double _tolerance;
+      METRIC _metric;
+      unsigned int _resets, _pushforwards;
+      vector<_entry> _points;
+      vector<double> _x, _f, _finv, _J, _qp;
+
+    private:
+
+      ShapeCache(const ShapeCache &);
+      ShapeCache & operator = (const ShapeCache &);
+    };
+
+  }
+
+}
+
+#endif // !defined(ELEMENT_MATERIALPOINT_SHAPECACHE_H__INCLUDED_)
@@ -0,0 +1,191 @@
+// ShapeTable.h: interface for the ShapeTable class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(ELEMENT_MATERIALPOINT_SHAPETABLE_H__INCLUDED_)
+#define ELEMENT_MATERIALPOINT_SHAPETABLE_H__INCLUDED_
+
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include "./MaterialPoint.h"
+#include "../../Solver/ExplicitDynamics/NodalField.h"
+
+using namespace std;
+
+namespace Element
+{
+  namespace MaterialPoint
+  {
+    //////////////////////////////////////////////////////////////////////
+    // Class ShapeTable
+    //
+    // Compressed row storage of the shape functions of a Data. Row q
+    // holds the support of quadrature point q as dense node indices of
+    // a Solver::NodalField, the values N and the gradients DN packed
+    // contiguously (DN of the kth entry at _DN[k*dim]). The index
+    // arrays are rebuilt only when the support of a quadrature point
+    // changes, i.e. after Data::Reset or Data::Remesh picked up new
+    // neighbors, or when the field was renumbered; otherwise Update
+    // only refreshes the values.
+    //
+    // The deformation gradient uses the storage of Dyadic(x, DN),
+    // F[i*dim + j] = sum_a x_a[i] DN_a[j], and the nodal forces are the
+    // work conjugate, f_a[i] += w sum_j P[i*dim + j] DN_a[j].
+    //////////////////////////////////////////////////////////////////////
+
+    class ShapeTable
+    {
+    public:
+
+      typedef Data::dof_type dof_type;
+
+      ShapeTable(unsigned int dim) : _dim(dim), _rebuilds(0), _numbering(0) {}
+      virtual ~ShapeTable() {}
+
+      // returns true if the support changed and the rows were rebuilt
+      bool Update(const Data & D, const Solver::NodalField & field) {
+	const vector<Data::shape_type> & N = D.GetN();
+	const vector<Data::dshape_type> & DN = D.GetDN();
+	assert(N.size() == DN.size());
+
+	bool rebuild = N.size() + 1 != _offsets.size() || field.GetNumbering() != _numbering;
+	for (unsigned int q = 0; !rebuild && q < N.size(); ++q) {
+	  if (N[q].size() != _offsets[q+1] - _offsets[q]) { rebuild = true; break; }
+	  unsigned int k = _offsets[q];
+	  for (Data::shape_type::const_iterator pN = N[q].begin();
+	       pN != N[q].end(); ++pN, ++k) {
+	    if (pN->first != _dofs[k]) { rebuild = true; break; }
+	  }
+	}
+
+	if (rebuild) {
+	  _build(N, field);
+	  _rebuilds++;
+	}
+	_fill(N, DN);
+	return rebuild;
+      }
+
+      unsigned int Dim() const { return _dim; }
+      unsigned int size() const { return _offsets.empty() ? 0 : _offsets.size() - 1; }
+      unsigned int GetNumofRebuilds() const { return _rebuilds; }
+
+      // entries of row q are [begin(q), end(q))
+      unsigned int begin(unsigned int q) const { return _offsets[q]; }
+      unsigned int end(unsigned int q) const { return _offsets[q+1]; }
+
+      const vector<unsigned int> & GetNodes() const { return _nodes; }
+      const vector<double> & GetN() const { return _N; }
+      const vector<double> & GetDN() const { return _DN; }
+
+      // xq = sum_a N_a x_a, x has ldx components per node
+      void Interpolate(unsigned int q, const double * __restrict__ x,
+		       unsigned int ldx, double * __restrict__ xq) const {
+	for (unsigned int i = 0; i < ldx; ++i) xq[i] = 0.0;
+	for (unsigned int k = _offsets[q]; k < _offsets[q+1]; ++k) {
+	  const double * xa = x + (size_t)_nodes[k] * ldx;
+	  const double Na = _N[k];
+	  for (unsigned int i = 0; i < ldx; ++i) xq[i] += Na * xa[i];
+	}
+      }
+
+      // F = sum_a x_a (x) DN_a, x has ldx >= dim components per node
+      void Gradient(unsigned int q, const double * __restrict__ x,
+		    unsigned int ldx, double * __restrict__ F) const {
+	const unsigned int dim = _dim;
+	for (unsigned int i = 0; i < dim*dim; ++i) F[i] = 0.0;
+	for (unsigned int k = _offsets[q]; k < _offsets[q+1]; ++k) {
+	  const double * xa = x + (size_t)_nodes[k] * ldx;
+	  const double * DNa = &_DN[(size_t)k * dim];
+	  for (unsigned int i = 0; i < dim; ++i)
+	    for (unsigned int j = 0; j < dim; ++j) F[i*dim + j] += xa[i] * DNa[j];
+	}
+      }
+
+      // f_a += w P(DN_a), f has ldf >= dim components per node
+      void Scatter(unsigned int q, const double * __restrict__ P, double w,
+		   double * __restrict__ f, unsigned int ldf) const {
+	const unsigned int dim = _dim;
+	for (unsigned int k = _offsets[q]; k < _offsets[q+1]; ++k) {
+	  double * fa = f + (size_t)_nodes[k] * ldf;
+	  const double * DNa = &_DN[(size_t)k * dim];
+	  for (unsigned int i = 0; i < dim; ++i) {
+	    double s = 0.0;
+	    for (unsigned int j = 0; j < dim; ++j) s += P[i*dim + j] * DNa[j];
+	    fa[i] += w * s;
+	  }
+	}
+      }
+
+    private:
+
+      void _build(const vector<Data::shape_type> & N,
+		  const Solver::NodalField & field) {
+	const unsigned int nq = N.size();
+	_numbering = field.GetNumbering();
+	_offsets.assign(nq + 1, 0);
+	for (unsigned int q = 0; q < nq; ++q) _offsets[q+1] = _offsets[q] + N[q].size();
+
+	const unsigned int nnz = _offsets[nq];
+	_dofs.resize(nnz);
+	_nodes.resize(nnz);
+	_N.resize(nnz);
+	_DN.resize((size_t)nnz * _dim);
+
+	unsigned int k = 0;
+	for (unsigned int q = 0; q < nq; ++q) {
+	  for (Data::shape_type::const_iterator pN = N[q].begin();
+	       pN != N[q].end(); ++pN, ++k) {
+	    const int id = field.Index(pN->first);
+	    if (id < 0) {
+	      cerr << "node is not bound to the nodal field @Element::MaterialPoint::ShapeTable" << endl;
+	      assert(false);
+	    }
+	    _dofs[k] = pN->first;
+	    _nodes[k] = (unsigned int)id;
+	  }
+	}
+      }
+
+      void _fill(const vector<Data::shape_type> & N,
+		 const vector<Data::dshape_type> & DN) {
+	unsigned int k = 0;
+	for (unsigned int q = 0; q < N.size(); ++q) {
+	  Data::shape_type::const_iterator pN = N[q].begin();
+	  Data::dshape_type::const_iterator pDN = DN[q].begin();
+	  for (; pN != N[q].end(); ++pN, ++pDN, ++k) {
+	    assert(pDN != DN[q].end() && pDN->first == pN->first);
+	    _N[k] = pN->second;
+	    double * DNk = &_DN[(size_t)k * _dim];
+	    const double * p = pDN->second.begin();
+	    for (unsigned int j = 0; j < _dim; ++j) DNk[j] = p[j];
+	  }
+	}
+      }
+
+    private:
+
+      unsigned int _dim;
+      unsigned int _rebuilds;
+      unsigned int _numbering;
+      vector<unsigned int> _offsets;
+      vector<dof_type *> _dofs;
+      vector<unsigned int> _nodes;
+      vector<double> _N;
+      vector<double> _DN;
+
+    private:
+
+      ShapeTable(const ShapeTable &);
+      ShapeTable & operator = (const ShapeTable &);
+    };
+
+  }
+
+}
+
+#endif // !defined(ELEMENT_MATERIALPOINT_SHAPETABLE_H__INCLUDED_)
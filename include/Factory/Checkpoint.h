@@ -0,0 +1,773 @@
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+////////////////////////////////////////////////////////////////////////////
+
+#if !defined(M4EXTREME_CHECKPOINT_H__INCLUDED_)
+#define M4EXTREME_CHECKPOINT_H__INCLUDED_
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <pthread.h>
+
+#include "Factory/MEMPModelBuilder.h"
+#include "Solver/ExplicitDynamics/ExplicitDynamics.h"
+#include "Geometry/Search/CellSearch/ParallelCellSearch.h"
+
+#if defined(_M4EXTREME_MPI_)
+#include "mpi.h"
+#endif
+
+namespace m4extreme {
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Checkpoint/restart of a material point run. Every rank writes one
+  // file <dir>/<prefix>_<step>_<rank>.ckp (one file per rank rather than
+  // a shared MPI-IO file, so a rank writes with plain stdio and needs no
+  // collective I/O) of packed binary sections:
+  //
+  //   clock    t, told, dt
+  //   nodes    per node: global id, carrier, dimension, mass, embedded
+  //            coordinates, constraint matrix, v and a (those of the
+  //            solver if one is given)
+  //   mpts     per body and material point: centroid, global ids of
+  //            the support nodes and the state written by
+  //            Element::LocalState::write, i.e. the records that
+  //            MEMPModelBuilder::read instantiates when points migrate
+  //
+  // and once every file is complete, rank 0 writes the manifest
+  // <prefix>_<step>.manifest (version, dimension, number of ranks, step,
+  // time, number of bodies, number of material points of every file) and
+  // points <prefix>.latest at it, so that a run preempted while writing
+  // restarts from the previous checkpoint.
+  //
+  // With SetAsync(true), Save only packs the state into a buffer (the
+  // snapshot copy) and a thread writes it while the run goes on; the
+  // manifest is committed by the next Save or by Wait, which is
+  // collective and must be called before MPI_Finalize.
+  //
+  // Restore rebuilds nodes and material points in a model whose bodies
+  // are inserted, without cells, and created, as on the receiving side
+  // of a migration. On as many ranks as were written every rank takes
+  // its own file. On another number of ranks the material points of each
+  // file are ordered along a Hilbert curve by centroid, the files are
+  // concatenated in rank order and split in equal parts; each rank
+  // creates its part and the support nodes, reading only the files its
+  // part overlaps according to the counts of the manifest. The forces
+  // are recomputed by the first step; under MPI the nodal masses are to
+  // be synchronized afterwards, e.g. by MPI_Core::update().
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  class Checkpoint {
+
+  public:
+    typedef Set::Manifold::Point dof_type;
+    typedef Set::Euclidean::Orthonormal::Point point_type;
+    typedef Set::VectorSpace::Vector vector_type;
+
+    enum SECTION_TYPE { CLOCK = 1, NODES = 2, MPTS = 3 };
+
+  public:
+
+    Checkpoint(const char * dir = "./restart", const char * prefix = "checkpoint") :
+      _dir(dir), _prefix(prefix), _async(false), _pending(false), _writing(false) {}
+
+    virtual ~Checkpoint() {
+      if ( _writing ) pthread_join(_thread, NULL);
+    }
+
+    void SetAsync(bool async) { _async = async; }
+
+    //
+    // collective: write the state of the local part of the run, the
+    // local nodes being numbered by idmap
+    //
+    void Save(int step, MEMPModelBuilder & model, const map<dof_type*, int> & idmap,
+	      Solver::ExplicitDynamics * solver = NULL, int rank = 0, int size = 1) {
+      Wait();
+
+      _buffer.clear();
+      _pack(step, model, idmap, solver, rank, size);
+
+      _job.filename = _filename(step, rank);
+      _job.step = step;
+      _job.rank = rank;
+      _job.size = size;
+      _job.time = model._pT->Time();
+      _job.bodies = model.GetMEMPLS().size();
+      _job.mpts = 0;
+      for ( size_t k = 0; k < model.GetMEMPLS().size(); ++k ) _job.mpts += model.GetMEMPLS()[k].size();
+      _pending = true;
+
+      if ( _async ) {
+	_writing = true;
+	pthread_create(&_thread, NULL, _run, this);
+      }
+      else {
+	_write();
+	Wait();
+      }
+
+      return;
+    }
+
+    //
+    // collective: wait for the last Save and commit its manifest
+    //
+    void Wait() {
+      if ( !_pending ) return;
+      if ( _writing ) {
+	pthread_join(_thread, NULL);
+	_writing = false;
+      }
+      _pending = false;
+
+      int failed = _job.failed ? 1 : 0;
+      _job.counts.assign(1, _job.mpts);
+#if defined(_M4EXTREME_MPI_)
+      if ( _job.size > 1 ) {
+	int local = failed;
+	MPI_Allreduce(&local, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+	_job.counts.resize(_job.rank == 0 ? _job.size : 1);
+	MPI_Gather(&_job.mpts, 1, MPI_LONG_LONG, &_job.counts[0], 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+      }
+#endif
+      if ( failed ) {
+	cerr << "failed to write checkpoint " << _job.step << ", the manifest is not updated" << endl;
+	return;
+      }
+      if ( _job.rank == 0 ) _commit();
+
+      return;
+    }
+
+    //
+    // the step of the latest complete checkpoint, -1 if there is none
+    //
+    int GetLatest() const {
+      FILE * fp = fopen((_dir + "/" + _prefix + ".latest").c_str(), "r");
+      if ( fp == NULL ) return -1;
+      int step = -1;
+      if ( fscanf(fp, "%d", &step) != 1 ) step = -1;
+      fclose(fp);
+      return step;
+    }
+
+    //
+    // collective: restore checkpoint step (the latest if negative) into
+    // model, see above; returns the step, -1 if there is no checkpoint or
+    // it cannot be read, in which case the model is left untouched. The
+    // nodes created are entered in idmap and dofmap and are owned by the
+    // caller, see GetRestoredNodes()
+    //
+    int Restore(MEMPModelBuilder & model, map<dof_type*, int> & idmap, map<int, dof_type*> & dofmap,
+		Solver::ExplicitDynamics * solver = NULL, int rank = 0, int size = 1, int step = -1) {
+      if ( step < 0 ) step = GetLatest();
+      if ( step < 0 ) return -1;
+
+      // everything is read and checked before the model is touched
+      int dim = 0, ranks = 0, bodies = 0;
+      vector<long long> counts;
+      vector< vector<char> > data;
+      vector<_MptRecord> mpts;
+      vector<char> selected;
+      bool ok = _readManifest(step, dim, ranks, bodies, counts);
+      if ( !ok ) {
+	cerr << "cannot read the manifest of checkpoint " << step << endl;
+      }
+      else if ( dim != (int)ModelBuilder::_DIM || bodies != (int)model.GetMEMPLS().size() ) {
+	cerr << "checkpoint " << step << " does not match the model" << endl;
+	ok = false;
+      }
+      else {
+	ok = _select(step, ranks, counts, rank, size, data, mpts, selected);
+      }
+#if defined(_M4EXTREME_MPI_)
+      if ( size > 1 ) {
+	int local = ok ? 1 : 0, all = 0;
+	MPI_Allreduce(&local, &all, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+	ok = all == 1;
+      }
+#endif
+      if ( !ok ) return -1;
+
+      // nodes: the supports of the selected points, and all the nodes
+      // of the own file
+      set<int> needed;
+      for ( size_t i = 0; i < mpts.size(); ++i ) {
+	if ( !selected[i] ) continue;
+	for ( long long j = 0; j < mpts[i].nids; ++j ) {
+	  int idloc;
+	  memcpy(&idloc, mpts[i].ids + j * sizeof(int), sizeof(int));
+	  needed.insert(idloc);
+	}
+      }
+
+      _created.clear();
+      for ( size_t f = 0; f < data.size(); ++f ) {
+	_restoreNodes(data[f], ranks == size, needed, model, idmap, dofmap, solver);
+      }
+
+      // clock
+      double clock[3];
+      if ( _find(data[0], CLOCK, clock, sizeof(clock)) ) {
+	model._pT->Time() = clock[0];
+	model._pT->TimeOld() = clock[1];
+	model._pT->DTime() = clock[2];
+      }
+
+      // material points, per body through the migration reader
+      for ( int k = 0; k < bodies; ++k ) {
+	std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+	int count = 0;
+	for ( size_t i = 0; i < mpts.size(); ++i ) {
+	  if ( selected[i] && mpts[i].body == k ) {
+	    ss.write(mpts[i].state, mpts[i].bytes);
+	    ++count;
+	  }
+	}
+	if ( count > 0 ) model.read(ss, k, count, dofmap);
+      }
+
+      model.ComputeLumpedMass();
+
+      return step;
+    }
+
+    const set<dof_type*> & GetRestoredNodes() const { return _created; }
+
+  private:
+
+    struct _MptRecord {
+      int file, body;
+      const char * centroid;        // double[dim], unaligned
+      const char * ids;             // int[nids], unaligned
+      long long nids;
+      const char * state;
+      long long bytes;
+    };
+
+    struct _Job {
+      string filename;
+      int step, rank, size, bodies;
+      double time;
+      long long mpts;
+      vector<long long> counts;     // material points per rank, on rank 0
+      bool failed;
+    };
+
+    string _filename(int step, int rank) const {
+      char buf[64];
+      sprintf(buf, "_%d_%d.ckp", step, rank);
+      return _dir + "/" + _prefix + buf;
+    }
+
+    string _manifest(int step) const {
+      char buf[64];
+      sprintf(buf, "_%d.manifest", step);
+      return _dir + "/" + _prefix + buf;
+    }
+
+    template<typename T>
+    void _put(const T & value) { _put(&value, sizeof(T)); }
+
+    void _put(const void * p, size_t bytes) {
+      const char * c = static_cast<const char *>(p);
+      _buffer.insert(_buffer.end(), c, c + bytes);
+    }
+
+    // section header, the length is patched by _end
+    size_t _begin(int type, int body) {
+      _put(type);
+      _put(body);
+      const size_t at = _buffer.size();
+      _put((long long)0);
+      return at;
+    }
+
+    void _end(size_t at) {
+      long long bytes = _buffer.size() - at - sizeof(long long);
+      memcpy(&_buffer[at], &bytes, sizeof(long long));
+    }
+
+    void _pack(int step, MEMPModelBuilder & model, const map<dof_type*, int> & idmap,
+	       Solver::ExplicitDynamics * solver, int rank, int size) {
+      const int dim = ModelBuilder::_DIM;
+      const vector< vector<Element::MaterialPoint::LocalState *> > & LS = model.GetMEMPLS();
+
+      // file header
+      _put("M4XCKPT", 8);
+      int header[6] = { 1, dim, rank, size, step, (int)LS.size() };
+      _put(header, sizeof(header));
+
+      size_t at = _begin(CLOCK, -1);
+      _put(model._pT->Time());
+      _put(model._pT->TimeOld());
+      _put(model._pT->DTime());
+      _end(at);
+
+      // nodes
+      map<dof_type *, vector_type> yemb;
+      dynamic_cast<Model::Static::LocalState*> (model._pLS)->Embed(model._x, yemb);
+      const map<dof_type *, vector_type> & a = solver != NULL ? solver->getA() : *model._a;
+
+      at = _begin(NODES, -1);
+      _put((long long)idmap.size());
+      vector<double> rec(4 + dim + dim * dim + 2 * dim);
+      for ( map<dof_type*, int>::const_iterator pI = idmap.begin(); pI != idmap.end(); ++pI ) {
+	dof_type * xloc = pI->first;
+	std::fill(rec.begin(), rec.end(), 0.0);
+	int dimloc = dim;
+#if defined(_M4EXTREME_BOUNDARY_CONDITIONS_)
+	map<dof_type*, Set::Manifold::Map*>::const_iterator pE = model._Emb.find(xloc);
+	if ( pE != model._Emb.end() && pE->second != 0 ) {
+	  double * A = &rec[4 + dim];
+	  Set::Euclidean::Cartesian::Embedding<0> * pEmb =
+	    dynamic_cast<Set::Euclidean::Cartesian::Embedding<0> *>(pE->second);
+	  assert( pEmb != NULL );
+	  dimloc = pEmb->size1();
+	  const Set::VectorSpace::Hom & M = pEmb->LinearMapping();
+	  for ( int i = 0; i < dimloc; ++i )
+	    for ( int j = 0; j < dim; ++j ) A[i * dim + j] = M[i][j];
+	}
+#endif
+	map<dof_type*, int>::const_iterator pC = model._node_carrier_id.find(xloc);
+	map<dof_type*, double>::const_iterator pM = model._m.find(xloc);
+	rec[0] = pI->second;
+	rec[1] = pC != model._node_carrier_id.end() ? pC->second : -1;
+	rec[2] = dimloc;
+	rec[3] = pM != model._m.end() ? pM->second : 0.0;
+
+	const vector_type & y = yemb.find(xloc)->second;
+	for ( int j = 0; j < dim; ++j ) rec[4 + j] = y[j];
+
+	map<dof_type*, vector_type>::const_iterator pV = model._v.find(xloc), pA = a.find(xloc);
+	double * v = &rec[4 + dim + dim * dim], * aloc = v + dim;
+	for ( int j = 0; j < dimloc; ++j ) {
+	  if ( pV != model._v.end() ) v[j] = pV->second[j];
+	  if ( pA != a.end() ) aloc[j] = pA->second[j];
+	}
+	_put(&rec[0], rec.size() * sizeof(double));
+      }
+      _end(at);
+
+      // material points
+      std::ostringstream os(std::ios::out | std::ios::binary);
+      vector<double> xc(dim);
+      for ( size_t k = 0; k < LS.size(); ++k ) {
+	at = _begin(MPTS, k);
+	_put((long long)LS[k].size());
+	for ( size_t i = 0; i < LS[k].size(); ++i ) {
+	  const vector<vector_type> & QP = LS[k][i]->GetQP();
+	  std::fill(xc.begin(), xc.end(), 0.0);
+	  for ( size_t q = 0; q < QP.size(); ++q )
+	    for ( int j = 0; j < dim; ++j ) xc[j] += QP[q][j] / QP.size();
+
+	  set<dof_type*> support;
+	  LS[k][i]->GetNodes(support);
+	  vector<int> ids;
+	  for ( set<dof_type*>::const_iterator pn = support.begin(); pn != support.end(); ++pn ) {
+	    map<dof_type*, int>::const_iterator pI = idmap.find(*pn);
+	    if ( pI != idmap.end() ) ids.push_back(pI->second);
+	  }
+
+	  os.str("");
+	  LS[k][i]->write(os, idmap);
+	  const string state = os.str();
+
+	  _put(&xc[0], dim * sizeof(double));
+	  _put((long long)ids.size());
+	  _put((long long)state.size());
+	  if ( !ids.empty() ) _put(&ids[0], ids.size() * sizeof(int));
+	  _put(state.data(), state.size());
+	}
+	_end(at);
+      }
+
+      return;
+    }
+
+    void _write() {
+      _job.failed = true;
+      string tmp = _job.filename + ".tmp";
+      FILE * fp = fopen(tmp.c_str(), "wb");
+      if ( fp == NULL ) return;
+      const size_t n = _buffer.size();
+      const bool ok = n == 0 || fwrite(&_buffer[0], 1, n, fp) == n;
+      if ( fclose(fp) != 0 || !ok ) return;
+      _job.failed = rename(tmp.c_str(), _job.filename.c_str()) != 0;
+      return;
+    }
+
+    static void * _run(void * arg) {
+      static_cast<Checkpoint *>(arg)->_write();
+      return NULL;
+    }
+
+    // manifest, then the pointer to it, each replaced atomically
+    void _commit() const {
+      string manifest = _manifest(_job.step);
+      FILE * fp = fopen((manifest + ".tmp").c_str(), "w");
+      if ( fp == NULL ) return;
+      fprintf(fp, "version 1\ndimension %d\nranks %d\nstep %d\ntime %.17g\nbodies %d\n",
+	      ModelBuilder::_DIM, _job.size, _job.step, _job.time, _job.bodies);
+      // unknown without MPI on several ranks, then restoring reads all the files
+      if ( (int)_job.counts.size() == _job.size ) {
+	for ( size_t r = 0; r < _job.counts.size(); ++r ) fprintf(fp, "mpts %lld\n", _job.counts[r]);
+      }
+      fclose(fp);
+      rename((manifest + ".tmp").c_str(), manifest.c_str());
+
+      string latest = _dir + "/" + _prefix + ".latest";
+      fp = fopen((latest + ".tmp").c_str(), "w");
+      if ( fp == NULL ) return;
+      fprintf(fp, "%d\n", _job.step);
+      fclose(fp);
+      rename((latest + ".tmp").c_str(), latest.c_str());
+      return;
+    }
+
+    // counts, the material points per rank, is empty if not listed
+    bool _readManifest(int step, int & dim, int & ranks, int & bodies, vector<long long> & counts) const {
+      FILE * fp = fopen(_manifest(step).c_str(), "r");
+      if ( fp == NULL ) return false;
+      char key[64];
+      double value;
+      int version = 0;
+      counts.clear();
+      while ( fscanf(fp, "%63s %lg", key, &value) == 2 ) {
+	if ( strcmp(key, "version") == 0 ) version = (int)value;
+	else if ( strcmp(key, "dimension") == 0 ) dim = (int)value;
+	else if ( strcmp(key, "ranks") == 0 ) ranks = (int)value;
+	else if ( strcmp(key, "bodies") == 0 ) bodies = (int)value;
+	else if ( strcmp(key, "mpts") == 0 ) counts.push_back((long long)value);
+      }
+      fclose(fp);
+      if ( (int)counts.size() != ranks ) counts.clear();
+      return version == 1 && dim > 0 && ranks > 0;
+    }
+
+    //
+    // load the files to restore from and mark the selected material
+    // points: the own file on as many ranks as were written, otherwise
+    // the files overlapping the part of this rank in the concatenation
+    // of the files, or all of them if the manifest has no counts
+    //
+    bool _select(int step, int ranks, const vector<long long> & counts, int rank, int size,
+		 vector< vector<char> > & data, vector<_MptRecord> & mpts, vector<char> & selected) const {
+      vector<int> files;
+      vector<long long> first(ranks + 1, 0);
+      long long lo = 0, hi = 0;
+      if ( ranks == size ) {
+	files.push_back(rank);
+      }
+      else if ( counts.empty() ) {
+	for ( int r = 0; r < ranks; ++r ) files.push_back(r);
+      }
+      else {
+	for ( int r = 0; r < ranks; ++r ) first[r + 1] = first[r] + counts[r];
+	lo = first[ranks] * rank / size;
+	hi = first[ranks] * (rank + 1) / size;
+	for ( int r = 0; r < ranks; ++r ) {
+	  if ( first[r] < hi && first[r + 1] > lo ) files.push_back(r);
+	}
+	// the clock is read from the first file
+	if ( files.empty() ) files.push_back(0);
+      }
+
+      // the records point into data, which is not resized afterwards
+      data.resize(files.size());
+      vector<long long> found(files.size(), 0);
+      for ( size_t f = 0; f < files.size(); ++f ) {
+	const size_t before = mpts.size();
+	if ( !_load(_filename(step, files[f]), data[f]) || !_scanMpts(data[f], f, mpts) ) return false;
+	found[f] = mpts.size() - before;
+	if ( !counts.empty() && found[f] != counts[files[f]] ) {
+	  cerr << "checkpoint file " << _filename(step, files[f]) << " does not match the manifest" << endl;
+	  return false;
+	}
+      }
+
+      selected.assign(mpts.size(), ranks == size ? 1 : 0);
+      if ( ranks == size ) return true;
+
+      if ( counts.empty() ) {
+	for ( int r = 0; r < ranks; ++r ) first[r + 1] = first[r] + found[r];
+	lo = first[ranks] * rank / size;
+	hi = first[ranks] * (rank + 1) / size;
+      }
+
+      // each file along the Hilbert curve, then its slice of [lo, hi)
+      const int dim = ModelBuilder::_DIM;
+      size_t begin = 0;
+      for ( size_t f = 0; f < files.size(); ++f ) {
+	const size_t n = found[f];
+	vector<double> xc(n * dim);
+	for ( size_t i = 0; i < n; ++i ) {
+	  memcpy(&xc[i * dim], mpts[begin + i].centroid, dim * sizeof(double));
+	}
+	vector<size_t> order;
+	geom::cellHilbertOrder(n, dim, xc.empty() ? NULL : &xc[0], dim, order);
+	for ( size_t j = 0; j < n; ++j ) {
+	  const long long g = first[files[f]] + (long long)j;
+	  if ( g >= lo && g < hi ) selected[begin + order[j]] = 1;
+	}
+	begin += n;
+      }
+
+      return true;
+    }
+
+    static bool _load(const string & filename, vector<char> & data) {
+      FILE * fp = fopen(filename.c_str(), "rb");
+      if ( fp == NULL ) {
+	cerr << "cannot open checkpoint file " << filename << endl;
+	return false;
+      }
+      bool ok = fseek(fp, 0, SEEK_END) == 0;
+      const long bytes = ok ? ftell(fp) : -1;
+      ok = bytes >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+      if ( ok ) {
+	data.resize(bytes);
+	ok = data.size() >= 8 + 6 * sizeof(int)
+	  && fread(&data[0], 1, data.size(), fp) == data.size()
+	  && memcmp(&data[0], "M4XCKPT", 8) == 0;
+      }
+      fclose(fp);
+      if ( ok ) {
+	_Checker c = { true };
+	ok = _sections(data, c) && c.ok;
+      }
+      if ( !ok ) cerr << "corrupted checkpoint file " << filename << endl;
+      return ok;
+    }
+
+    // calls f(type, body, payload, bytes) for every section, false if a
+    // section runs past the end of the data
+    template<typename F>
+    static bool _sections(const vector<char> & data, F & f) {
+      size_t at = 8 + 6 * sizeof(int);
+      while ( at + 2 * sizeof(int) + sizeof(long long) <= data.size() ) {
+	int type, body;
+	long long bytes;
+	memcpy(&type, &data[at], sizeof(int));
+	memcpy(&body, &data[at + sizeof(int)], sizeof(int));
+	memcpy(&bytes, &data[at + 2 * sizeof(int)], sizeof(long long));
+	at += 2 * sizeof(int) + sizeof(long long);
+	if ( bytes < 0 || (unsigned long long)bytes > data.size() - at ) return false;
+	f(type, body, bytes > 0 ? &data[at] : NULL, bytes);
+	at += bytes;
+      }
+      return at == data.size();
+    }
+
+    // the node and material point sections are consistent with their
+    // counts, and constrained nodes can be restored
+    struct _Checker {
+      bool ok;
+      void operator()(int type, int, const char * p, long long bytes) {
+	const int dim = ModelBuilder::_DIM;
+	if ( type != NODES && type != MPTS ) return;
+	long long n = -1;
+	if ( bytes >= (long long)sizeof(long long) ) memcpy(&n, p, sizeof(long long));
+	if ( n < 0 ) { ok = false; return; }
+	const char * end = p + bytes;
+	p += sizeof(long long);
+	if ( type == NODES ) {
+	  const long long stride = 4 + dim + dim * dim + 2 * dim;
+	  if ( n * stride * (long long)sizeof(double) != end - p ) { ok = false; return; }
+#if !defined(_M4EXTREME_BOUNDARY_CONDITIONS_)
+	  for ( long long i = 0; i < n; ++i ) {
+	    double dimloc;
+	    memcpy(&dimloc, p + (i * stride + 2) * sizeof(double), sizeof(double));
+	    if ( (int)dimloc < dim ) {
+	      cerr << "constrained nodes need _M4EXTREME_BOUNDARY_CONDITIONS_" << endl;
+	      ok = false;
+	      return;
+	    }
+	  }
+#endif
+	  return;
+	}
+	for ( long long i = 0; i < n; ++i ) {
+	  long long nids, bytesloc;
+	  if ( end - p < (long long)(dim * sizeof(double) + 2 * sizeof(long long)) ) { ok = false; return; }
+	  p += dim * sizeof(double);
+	  memcpy(&nids, p, sizeof(long long));
+	  memcpy(&bytesloc, p + sizeof(long long), sizeof(long long));
+	  p += 2 * sizeof(long long);
+	  if ( nids < 0 || bytesloc < 0 || end - p < nids * (long long)sizeof(int) + bytesloc ) { ok = false; return; }
+	  p += nids * sizeof(int) + bytesloc;
+	}
+	if ( p != end ) ok = false;
+      }
+    };
+
+    struct _Finder {
+      int type;
+      void * dst;
+      size_t bytes;
+      bool found;
+      void operator()(int t, int, const char * p, long long n) {
+	if ( t == type && n >= (long long)bytes ) {
+	  memcpy(dst, p, bytes);
+	  found = true;
+	}
+      }
+    };
+
+    static bool _find(const vector<char> & data, int type, void * dst, size_t bytes) {
+      _Finder f = { type, dst, bytes, false };
+      _sections(data, f);
+      return f.found;
+    }
+
+    // the records point into data, which is kept until they are used
+    struct _MptScanner {
+      int file;
+      vector<_MptRecord> * mpts;
+      void operator()(int type, int body, const char * p, long long) {
+	if ( type != MPTS ) return;
+	const int dim = ModelBuilder::_DIM;
+	long long n;
+	memcpy(&n, p, sizeof(long long));
+	p += sizeof(long long);
+	for ( long long i = 0; i < n; ++i ) {
+	  _MptRecord r;
+	  r.file = file;
+	  r.body = body;
+	  r.centroid = p;
+	  p += dim * sizeof(double);
+	  memcpy(&r.nids, p, sizeof(long long));
+	  memcpy(&r.bytes, p + sizeof(long long), sizeof(long long));
+	  p += 2 * sizeof(long long);
+	  r.ids = p;
+	  p += r.nids * sizeof(int);
+	  r.state = p;
+	  p += r.bytes;
+	  mpts->push_back(r);
+	}
+      }
+    };
+
+    static bool _scanMpts(const vector<char> & data, int file, vector<_MptRecord> & mpts) {
+      _MptScanner s = { file, &mpts };
+      return _sections(data, s);
+    }
+
+    struct _NodeRestorer {
+      Checkpoint * owner;
+      bool all;
+      const set<int> * needed;
+      MEMPModelBuilder * model;
+      map<dof_type*, int> * idmap;
+      map<int, dof_type*> * dofmap;
+      Solver::ExplicitDynamics * solver;
+
+      void operator()(int type, int, const char * p, long long) {
+	if ( type != NODES ) return;
+	const int dim = ModelBuilder::_DIM;
+	const int stride = 4 + dim + dim * dim + 2 * dim;
+	long long n;
+	memcpy(&n, p, sizeof(long long));
+	p += sizeof(long long);
+
+	vector<double> rec(stride);
+	for ( long long i = 0; i < n; ++i, p += stride * sizeof(double) ) {
+	  memcpy(&rec[0], p, stride * sizeof(double));
+	  const int idloc = (int)rec[0];
+	  if ( (!all && needed->find(idloc) == needed->end()) || dofmap->find(idloc) != dofmap->end() ) continue;
+	  owner->_createNode(rec, *model, *idmap, *dofmap, solver);
+	}
+      }
+    };
+
+    void _restoreNodes(const vector<char> & data, bool all, const set<int> & needed,
+		       MEMPModelBuilder & model, map<dof_type*, int> & idmap,
+		       map<int, dof_type*> & dofmap, Solver::ExplicitDynamics * solver) {
+      _NodeRestorer r = { this, all, &needed, &model, &idmap, &dofmap, solver };
+      _sections(data, r);
+    }
+
+    // as a node received by MPI_Core_3D::_synchronizeNodes
+    void _createNode(const vector<double> & rec, MEMPModelBuilder & model,
+		     map<dof_type*, int> & idmap, map<int, dof_type*> & dofmap,
+		     Solver::ExplicitDynamics * solver) {
+      const int dim = ModelBuilder::_DIM;
+      const int idloc = (int)rec[0], cid = (int)rec[1], dimloc = (int)rec[2];
+
+      point_type * pnewloc = new point_type(dim);
+      for ( int j = 0; j < dim; ++j ) (*pnewloc)[j] = rec[4 + j];
+
+      dof_type * xnewloc = pnewloc;
+      Set::Manifold::Map  * emb  = 0;
+      Set::Manifold::TMap * demb = 0;
+
+      // the constrained nodes were rejected by _Checker without boundary
+      // conditions
+      if ( dimloc < dim ) {
+#if defined(_M4EXTREME_BOUNDARY_CONDITIONS_)
+	xnewloc = new Set::Euclidean::Cartesian::Point(dimloc);
+
+	Set::VectorSpace::Hom A(dim, dimloc);
+	for ( int i = 0; i < dimloc; ++i )
+	  for ( int j = 0; j < dim; ++j ) A[i][j] = rec[4 + dim + i * dim + j];
+
+	Set::Euclidean::Cartesian::Point Origin(dimloc);
+	emb  = new Set::Euclidean::Cartesian::Embedding<0>(Origin, *pnewloc, A);
+	demb = new Set::Euclidean::Cartesian::Embedding<1>(*dynamic_cast<Set::Euclidean::Cartesian::Embedding<0>*>(emb));
+	delete pnewloc;
+#endif
+      }
+
+      vector_type vloc(dimloc), aloc(dimloc);
+      for ( int j = 0; j < dimloc; ++j ) {
+	vloc[j] = rec[4 + dim + dim * dim + j];
+	aloc[j] = rec[4 + 2 * dim + dim * dim + j];
+      }
+
+      idmap.insert(make_pair(xnewloc, idloc));
+      dofmap.insert(make_pair(idloc, xnewloc));
+
+      model._x.insert(xnewloc);
+      model._v.insert(make_pair(xnewloc, vloc));
+      model._a->insert(make_pair(xnewloc, aloc));
+      if ( solver != NULL && &solver->getA() != model._a ) solver->getA().insert(make_pair(xnewloc, aloc));
+      model._m.insert(make_pair(xnewloc, rec[3]));
+      model._Emb.insert(make_pair(xnewloc, emb));
+      model._DEmb.insert(make_pair(xnewloc, demb));
+
+      if ( cid >= 0 && cid < (int)model._carriers.size() ) {
+	model._carriers[cid]->insert(xnewloc);
+	model._node_carrier_id.insert(make_pair(xnewloc, cid));
+      }
+
+      _created.insert(xnewloc);
+      return;
+    }
+
+  private:
+    string _dir, _prefix;
+    bool _async, _pending, _writing;
+    vector<char> _buffer;
+    _Job _job;
+    pthread_t _thread;
+    set<dof_type*> _created;
+
+  private:
+    Checkpoint(const Checkpoint &);
+    Checkpoint & operator = (const Checkpoint &);
+  };
+
+}
+
+#endif // !defined(M4EXTREME_CHECKPOINT_H__INCLUDED_)
@@ -6,7 +6,11 @@
 #if !defined(M4EXTREME_MEMPMODELBUILDER_H__INCLUDED_)
 #define M4EXTREME_MEMPMODELBUILDER_H__INCLUDED_
 
+#include <algorithm>
 #include "ModelBuilder.h"
+#include "Solver/ExplicitDynamics/NodalField.h"
+#include "Element/MaterialPoint/ShapeCache.h"
+#include "Geometry/Search/CellSearch/ParallelCellSearchAllNeighbors.h"
 
 namespace m4extreme {
     
@@ -49,6 +53,57 @@ namespace m4extreme {
         virtual void Reset();
         void UpdateMaterialPoints();
         void UpdateMaterialPoints(int);
+
+	// as UpdateMaterialPoints(k), but the shape functions are recomputed
+	// only at the material points whose support deformed past the
+	// tolerance of cache, the others are pushed forward; one cache per body
+	void UpdateMaterialPoints(int k, Element::MaterialPoint::ShapeCache & cache) {
+	  map<dof_type *, vector_type> yemb;
+	  dynamic_cast<Model::Static::LocalState*> (_pLS)->Embed(_x, yemb);
+	  cache.Update(_MEMPLS[k], yemb);
+	  return;
+	}
+
+	// rebuild the node search of the material points at the current
+	// positions with geom::ParallelCellSearchAllNeighbors, whose cell
+	// sort and neighbor queries run on the task scheduler, in place of
+	// the serial search CreateModel() and Reset() build; call after
+	// them. The adaptive search is left as it is
+	void UpdateSearchParallel() {
+	  if ( _isAdaptiveSearch ) return;
+
+	  map<dof_type *, vector_type> yemb;
+	  dynamic_cast<Model::Static::LocalState*> (_pLS)->Embed(_x, yemb);
+	  map<dof_type *, point_type> points;
+	  for ( map<dof_type *, vector_type>::const_iterator it = yemb.begin();
+		it != yemb.end(); ++it ) {
+	    if ( IsNAN(it->second.begin(), _DIM) ) continue;
+	    point_type y(_DIM);
+	    for ( unsigned int j = 0; j < _DIM; ++j ) y[j] = it->second[j];
+	    points.insert(make_pair(it->first, y));
+	  }
+
+	  Geometry::Search<dof_type*> * nbs = NULL;
+	  if ( _DIM == 1 ) nbs = new geom::ParallelCellSearchAllNeighbors<1>(points, _range);
+	  else if ( _DIM == 2 ) nbs = new geom::ParallelCellSearchAllNeighbors<2>(points, _range);
+	  else nbs = new geom::ParallelCellSearchAllNeighbors<3>(points, _range);
+
+	  delete _nbs;
+	  _nbs = nbs;
+	  return;
+	}
+	// the element energies behind the model forces, e.g. for a
+	// Solver::ElementForce kernel
+	void GetElementForces(vector<Element::Energy<1> *> & DE) const {
+#if defined(_M4EXTREME_THREAD_POOL)
+	  if ( !_EDE_mt.empty() ) {
+	    DE.assign(_EDE_mt.begin(), _EDE_mt.end());
+	    return;
+	  }
+#endif
+	  DE.assign(_EDE.begin(), _EDE.end());
+	}
+
 	Geometry::Search<dof_type*> ** GetSearch() { return &_nbs; }
         void SetSearchRange(double searchRange) { _range = searchRange;	}
         double GetSearchRange(){ return _range;	}
@@ -259,6 +314,105 @@ namespace m4extreme {
 	const vector< vector<Element::MaterialPoint::LumpedMass *> > & GetMEMPMass() const;
         const vector<Geometry::Cell *> & GetMEMPQP(int) const;
         const vector< vector<Geometry::Cell *> > & GetMEMPQP() const;
+
+	//
+	// Sort the material points of every body along a Hilbert curve of
+	// their positions, and the dense node indices of field (bound to
+	// the nodes of the model) along a Hilbert curve of the nodes. The
+	// per material point vectors of a body (_MEMPLS, _MEMPMass, _MEMPEE,
+	// _MEMPQP, _EAVLS, the element sizes and masses and, with eigen
+	// fracture, the _qps vectors aligned with them) are permuted
+	// together. The element vectors the compiled model evaluates with
+	// the thread pool (_ELS_mt, _EE_mt, _EDE_mt, _EDDE_mt, _ELM_mt) hold
+	// the material points of the body in the same order afterwards, in
+	// the slots they already took, so the other elements stay in place.
+	// The model keys everything else by address. Call after
+	// CreateModel() and after every migration of material points, and
+	// Setup again the kernels built from GetElementForces.
+	//
+	void Renumber(Solver::NodalField * field = NULL) {
+	  for ( int k = 0; k < _MEMPLS.size(); ++k ) {
+	    RenumberMaterialPoints(k);
+	  }
+	  if ( field != NULL ) field->RenumberHilbert();
+	  return;
+	}
+
+	void RenumberMaterialPoints(int k) {
+	  const vector<Element::MaterialPoint::LocalState *> & ELSloc = _MEMPLS[k];
+	  const size_t n = ELSloc.size();
+	  if ( n < 2 ) return;
+
+	  // the position of a material point is the mean of its quadrature points
+	  vector<double> xq(n * _DIM, 0.0);
+	  for ( size_t i = 0; i < n; ++i ) {
+	    const vector<Set::VectorSpace::Vector> & QP = ELSloc[i]->GetQP();
+	    double * xloc = &xq[i * _DIM];
+	    for ( int q = 0; q < QP.size(); ++q ) {
+	      for ( unsigned int j = 0; j < _DIM && j < QP[q].size(); ++j ) {
+		xloc[j] += QP[q][j] / QP.size();
+	      }
+	    }
+	  }
+
+	  vector<size_t> order;
+	  geom::cellHilbertOrder(n, _DIM, &xq[0], _DIM, order);
+
+#if defined(_M4EXTREME_EIGEN_FRACTURE_)
+	  // the _qps vectors follow the material points only when built from them
+	  const bool qps = k < _qps_cell.size() && k < _MEMPQP.size() && _qps_cell[k] == _MEMPQP[k];
+#endif
+
+	  _permute(order, _MEMPLS[k]);
+	  if ( k < _MEMPMass.size() ) _permute(order, _MEMPMass[k]);
+	  if ( k < _MEMPEE.size() ) _permute(order, _MEMPEE[k]);
+	  if ( k < _MEMPQP.size() ) _permute(order, _MEMPQP[k]);
+	  if ( k < _EAVLS.size() ) _permute(order, _EAVLS[k]);
+	  if ( k < _element_sizes.size() ) _permute(order, _element_sizes[k]);
+	  if ( k < _element_mass.size() ) _permute(order, _element_mass[k]);
+
+#if defined(_M4EXTREME_EIGEN_FRACTURE_)
+	  if ( qps ) {
+	    _permute(order, _qps_cell[k]);
+	    if ( k < _qps_point.size() ) _permute(order, _qps_point[k]);
+	    if ( k < _qps_weight.size() ) _permute(order, _qps_weight[k]);
+	    if ( k < _qps_status.size() ) _permute(order, _qps_status[k]);
+	    if ( k < _qps_E.size() ) _permute(order, _qps_E[k]);
+	    if ( k < _qps_Gc.size() ) _permute(order, _qps_Gc[k]);
+	    if ( k < _qps_MPE.size() ) _permute(order, _qps_MPE[k]);
+	  }
+#endif
+
+#if defined(_M4EXTREME_THREAD_POOL)
+	  // new position of the material points and of their masses, the
+	  // energies are found through their local state
+	  map<const void *, size_t> rank;
+	  for ( size_t j = 0; j < n; ++j ) {
+	    rank[static_cast<const Element::LocalState *>(_MEMPLS[k][j])] = j;
+	    if ( k < _MEMPMass.size() && _MEMPMass[k].size() == n ) {
+	      rank[static_cast<const Element::LumpedMass *>(_MEMPMass[k][j])] = j;
+	    }
+	  }
+	  _permuteSlots(rank, _ELS_mt);
+	  _permuteSlots(rank, _EE_mt);
+	  _permuteSlots(rank, _EDE_mt);
+	  _permuteSlots(rank, _EDDE_mt);
+	  _permuteSlots(rank, _ELM_mt);
+
+	  // the artificial viscosity elements of the material points
+	  if ( k < _EAVLS.size() && _EAVLS[k].size() == n ) {
+	    rank.clear();
+	    for ( size_t j = 0; j < n; ++j ) {
+	      rank[static_cast<const Element::LocalState *>(_EAVLS[k][j])] = j;
+	    }
+	    _permuteSlots(rank, _ELS_mt);
+	    _permuteSlots(rank, _EE_mt);
+	    _permuteSlots(rank, _EDE_mt);
+	    _permuteSlots(rank, _EDDE_mt);
+	  }
+#endif
+	  return;
+	}
         void GetQP(int, std::vector<Set::VectorSpace::Vector> &, std::vector<double> &, std::vector<int> &) const;
         void GetQPData(map<Geometry::Cell *, double> &,
                 DATA_TYPE) const;
@@ -451,6 +605,42 @@ namespace m4extreme {
                 const double * = NULL);
 
         void _updateSearch();
+
+	// v[j] = v[order[j]], vectors not filled for the body are left alone
+	template<typename T>
+	static void _permute(const vector<size_t> & order, vector<T> & v) {
+	  if ( v.size() != order.size() ) return;
+	  vector<T> w(v.size());
+	  for ( size_t j = 0; j < order.size(); ++j ) w[j] = v[order[j]];
+	  v.swap(w);
+	  return;
+	}
+
+#if defined(_M4EXTREME_THREAD_POOL)
+	// the entries of v found in rank are written back, into the slots
+	// they occupy, in the order of their rank; the others stay put
+	template<typename T>
+	static void _permuteSlots(const map<const void *, size_t> & rank, vector<T *> & v) {
+	  vector<size_t> slots;
+	  vector< pair<size_t, T *> > moved;
+	  for ( size_t j = 0; j < v.size(); ++j ) {
+	    map<const void *, size_t>::const_iterator pR = rank.find(_slotKey(v[j]));
+	    if ( pR == rank.end() ) continue;
+	    slots.push_back(j);
+	    moved.push_back(make_pair(pR->second, v[j]));
+	  }
+	  sort(moved.begin(), moved.end());
+	  for ( size_t i = 0; i < slots.size(); ++i ) v[slots[i]] = moved[i].second;
+	  return;
+	}
+	static const void * _slotKey(const Element::LocalState * p) { return p; }
+	static const void * _slotKey(const Element::LumpedMass * p) { return p; }
+	template<unsigned int p>
+	static const void * _slotKey(const Element::Energy<p> * E) {
+	  return static_cast<const Element::LocalState *>(E->GetLocalState());
+	}
+#endif
+
 	void _initializeAuxiliaryData(const set<Geometry::Cell *> & ,
 				      ElementBuilder * ,
 				      Material::Builder *,
@@ -58,6 +58,29 @@ namespace Geometry {
                 GeneralGeometry(int, const char*, const FILE_TYPE &, int flag = 0);
                 GeneralGeometry(int, const char*, const char*, int flag = 0);
 
+		// from the nodes and elements of a rank as they would be read
+		// from its init file, e.g. a slice of a MeshFile; the groups
+		// are in global ids and keep the members present here
+                GeneralGeometry(int dim,
+				const map<unsigned int, point_type> & nodes,
+				const map<unsigned int, vector<unsigned int> > & elements,
+				const map<string, vector<int> > & nodeGroups,
+				const map<string, vector<int> > & elementGroups,
+				int flag = 0)
+		  : _type(M4EXTREME_NEUTRAL_FULL), _flag(flag) {
+		  assert( dim > 1 && dim < 4 );
+		  if ( _flag == 0 ) {
+		    _readTable(nodes, elements, _node_idmap, _elm_idmap,
+			       _node_inverse_idmap, _elm_inverse_idmap);
+		  }
+		  else {
+		    _readTable_general(nodes, elements, _node_idmap, _elm_idmap,
+				       _node_inverse_idmap, _elm_inverse_idmap);
+		  }
+		  _insertGroups(nodeGroups, _node_idmap, _node_groups);
+		  _insertGroups(elementGroups, _elm_idmap, _solid_groups);
+		}
+
                 const CellComplex & GetCellComplex() const;
                 CellComplex & GetCellComplex();
 
@@ -160,6 +183,19 @@ namespace Geometry {
 		void _getVertices(Geometry::Cell* e, 
 				  set<Geometry::Cell*> & vs);
 
+		static void _insertGroups(const map<string, vector<int> > & groups,
+					  const map<int, Cell *> & idmap,
+					  map<string, set<Cell*> > & cells) {
+		  map<string, vector<int> >::const_iterator pG;
+		  for ( pG = groups.begin(); pG != groups.end(); pG++ ) {
+		    set<Cell*> & members = cells[pG->first];
+		    for ( size_t i = 0; i < pG->second.size(); ++i ) {
+		      map<int, Cell *>::const_iterator pC = idmap.find(pG->second[i]);
+		      if ( pC != idmap.end() ) members.insert(pC->second);
+		    }
+		  }
+		}
+
                 GeneralGeometry(const GeneralGeometry &); // Not implemented
                 GeneralGeometry & operator =(const GeneralGeometry &); // Not implemented
             };
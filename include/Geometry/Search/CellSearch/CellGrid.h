@@ -0,0 +1,256 @@
+// -*- C++ -*-
+
+/*!
+  \file CellGrid.h
+  \brief A uniform cell array over a fixed set of records.
+*/
+
+#if !defined(__geom_CellGrid_h__)
+#define __geom_CellGrid_h__
+
+#include <tr1/array>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cassert>
+#include <cstring>
+
+#include "ParallelCellSearch.h"
+
+namespace geom {
+
+//! A uniform cell array over a fixed set of records.
+/*!
+  \param _D The space dimension.
+  \param _Record The record type.
+
+  The records and their locations are sorted by the container index of
+  their cell (counting sort, linear time) and stored in that order in
+  \c records and \c locations; \c permutation maps a position in the
+  cell order back to the position in the input sequence. A cell is the
+  range [_cellStart[c], _cellStart[c+1]) of the sorted records. The
+  first dimension varies fastest, so a row of cells along it is one
+  contiguous range of records.
+
+  The cell length is at least the requested length and large enough
+  that there are no more cells than records.
+
+  Neighbor lists are produced in compressed row storage: the neighbors
+  of the nth record (in cell order) are
+  \c packed[delimiters[n]] ... \c packed[delimiters[n+1]-1], given as
+  positions in the cell order.
+
+  The sort, the neighbor lists and the Morton order run in parallel
+  (see \ref geom_ParallelCellSearch).
+*/
+template<std::size_t _D, typename _Record>
+class CellGrid {
+   //
+   // Types.
+   //
+public:
+
+   typedef _Record Record;
+   //! A Cartesian point.
+   typedef std::tr1::array<double, _D> Point;
+   //! A multi-index.
+   typedef std::tr1::array<std::size_t, _D> IndexList;
+
+   //
+   // Data
+   //
+public:
+
+   //! The records in cell order.
+   std::vector<Record> records;
+   //! The locations in cell order.
+   std::vector<Point> locations;
+   //! The input position of the records in cell order.
+   std::vector<std::size_t> permutation;
+
+private:
+
+   Point _lowerCorner;
+   Point _inverseCellLengths;
+   IndexList _extents;
+   std::vector<std::size_t> _cellStart;
+
+private:
+
+   // The cell container index of a location.
+   struct CellKey {
+      const CellGrid& grid;
+      const std::vector<Point>& locations;
+
+      CellKey(const CellGrid& grid_, const std::vector<Point>& locations_) :
+         grid(grid_),
+         locations(locations_) {
+      }
+
+      std::size_t
+      operator()(const std::size_t i) const {
+         return grid.containerIndex(grid.locationToIndices(locations[i]));
+      }
+   };
+
+   // The location of a record in cell order.
+   struct CellLocation {
+      const std::vector<Point>& locations;
+
+      CellLocation(const std::vector<Point>& locations_) :
+         locations(locations_) {
+      }
+
+      const Point&
+      operator()(const std::size_t i) const {
+         return locations[i];
+      }
+   };
+
+   // Count the neighbors of a record, or write them.
+   struct NeighborQuery {
+      struct Count {
+         std::size_t self, n;
+
+         void
+         operator()(const std::size_t j) {
+            n += j != self;
+         }
+      };
+
+      struct Fill {
+         std::size_t self, n;
+         std::size_t* out;
+
+         void
+         operator()(const std::size_t j) {
+            if (j != self) {
+               out[n++] = j;
+            }
+         }
+      };
+
+      const CellGrid& grid;
+      double radius;
+
+      NeighborQuery(const CellGrid& grid_, const double radius_) :
+         grid(grid_),
+         radius(radius_) {
+      }
+
+      std::size_t
+      count(const std::size_t i) const {
+         Count c = {i, 0};
+         grid.visit(grid.locations[i], radius, c);
+         return c.n;
+      }
+
+      std::size_t
+      fill(const std::size_t i, std::size_t* out) const {
+         Fill f = {i, 0, out};
+         grid.visit(grid.locations[i], radius, f);
+         return f.n;
+      }
+   };
+
+   // Append to a vector.
+   struct Append {
+      std::vector<std::size_t>& neighbors;
+
+      Append(std::vector<std::size_t>& neighbors_) :
+         neighbors(neighbors_) {
+      }
+
+      void
+      operator()(const std::size_t j) {
+         neighbors.push_back(j);
+      }
+   };
+
+private:
+
+   // Copy constructor not implemented.
+   CellGrid(const CellGrid&);
+
+   // Assignment operator not implemented.
+   CellGrid&
+   operator=(const CellGrid&);
+
+public:
+
+   CellGrid() {
+      for (std::size_t i = 0; i != _D; ++i) {
+         _lowerCorner[i] = 0;
+         _inverseCellLengths[i] = 0;
+         _extents[i] = 0;
+      }
+   }
+
+   //! Bin the records, the cells are at least cellLength wide.
+   void
+   build(const std::vector<Record>& records_, const std::vector<Point>& locations_,
+         double cellLength);
+
+   //! The number of records.
+   std::size_t
+   size() const {
+      return records.size();
+   }
+
+   //! The number of cells.
+   std::size_t
+   numberOfCells() const {
+      return _cellStart.empty() ? 0 : _cellStart.size() - 1;
+   }
+
+   //! Append the positions (cell order) of the records in the ball.
+   void
+   query(const Point& center, double radius,
+         std::vector<std::size_t>& neighbors) const;
+
+   //! Visit the positions (cell order) of the records in the ball.
+   /*! \c visitor(j) is called for each of them. */
+   template<typename _Visitor>
+   void
+   visit(const Point& center, double radius, _Visitor& visitor) const;
+
+   //! Neighbors within radius of every record, excluding the record itself.
+   void
+   allNeighbors(double radius, std::vector<std::size_t>& delimiters,
+                std::vector<std::size_t>& packed) const;
+
+   //! The positions (cell order) of the records along the Morton curve.
+   /*! Permuting per-record data with the order gives it a better
+     locality than the cell order, which only follows the first
+     dimension. */
+   void
+   mortonOrder(std::vector<std::size_t>& order) const;
+
+protected:
+
+   //! Convert a location to a valid cell multi-index.
+   IndexList
+   locationToIndices(const Point& x) const;
+
+   //! Convert a multi-index to a container index.
+   std::size_t
+   containerIndex(const IndexList& index) const {
+      std::size_t c = index[_D-1];
+      for (std::size_t i = _D - 1; i-- > 0;) {
+         c = c * _extents[i] + index[i];
+      }
+      return c;
+   }
+
+   //! Sort the records by cell container indices.
+   void
+   cellSort(const std::vector<Record>& records_, const std::vector<Point>& locations_);
+};
+
+} // namespace geom
+
+#define __geom_CellGrid_ipp__
+#include "CellGrid.ipp"
+#undef __geom_CellGrid_ipp__
+
+#endif
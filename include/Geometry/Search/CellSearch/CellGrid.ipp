@@ -0,0 +1,181 @@
+// -*- C++ -*-
+
+#if !defined(__geom_CellGrid_ipp__)
+#error This file is an implementation detail of the class CellGrid.
+#endif
+
+namespace geom {
+
+template<std::size_t _D, typename _Record>
+inline
+void
+CellGrid<_D, _Record>::
+build(const std::vector<Record>& records_, const std::vector<Point>& locations_,
+      const double cellLength) {
+   assert(records_.size() == locations_.size());
+   records.clear();
+   locations.clear();
+   permutation.clear();
+   _cellStart.clear();
+   // Dispense with the trivial case.
+   if (records_.empty()) {
+      return;
+   }
+
+   // Bound the locations.
+   Point lower = locations_[0], upper = locations_[0];
+   for (std::size_t i = 1; i != locations_.size(); ++i) {
+      for (std::size_t d = 0; d != _D; ++d) {
+         lower[d] = std::min(lower[d], locations_[i][d]);
+         upper[d] = std::max(upper[d], locations_[i][d]);
+      }
+   }
+
+   // Expand to avoid errors in converting locations to cell multi-indices.
+   double width = 0;
+   for (std::size_t d = 0; d != _D; ++d) {
+      width = std::max(width, upper[d] - lower[d]);
+   }
+   const double eps = std::sqrt(std::numeric_limits<double>::epsilon()) * (1. + width);
+   double content = 1;
+   for (std::size_t d = 0; d != _D; ++d) {
+      lower[d] -= eps;
+      upper[d] += eps;
+      content *= upper[d] - lower[d];
+   }
+
+   // No more cells than records.
+   double h = std::pow(content / double(records_.size()), 1.0 / double(_D));
+   h = std::max(h, cellLength);
+   std::size_t numberOfCells = 1;
+   for (std::size_t d = 0; d != _D; ++d) {
+      _lowerCorner[d] = lower[d];
+      _extents[d] = std::max(std::size_t(1), std::size_t((upper[d] - lower[d]) / h));
+      _inverseCellLengths[d] = _extents[d] / (upper[d] - lower[d]);
+      numberOfCells *= _extents[d];
+   }
+   _cellStart.resize(numberOfCells + 1);
+
+   // Sort by the cell indices and define the cells.
+   cellSort(records_, locations_);
+}
+
+
+template<std::size_t _D, typename _Record>
+inline
+void
+CellGrid<_D, _Record>::
+cellSort(const std::vector<Record>& records_, const std::vector<Point>& locations_) {
+   const std::size_t n = records_.size();
+   // Sort by the cell indices, stable within a cell.
+   CellKey key(*this, locations_);
+   cellCountingSort(n, numberOfCells(), key, permutation, _cellStart);
+   records.resize(n);
+   locations.resize(n);
+   for (std::size_t j = 0; j != n; ++j) {
+      records[j] = records_[permutation[j]];
+      locations[j] = locations_[permutation[j]];
+   }
+}
+
+
+template<std::size_t _D, typename _Record>
+inline
+typename CellGrid<_D, _Record>::IndexList
+CellGrid<_D, _Record>::
+locationToIndices(const Point& x) const {
+   IndexList index;
+   for (std::size_t i = 0; i != _D; ++i) {
+      const double t = std::max(0., x[i] - _lowerCorner[i]) * _inverseCellLengths[i];
+      index[i] = t < double(_extents[i] - 1) ? std::size_t(t) : _extents[i] - 1;
+   }
+   return index;
+}
+
+
+template<std::size_t _D, typename _Record>
+template<typename _Visitor>
+inline
+void
+CellGrid<_D, _Record>::
+visit(const Point& center, const double radius, _Visitor& visitor) const {
+   // Check trivial case.
+   if (records.empty()) {
+      return;
+   }
+
+   Point xlo, xhi;
+   for (std::size_t i = 0; i != _D; ++i) {
+      xlo[i] = center[i] - radius;
+      xhi[i] = center[i] + radius;
+   }
+   const IndexList lo = locationToIndices(xlo);
+   const IndexList hi = locationToIndices(xhi);
+   const double squaredRadius = radius * radius;
+
+   // Iterate over the rows of cells along the first dimension.
+   IndexList i = lo;
+   for (;;) {
+      i[0] = lo[0];
+      const std::size_t jBegin = _cellStart[containerIndex(i)];
+      i[0] = hi[0];
+      const std::size_t jEnd = _cellStart[containerIndex(i) + 1];
+      for (std::size_t j = jBegin; j != jEnd; ++j) {
+         double d2 = 0;
+         for (std::size_t d = 0; d != _D; ++d) {
+            const double t = locations[j][d] - center[d];
+            d2 += t * t;
+         }
+         if (d2 < squaredRadius) {
+            visitor(j);
+         }
+      }
+
+      // Next row.
+      std::size_t d = 1;
+      for (; d < _D; ++d) {
+         if (i[d] < hi[d]) {
+            ++i[d];
+            break;
+         }
+         i[d] = lo[d];
+      }
+      if (d >= _D) {
+         break;
+      }
+   }
+}
+
+
+template<std::size_t _D, typename _Record>
+inline
+void
+CellGrid<_D, _Record>::
+query(const Point& center, const double radius,
+      std::vector<std::size_t>& neighbors) const {
+   Append append(neighbors);
+   visit(center, radius, append);
+}
+
+
+template<std::size_t _D, typename _Record>
+inline
+void
+CellGrid<_D, _Record>::
+allNeighbors(const double radius, std::vector<std::size_t>& delimiters,
+             std::vector<std::size_t>& packed) const {
+   NeighborQuery query(*this, radius);
+   cellPackNeighbors(records.size(), query, delimiters, packed);
+}
+
+
+template<std::size_t _D, typename _Record>
+inline
+void
+CellGrid<_D, _Record>::
+mortonOrder(std::vector<std::size_t>& order) const {
+   CellLocation location(locations);
+   cellMortonOrder<_D>(records.size(), location, order);
+}
+
+} // namespace geom
@@ -0,0 +1,43 @@
+// -*- C++ -*-
+
+/*!
+  \file MPI_ParallelCellSearchAllNeighbors.h
+  \brief The threaded counterpart of MPI_CellSearchAllNeighbors.
+*/
+
+#if !defined(__geom_MPI_ParallelCellSearchAllNeighbors_h__)
+#define __geom_MPI_ParallelCellSearchAllNeighbors_h__
+
+#include "ParallelCellSearchAllNeighbors.h"
+
+namespace geom {
+
+//! ParallelCellSearchAllNeighbors over the global ids of the records.
+/*!
+  \param _D The space dimension.
+
+  The drop-in replacement of MPI_CellSearchAllNeighbors; see
+  ParallelCellSearchAllNeighbors.
+  \code
+  std::map<int, Set::Euclidean::Orthonormal::Point> points;
+  ...
+  geom::MPI_ParallelCellSearchAllNeighbors<3> neighborSearch(points, searchRadius);
+  \endcode
+*/
+  template<unsigned int _D>
+  class MPI_ParallelCellSearchAllNeighbors :
+    public ParallelCellSearchAllNeighbors<_D, int> {
+public:
+    typedef ParallelCellSearchAllNeighbors<_D, int> Parent;
+    typedef typename Parent::point_type point_type;
+    typedef typename Parent::Record      Record;
+
+   //! Construct from the locations and the search radius.
+    MPI_ParallelCellSearchAllNeighbors(const map<Record, point_type> & points_,
+				       const double searchRadius_) :
+      Parent(points_, searchRadius_) {}
+};
+
+} // namespace geom
+
+#endif
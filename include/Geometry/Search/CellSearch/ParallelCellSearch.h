@@ -0,0 +1,119 @@
+// -*- C++ -*-
+
+/*!
+  \file ParallelCellSearch.h
+  \brief Parallel building blocks of the cell array searches.
+*/
+
+#if !defined(__geom_ParallelCellSearch_h__)
+#define __geom_ParallelCellSearch_h__
+
+#include <tr1/array>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+
+#include "Threads/TaskScheduler.h"
+
+namespace geom {
+
+//! \defgroup geom_ParallelCellSearch Parallel Cell Search
+/*!
+  The cell array searches (CellGrid, CellSearchAllNeighbors,
+  MPI_CellSearchAllNeighbors and CellSearchAdaptiveNeighbors) share
+  the following steps, which run on the process wide
+  m4extreme::Utils::TaskScheduler if one was created and serially
+  otherwise:
+  - cellCountingSort() sorts the records by cell. Each thread counts
+    the keys of its block of records into a histogram over a few
+    ranges of keys; a prefix sum over the histograms gives every
+    thread its own slots, so that the records are scattered to their
+    ranges without synchronization. The ranges are then sorted
+    independently by ordinary counting sorts. Both passes are stable.
+  - cellPackNeighbors() produces neighbor lists in compressed row
+    storage in two passes: the lists are counted, the delimiters are
+    the prefix sum of the counts and every list is then written to its
+    preallocated slots.
+  - cellMortonOrder() and cellHilbertOrder() order records along the
+    Morton (Z-order) or the Hilbert curve so that records that are
+    close in space are close in memory. The Hilbert curve has no jumps
+    and gives the better locality, the Morton code is cheaper.
+
+  A search that is called from the body of a parallel_for runs
+  serially, as parallel_for does not nest.
+*/
+//@{
+
+//! The scheduler for the cell searches, NULL to run serially.
+m4extreme::Utils::TaskScheduler*
+cellSearchScheduler();
+
+//! The number of blocks that a loop over n records is cut into.
+std::size_t
+cellSearchBlocks(std::size_t n);
+
+//! Call f(lo, hi) for chunks of grain in [0, n), in parallel if possible.
+template<typename _Function>
+void
+cellSearchFor(std::size_t n, std::size_t grain, _Function& f);
+
+//! Stable counting sort of the records 0 ... n-1 by key(i) < numberOfKeys.
+/*!
+  On return, \c order[j] is the record at the jth position and the
+  records with key k are at the positions [start[k], start[k+1]).
+*/
+template<typename _Key>
+void
+cellCountingSort(std::size_t n, std::size_t numberOfKeys, _Key& key,
+                 std::vector<std::size_t>& order,
+                 std::vector<std::size_t>& start);
+
+//! Neighbor lists of the records 0 ... n-1 in compressed row storage.
+/*!
+  \c query.count(i) returns the number of neighbors of the ith record
+  and \c query.fill(i, out) writes them to out and returns the number
+  written, which must be the same.
+*/
+template<typename _Query, typename _T>
+void
+cellPackNeighbors(std::size_t n, _Query& query,
+                  std::vector<std::size_t>& delimiters,
+                  std::vector<_T>& packed);
+
+//! Order the records 0 ... n-1 along the Morton curve.
+/*!
+  \c location(i) returns the location of the ith record as a
+  \c std::tr1::array<double,_D>; it is called concurrently. On return, \c order[j] is the record
+  at the jth position.
+*/
+template<std::size_t _D, typename _Location>
+void
+cellMortonOrder(std::size_t n, _Location& location,
+                std::vector<std::size_t>& order);
+
+//! Order the records 0 ... n-1 along the Hilbert curve.
+/*! The arguments are those of cellMortonOrder(). */
+template<std::size_t _D, typename _Location>
+void
+cellHilbertOrder(std::size_t n, _Location& location,
+                 std::vector<std::size_t>& order);
+
+//! Order n points along the Hilbert curve.
+/*!
+  The coordinates of the ith point are coordinates[i*stride] ...
+  coordinates[i*stride + dimension - 1], with 1 <= dimension <= 3.
+*/
+void
+cellHilbertOrder(std::size_t n, std::size_t dimension, const double* coordinates,
+                 std::size_t stride, std::vector<std::size_t>& order);
+
+//@}
+
+} // namespace geom
+
+#define __geom_ParallelCellSearch_ipp__
+#include "ParallelCellSearch.ipp"
+#undef __geom_ParallelCellSearch_ipp__
+
+#endif
@@ -0,0 +1,644 @@
+// -*- C++ -*-
+
+#if !defined(__geom_ParallelCellSearch_ipp__)
+#error This file is an implementation detail of ParallelCellSearch.
+#endif
+
+namespace geom {
+
+namespace internal {
+
+// The smallest block of records worth a thread.
+const std::size_t CellSearchMinimumBlock = 1024;
+
+// The body of a parallel_for calling f(lo, hi).
+template<typename _Function>
+struct CellSearchBody {
+   _Function& f;
+
+   CellSearchBody(_Function& f_) :
+      f(f_) {
+   }
+
+   void
+   operator()(const int lo, const int hi, int /*tid*/) {
+      f(std::size_t(lo), std::size_t(hi));
+   }
+};
+
+// The first record of a block.
+inline
+std::size_t
+cellSearchBlockBegin(const std::size_t n, const std::size_t numberOfBlocks,
+                     const std::size_t b) {
+   return n * b / numberOfBlocks;
+}
+
+// The first key of a range of keys.
+inline
+std::size_t
+cellSearchRangeBegin(const std::size_t numberOfKeys,
+                     const std::size_t numberOfRanges, const std::size_t r) {
+   return (r * numberOfKeys + numberOfRanges - 1) / numberOfRanges;
+}
+
+// Compute the keys of a block and count them by range.
+template<typename _Key>
+struct CellSortCount {
+   _Key& key;
+   std::size_t n, numberOfKeys, numberOfBlocks;
+   std::size_t* keys;
+   std::size_t* histogram;
+
+   CellSortCount(_Key& key_, const std::size_t n_, const std::size_t numberOfKeys_,
+                 const std::size_t numberOfBlocks_, std::size_t* keys_,
+                 std::size_t* histogram_) :
+      key(key_),
+      n(n_),
+      numberOfKeys(numberOfKeys_),
+      numberOfBlocks(numberOfBlocks_),
+      keys(keys_),
+      histogram(histogram_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t b = lo; b != hi; ++b) {
+         std::size_t* h = histogram + b * numberOfBlocks;
+         const std::size_t end = cellSearchBlockBegin(n, numberOfBlocks, b + 1);
+         for (std::size_t i = cellSearchBlockBegin(n, numberOfBlocks, b); i != end; ++i) {
+            keys[i] = key(i);
+            assert(keys[i] < numberOfKeys);
+            ++h[keys[i] * numberOfBlocks / numberOfKeys];
+         }
+      }
+   }
+};
+
+// Scatter the records of a block to the slots of the block in their range.
+struct CellSortScatter {
+   std::size_t n, numberOfKeys, numberOfBlocks;
+   const std::size_t* keys;
+   std::size_t* offsets;
+   std::size_t* byRange;
+
+   CellSortScatter(const std::size_t n_, const std::size_t numberOfKeys_,
+                   const std::size_t numberOfBlocks_, const std::size_t* keys_,
+                   std::size_t* offsets_, std::size_t* byRange_) :
+      n(n_),
+      numberOfKeys(numberOfKeys_),
+      numberOfBlocks(numberOfBlocks_),
+      keys(keys_),
+      offsets(offsets_),
+      byRange(byRange_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t b = lo; b != hi; ++b) {
+         std::size_t* o = offsets + b * numberOfBlocks;
+         const std::size_t end = cellSearchBlockBegin(n, numberOfBlocks, b + 1);
+         for (std::size_t i = cellSearchBlockBegin(n, numberOfBlocks, b); i != end; ++i) {
+            byRange[o[keys[i] * numberOfBlocks / numberOfKeys]++] = i;
+         }
+      }
+   }
+};
+
+// Counting sort of the records in a range of keys.
+struct CellSortRange {
+   std::size_t numberOfKeys, numberOfRanges;
+   const std::size_t* keys;
+   const std::size_t* rangeStart;
+   const std::size_t* byRange;
+   std::size_t* order;
+   std::size_t* start;
+
+   CellSortRange(const std::size_t numberOfKeys_, const std::size_t numberOfRanges_,
+                 const std::size_t* keys_, const std::size_t* rangeStart_,
+                 const std::size_t* byRange_, std::size_t* order_,
+                 std::size_t* start_) :
+      numberOfKeys(numberOfKeys_),
+      numberOfRanges(numberOfRanges_),
+      keys(keys_),
+      rangeStart(rangeStart_),
+      byRange(byRange_),
+      order(order_),
+      start(start_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      std::vector<std::size_t> position;
+      for (std::size_t r = lo; r != hi; ++r) {
+         const std::size_t kBegin = cellSearchRangeBegin(numberOfKeys, numberOfRanges, r);
+         const std::size_t kEnd = cellSearchRangeBegin(numberOfKeys, numberOfRanges, r + 1);
+         // Count the records in each cell.
+         position.assign(kEnd - kBegin + 1, 0);
+         for (std::size_t j = rangeStart[r]; j != rangeStart[r+1]; ++j) {
+            ++position[keys[byRange[j]] - kBegin + 1];
+         }
+         // Turn the counts into begin delimiters.
+         position[0] = rangeStart[r];
+         for (std::size_t k = 1; k != position.size(); ++k) {
+            position[k] += position[k-1];
+         }
+         std::copy(position.begin(), position.end() - 1, start + kBegin);
+         // Sort by the keys.
+         for (std::size_t j = rangeStart[r]; j != rangeStart[r+1]; ++j) {
+            const std::size_t i = byRange[j];
+            order[position[keys[i] - kBegin]++] = i;
+         }
+      }
+   }
+};
+
+// Count the neighbors of records.
+template<typename _Query>
+struct CellPackCount {
+   _Query& query;
+   std::size_t* counts;
+
+   CellPackCount(_Query& query_, std::size_t* counts_) :
+      query(query_),
+      counts(counts_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t i = lo; i != hi; ++i) {
+         counts[i] = query.count(i);
+      }
+   }
+};
+
+// Write the neighbors of records to their slots.
+template<typename _Query, typename _T>
+struct CellPackFill {
+   _Query& query;
+   const std::size_t* delimiters;
+   _T* packed;
+
+   CellPackFill(_Query& query_, const std::size_t* delimiters_, _T* packed_) :
+      query(query_),
+      delimiters(delimiters_),
+      packed(packed_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t i = lo; i != hi; ++i) {
+#ifdef NDEBUG
+         query.fill(i, packed + delimiters[i]);
+#else
+         const std::size_t n = query.fill(i, packed + delimiters[i]);
+         assert(n == delimiters[i+1] - delimiters[i]);
+#endif
+      }
+   }
+};
+
+// Bound the locations of the records of a block.
+template<std::size_t _D, typename _Location>
+struct CellMortonBound {
+   typedef std::tr1::array<double, _D> Point;
+
+   _Location& location;
+   std::size_t n, numberOfBlocks;
+   Point* lower;
+   Point* upper;
+
+   CellMortonBound(_Location& location_, const std::size_t n_,
+                   const std::size_t numberOfBlocks_, Point* lower_,
+                   Point* upper_) :
+      location(location_),
+      n(n_),
+      numberOfBlocks(numberOfBlocks_),
+      lower(lower_),
+      upper(upper_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t b = lo; b != hi; ++b) {
+         const std::size_t end = cellSearchBlockBegin(n, numberOfBlocks, b + 1);
+         std::size_t i = cellSearchBlockBegin(n, numberOfBlocks, b);
+         lower[b] = upper[b] = location(i);
+         for (++i; i != end; ++i) {
+            const Point& x = location(i);
+            for (std::size_t d = 0; d != _D; ++d) {
+               lower[b][d] = std::min(lower[b][d], x[d]);
+               upper[b][d] = std::max(upper[b][d], x[d]);
+            }
+         }
+      }
+   }
+};
+
+typedef std::pair<unsigned long long, std::size_t> CellMortonKey;
+
+// Compute the Morton or Hilbert codes of records.
+template<std::size_t _D, typename _Location>
+struct CellMortonCode {
+   typedef std::tr1::array<double, _D> Point;
+
+   _Location& location;
+   Point lower, scale;
+   std::size_t bits;
+   bool hilbert;
+   CellMortonKey* codes;
+
+   CellMortonCode(_Location& location_, const Point& lower_, const Point& scale_,
+                  const std::size_t bits_, const bool hilbert_,
+                  CellMortonKey* codes_) :
+      location(location_),
+      lower(lower_),
+      scale(scale_),
+      bits(bits_),
+      hilbert(hilbert_),
+      codes(codes_) {
+   }
+
+   // Transform the coordinates to the transposed Hilbert index
+   // (J. Skilling, Programming the Hilbert curve, 2004).
+   void
+   transpose(std::tr1::array<unsigned long long, _D>& q) const {
+      const unsigned long long m = 1ULL << (bits - 1);
+      // Inverse undo.
+      for (unsigned long long b = m; b > 1; b >>= 1) {
+         const unsigned long long p = b - 1;
+         for (std::size_t d = 0; d != _D; ++d) {
+            if (q[d] & b) {
+               q[0] ^= p;
+            }
+            else {
+               const unsigned long long t = (q[0] ^ q[d]) & p;
+               q[0] ^= t;
+               q[d] ^= t;
+            }
+         }
+      }
+      // Gray encode.
+      for (std::size_t d = 1; d != _D; ++d) {
+         q[d] ^= q[d-1];
+      }
+      unsigned long long t = 0;
+      for (unsigned long long b = m; b > 1; b >>= 1) {
+         if (q[_D-1] & b) {
+            t ^= b - 1;
+         }
+      }
+      for (std::size_t d = 0; d != _D; ++d) {
+         q[d] ^= t;
+      }
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      std::tr1::array<unsigned long long, _D> q;
+      for (std::size_t i = lo; i != hi; ++i) {
+         const Point& x = location(i);
+         for (std::size_t d = 0; d != _D; ++d) {
+            q[d] = (unsigned long long)((x[d] - lower[d]) * scale[d]);
+         }
+         // In one dimension both curves are the identity.
+         if (hilbert && _D > 1) {
+            transpose(q);
+         }
+         // Interleave the bits, most significant first.
+         unsigned long long code = 0;
+         for (std::size_t bit = bits; bit-- > 0;) {
+            for (std::size_t d = 0; d != _D; ++d) {
+               code = (code << 1) | ((q[d] >> bit) & 1);
+            }
+         }
+         codes[i] = CellMortonKey(code, i);
+      }
+   }
+};
+
+// The location of a point in a strided array.
+template<std::size_t _D>
+struct CellStridedLocation {
+   typedef std::tr1::array<double, _D> Point;
+
+   const double* coordinates;
+   std::size_t stride;
+
+   CellStridedLocation(const double* coordinates_, const std::size_t stride_) :
+      coordinates(coordinates_),
+      stride(stride_) {
+   }
+
+   Point
+   operator()(const std::size_t i) const {
+      Point x;
+      for (std::size_t d = 0; d != _D; ++d) {
+         x[d] = coordinates[i * stride + d];
+      }
+      return x;
+   }
+};
+
+// Sort blocks of codes.
+struct CellMortonSort {
+   std::size_t n, numberOfBlocks;
+   CellMortonKey* codes;
+
+   CellMortonSort(const std::size_t n_, const std::size_t numberOfBlocks_,
+                  CellMortonKey* codes_) :
+      n(n_),
+      numberOfBlocks(numberOfBlocks_),
+      codes(codes_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t b = lo; b != hi; ++b) {
+         std::sort(codes + cellSearchBlockBegin(n, numberOfBlocks, b),
+                   codes + cellSearchBlockBegin(n, numberOfBlocks, b + 1));
+      }
+   }
+};
+
+// Merge pairs of adjacent sorted runs of blocks.
+struct CellMortonMerge {
+   std::size_t n, numberOfBlocks, width;
+   const CellMortonKey* source;
+   CellMortonKey* target;
+
+   CellMortonMerge(const std::size_t n_, const std::size_t numberOfBlocks_,
+                   const std::size_t width_, const CellMortonKey* source_,
+                   CellMortonKey* target_) :
+      n(n_),
+      numberOfBlocks(numberOfBlocks_),
+      width(width_),
+      source(source_),
+      target(target_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t p = lo; p != hi; ++p) {
+         const std::size_t b = 2 * p * width;
+         const std::size_t first = cellSearchBlockBegin(n, numberOfBlocks, b);
+         const std::size_t middle =
+            cellSearchBlockBegin(n, numberOfBlocks, std::min(b + width, numberOfBlocks));
+         const std::size_t last =
+            cellSearchBlockBegin(n, numberOfBlocks, std::min(b + 2 * width, numberOfBlocks));
+         std::merge(source + first, source + middle, source + middle, source + last,
+                    target + first);
+      }
+   }
+};
+
+// Extract the order from the sorted codes.
+struct CellMortonExtract {
+   const CellMortonKey* codes;
+   std::size_t* order;
+
+   CellMortonExtract(const CellMortonKey* codes_, std::size_t* order_) :
+      codes(codes_),
+      order(order_) {
+   }
+
+   void
+   operator()(const std::size_t lo, const std::size_t hi) {
+      for (std::size_t i = lo; i != hi; ++i) {
+         order[i] = codes[i].second;
+      }
+   }
+};
+
+} // namespace internal
+
+
+inline
+m4extreme::Utils::TaskScheduler*
+cellSearchScheduler() {
+   m4extreme::Utils::TaskScheduler* scheduler = m4extreme::Utils::GetTaskScheduler();
+   if (scheduler != 0 &&
+       (scheduler->getNumberThreads() == 1 || scheduler->isRunning())) {
+      return 0;
+   }
+   return scheduler;
+}
+
+
+inline
+std::size_t
+cellSearchBlocks(const std::size_t n) {
+   m4extreme::Utils::TaskScheduler* scheduler = cellSearchScheduler();
+   if (scheduler == 0) {
+      return 1;
+   }
+   return std::max(std::size_t(1),
+                   std::min(std::size_t(scheduler->getNumberThreads()),
+                            n / internal::CellSearchMinimumBlock));
+}
+
+
+template<typename _Function>
+inline
+void
+cellSearchFor(const std::size_t n, const std::size_t grain, _Function& f) {
+   m4extreme::Utils::TaskScheduler* scheduler = cellSearchScheduler();
+   if (scheduler == 0 || n <= grain) {
+      if (n != 0) {
+         f(std::size_t(0), n);
+      }
+      return;
+   }
+   internal::CellSearchBody<_Function> body(f);
+   scheduler->parallel_for(0, int(n), int(grain), body);
+}
+
+
+template<typename _Key>
+inline
+void
+cellCountingSort(const std::size_t n, const std::size_t numberOfKeys, _Key& key,
+                 std::vector<std::size_t>& order,
+                 std::vector<std::size_t>& start) {
+   assert(numberOfKeys > 0);
+   order.resize(n);
+   start.resize(numberOfKeys + 1);
+   if (n == 0) {
+      std::fill(start.begin(), start.end(), std::size_t(0));
+      return;
+   }
+
+   // There are as many ranges of keys as there are blocks of records.
+   const std::size_t numberOfBlocks = std::min(cellSearchBlocks(n), numberOfKeys);
+   std::vector<std::size_t> keys(n);
+   std::vector<std::size_t> histogram(numberOfBlocks * numberOfBlocks, 0);
+   {
+      internal::CellSortCount<_Key> count(key, n, numberOfKeys, numberOfBlocks,
+                                          &keys[0], &histogram[0]);
+      cellSearchFor(numberOfBlocks, 1, count);
+   }
+
+   // Turn the histograms into the first slot of each block in each range.
+   std::vector<std::size_t> rangeStart(numberOfBlocks + 1);
+   std::size_t sum = 0;
+   for (std::size_t r = 0; r != numberOfBlocks; ++r) {
+      rangeStart[r] = sum;
+      for (std::size_t b = 0; b != numberOfBlocks; ++b) {
+         const std::size_t c = histogram[b * numberOfBlocks + r];
+         histogram[b * numberOfBlocks + r] = sum;
+         sum += c;
+      }
+   }
+   rangeStart[numberOfBlocks] = sum;
+
+   // Scatter to the ranges, then sort each range.
+   std::vector<std::size_t> byRange(n);
+   {
+      internal::CellSortScatter scatter(n, numberOfKeys, numberOfBlocks, &keys[0],
+                                        &histogram[0], &byRange[0]);
+      cellSearchFor(numberOfBlocks, 1, scatter);
+   }
+   {
+      internal::CellSortRange sort(numberOfKeys, numberOfBlocks, &keys[0],
+                                   &rangeStart[0], &byRange[0], &order[0], &start[0]);
+      cellSearchFor(numberOfBlocks, 1, sort);
+   }
+   start[numberOfKeys] = n;
+}
+
+
+template<typename _Query, typename _T>
+inline
+void
+cellPackNeighbors(const std::size_t n, _Query& query,
+                  std::vector<std::size_t>& delimiters,
+                  std::vector<_T>& packed) {
+   // Many small queries of different cost.
+   const std::size_t grain = 64;
+
+   delimiters.resize(n + 1);
+   {
+      internal::CellPackCount<_Query> count(query, &delimiters[0]);
+      cellSearchFor(n, grain, count);
+   }
+   // Turn the counts into begin delimiters.
+   std::size_t sum = 0;
+   for (std::size_t i = 0; i != n; ++i) {
+      const std::size_t c = delimiters[i];
+      delimiters[i] = sum;
+      sum += c;
+   }
+   delimiters[n] = sum;
+
+   packed.resize(sum);
+   if (sum != 0) {
+      internal::CellPackFill<_Query, _T> fill(query, &delimiters[0], &packed[0]);
+      cellSearchFor(n, grain, fill);
+   }
+}
+
+
+namespace internal {
+
+template<std::size_t _D, typename _Location>
+inline
+void
+cellCurveOrder(const std::size_t n, _Location& location,
+               std::vector<std::size_t>& order, const bool hilbert) {
+   typedef std::tr1::array<double, _D> Point;
+
+   order.resize(n);
+   if (n == 0) {
+      return;
+   }
+   const std::size_t numberOfBlocks = cellSearchBlocks(n);
+
+   // Bound the locations.
+   std::vector<Point> lowers(numberOfBlocks), uppers(numberOfBlocks);
+   {
+      CellMortonBound<_D, _Location> bound(location, n, numberOfBlocks,
+                                           &lowers[0], &uppers[0]);
+      cellSearchFor(numberOfBlocks, 1, bound);
+   }
+   Point lower = lowers[0], upper = uppers[0];
+   for (std::size_t b = 1; b != numberOfBlocks; ++b) {
+      for (std::size_t d = 0; d != _D; ++d) {
+         lower[d] = std::min(lower[d], lowers[b][d]);
+         upper[d] = std::max(upper[d], uppers[b][d]);
+      }
+   }
+
+   // Quantize each coordinate to as many bits as fit in the code.
+   const std::size_t bits = std::min(std::size_t(63 / _D), std::size_t(32));
+   const double maximum = double((1ULL << bits) - 1);
+   Point scale;
+   for (std::size_t d = 0; d != _D; ++d) {
+      scale[d] = upper[d] > lower[d] ? maximum / (upper[d] - lower[d]) : 0;
+   }
+
+   // Sort the codes by blocks and merge the blocks pairwise.
+   std::vector<CellMortonKey> codes(n), buffer(n);
+   {
+      CellMortonCode<_D, _Location> code(location, lower, scale, bits, hilbert,
+                                         &codes[0]);
+      cellSearchFor(n, CellSearchMinimumBlock, code);
+   }
+   {
+      CellMortonSort sort(n, numberOfBlocks, &codes[0]);
+      cellSearchFor(numberOfBlocks, 1, sort);
+   }
+   for (std::size_t width = 1; width < numberOfBlocks; width *= 2) {
+      CellMortonMerge merge(n, numberOfBlocks, width, &codes[0], &buffer[0]);
+      cellSearchFor((numberOfBlocks + 2 * width - 1) / (2 * width), 1, merge);
+      codes.swap(buffer);
+   }
+
+   CellMortonExtract extract(&codes[0], &order[0]);
+   cellSearchFor(n, CellSearchMinimumBlock, extract);
+}
+
+} // namespace internal
+
+
+template<std::size_t _D, typename _Location>
+inline
+void
+cellMortonOrder(const std::size_t n, _Location& location,
+                std::vector<std::size_t>& order) {
+   internal::cellCurveOrder<_D>(n, location, order, false);
+}
+
+
+template<std::size_t _D, typename _Location>
+inline
+void
+cellHilbertOrder(const std::size_t n, _Location& location,
+                 std::vector<std::size_t>& order) {
+   internal::cellCurveOrder<_D>(n, location, order, true);
+}
+
+
+inline
+void
+cellHilbertOrder(const std::size_t n, const std::size_t dimension,
+                 const double* coordinates, const std::size_t stride,
+                 std::vector<std::size_t>& order) {
+   assert(stride >= dimension);
+   if (dimension == 1) {
+      internal::CellStridedLocation<1> location(coordinates, stride);
+      cellHilbertOrder<1>(n, location, order);
+   }
+   else if (dimension == 2) {
+      internal::CellStridedLocation<2> location(coordinates, stride);
+      cellHilbertOrder<2>(n, location, order);
+   }
+   else if (dimension == 3) {
+      internal::CellStridedLocation<3> location(coordinates, stride);
+      cellHilbertOrder<3>(n, location, order);
+   }
+   else {
+      assert(false);
+   }
+}
+
+} // namespace geom
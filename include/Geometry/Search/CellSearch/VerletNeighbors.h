@@ -0,0 +1,196 @@
+// -*- C++ -*-
+
+/*!
+  \file VerletNeighbors.h
+  \brief Incremental all-neighbors search with a Verlet skin.
+*/
+
+#if !defined(__geom_VerletNeighbors_h__)
+#define __geom_VerletNeighbors_h__
+
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+
+#include "CellGrid.h"
+#include "Set/SetLib.h"
+#include "Geometry/Search/Search.h"
+#include "Utils/Profiler/Profiler.h"
+
+namespace geom {
+
+//! Incremental all-neighbors search with a Verlet skin.
+/*!
+  \param _D The space dimension.
+  \param T The record type.
+
+  The neighbor lists are computed with the enlarged radius
+  searchRadius + skin and kept in compressed row storage,
+  \c packedNeighbors and \c neighborDelimiters, which are the
+  authoritative form of the lists. Update() only records the new
+  locations as long as no record moved by more than skin/2 since the
+  last build, because then every pair within searchRadius is still in
+  the lists. Otherwise, or if the records changed, the cell binning and
+  the lists are rebuilt.
+
+  The neighbors of a record are the entries of its list that are
+  within searchRadius at the current locations; neighbors() returns
+  them and is the interface to use. operator()(Record) returns them as
+  a set for the Geometry::Search interface; the set of a record is
+  built on its first query after an update, under a lock, so
+  concurrent queries between two updates are safe and Update() itself
+  costs no more than the displacement check.
+
+  \code
+  geom::VerletNeighbors<3> nbs(points, radius, 0.2 * radius);
+  ...
+  // every step
+  if (nbs.Update(points)) {
+     // the lists were rebuilt
+  }
+  \endcode
+*/
+template<unsigned int _D, typename T = Set::Manifold::Point*>
+class VerletNeighbors : public Geometry::Search<T> {
+   //
+   // Types.
+   //
+public:
+
+   typedef typename Geometry::Search<T> BASE;
+   typedef typename BASE::point_type point_type;
+   typedef typename BASE::Record Record;
+   typedef std::map<Record, point_type> pointset_type;
+
+   //! A Cartesian point.
+   typedef std::tr1::array<double, _D> Point;
+
+   //
+   // Data
+   //
+public:
+
+   //! The search radius for finding neighbors.
+   const double searchRadius;
+   //! The skin added to the search radius.
+   const double skin;
+   //! The records, in cell order of the last build.
+   std::vector<Record> records;
+   //! The packed Verlet lists (positions in records).
+   std::vector<std::size_t> packedNeighbors;
+   //! The delimiters of the Verlet lists.
+   std::vector<std::size_t> neighborDelimiters;
+
+private:
+
+   //! The cell array of the locations at the last build.
+   CellGrid<_D, Record> _grid;
+   //! The current locations, in the order of records.
+   std::vector<Point> _locations;
+   //! Records sorted, with their position in records.
+   std::vector<std::pair<Record, std::size_t> > _index;
+   //! The largest displacement since the last build.
+   double _maxDisplacement;
+   std::size_t _builds;
+   std::size_t _updates;
+
+   //! The neighbor sets, in the order of records, built on demand.
+   mutable std::vector< std::set<Record> > _nhs;
+   //! Whether the set of a record is up to date.
+   mutable std::vector<char> _nhsBuilt;
+   //! Serializes the building of the sets.
+   mutable pthread_mutex_t _nhsMutex;
+
+private:
+
+   // Copy constructor not implemented
+   VerletNeighbors(const VerletNeighbors&);
+
+   // Assignment operator not implemented
+   VerletNeighbors&
+   operator=(const VerletNeighbors&);
+
+public:
+
+   //! Construct from the locations, the search radius and the skin.
+   VerletNeighbors(const pointset_type& points_, const double searchRadius_,
+                   const double skin_) :
+      searchRadius(searchRadius_),
+      skin(skin_),
+      _maxDisplacement(0),
+      _builds(0),
+      _updates(0) {
+      assert(skin >= 0);
+      pthread_mutex_init(&_nhsMutex, NULL);
+      build(points_);
+   }
+
+   ~VerletNeighbors() {
+      pthread_mutex_destroy(&_nhsMutex);
+   }
+
+   //! Take the new locations; returns true if the lists were rebuilt.
+   bool
+   Update(const pointset_type& points_);
+
+   //! Rebuild the cell binning and the lists.
+   void
+   build(const pointset_type& points_);
+
+private:
+
+   //! Mark the neighbor sets out of date.
+   void
+   invalidateSets();
+
+public:
+
+   //! The largest displacement since the last build.
+   double
+   getMaxDisplacement() const {
+      return _maxDisplacement;
+   }
+
+   //! The number of builds.
+   std::size_t
+   getNumberOfBuilds() const {
+      return _builds;
+   }
+
+   //! The number of updates.
+   std::size_t
+   getNumberOfUpdates() const {
+      return _updates;
+   }
+
+   //! Position of a record in records, records.size() if there is none.
+   std::size_t
+   position(Record r) const {
+      typename std::vector<std::pair<Record, std::size_t> >::const_iterator
+         i = std::lower_bound(_index.begin(), _index.end(),
+                              std::make_pair(r, std::size_t(0)));
+      return i != _index.end() && i->first == r ? i->second : records.size();
+   }
+
+   //! Append the neighbors within searchRadius of the nth record.
+   void
+   neighbors(std::size_t n, std::vector<Record>& ngh) const;
+
+   //! Append the records within radius of a location.
+   void
+   operator () (const point_type& p, double radius, std::vector<Record>& ngh);
+
+   //! The neighbors of a record, NULL if the record is unknown.
+   const std::set<Record>*
+   operator () (Record cy) const;
+};
+
+} // namespace geom
+
+#define __geom_VerletNeighbors_ipp__
+#include "VerletNeighbors.ipp"
+#undef __geom_VerletNeighbors_ipp__
+
+#endif
@@ -0,0 +1,169 @@
+// -*- C++ -*-
+
+#if !defined(__geom_VerletNeighbors_ipp__)
+#error This file is an implementation detail of the class VerletNeighbors.
+#endif
+
+namespace geom {
+
+template<unsigned int _D, typename T>
+inline
+void
+VerletNeighbors<_D, T>::
+build(const pointset_type& points_) {
+   std::vector<Record> input;
+   std::vector<Point> locations;
+   input.reserve(points_.size());
+   locations.reserve(points_.size());
+   for (typename pointset_type::const_iterator p = points_.begin();
+        p != points_.end(); ++p) {
+      Point x;
+      for (std::size_t i = 0; i != _D; ++i) {
+         x[i] = p->second[i];
+      }
+      input.push_back(p->first);
+      locations.push_back(x);
+   }
+
+   _grid.build(input, locations, searchRadius + skin);
+   records = _grid.records;
+   _locations = _grid.locations;
+   _grid.allNeighbors(searchRadius + skin, neighborDelimiters, packedNeighbors);
+
+   // The input is sorted by record.
+   _index.resize(records.size());
+   for (std::size_t j = 0; j != records.size(); ++j) {
+      _index[_grid.permutation[j]] = std::make_pair(records[j], j);
+   }
+
+   _maxDisplacement = 0;
+   ++_builds;
+   _nhs.resize(records.size());
+   invalidateSets();
+}
+
+
+template<unsigned int _D, typename T>
+inline
+bool
+VerletNeighbors<_D, T>::
+Update(const pointset_type& points_) {
+   ++_updates;
+
+   bool rebuild = points_.size() != _index.size();
+   double maxDisplacement = 0;
+   std::size_t k = 0;
+   for (typename pointset_type::const_iterator p = points_.begin();
+        !rebuild && p != points_.end(); ++p, ++k) {
+      if (p->first != _index[k].first) {
+         rebuild = true;
+         break;
+      }
+      const std::size_t j = _index[k].second;
+      const Point& x0 = _grid.locations[j];
+      Point& x = _locations[j];
+      double d2 = 0;
+      for (std::size_t i = 0; i != _D; ++i) {
+         x[i] = p->second[i];
+         const double t = x[i] - x0[i];
+         d2 += t * t;
+      }
+      maxDisplacement = std::max(maxDisplacement, d2);
+   }
+   _maxDisplacement = std::sqrt(maxDisplacement);
+
+   // Two records may have approached each other by twice the displacement.
+   if (rebuild || 2 * _maxDisplacement > skin) {
+      build(points_);
+      return true;
+   }
+   invalidateSets();
+   return false;
+}
+
+
+template<unsigned int _D, typename T>
+inline
+void
+VerletNeighbors<_D, T>::
+invalidateSets() {
+   _nhsBuilt.assign(records.size(), 0);
+}
+
+
+template<unsigned int _D, typename T>
+inline
+void
+VerletNeighbors<_D, T>::
+neighbors(const std::size_t n, std::vector<Record>& ngh) const {
+   M4EXTREME_PROFILE_COUNT(NEIGHBOR_QUERIES, 1);
+   const double squaredRadius = searchRadius * searchRadius;
+   const Point& x = _locations[n];
+   for (std::size_t k = neighborDelimiters[n]; k != neighborDelimiters[n+1]; ++k) {
+      const std::size_t j = packedNeighbors[k];
+      double d2 = 0;
+      for (std::size_t i = 0; i != _D; ++i) {
+         const double t = _locations[j][i] - x[i];
+         d2 += t * t;
+      }
+      if (d2 < squaredRadius) {
+         ngh.push_back(records[j]);
+      }
+   }
+}
+
+
+template<unsigned int _D, typename T>
+inline
+void
+VerletNeighbors<_D, T>::
+operator () (const point_type& p, const double radius, std::vector<Record>& ngh) {
+   Point center;
+   for (std::size_t i = 0; i != _D; ++i) {
+      center[i] = p[i];
+   }
+   // The cells hold the locations of the last build.
+   std::vector<std::size_t> candidates;
+   _grid.query(center, radius + _maxDisplacement, candidates);
+   const double squaredRadius = radius * radius;
+   for (std::size_t k = 0; k != candidates.size(); ++k) {
+      const Point& x = _locations[candidates[k]];
+      double d2 = 0;
+      for (std::size_t i = 0; i != _D; ++i) {
+         const double t = x[i] - center[i];
+         d2 += t * t;
+      }
+      if (d2 < squaredRadius) {
+         ngh.push_back(records[candidates[k]]);
+      }
+   }
+}
+
+
+template<unsigned int _D, typename T>
+inline
+const std::set<typename VerletNeighbors<_D, T>::Record>*
+VerletNeighbors<_D, T>::
+operator () (Record cy) const {
+   const std::size_t n = position(cy);
+   if (n == records.size()) {
+      return NULL;
+   }
+   if (!*static_cast<volatile char*>(&_nhsBuilt[n])) {
+      pthread_mutex_lock(&_nhsMutex);
+      if (!_nhsBuilt[n]) {
+         std::vector<Record> ngh;
+         neighbors(n, ngh);
+         _nhs[n].clear();
+         _nhs[n].insert(ngh.begin(), ngh.end());
+         // The set is complete before the flag is seen.
+         __sync_synchronize();
+         _nhsBuilt[n] = 1;
+      }
+      pthread_mutex_unlock(&_nhsMutex);
+   }
+   __sync_synchronize();
+   return &_nhs[n];
+}
+
+} // namespace geom
@@ -13,5 +13,9 @@
 #include "./CellSearch/CellSearchAdaptiveNeighbors.h"
 #include "./CellSearch/CellSearchAllNeighbors.h"
 #include "./CellSearch/MPI_CellSearchAllNeighbors.h"
+#include "./CellSearch/ParallelCellSearchAdaptiveNeighbors.h"
+#include "./CellSearch/ParallelCellSearchAllNeighbors.h"
+#include "./CellSearch/MPI_ParallelCellSearchAllNeighbors.h"
+#include "./CellSearch/VerletNeighbors.h"
 
 #endif // !defined(GEOMETRY_SEARCHLIB_H__INCLUDED_)
@@ -0,0 +1,238 @@
+// Batch.h: interface for the Batch class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(MATERIAL_BATCH_H__INCLUDED_)
+#define MATERIAL_BATCH_H__INCLUDED_
+
+#pragma once
+
+#include <cassert>
+#include <math.h>
+#include <vector>
+#include "../Material.h"
+#include "../Symmetric/Symmetric.h"
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////////
+// Batched constitutive updates. A batch energy evaluates n material
+// points in one call on arrays in structure-of-arrays layout:
+//
+//	F[k*n + i]		component k of the domain of point i
+//	P[k*n + i]		component k of the stress of point i
+//	C[(k*m + l)*n + i]	component (k,l) of the tangent of point i
+//
+// where m = GetDomainDim(). For the Material::Energy family the
+// components are those of the Vector domain (Hom storage of F or of
+// the displacement gradient). For the Material::Symmetric family they
+// are the tensor components of the lower triangle packed row by row,
+// i.e. (00), (10), (11), (20), (21), (22), and the tangent is the
+// derivative of the packed stress with respect to the packed strain.
+// The tangent is computed only when C is not null.
+//////////////////////////////////////////////////////////////////////
+
+namespace Material
+{
+namespace Batch
+{
+template<unsigned int p> class Energy;
+class Adaptor;
+class SymAdaptor;
+
+//////////////////////////////////////////////////////////////////////
+// Class Energy<1>
+//////////////////////////////////////////////////////////////////////
+
+template<> class Energy<1>
+{
+public:
+
+	Energy(){}
+	virtual ~Energy(){}
+	virtual Energy<1> *Clone() const=0;
+
+	// number of components per point
+	virtual unsigned int GetDomainDim() const=0;
+
+	// P = dW/dF and optionally C = ddW/dFdF for n points
+	virtual void operator () (unsigned int n, const double * F,
+				  double * P, double * C = 0) const=0;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class Adaptor
+//
+// Evaluates a Material::Energy<1> (and optionally its Energy<2>) one
+// point at a time. Used for the models without a vectorized kernel.
+//////////////////////////////////////////////////////////////////////
+
+class Adaptor : public Energy<1>
+{
+public:
+
+	Adaptor(unsigned int m, const Material::Energy<1> * DW,
+		const Material::Energy<2> * DDW = 0)
+	  : _m(m), _DW(DW), _DDW(DDW) {}
+	virtual ~Adaptor() {}
+
+	Energy<1> *Clone() const { return new Adaptor(_m, _DW, _DDW); }
+
+	unsigned int GetDomainDim() const { return _m; }
+
+	void operator () (unsigned int n, const double * F,
+			  double * P, double * C = 0) const {
+	  Set::VectorSpace::Vector Floc(_m);
+	  for (unsigned int i = 0; i < n; ++i) {
+	    for (unsigned int k = 0; k < _m; ++k) Floc[k] = F[k*n + i];
+
+	    Set::VectorSpace::Vector Ploc = (*_DW)(Floc);
+	    assert(Ploc.size() == _m);
+	    for (unsigned int k = 0; k < _m; ++k) P[k*n + i] = Ploc[k];
+
+	    if (C != 0) {
+	      if (_DDW == 0) {
+		cerr << "tangent requested without Energy<2> @Material::Batch::Adaptor" << endl;
+		assert(false);
+	      }
+	      Set::VectorSpace::Hom Cloc = (*_DDW)(Floc);
+	      const double * q = Cloc.begin();
+	      for (unsigned int kl = 0; kl < _m*_m; ++kl) C[kl*n + i] = q[kl];
+	    }
+	  }
+	}
+
+private:
+
+	unsigned int _m;
+	const Material::Energy<1> * _DW;
+	const Material::Energy<2> * _DDW;
+
+private:
+
+	Adaptor(const Adaptor &);
+	Adaptor & operator = (const Adaptor &);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class SymAdaptor
+//
+// Evaluates a Material::Symmetric::Energy<1> one point at a time. The
+// map between the packed layout above and the components of Sym is
+// probed once at construction, so that no assumption is made on the
+// internal ordering of Sym.
+//////////////////////////////////////////////////////////////////////
+
+class SymAdaptor : public Energy<1>
+{
+public:
+
+	SymAdaptor(unsigned int dim, const Material::Symmetric::Energy<1> * DW,
+		   const Material::Symmetric::Energy<2> * DDW = 0)
+	  : _dim(dim), _m(dim*(dim+1)/2), _DW(DW), _DDW(DDW),
+	    _row(_m), _col(_m), _index(_m), _scale(_m) {
+	  unsigned int a = 0;
+	  for (unsigned int r = 0; r < _dim; ++r) {
+	    for (unsigned int c = 0; c <= r; ++c, ++a) {
+	      _row[a] = r; _col[a] = c;
+	      Set::VectorSpace::Hom E(_dim);
+	      E(r,c) = 1.0; E(c,r) = 1.0;
+	      Set::VectorSpace::Sym S(E);
+	      _index[a] = _m;
+	      for (unsigned int k = 0; k < _m; ++k) {
+		if (S[k] != 0.0) { _index[a] = k; _scale[a] = S[k]; break; }
+	      }
+	      assert(_index[a] < _m);
+	    }
+	  }
+	}
+	virtual ~SymAdaptor() {}
+
+	Energy<1> *Clone() const { return new SymAdaptor(_dim, _DW, _DDW); }
+
+	unsigned int GetDomainDim() const { return _m; }
+
+	void operator () (unsigned int n, const double * F,
+			  double * P, double * C = 0) const {
+	  Set::VectorSpace::Sym Floc(_dim);
+	  for (unsigned int i = 0; i < n; ++i) {
+	    for (unsigned int a = 0; a < _m; ++a) Floc[_index[a]] = _scale[a] * F[a*n + i];
+
+	    Set::VectorSpace::Hom Ploc = (*_DW)(Floc).Embed();
+	    for (unsigned int a = 0; a < _m; ++a) P[a*n + i] = Ploc(_row[a], _col[a]);
+
+	    if (C != 0) {
+	      if (_DDW == 0) {
+		cerr << "tangent requested without Energy<2> @Material::Batch::SymAdaptor" << endl;
+		assert(false);
+	      }
+	      Set::VectorSpace::Hom Cloc = (*_DDW)(Floc);
+	      for (unsigned int a = 0; a < _m; ++a) {
+		const double wa = _row[a] == _col[a] ? 1.0 : 2.0;
+		for (unsigned int b = 0; b < _m; ++b) {
+		  C[(a*_m + b)*n + i] = _scale[a] * _scale[b] / wa *
+		    Cloc(_index[a], _index[b]);
+		}
+	      }
+	    }
+	  }
+	}
+
+private:
+
+	unsigned int _dim;
+	unsigned int _m;
+	const Material::Symmetric::Energy<1> * _DW;
+	const Material::Symmetric::Energy<2> * _DDW;
+	vector<unsigned int> _row;
+	vector<unsigned int> _col;
+	vector<unsigned int> _index;
+	vector<double> _scale;
+
+private:
+
+	SymAdaptor(const SymAdaptor &);
+	SymAdaptor & operator = (const SymAdaptor &);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Kinematic helpers used by the vectorized kernels. Matrices are
+// stored as in Hom, A[r*DIM + c]; the formulas below are invariant
+// under transposition of the storage.
+//////////////////////////////////////////////////////////////////////
+
+// G = A^{-1}, returns det(A)
+inline double Inverse3(const double * A, double * G)
+{
+	G[0] = A[4]*A[8] - A[5]*A[7];
+	G[1] = A[2]*A[7] - A[1]*A[8];
+	G[2] = A[1]*A[5] - A[2]*A[4];
+	G[3] = A[5]*A[6] - A[3]*A[8];
+	G[4] = A[0]*A[8] - A[2]*A[6];
+	G[5] = A[2]*A[3] - A[0]*A[5];
+	G[6] = A[3]*A[7] - A[4]*A[6];
+	G[7] = A[1]*A[6] - A[0]*A[7];
+	G[8] = A[0]*A[4] - A[1]*A[3];
+	const double J = A[0]*G[0] + A[1]*G[3] + A[2]*G[6];
+	const double Jinv = 1.0 / J;
+	for (unsigned int k = 0; k < 9; ++k) G[k] *= Jinv;
+	return J;
+}
+
+// G = A^{-1}, returns det(A)
+inline double Inverse2(const double * A, double * G)
+{
+	const double J = A[0]*A[3] - A[1]*A[2];
+	const double Jinv = 1.0 / J;
+	G[0] =  A[3]*Jinv; G[1] = -A[1]*Jinv;
+	G[2] = -A[2]*Jinv; G[3] =  A[0]*Jinv;
+	return J;
+}
+
+}
+
+}
+
+#endif // !defined(MATERIAL_BATCH_H__INCLUDED_)
@@ -0,0 +1,134 @@
+// Batch.h: interface for the Gas Batch class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(MATERIAL_LAW_GAS_BATCH_H__INCLUDED_)
+#define MATERIAL_LAW_GAS_BATCH_H__INCLUDED_
+
+#pragma once
+
+#include <vector>
+#include "./EoS/EoS.h"
+#include "../Batch/Batch.h"
+
+namespace Material
+{
+namespace Gas
+{
+//////////////////////////////////////////////////////////////////////
+// Class Batch
+//
+// W(F) = f(J), P = f'(J) J F^{-T}. The equation of state is evaluated
+// first for all points on the contiguous array of J, the kinematics
+// are then vectorized across points. Works for any member of the
+// Gas::EoS family.
+//////////////////////////////////////////////////////////////////////
+
+class Batch : public Material::Batch::Energy<1>
+{
+public:
+
+	Batch(unsigned int dim, const Material::Gas::EoS::Energy<1> * Df,
+	      const Material::Gas::EoS::Energy<2> * DDf = 0)
+	  : _dim(dim), _Df(Df), _DDf(DDf) { assert(dim == 2 || dim == 3); }
+
+	virtual ~Batch() {}
+
+	Material::Batch::Energy<1> *Clone() const { return new Batch(_dim, _Df, _DDf); }
+
+	unsigned int GetDomainDim() const { return _dim*_dim; }
+
+	void operator () (unsigned int n, const double * F,
+			  double * P, double * C = 0) const {
+	  if (_dim == 3) _evaluate<3>(n, F, P, C);
+	  else _evaluate<2>(n, F, P, C);
+	}
+
+private:
+
+	template<unsigned int DIM>
+	void _evaluate(unsigned int n, const double * __restrict__ F,
+		       double * __restrict__ P, double * __restrict__ C) const {
+	  _J.resize(n); _df.resize(n);
+	  double * __restrict__ Jv = &_J[0];
+	  double * __restrict__ df = &_df[0];
+
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    double Fl[DIM*DIM], G[DIM*DIM];
+	    for (unsigned int k = 0; k < DIM*DIM; ++k) Fl[k] = F[k*n + i];
+	    Jv[i] = DIM == 3 ? Material::Batch::Inverse3(Fl, G)
+	      : Material::Batch::Inverse2(Fl, G);
+	  }
+
+	  for (unsigned int i = 0; i < n; ++i) df[i] = (*_Df)(Jv[i]);
+
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    double Fl[DIM*DIM], G[DIM*DIM];
+	    for (unsigned int k = 0; k < DIM*DIM; ++k) Fl[k] = F[k*n + i];
+	    const double J = DIM == 3 ? Material::Batch::Inverse3(Fl, G)
+	      : Material::Batch::Inverse2(Fl, G);
+	    const double a = df[i] * J;
+	    for (unsigned int r = 0; r < DIM; ++r)
+	      for (unsigned int c = 0; c < DIM; ++c)
+		P[(r*DIM + c)*n + i] = a * G[c*DIM + r];
+	  }
+
+	  if (C == 0) return;
+
+	  if (_DDf == 0) {
+	    cerr << "tangent requested without EoS::Energy<2> @Material::Gas::Batch" << endl;
+	    assert(false);
+	  }
+
+	  _ddf.resize(n);
+	  double * __restrict__ ddf = &_ddf[0];
+	  for (unsigned int i = 0; i < n; ++i) ddf[i] = (*_DDf)(Jv[i]);
+
+	  const unsigned int m = DIM*DIM;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    double Fl[DIM*DIM], G[DIM*DIM];
+	    for (unsigned int k = 0; k < DIM*DIM; ++k) Fl[k] = F[k*n + i];
+	    const double J = DIM == 3 ? Material::Batch::Inverse3(Fl, G)
+	      : Material::Batch::Inverse2(Fl, G);
+	    const double a = df[i] * J;
+	    const double b = (ddf[i] * J + df[i]) * J;
+	    for (unsigned int r = 0; r < DIM; ++r)
+	      for (unsigned int c = 0; c < DIM; ++c)
+		for (unsigned int k = 0; k < DIM; ++k)
+		  for (unsigned int l = 0; l < DIM; ++l)
+		    C[((r*DIM + c)*m + k*DIM + l)*n + i] =
+		      b * G[c*DIM + r] * G[l*DIM + k] - a * G[c*DIM + k] * G[l*DIM + r];
+	  }
+	}
+
+private:
+
+	unsigned int _dim;
+	const Material::Gas::EoS::Energy<1> * _Df;
+	const Material::Gas::EoS::Energy<2> * _DDf;
+	mutable vector<double> _J;
+	mutable vector<double> _df;
+	mutable vector<double> _ddf;
+
+private:
+
+	Batch(const Batch &);
+	Batch & operator = (const Batch &);
+};
+
+}
+
+}
+
+#endif // !defined(MATERIAL_LAW_GAS_BATCH_H__INCLUDED_)
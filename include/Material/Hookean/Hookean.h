@@ -17,6 +17,7 @@
 #include "./Isotropic/Factory.h"
 #include "./Isotropic/FactoryThermal.h"
 #include "./Isotropic/IsotropicData.h"
+#include "./Isotropic/Batch.h"
 #include "./TGO/Factory.h"
 #include "./TGOGrowth/Factory.h"
 
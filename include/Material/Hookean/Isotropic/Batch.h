@@ -0,0 +1,107 @@
+// Batch.h: interface for the Hookean Isotropic Batch class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(MATERIAL_HOOKEAN_ISOTROPIC_BATCH_H__INCLUDED_)
+#define MATERIAL_HOOKEAN_ISOTROPIC_BATCH_H__INCLUDED_
+
+#pragma once
+
+#include "./Isotropic.h"
+#include "../../Batch/Batch.h"
+
+namespace Material
+{
+namespace Hookean
+{
+namespace Isotropic
+{
+//////////////////////////////////////////////////////////////////////
+// Class Batch
+//
+// The domain is the displacement gradient H,
+// P = Lambda tr(H) I + Mu (H + H^T)
+//////////////////////////////////////////////////////////////////////
+
+class Batch : public Material::Batch::Energy<1>
+{
+public:
+
+	Batch(unsigned int dim, double Lambda, double Mu)
+	  : _dim(dim), _Lambda(Lambda), _Mu(Mu) { assert(dim == 2 || dim == 3); }
+
+	Batch(unsigned int dim, Data * Prop)
+	  : _dim(dim), _Lambda(Prop->GetLambda()), _Mu(Prop->GetMu()) {
+	  assert(dim == 2 || dim == 3);
+	}
+
+	virtual ~Batch() {}
+
+	Material::Batch::Energy<1> *Clone() const { return new Batch(_dim, _Lambda, _Mu); }
+
+	unsigned int GetDomainDim() const { return _dim*_dim; }
+
+	void operator () (unsigned int n, const double * F,
+			  double * P, double * C = 0) const {
+	  if (_dim == 3) _evaluate<3>(n, F, P);
+	  else _evaluate<2>(n, F, P);
+
+	  if (C == 0) return;
+
+	  // the tangent does not depend on H
+	  const unsigned int m = _dim*_dim;
+	  for (unsigned int r = 0; r < _dim; ++r)
+	    for (unsigned int c = 0; c < _dim; ++c)
+	      for (unsigned int k = 0; k < _dim; ++k)
+		for (unsigned int l = 0; l < _dim; ++l) {
+		  double Cloc = 0.0;
+		  if (r == c && k == l) Cloc += _Lambda;
+		  if (r == k && c == l) Cloc += _Mu;
+		  if (r == l && c == k) Cloc += _Mu;
+		  double * q = C + ((r*_dim + c)*m + k*_dim + l)*n;
+		  for (unsigned int i = 0; i < n; ++i) q[i] = Cloc;
+		}
+	}
+
+private:
+
+	template<unsigned int DIM>
+	void _evaluate(unsigned int n, const double * __restrict__ H,
+		       double * __restrict__ P) const {
+	  const double Lambda = _Lambda, Mu = _Mu;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    double tr = 0.0;
+	    for (unsigned int r = 0; r < DIM; ++r) tr += H[(r*DIM + r)*n + i];
+	    for (unsigned int r = 0; r < DIM; ++r)
+	      for (unsigned int c = 0; c < DIM; ++c) {
+		double Ploc = Mu * (H[(r*DIM + c)*n + i] + H[(c*DIM + r)*n + i]);
+		if (r == c) Ploc += Lambda * tr;
+		P[(r*DIM + c)*n + i] = Ploc;
+	      }
+	  }
+	}
+
+private:
+
+	unsigned int _dim;
+	double _Lambda;
+	double _Mu;
+
+private:
+
+	Batch(const Batch &);
+	Batch & operator = (const Batch &);
+};
+
+}
+
+}
+
+}
+
+#endif // !defined(MATERIAL_HOOKEAN_ISOTROPIC_BATCH_H__INCLUDED_)
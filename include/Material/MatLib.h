@@ -11,10 +11,13 @@
 
 #include "./Material.h"
 #include "./Factory.h"
+#include "./Batch/Batch.h"
 #include "./Hookean/Hookean.h"
 #include "./NeoHookean/Factory.h"
+#include "./NeoHookean/Batch.h"
 #include "./Incompressible_NeoHookean/Factory.h"
 #include "./Gas/Factory.h"
+#include "./Gas/Batch.h"
 #include "./Gas/EoS/EoSLib.h"
 #include "./Uniaxial/UniLib.h"
 #include "./PlaneStrain/PSLib.h"
@@ -0,0 +1,110 @@
+// Batch.h: interface for the NeoHookean Batch class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(MATERIAL_LAW_NEOHOOKEAN_BATCH_H__INCLUDED_)
+#define MATERIAL_LAW_NEOHOOKEAN_BATCH_H__INCLUDED_
+
+#pragma once
+
+#include "./NeoHookean.h"
+#include "../Batch/Batch.h"
+
+namespace Material
+{
+namespace NeoHookean
+{
+//////////////////////////////////////////////////////////////////////
+// Class Batch
+//
+// W = Lambda/2 (log J)^2 - Mu log J + Mu/2 (F:F - DIM)
+// P = Mu F + (Lambda log J - Mu) F^{-T}
+//////////////////////////////////////////////////////////////////////
+
+class Batch : public Material::Batch::Energy<1>
+{
+public:
+
+	Batch(unsigned int dim, double Lambda, double Mu)
+	  : _dim(dim), _Lambda(Lambda), _Mu(Mu) { assert(dim == 2 || dim == 3); }
+
+	Batch(unsigned int dim, Data * Prop)
+	  : _dim(dim), _Lambda(Prop->GetLambda()), _Mu(Prop->GetMu()) {
+	  assert(dim == 2 || dim == 3);
+	}
+
+	virtual ~Batch() {}
+
+	Material::Batch::Energy<1> *Clone() const { return new Batch(_dim, _Lambda, _Mu); }
+
+	unsigned int GetDomainDim() const { return _dim*_dim; }
+
+	void operator () (unsigned int n, const double * F,
+			  double * P, double * C = 0) const {
+	  if (_dim == 3) _evaluate<3>(n, F, P, C);
+	  else _evaluate<2>(n, F, P, C);
+	}
+
+private:
+
+	template<unsigned int DIM>
+	void _evaluate(unsigned int n, const double * __restrict__ F,
+		       double * __restrict__ P, double * __restrict__ C) const {
+	  const double Lambda = _Lambda, Mu = _Mu;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    double Fl[DIM*DIM], G[DIM*DIM];
+	    for (unsigned int k = 0; k < DIM*DIM; ++k) Fl[k] = F[k*n + i];
+	    const double J = DIM == 3 ? Material::Batch::Inverse3(Fl, G)
+	      : Material::Batch::Inverse2(Fl, G);
+	    const double a = Lambda * log(J) - Mu;
+	    for (unsigned int r = 0; r < DIM; ++r)
+	      for (unsigned int c = 0; c < DIM; ++c)
+		P[(r*DIM + c)*n + i] = Mu * Fl[r*DIM + c] + a * G[c*DIM + r];
+	  }
+
+	  if (C == 0) return;
+
+	  const unsigned int m = DIM*DIM;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    double Fl[DIM*DIM], G[DIM*DIM];
+	    for (unsigned int k = 0; k < DIM*DIM; ++k) Fl[k] = F[k*n + i];
+	    const double J = DIM == 3 ? Material::Batch::Inverse3(Fl, G)
+	      : Material::Batch::Inverse2(Fl, G);
+	    const double a = Lambda * log(J) - Mu;
+	    for (unsigned int r = 0; r < DIM; ++r)
+	      for (unsigned int c = 0; c < DIM; ++c)
+		for (unsigned int k = 0; k < DIM; ++k)
+		  for (unsigned int l = 0; l < DIM; ++l) {
+		    double Cloc = Lambda * G[c*DIM + r] * G[l*DIM + k]
+		      - a * G[c*DIM + k] * G[l*DIM + r];
+		    if (r == k && c == l) Cloc += Mu;
+		    C[((r*DIM + c)*m + k*DIM + l)*n + i] = Cloc;
+		  }
+	  }
+	}
+
+private:
+
+	unsigned int _dim;
+	double _Lambda;
+	double _Mu;
+
+private:
+
+	Batch(const Batch &);
+	Batch & operator = (const Batch &);
+};
+
+}
+
+}
+
+#endif // !defined(MATERIAL_LAW_NEOHOOKEAN_BATCH_H__INCLUDED_)
@@ -0,0 +1,168 @@
+// Batch.h: interface for the J2Isotropic Batch class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(MATERIAL_SYMMETRIC_J2ISOTROPIC_BATCH_H__INCLUDED_)
+#define MATERIAL_SYMMETRIC_J2ISOTROPIC_BATCH_H__INCLUDED_
+
+#pragma once
+
+#include <vector>
+#include "./J2Isotropic.h"
+#include "../../Batch/Batch.h"
+
+namespace Material
+{
+namespace Symmetric
+{
+namespace J2Isotropic
+{
+class BatchLocalState;
+class Batch;
+
+//////////////////////////////////////////////////////////////////////
+// Class BatchLocalState
+//
+// Plastic strain and effective plastic strain of n material points
+// in structure-of-arrays layout, Epsp[a*n + i] with the packed
+// ordering of Material::Batch.
+//////////////////////////////////////////////////////////////////////
+
+class BatchLocalState
+{
+friend class Batch;
+
+public:
+
+	BatchLocalState(unsigned int n)
+	  : _n(n), Epsp(6*n, 0.0), EpspOld(6*n, 0.0),
+	    EpspEff(n, 0.0), EpspEffOld(n, 0.0) {}
+
+	virtual ~BatchLocalState() {}
+
+	unsigned int size() const { return _n; }
+
+	// commit the current internal variables
+	void operator ++ () {
+	  EpspOld = Epsp;
+	  EpspEffOld = EpspEff;
+	}
+
+	const double * GetEpsp() const { return &Epsp[0]; }
+	const double * GetEpspEff() const { return &EpspEff[0]; }
+
+private:
+
+	unsigned int _n;
+	vector<double> Epsp;
+	vector<double> EpspOld;
+	vector<double> EpspEff;
+	vector<double> EpspEffOld;
+
+private:
+
+	BatchLocalState(const BatchLocalState &);
+	BatchLocalState & operator = (const BatchLocalState &);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class Batch
+//
+// Small strain J2 plasticity with linear volumetric response, constant
+// shear modulus and linear isotropic hardening,
+//	sigma = K tr(eps) I + 2 Mu (dev(eps) - Epsp),
+//	sigma_y = Y0 + H EpspEff,
+// integrated by a closed-form radial return so that the update is free
+// of virtual calls and branches and vectorizes across points. Models
+// with general Uniaxial hardening or rate dependence go through
+// Material::Batch::SymAdaptor.
+//////////////////////////////////////////////////////////////////////
+
+class Batch : public Material::Batch::Energy<1>
+{
+public:
+
+	Batch(BatchLocalState * LS_, double K, double Mu, double Y0, double H)
+	  : LS(LS_), _K(K), _Mu(Mu), _Y0(Y0), _H(H) {}
+
+	virtual ~Batch() {}
+
+	Material::Batch::Energy<1> *Clone() const { return new Batch(LS, _K, _Mu, _Y0, _H); }
+
+	unsigned int GetDomainDim() const { return 6; }
+
+	void operator () (unsigned int n, const double * __restrict__ Eps,
+			  double * __restrict__ Sig, double * __restrict__ C = 0) const {
+	  assert(n == LS->_n);
+	  const double K = _K, Mu = _Mu, Y0 = _Y0, H = _H;
+	  const double s32 = sqrt(1.5);
+	  const double * __restrict__ epOld = &LS->EpspOld[0];
+	  const double * __restrict__ eeOld = &LS->EpspEffOld[0];
+	  double * __restrict__ ep = &LS->Epsp[0];
+	  double * __restrict__ ee = &LS->EpspEff[0];
+
+	  // packed index of the diagonal components
+	  static const int diag[6] = { 1, 0, 1, 0, 0, 1 };
+
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (unsigned int i = 0; i < n; ++i) {
+	    const double theta = Eps[0*n + i] + Eps[2*n + i] + Eps[5*n + i];
+
+	    // trial deviatoric stress
+	    double s[6], snorm2 = 0.0;
+	    for (unsigned int a = 0; a < 6; ++a) {
+	      const double e = Eps[a*n + i] - (diag[a] ? theta / 3.0 : 0.0);
+	      s[a] = 2.0 * Mu * (e - epOld[a*n + i]);
+	      snorm2 += (diag[a] ? 1.0 : 2.0) * s[a] * s[a];
+	    }
+	    const double snorm = sqrt(snorm2);
+	    const double q = s32 * snorm;
+	    const double f = q - (Y0 + H * eeOld[i]);
+	    const double dep = f > 0.0 ? f / (3.0 * Mu + H) : 0.0;
+	    const double beta = dep > 0.0 ? 1.0 - 3.0 * Mu * dep / q : 1.0;
+	    const double sinv = snorm > 0.0 ? 1.0 / snorm : 0.0;
+
+	    ee[i] = eeOld[i] + dep;
+	    for (unsigned int a = 0; a < 6; ++a) {
+	      ep[a*n + i] = epOld[a*n + i] + s32 * dep * s[a] * sinv;
+	      Sig[a*n + i] = beta * s[a] + (diag[a] ? K * theta : 0.0);
+	    }
+
+	    if (C == 0) continue;
+
+	    const double gamma = dep > 0.0 ? 3.0 * Mu / (3.0 * Mu + H) - (1.0 - beta) : 0.0;
+	    for (unsigned int a = 0; a < 6; ++a)
+	      for (unsigned int b = 0; b < 6; ++b) {
+		double Cab = (diag[a] && diag[b]) ? K - 2.0 * Mu * beta / 3.0 : 0.0;
+		if (a == b) Cab += 2.0 * Mu * beta / (diag[b] ? 1.0 : 2.0);
+		Cab -= 2.0 * Mu * gamma * s[a] * s[b] * sinv * sinv;
+		C[(a*6 + b)*n + i] = Cab * (diag[b] ? 1.0 : 2.0);
+	      }
+	  }
+	}
+
+private:
+
+	BatchLocalState *LS;
+	double _K;
+	double _Mu;
+	double _Y0;
+	double _H;
+
+private:
+
+	Batch(const Batch &);
+	Batch & operator = (const Batch &);
+};
+
+}
+
+}
+
+}
+
+#endif // !defined(MATERIAL_SYMMETRIC_J2ISOTROPIC_BATCH_H__INCLUDED_)
@@ -21,6 +21,7 @@
 #include "./Hookean/Hookean.h"
 #include "./J2Isotropic/J2Isotropic.h"
 #include "./J2Isotropic/Factory.h"
+#include "./J2Isotropic/Batch.h"
 #include "./J2Isotropic_thermal/Factory.h"
 #include "./J2IsotropicAdiabatic/Factory.h"
 #include "./LK2FK/LK2FK.h"
@@ -11,6 +11,7 @@
 
 #include <vector>
 #include "../Static/Static.h"
+#include "../../Solver/ExplicitDynamics/NodalField.h"
 
 #if defined(_M4EXTREME_THREAD_POOL)
 #include "cc++/thread.h"
@@ -162,6 +163,20 @@ namespace Model {
 	      return _computational_cost;
 	    }
 
+#if !defined(_M4EXTREME_THREAD_POOL)
+            using Model::Static::Energy < 1 >::operator ();
+#endif
+
+            // evaluate the nodal forces into a flat nodal field; the
+            // field keeps the force map alive between steps so that
+            // its vectors are not reallocated
+            void operator () (const domain_type & x, Solver::NodalField & field) {
+                range_type & f = field.GetForceBuffer();
+                (*this)(x, f);
+                field.SetForceToZero();
+                field.AddForce(f);
+            }
+
 #if defined(_M4EXTREME_THREAD_POOL)
 
             void operator () (const domain_type &, range_type &);
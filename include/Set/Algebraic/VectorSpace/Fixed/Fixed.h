@@ -0,0 +1,647 @@
+// Fixed.h: interface for the fixed-dimension Vec, Mat and SymMat classes.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SET_VECTORSPACE_FIXED_H__INCLUDED_)
+#define SET_VECTORSPACE_FIXED_H__INCLUDED_
+
+#pragma once
+
+#include <cassert>
+#include <math.h>
+#include "../Vector/Vector.h"
+#include "../Category/Category.h"
+#include "../Category/Symmetric/Symmetric.h"
+
+#if defined(__GNUC__)
+#define M4EXTREME_FIXED_ALIGN(n) __attribute__((aligned(n)))
+#else
+#define M4EXTREME_FIXED_ALIGN(n)
+#endif
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////////
+// Stack-allocated counterparts of Vector, Hom and Sym whose size is a
+// template parameter. They never touch the heap, so they can be used
+// for F, P, shape function gradients and temporaries inside material
+// and element kernels. Conversions to and from the run-time sized
+// classes are provided so that models can be ported one at a time.
+//
+// Mat<N1,N2> uses the storage of Hom(N1,N2): N2 columns of length N1,
+// A[i][j] is the jth entry of the ith column and A(v) maps R^N2 into
+// R^N1. SymMat<N> packs the lower triangle row by row.
+//////////////////////////////////////////////////////////////////////
+
+namespace Set
+{
+namespace VectorSpace
+{
+template<unsigned int N> class Vec;
+template<unsigned int N1, unsigned int N2> class Mat;
+template<unsigned int N> class SymMat;
+
+//////////////////////////////////////////////////////////////////////
+// Class Vec<N>
+//////////////////////////////////////////////////////////////////////
+
+template<unsigned int N>
+class Vec
+{
+public:
+
+	enum { dim = N };
+
+	inline
+	Vec() { for (unsigned int i=0; i<N; i++) d[i] = 0.0; }
+
+	inline
+	explicit Vec(double u) { for (unsigned int i=0; i<N; i++) d[i] = u; }
+
+	inline
+	explicit Vec(const double * u) { for (unsigned int i=0; i<N; i++) d[i] = u[i]; }
+
+	inline
+	explicit Vec(const Set::Array & A) {
+	  assert(A.size() == N);
+	  const double *p = A.begin();
+	  for (unsigned int i=0; i<N; i++) d[i] = p[i];
+	}
+
+	inline
+	Vec & operator = (const Set::Array & A) {
+	  assert(A.size() == N);
+	  const double *p = A.begin();
+	  for (unsigned int i=0; i<N; i++) d[i] = p[i];
+	  return *this;
+	}
+
+	// copy into a run-time sized vector of the same size
+	inline
+	Set::Array & Export(Set::Array & A) const {
+	  assert(A.size() == N);
+	  double *p = A.begin();
+	  for (unsigned int i=0; i<N; i++) p[i] = d[i];
+	  return A;
+	}
+
+	inline
+	Vector ToVector() const { Vector A(N); Export(A); return A; }
+
+	inline double * begin() { return d; }
+	inline double * end() { return d + N; }
+	inline const double * begin() const { return d; }
+	inline const double * end() const { return d + N; }
+	inline unsigned int size() const { return N; }
+
+	inline
+	const double & operator [] (unsigned int i) const { assert(i<N); return d[i]; }
+
+	inline
+	double & operator [] (unsigned int i) { assert(i<N); return d[i]; }
+
+	inline
+	void operator += (const Vec & A) { for (unsigned int i=0; i<N; i++) d[i] += A.d[i]; }
+
+	inline
+	void operator -= (const Vec & A) { for (unsigned int i=0; i<N; i++) d[i] -= A.d[i]; }
+
+	inline
+	void operator *= (double a) { for (unsigned int i=0; i<N; i++) d[i] *= a; }
+
+	inline
+	void operator /= (double a) { for (unsigned int i=0; i<N; i++) d[i] /= a; }
+
+	// this += a * A
+	inline
+	void Axpy(double a, const Vec & A) { for (unsigned int i=0; i<N; i++) d[i] += a * A.d[i]; }
+
+	inline
+	double operator () (const Vec & A) const {
+	  double a = 0.0;
+	  for (unsigned int i=0; i<N; i++) a += d[i] * A.d[i];
+	  return a;
+	}
+
+private:
+
+	double d[N] M4EXTREME_FIXED_ALIGN(16);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class Mat<N1,N2>
+//////////////////////////////////////////////////////////////////////
+
+template<unsigned int N1, unsigned int N2>
+class Mat
+{
+public:
+
+	enum { dim1 = N1, dim2 = N2, dim = N1*N2 };
+
+	inline
+	Mat() { for (unsigned int i=0; i<N1*N2; i++) d[i] = 0.0; }
+
+	inline
+	explicit Mat(const double * u) { for (unsigned int i=0; i<N1*N2; i++) d[i] = u[i]; }
+
+	inline
+	explicit Mat(const Hom & A) {
+	  assert(A.size1() == N1 && A.size2() == N2);
+	  const double *p = A.begin();
+	  for (unsigned int i=0; i<N1*N2; i++) d[i] = p[i];
+	}
+
+	inline
+	Mat & operator = (const Hom & A) {
+	  assert(A.size1() == N1 && A.size2() == N2);
+	  const double *p = A.begin();
+	  for (unsigned int i=0; i<N1*N2; i++) d[i] = p[i];
+	  return *this;
+	}
+
+	// copy into a run-time sized Hom(N1,N2)
+	inline
+	Hom & Export(Hom & A) const {
+	  assert(A.size1() == N1 && A.size2() == N2);
+	  double *p = A.begin();
+	  for (unsigned int i=0; i<N1*N2; i++) p[i] = d[i];
+	  return A;
+	}
+
+	inline
+	Hom ToHom() const { Hom A(N1,N2); Export(A); return A; }
+
+	inline double * begin() { return d; }
+	inline double * end() { return d + N1*N2; }
+	inline const double * begin() const { return d; }
+	inline const double * end() const { return d + N1*N2; }
+	inline unsigned int size1() const { return N1; }
+	inline unsigned int size2() const { return N2; }
+
+	// ith column
+	inline
+	const double * operator [] (unsigned int i) const { assert(i<N2); return d + i*N1; }
+
+	inline
+	double * operator [] (unsigned int i) { assert(i<N2); return d + i*N1; }
+
+	// ith column and jth row
+	inline
+	double operator () (unsigned int i, unsigned int j) const {
+	  assert(i<N2 && j<N1); return d[i*N1 + j];
+	}
+
+	inline
+	double & operator () (unsigned int i, unsigned int j) {
+	  assert(i<N2 && j<N1); return d[i*N1 + j];
+	}
+
+	// u = this(v)
+	inline
+	Vec<N1> operator () (const Vec<N2> & v) const {
+	  Vec<N1> u;
+	  for (unsigned int i=0; i<N2; i++)
+	    for (unsigned int j=0; j<N1; j++) u[j] += d[i*N1 + j] * v[i];
+	  return u;
+	}
+
+	// this[i][j] * A[j] * B[i]
+	inline
+	double operator () (const Vec<N2> & A, const Vec<N1> & B) const {
+	  double a = 0.0;
+	  for (unsigned int i=0; i<N2; i++)
+	    for (unsigned int j=0; j<N1; j++) a += d[i*N1 + j] * A[i] * B[j];
+	  return a;
+	}
+
+	// full contraction
+	inline
+	double operator () (const Mat & A) const {
+	  double a = 0.0;
+	  for (unsigned int i=0; i<N1*N2; i++) a += d[i] * A.d[i];
+	  return a;
+	}
+
+	inline
+	void operator += (const Mat & A) { for (unsigned int i=0; i<N1*N2; i++) d[i] += A.d[i]; }
+
+	inline
+	void operator -= (const Mat & A) { for (unsigned int i=0; i<N1*N2; i++) d[i] -= A.d[i]; }
+
+	inline
+	void operator *= (double a) { for (unsigned int i=0; i<N1*N2; i++) d[i] *= a; }
+
+	inline
+	void operator /= (double a) { for (unsigned int i=0; i<N1*N2; i++) d[i] /= a; }
+
+	// this += a * A
+	inline
+	void Axpy(double a, const Mat & A) { for (unsigned int i=0; i<N1*N2; i++) d[i] += a * A.d[i]; }
+
+private:
+
+	double d[N1*N2] M4EXTREME_FIXED_ALIGN(16);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class SymMat<N>
+//////////////////////////////////////////////////////////////////////
+
+template<unsigned int N>
+class SymMat
+{
+public:
+
+	enum { dim1 = N, dim = N*(N+1)/2 };
+
+	inline
+	SymMat() { for (unsigned int i=0; i<dim; i++) d[i] = 0.0; }
+
+	// symmetric part of A
+	inline
+	explicit SymMat(const Mat<N,N> & A) {
+	  for (unsigned int i=0; i<N; i++)
+	    for (unsigned int j=0; j<=i; j++) d[_index(i,j)] = 0.5 * (A(i,j) + A(j,i));
+	}
+
+	// symmetric part of A
+	inline
+	explicit SymMat(const Hom & A) {
+	  assert(A.size1() == N && A.size2() == N);
+	  for (unsigned int i=0; i<N; i++)
+	    for (unsigned int j=0; j<=i; j++) d[_index(i,j)] = 0.5 * (A(i,j) + A(j,i));
+	}
+
+	inline
+	explicit SymMat(const Sym & A) {
+	  assert(A.size1() == N);
+	  Hom B = A.Embed();
+	  for (unsigned int i=0; i<N; i++)
+	    for (unsigned int j=0; j<=i; j++) d[_index(i,j)] = B(i,j);
+	}
+
+	inline
+	Mat<N,N> Embed() const {
+	  Mat<N,N> A;
+	  for (unsigned int i=0; i<N; i++)
+	    for (unsigned int j=0; j<N; j++) A(i,j) = (*this)(i,j);
+	  return A;
+	}
+
+	// copy into a run-time sized Sym(N)
+	inline
+	Sym & Export(Sym & A) const {
+	  assert(A.size1() == N);
+	  Hom B(N); Embed().Export(B);
+	  A = B;
+	  return A;
+	}
+
+	inline double * begin() { return d; }
+	inline double * end() { return d + dim; }
+	inline const double * begin() const { return d; }
+	inline const double * end() const { return d + dim; }
+	inline unsigned int size1() const { return N; }
+	inline unsigned int size2() const { return N; }
+
+	inline
+	double operator () (unsigned int i, unsigned int j) const {
+	  assert(i<N && j<N); return d[_index(i,j)];
+	}
+
+	inline
+	double & operator () (unsigned int i, unsigned int j) {
+	  assert(i<N && j<N); return d[_index(i,j)];
+	}
+
+	// full contraction, accounting for the off-diagonal entries twice
+	inline
+	double operator () (const SymMat & A) const {
+	  double a = 0.0;
+	  for (unsigned int i=0; i<N; i++) {
+	    for (unsigned int j=0; j<i; j++) a += 2.0 * d[_index(i,j)] * A.d[_index(i,j)];
+	    a += d[_index(i,i)] * A.d[_index(i,i)];
+	  }
+	  return a;
+	}
+
+	inline
+	void operator += (const SymMat & A) { for (unsigned int i=0; i<dim; i++) d[i] += A.d[i]; }
+
+	inline
+	void operator -= (const SymMat & A) { for (unsigned int i=0; i<dim; i++) d[i] -= A.d[i]; }
+
+	inline
+	void operator *= (double a) { for (unsigned int i=0; i<dim; i++) d[i] *= a; }
+
+	inline
+	void operator /= (double a) { for (unsigned int i=0; i<dim; i++) d[i] /= a; }
+
+	inline
+	void Axpy(double a, const SymMat & A) { for (unsigned int i=0; i<dim; i++) d[i] += a * A.d[i]; }
+
+private:
+
+	static inline unsigned int _index(unsigned int i, unsigned int j) {
+	  return i >= j ? i*(i+1)/2 + j : j*(j+1)/2 + i;
+	}
+
+	double d[N*(N+1)/2];
+};
+
+}
+
+}
+
+//////////////////////////////////////////////////////////////////////
+// Class Vec<N>
+//////////////////////////////////////////////////////////////////////
+
+template<unsigned int N> inline
+Set::VectorSpace::Vec<N>
+operator + (const Set::VectorSpace::Vec<N> & A, const Set::VectorSpace::Vec<N> & B)
+{
+	Set::VectorSpace::Vec<N> C=A; C += B; return C;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::Vec<N>
+operator - (const Set::VectorSpace::Vec<N> & A, const Set::VectorSpace::Vec<N> & B)
+{
+	Set::VectorSpace::Vec<N> C=A; C -= B; return C;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::Vec<N>
+operator - (const Set::VectorSpace::Vec<N> & A)
+{
+	Set::VectorSpace::Vec<N> B=A; B *= -1.0; return B;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::Vec<N>
+operator * (double a, const Set::VectorSpace::Vec<N> & A)
+{
+	Set::VectorSpace::Vec<N> B=A; B *= a; return B;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::Vec<N>
+operator * (const Set::VectorSpace::Vec<N> & A, double a)
+{
+	Set::VectorSpace::Vec<N> B=A; B *= a; return B;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::Vec<N>
+operator / (const Set::VectorSpace::Vec<N> & A, double a)
+{
+	Set::VectorSpace::Vec<N> B=A; B /= a; return B;
+}
+
+template<unsigned int N> inline
+void Null(Set::VectorSpace::Vec<N> & A)
+{
+	for (unsigned int i=0; i<N; i++) A[i] = 0.0;
+}
+
+template<unsigned int N> inline
+double Norm(const Set::VectorSpace::Vec<N> & A)
+{
+	return sqrt(A(A));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Class Mat<N1,N2>
+//////////////////////////////////////////////////////////////////////
+
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Mat<N1,N2>
+operator + (const Set::VectorSpace::Mat<N1,N2> & A, const Set::VectorSpace::Mat<N1,N2> & B)
+{
+	Set::VectorSpace::Mat<N1,N2> C=A; C += B; return C;
+}
+
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Mat<N1,N2>
+operator - (const Set::VectorSpace::Mat<N1,N2> & A, const Set::VectorSpace::Mat<N1,N2> & B)
+{
+	Set::VectorSpace::Mat<N1,N2> C=A; C -= B; return C;
+}
+
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Mat<N1,N2>
+operator * (double a, const Set::VectorSpace::Mat<N1,N2> & A)
+{
+	Set::VectorSpace::Mat<N1,N2> B=A; B *= a; return B;
+}
+
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Mat<N1,N2>
+operator * (const Set::VectorSpace::Mat<N1,N2> & A, double a)
+{
+	Set::VectorSpace::Mat<N1,N2> B=A; B *= a; return B;
+}
+
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Vec<N1>
+operator * (const Set::VectorSpace::Mat<N1,N2> & A, const Set::VectorSpace::Vec<N2> & v)
+{
+	return A(v);
+}
+
+template<unsigned int N1, unsigned int N2> inline
+void Null(Set::VectorSpace::Mat<N1,N2> & A)
+{
+	for (double *p=A.begin(); p!=A.end(); p++) *p = 0.0;
+}
+
+// C = A o B (composition, same as operator * for Hom)
+template<unsigned int N1, unsigned int N2, unsigned int N3> inline
+Set::VectorSpace::Mat<N1,N3> &
+Multiply(const Set::VectorSpace::Mat<N1,N2> & A,
+	 const Set::VectorSpace::Mat<N2,N3> & B,
+	 Set::VectorSpace::Mat<N1,N3> & C)
+{
+	for (unsigned int k=0; k<N3; k++) {
+	  double *c = C[k];
+	  for (unsigned int j=0; j<N1; j++) c[j] = 0.0;
+	  for (unsigned int i=0; i<N2; i++) {
+	    const double b = B[k][i];
+	    const double *a = A[i];
+	    for (unsigned int j=0; j<N1; j++) c[j] += a[j] * b;
+	  }
+	}
+	return C;
+}
+
+template<unsigned int N1, unsigned int N2, unsigned int N3> inline
+Set::VectorSpace::Mat<N1,N3>
+operator * (const Set::VectorSpace::Mat<N1,N2> & A, const Set::VectorSpace::Mat<N2,N3> & B)
+{
+	Set::VectorSpace::Mat<N1,N3> C; Multiply(A, B, C); return C;
+}
+
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Mat<N2,N1>
+Adjoint(const Set::VectorSpace::Mat<N1,N2> & A)
+{
+	Set::VectorSpace::Mat<N2,N1> B;
+	for (unsigned int i=0; i<N2; i++)
+	  for (unsigned int j=0; j<N1; j++) B[j][i] = A[i][j];
+	return B;
+}
+
+// A[i][j] = a[i] * b[j]
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Mat<N1,N2> &
+Dyadic(const Set::VectorSpace::Vec<N2> & a,
+       const Set::VectorSpace::Vec<N1> & b,
+       Set::VectorSpace::Mat<N1,N2> & A)
+{
+	for (unsigned int i=0; i<N2; i++)
+	  for (unsigned int j=0; j<N1; j++) A[i][j] = a[i] * b[j];
+	return A;
+}
+
+// A[i][j] += a[i] * b[j]
+template<unsigned int N1, unsigned int N2> inline
+Set::VectorSpace::Mat<N1,N2> &
+DyadicSum(const Set::VectorSpace::Vec<N2> & a,
+	  const Set::VectorSpace::Vec<N1> & b,
+	  Set::VectorSpace::Mat<N1,N2> & A)
+{
+	for (unsigned int i=0; i<N2; i++)
+	  for (unsigned int j=0; j<N1; j++) A[i][j] += a[i] * b[j];
+	return A;
+}
+
+template<unsigned int N> inline
+void Identity(Set::VectorSpace::Mat<N,N> & A)
+{
+	Null(A);
+	for (unsigned int i=0; i<N; i++) A[i][i] = 1.0;
+}
+
+template<unsigned int N> inline
+double Trace(const Set::VectorSpace::Mat<N,N> & A)
+{
+	double a = 0.0;
+	for (unsigned int i=0; i<N; i++) a += A[i][i];
+	return a;
+}
+
+template<unsigned int N1, unsigned int N2> inline
+double Norm(const Set::VectorSpace::Mat<N1,N2> & A)
+{
+	return sqrt(A(A));
+}
+
+template<unsigned int N> inline
+double Jacobian(const Set::VectorSpace::Mat<N,N> & A)
+{
+	const double *a = A.begin();
+	switch (N) {
+	case 1:
+	  return a[0];
+	case 2:
+	  return a[0]*a[3] - a[1]*a[2];
+	case 3:
+	  return a[0]*(a[4]*a[8] - a[5]*a[7])
+	    - a[3]*(a[1]*a[8] - a[2]*a[7])
+	    + a[6]*(a[1]*a[5] - a[2]*a[4]);
+	default:
+	  assert(false);
+	}
+	return 0.0;
+}
+
+template<unsigned int N> inline
+void Inverse(const Set::VectorSpace::Mat<N,N> & A,
+	     Set::VectorSpace::Mat<N,N> & B)
+{
+	const double J = Jacobian(A);
+	assert(J != 0.0);
+	const double *a = A.begin();
+	double *b = B.begin();
+	switch (N) {
+	case 1:
+	  b[0] = 1.0/a[0];
+	  break;
+	case 2:
+	  b[0] =  a[3]/J; b[1] = -a[1]/J;
+	  b[2] = -a[2]/J; b[3] =  a[0]/J;
+	  break;
+	case 3:
+	  b[0] = (a[4]*a[8] - a[5]*a[7])/J;
+	  b[1] = (a[2]*a[7] - a[1]*a[8])/J;
+	  b[2] = (a[1]*a[5] - a[2]*a[4])/J;
+	  b[3] = (a[5]*a[6] - a[3]*a[8])/J;
+	  b[4] = (a[0]*a[8] - a[2]*a[6])/J;
+	  b[5] = (a[2]*a[3] - a[0]*a[5])/J;
+	  b[6] = (a[3]*a[7] - a[4]*a[6])/J;
+	  b[7] = (a[1]*a[6] - a[0]*a[7])/J;
+	  b[8] = (a[0]*a[4] - a[1]*a[3])/J;
+	  break;
+	default:
+	  assert(false);
+	}
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::Mat<N,N>
+Inverse(const Set::VectorSpace::Mat<N,N> & A)
+{
+	Set::VectorSpace::Mat<N,N> B; Inverse(A, B); return B;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Class SymMat<N>
+//////////////////////////////////////////////////////////////////////
+
+template<unsigned int N> inline
+Set::VectorSpace::SymMat<N>
+operator + (const Set::VectorSpace::SymMat<N> & A, const Set::VectorSpace::SymMat<N> & B)
+{
+	Set::VectorSpace::SymMat<N> C=A; C += B; return C;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::SymMat<N>
+operator - (const Set::VectorSpace::SymMat<N> & A, const Set::VectorSpace::SymMat<N> & B)
+{
+	Set::VectorSpace::SymMat<N> C=A; C -= B; return C;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::SymMat<N>
+operator * (double a, const Set::VectorSpace::SymMat<N> & A)
+{
+	Set::VectorSpace::SymMat<N> B=A; B *= a; return B;
+}
+
+template<unsigned int N> inline
+Set::VectorSpace::SymMat<N>
+operator * (const Set::VectorSpace::SymMat<N> & A, double a)
+{
+	Set::VectorSpace::SymMat<N> B=A; B *= a; return B;
+}
+
+template<unsigned int N> inline
+double Trace(const Set::VectorSpace::SymMat<N> & A)
+{
+	double a = 0.0;
+	for (unsigned int i=0; i<N; i++) a += A(i,i);
+	return a;
+}
+
+template<unsigned int N> inline
+double Norm(const Set::VectorSpace::SymMat<N> & A)
+{
+	return sqrt(A(A));
+}
+
+#endif // !defined(SET_VECTORSPACE_FIXED_H__INCLUDED_)
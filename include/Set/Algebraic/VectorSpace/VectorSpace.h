@@ -15,6 +15,7 @@
 #include "./Category/MultiHom.h"
 #include "./Category/Symmetric/Symmetric.h"
 #include "./Category/SkewSymmetric/SkewSymmetric.h"
+#include "./Fixed/Fixed.h"
 //#include "./Category/Diagonal/Diagonal.h"
 
 #endif // !defined(SET_ALGEBRAIC_VECTORSPACE_H__INCLUDED_)
@@ -0,0 +1,217 @@
+//
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_SNAPSHOTPIPELINE_H_
+#define _M4EXTREME_SNAPSHOTPIPELINE_H_
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "WriteVTU.h"
+
+#if defined(_M4EXTREME_MPI_)
+#include "mpi.h"
+#endif
+
+namespace m4extreme {
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Asynchronous field output. The solver thread copies the requested
+  // fields into one of a fixed number of staging buffers (VTUWriter) and
+  // queues it; a dedicated I/O thread builds, encodes, compresses and
+  // writes the queued buffers while the solver moves on. Snapshot only
+  // copies the node positions, the cell vertices and the values read
+  // from the model on the solver thread; the geometry tables and the
+  // derived fields are built by the I/O thread from these copies only. With two buffers one
+  // snapshot can be staged while the previous one is written. Acquire
+  // blocks while every buffer is queued or being written, so that the
+  // memory held by the pipeline stays bounded.
+  //
+  // The I/O thread makes no MPI call: under MPI the rank and size are
+  // taken at Submit time and every rank writes its own piece.
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  class SnapshotPipeline {
+
+  public:
+
+    SnapshotPipeline(int numofBuffers = 2,
+		     VTUWriter::ENCODING encoding = VTUWriter::RAW,
+		     bool compress = false) :
+      _shutdown(false), _busy(0), _stalls(0), _written(0) {
+      if ( numofBuffers < 1 ) numofBuffers = 1;
+      for ( int i = 0; i < numofBuffers; ++i ) {
+	_buffers.push_back(new VTUWriter(encoding, compress));
+	_free.push_back(_buffers.back());
+      }
+      pthread_mutex_init(&_mutex, NULL);
+      pthread_cond_init(&_queued, NULL);
+      pthread_cond_init(&_released, NULL);
+      pthread_create(&_thread, NULL, _run, this);
+    }
+
+    virtual ~SnapshotPipeline() {
+      Flush();
+      pthread_mutex_lock(&_mutex);
+      _shutdown = true;
+      pthread_cond_broadcast(&_queued);
+      pthread_mutex_unlock(&_mutex);
+      pthread_join(_thread, NULL);
+
+      pthread_cond_destroy(&_released);
+      pthread_cond_destroy(&_queued);
+      pthread_mutex_destroy(&_mutex);
+      for ( int i = 0; i < _buffers.size(); ++i ) delete _buffers[i];
+    }
+
+    //
+    // a free staging buffer, waits for the I/O thread if there is none
+    //
+    VTUWriter * Acquire() {
+      pthread_mutex_lock(&_mutex);
+      if ( _free.empty() ) ++_stalls;
+      while ( _free.empty() ) pthread_cond_wait(&_released, &_mutex);
+      VTUWriter * writer = _free.back();
+      _free.pop_back();
+      pthread_mutex_unlock(&_mutex);
+      writer->Clear();
+      return writer;
+    }
+
+    //
+    // queue an acquired buffer; written to name (.vtu), or as piece
+    // rank of size to basename_<rank>.vtu and basename.pvtu if size > 0
+    //
+    void Submit(VTUWriter * writer, const string & name, int rank = 0, int size = 0) {
+      _Job job;
+      job.writer = writer;
+      job.name = name;
+      job.rank = rank;
+      job.size = size;
+
+      pthread_mutex_lock(&_mutex);
+      _queue.push_back(job);
+      pthread_cond_signal(&_queued);
+      pthread_mutex_unlock(&_mutex);
+      return;
+    }
+
+#if defined(_M4EXTREME_MPI_)
+    void SubmitParallel(VTUWriter * writer, const string & basename, MPI_Comm comm = MPI_COMM_WORLD) {
+      int rank = 0, size = 1;
+      MPI_Comm_rank(comm, &rank);
+      MPI_Comm_size(comm, &size);
+      Submit(writer, basename, rank, size);
+      return;
+    }
+#endif
+
+    //
+    // stage the default fields of WriteVTKFile and queue them
+    //
+    void Snapshot(int index,
+		  const map<Geometry::Cell *, Set::Euclidean::Orthonormal::Point> & P,
+		  Geometry::CellComplex* solid,
+		  const char * name,
+		  m4extreme::MEMPModelBuilder * pModel,
+		  int elementType) {
+      VTUWriter * writer = Acquire();
+      writer->StageGeometry(P, solid, elementType);
+      writer->StageModelData(index, pModel);
+      Submit(writer, name);
+      return;
+    }
+
+    //
+    // wait until every queued snapshot is on disk
+    //
+    void Flush() {
+      pthread_mutex_lock(&_mutex);
+      while ( !_queue.empty() || _busy > 0 ) pthread_cond_wait(&_released, &_mutex);
+      pthread_mutex_unlock(&_mutex);
+      return;
+    }
+
+    int GetNumofBuffers() const { return _buffers.size(); }
+
+    // number of times Acquire had to wait for the I/O thread
+    int GetNumofStalls() const { return _locked(_stalls); }
+    int GetNumofWritten() const { return _locked(_written); }
+
+  private:
+
+    struct _Job {
+      VTUWriter * writer;
+      string name;
+      int rank;
+      int size;
+    };
+
+    int _locked(const int & counter) const {
+      pthread_mutex_lock(&_mutex);
+      const int value = counter;
+      pthread_mutex_unlock(&_mutex);
+      return value;
+    }
+
+    static void * _run(void * arg) {
+      SnapshotPipeline * p = static_cast<SnapshotPipeline *>(arg);
+      for (;;) {
+	pthread_mutex_lock(&p->_mutex);
+	while ( p->_queue.empty() && !p->_shutdown ) pthread_cond_wait(&p->_queued, &p->_mutex);
+	if ( p->_queue.empty() ) {
+	  pthread_mutex_unlock(&p->_mutex);
+	  break;
+	}
+	_Job job = p->_queue.front();
+	p->_queue.pop_front();
+	++p->_busy;
+	pthread_mutex_unlock(&p->_mutex);
+
+	job.writer->Build();
+	if ( job.size > 0 ) {
+	  job.writer->WritePiece(job.name, job.rank, job.size);
+	}
+	else {
+	  job.writer->Write(job.name.c_str());
+	}
+
+	pthread_mutex_lock(&p->_mutex);
+	--p->_busy;
+	++p->_written;
+	p->_free.push_back(job.writer);
+	pthread_cond_broadcast(&p->_released);
+	pthread_mutex_unlock(&p->_mutex);
+      }
+      return NULL;
+    }
+
+  private:
+    vector<VTUWriter *> _buffers;
+    vector<VTUWriter *> _free;
+    std::deque<_Job> _queue;
+    bool _shutdown;
+    int _busy;
+    int _stalls;
+    int _written;
+
+    pthread_t _thread;
+    mutable pthread_mutex_t _mutex;
+    pthread_cond_t _queued;
+    pthread_cond_t _released;
+
+  private:
+    SnapshotPipeline(const SnapshotPipeline &);
+    SnapshotPipeline & operator = (const SnapshotPipeline &);
+  }; // end_of_SnapshotPipeline
+
+}
+
+#endif
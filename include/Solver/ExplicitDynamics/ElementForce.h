@@ -0,0 +1,169 @@
+// ElementForce.h: interface for the ElementForce class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_ELEMENTFORCE__INCLUDED_)
+#define SOLVER_ELEMENTFORCE__INCLUDED_
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <set>
+#include <cassert>
+#include "../../Element/Element.h"
+#include "../../Model/Static/Static.h"
+#include "./NodalField.h"
+#include "./ForceAccumulator.h"
+
+using namespace std;
+
+namespace Solver
+{
+//////////////////////////////////////////////////////////////////////
+// Class ElementForce
+//
+// Kernel of ForceAccumulator over the element energies of a model,
+// e.g. the material points, tractions and potentials given by
+// MEMPModelBuilder::GetElementForces. kernel(e, f, tid) evaluates the
+// forces of element e and adds them into the flat array f laid out as
+// the nodal field (Dim() values per node), so the model forces can be
+// evaluated in the COLORED, PRIVATIZED or ORDERED mode instead of
+// through the locked or per-thread maps of Model::Energy<1>.
+//
+// Setup records the nodes of every element as dense indices of the
+// field and must be called again whenever the supports change (after
+// UpdateMaterialPoints, a migration or NodalField::Renumber). The
+// coordinates are read from the nodes, so the positions of the field
+// must have been pushed (FlatExplicitDynamics does it in Predictor).
+// The elements touching a node with an embedding map (a constrained
+// node) go through Embed and Submerge of the model local state like
+// the model forces; the others read the coordinates directly.
+//////////////////////////////////////////////////////////////////////
+
+class ElementForce
+{
+public:
+
+	typedef Set::Manifold::Point dof_type;
+	typedef map<dof_type *, Set::VectorSpace::Vector> vector_type;
+
+	ElementForce(const vector<Element::Energy<1> *> & DE,
+		     Model::Static::LocalState * LS,
+		     const map<dof_type *, Set::Manifold::Map *> * Emb,
+		     NodalField * field, int nthreads = 1)
+	  : _DE(DE), _LS(LS), _Emb(Emb), _field(field),
+	    _scratch(nthreads > 0 ? nthreads : 1) {
+	  Setup();
+	}
+
+	virtual ~ElementForce() {}
+
+	unsigned int size() const { return _DE.size(); }
+
+	// element to dense node adjacency, for ForceAccumulator::SetGraph
+	const vector<unsigned int> & GetOffsets() const { return _offsets; }
+	const vector<unsigned int> & GetNodes() const { return _nodes; }
+
+	void Setup() {
+	  const unsigned int nelem = _DE.size();
+	  _offsets.assign(nelem + 1, 0);
+	  _nodes.clear();
+	  _dofs.clear();
+	  _coords.clear();
+	  _embedded.assign(nelem, 0);
+
+	  set<dof_type *> nodes;
+	  for (unsigned int e = 0; e < nelem; ++e) {
+	    nodes = _DE[e]->GetLocalState()->GetNodes();
+	    for (set<dof_type *>::const_iterator pN = nodes.begin(); pN != nodes.end(); ++pN) {
+	      const int id = _field->Index(*pN);
+	      if (id < 0) {
+		cerr << "node is not bound to the nodal field @Solver::ElementForce" << endl;
+		assert(false);
+	      }
+	      _nodes.push_back((unsigned int)id);
+	      _dofs.push_back(*pN);
+	      _coords.push_back(dynamic_cast<Set::Array *>(*pN));
+	      if (_Emb != 0) {
+		map<dof_type *, Set::Manifold::Map *>::const_iterator pE = _Emb->find(*pN);
+		if (pE != _Emb->end() && pE->second != 0) _embedded[e] = 1;
+	      }
+	      if (_coords.back() == 0) _embedded[e] = 1;
+	    }
+	    _offsets[e+1] = _nodes.size();
+	  }
+	}
+
+	// f += forces of element e
+	void operator () (unsigned int e, double * f, int tid) {
+	  assert(tid >= 0 && tid < (int)_scratch.size());
+	  _Scratch & S = _scratch[tid];
+	  const unsigned int k0 = _offsets[e], k1 = _offsets[e+1];
+
+	  S.yemb.clear();
+	  if (_embedded[e]) {
+	    S.nodes.clear();
+	    S.nodes.insert(_dofs.begin() + k0, _dofs.begin() + k1);
+	    _LS->Model::Static::LocalState::Embed(S.nodes, S.yemb);
+	  }
+	  else {
+	    for (unsigned int k = k0; k < k1; ++k) {
+	      S.yemb.insert(S.yemb.end(),
+			    make_pair(_dofs[k], Set::VectorSpace::Vector(_coords[k]->size(), _coords[k]->begin())));
+	    }
+	  }
+
+	  S.fe = (*_DE[e])(S.yemb);
+	  const vector_type * fe = &S.fe;
+	  if (_embedded[e]) {
+	    S.fsub.clear();
+	    _LS->Submerge(S.fe, S.fsub);
+	    fe = &S.fsub;
+	  }
+
+	  // both in address order, merge
+	  const unsigned int ld = _field->Dim();
+	  unsigned int k = k0;
+	  for (vector_type::const_iterator pF = fe->begin(); pF != fe->end(); ++pF) {
+	    while (k < k1 && _dofs[k] < pF->first) ++k;
+	    if (k == k1 || _dofs[k] != pF->first) continue;
+	    double * fa = f + (size_t)_nodes[k] * ld;
+	    const double * q = pF->second.begin();
+	    for (unsigned int j = 0; j < pF->second.size(); ++j) fa[j] += q[j];
+	  }
+	}
+
+private:
+
+	struct _Scratch {
+	  set<dof_type *> nodes;
+	  vector_type yemb;
+	  vector_type fe;
+	  vector_type fsub;
+	};
+
+private:
+
+	vector<Element::Energy<1> *> _DE;
+	Model::Static::LocalState * _LS;
+	const map<dof_type *, Set::Manifold::Map *> * _Emb;
+	NodalField * _field;
+	vector<unsigned int> _offsets;
+	vector<unsigned int> _nodes;
+	vector<dof_type *> _dofs;
+	vector<Set::Array *> _coords;
+	vector<char> _embedded;
+	vector<_Scratch> _scratch;
+
+private:
+
+	ElementForce(const ElementForce &);
+	ElementForce & operator = (const ElementForce &);
+};
+
+}
+
+#endif // !defined(SOLVER_ELEMENTFORCE__INCLUDED_)
@@ -15,11 +15,23 @@
 #include "../../Model/Model.h"
 #include "../../Set/Manifold/Manifold.h"
 #include "../../Model/LumpedMass/LumpedMass.h"
+#include "./NodalField.h"
+#include "./Overlap.h"
+#include "../../Utils/Profiler/Profiler.h"
 
 using namespace std;
 
 namespace Solver
 {
+//////////////////////////////////////////////////////////////////////
+// Class ExplicitDynamics
+//
+// Newmark scheme over the maps of the model. The forces are those of
+// Model::Energy<1> evaluated at once, there is no overlap of the
+// exchange across partitions with the force evaluation here; it is
+// FlatExplicitDynamics::SetOverlap that provides it.
+//////////////////////////////////////////////////////////////////////
+
 class ExplicitDynamics : public Propagator  
 {
 public:
@@ -79,6 +91,133 @@ private:
 	void operator=(ExplicitDynamics &);       
 };
 
+//////////////////////////////////////////////////////////////////////
+// Class FlatExplicitDynamics
+//
+// Same Newmark scheme as ExplicitDynamics, but the nodal fields live
+// in a NodalField (contiguous, index-based) instead of maps keyed by
+// Set::Manifold::Point *. The node coordinates are pushed back to the
+// points once per step, right before the forces are evaluated.
+//
+// With SetOverlap the forces of a partitioned run are evaluated in
+// two parts so that the assembly across partitions is hidden behind
+// the interior material points:
+//	1. forces of the material points touching shared nodes,
+//	2. exchange->Begin, the partial forces are posted,
+//	3. forces of the interior material points,
+//	4. exchange->End, the messages are completed and
+//	5. the forces of the other partitions are assembled.
+// The SplitForce then replaces the model forces DE, e.g. a
+// PartitionedForce over the ElementForce kernel of the element
+// energies of the model, with a HaloExchange as the exchange; both
+// are set up by MPI_Core::buildOverlap.
+// Without a SplitForce the model forces are evaluated at once and
+// the exchange, if any, is a plain assembly.
+//////////////////////////////////////////////////////////////////////
+
+class FlatExplicitDynamics : public Propagator
+{
+public:
+
+	FlatExplicitDynamics(
+		Clock *T_,
+		Model::LocalState *LS_,
+		Model::Energy<1> *DE_,
+		set<Set::Manifold::Point *> *x_,
+		NodalField *field_,
+		const double Gamma=0.5) :
+		GamOld(Gamma), GamNew(Gamma), Print(false),
+		T(T_), LS(LS_), DE(DE_), x(x_), field(field_),
+		split(0), exchange(0) {
+	  assert(field != 0 && field->size() == x->size());
+	}
+
+	virtual ~FlatExplicitDynamics() {}
+
+	bool & SetPrint() { return Print; }
+	NodalField & GetField() { return *field; }
+	const NodalField & GetField() const { return *field; }
+
+	void SetOverlap(SplitForce *split_, NodalExchange *exchange_) {
+	  split = split_;
+	  exchange = exchange_;
+	}
+
+	void UpdateMass(map<Set::Manifold::Point*, double> *m) {
+	  field->UpdateMass(*m);
+	}
+
+	void operator ++ () {
+	  M4EXTREME_PROFILE_SCOPE("step");
+	  Predictor();
+	  ++(*T);
+	  Corrector();
+	  M4EXTREME_PROFILE_SCOPE("material update");
+	  ++(*LS);
+	}
+
+	void BallisticUpdate() {
+	  field->BallisticUpdate(T->DTime());
+	  field->PushPositions();
+	}
+
+	void Predictor() {
+	  M4EXTREME_PROFILE_SCOPE("predictor");
+	  field->Predictor(T->DTime(), GamOld);
+	  field->PushPositions();
+	}
+
+	void Corrector() {
+	  double * f = field->F();
+	  if (split != 0) {
+	    {
+	      M4EXTREME_PROFILE_SCOPE("force");
+	      field->SetForceToZero();
+	      (*split)(SplitForce::BOUNDARY, f);
+	      if (exchange != 0) exchange->Begin(f);
+	      (*split)(SplitForce::INTERIOR, f);
+	    }
+	    if (exchange != 0) {
+	      M4EXTREME_PROFILE_SCOPE("sync");
+	      exchange->End(f);
+	    }
+	  }
+	  else {
+	    {
+	      M4EXTREME_PROFILE_SCOPE("force");
+	      NodalField::vector_type & fmap = field->GetForceBuffer();
+	      (*DE)(*x, fmap);
+	      field->SetForceToZero();
+	      field->AddForce(fmap);
+	    }
+	    if (exchange != 0) {
+	      M4EXTREME_PROFILE_SCOPE("sync");
+	      exchange->Begin(f);
+	      exchange->End(f);
+	    }
+	  }
+	  M4EXTREME_PROFILE_SCOPE("corrector");
+	  field->Corrector(T->DTime(), GamNew);
+	}
+
+private:
+
+	double GamOld;
+	double GamNew;
+	bool Print; Clock *T;
+	Model::LocalState *LS;
+	Model::Energy<1> *DE;
+	set<Set::Manifold::Point *> *x;
+	NodalField *field;
+	SplitForce *split;
+	NodalExchange *exchange;
+
+private:
+
+	FlatExplicitDynamics(FlatExplicitDynamics &);
+	void operator=(FlatExplicitDynamics &);
+};
+
 }
 
 #endif // !defined(SOLVER_EXPLICITDYNAMICS__INCLUDED_)
@@ -0,0 +1,288 @@
+// ForceAccumulator.h: interface for the ForceAccumulator class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_FORCEACCUMULATOR__INCLUDED_)
+#define SOLVER_FORCEACCUMULATOR__INCLUDED_
+
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include <cstring>
+#include "../../Threads/TaskScheduler.h"
+#include "../../Element/MaterialPoint/ShapeTable.h"
+
+using namespace std;
+
+namespace Solver
+{
+//////////////////////////////////////////////////////////////////////
+// Class ForceAccumulator
+//
+// Lock-free scatter-add of element contributions into a flat nodal
+// array f of length n*ld (e.g. NodalField::F()). The kernel is called
+// as kernel(e, f, tid) and adds the contribution of element e into f.
+//
+//  COLORED	the elements are greedily colored so that no two
+//		elements of a color share a node; the colors are
+//		processed one after the other and the elements of a
+//		color scatter into f directly. Requires SetGraph.
+//  PRIVATIZED	each thread scatters into its own dense buffer, the
+//		buffers are then summed by a parallel pairwise tree.
+//  ORDERED	as PRIVATIZED, but element e always goes into the
+//		buffer of the static block it belongs to, so the result
+//		is bitwise reproducible for a given number of threads.
+//
+// COLORED is reproducible as well since each node receives at most
+// one contribution per color and the colors are visited in order.
+// ElementForce (ElementForce.h) is the kernel over the element
+// energies of a model.
+//////////////////////////////////////////////////////////////////////
+
+class ForceAccumulator
+{
+public:
+
+	enum MODE { COLORED = 0, PRIVATIZED = 1, ORDERED = 2 };
+
+	ForceAccumulator(m4extreme::Utils::TaskScheduler * scheduler, MODE mode = PRIVATIZED)
+	  : _scheduler(scheduler), _mode(mode), _grain(16) {}
+
+	virtual ~ForceAccumulator() {}
+
+	MODE GetMode() const { return _mode; }
+	void SetMode(MODE mode) { _mode = mode; }
+	void SetGrain(int grain) { _grain = grain > 0 ? grain : 1; }
+
+	// element to node adjacency in compressed row storage
+	void SetGraph(unsigned int nelem,
+		      const vector<unsigned int> & offsets,
+		      const vector<unsigned int> & nodes) {
+	  assert(offsets.size() == nelem + 1);
+	  _color(nelem, offsets, nodes);
+	}
+
+	// adjacency of material points given by their shape function tables
+	void SetGraph(const vector<const Element::MaterialPoint::ShapeTable *> & tables) {
+	  vector<unsigned int> offsets(tables.size() + 1, 0), nodes;
+	  for (unsigned int e = 0; e < tables.size(); ++e) {
+	    const vector<unsigned int> & en = tables[e]->GetNodes();
+	    nodes.insert(nodes.end(), en.begin(), en.end());
+	    offsets[e+1] = nodes.size();
+	  }
+	  _color(tables.size(), offsets, nodes);
+	}
+
+	unsigned int GetNumofColors() const {
+	  return _colorOffsets.empty() ? 0 : _colorOffsets.size() - 1;
+	}
+
+	// f += sum_e kernel(e)
+	template<class Kernel>
+	void operator () (unsigned int nelem, Kernel & kernel,
+			  double * f, unsigned int n, unsigned int ld) {
+	  const int nthreads = _scheduler == 0 ? 1 : _scheduler->getNumberThreads();
+	  const size_t len = (size_t)n * ld;
+	  if (len == 0) return;
+
+	  if (nthreads == 1) {
+	    for (unsigned int e = 0; e < nelem; ++e) kernel(e, f, 0);
+	    return;
+	  }
+
+	  if (_mode == COLORED) {
+	    if (_colorOffsets.empty() || _colorOffsets.back() != nelem) {
+	      cerr << "element graph is not set @Solver::ForceAccumulator" << endl;
+	      assert(false);
+	    }
+	    for (unsigned int c = 0; c + 1 < _colorOffsets.size(); ++c) {
+	      _ColoredBody<Kernel> body(kernel, f, &_colorElements[_colorOffsets[c]]);
+	      _scheduler->parallel_for(0, _colorOffsets[c+1] - _colorOffsets[c], _grain, body);
+	    }
+	    return;
+	  }
+
+	  // per-thread dense partial buffers
+	  if (_buffers.size() != (size_t)nthreads) _buffers.resize(nthreads);
+	  for (int t = 0; t < nthreads; ++t) _buffers[t].resize(len);
+
+	  _ZeroBody zero(_buffers, len);
+	  _scheduler->parallel_for(0, nthreads, 1, zero);
+
+	  if (_mode == ORDERED) {
+	    _BlockBody<Kernel> body(kernel, _buffers, nelem, nthreads);
+	    _scheduler->parallel_for(0, nthreads, 1, body);
+	  }
+	  else {
+	    _PrivateBody<Kernel> body(kernel, _buffers);
+	    _scheduler->parallel_for(0, nelem, _grain, body);
+	  }
+
+	  // pairwise tree: buffer[i] += buffer[i + stride]
+	  const int chunk = 4096;
+	  for (int stride = 1; stride < nthreads; stride *= 2) {
+	    _TreeBody tree(_buffers, stride, len, chunk);
+	    const int npairs = (nthreads + 2*stride - 1) / (2*stride);
+	    const int nchunks = (int)((len + chunk - 1) / chunk);
+	    _scheduler->parallel_for(0, npairs * nchunks, 1, tree);
+	  }
+
+	  _AddBody add(f, &_buffers[0][0]);
+	  _scheduler->parallel_for(0, (int)len, chunk, add);
+	}
+
+private:
+
+	template<class Kernel>
+	struct _ColoredBody {
+	  _ColoredBody(Kernel & k, double * f, const unsigned int * el) : _k(k), _f(f), _el(el) {}
+	  void operator () (int lo, int hi, int tid) {
+	    for (int i = lo; i < hi; ++i) _k(_el[i], _f, tid);
+	  }
+	  Kernel & _k; double * _f; const unsigned int * _el;
+	};
+
+	template<class Kernel>
+	struct _PrivateBody {
+	  _PrivateBody(Kernel & k, vector<vector<double> > & b) : _k(k), _b(b) {}
+	  void operator () (int lo, int hi, int tid) {
+	    double * f = &_b[tid][0];
+	    for (int e = lo; e < hi; ++e) _k(e, f, tid);
+	  }
+	  Kernel & _k; vector<vector<double> > & _b;
+	};
+
+	template<class Kernel>
+	struct _BlockBody {
+	  _BlockBody(Kernel & k, vector<vector<double> > & b, unsigned int nelem, int nblocks)
+	    : _k(k), _b(b), _nelem(nelem), _nblocks(nblocks) {}
+	  void operator () (int lo, int hi, int tid) {
+	    for (int blk = lo; blk < hi; ++blk) {
+	      const unsigned int e0 = (unsigned int)(((unsigned long long)_nelem * blk) / _nblocks);
+	      const unsigned int e1 = (unsigned int)(((unsigned long long)_nelem * (blk + 1)) / _nblocks);
+	      double * f = &_b[blk][0];
+	      for (unsigned int e = e0; e < e1; ++e) _k(e, f, tid);
+	    }
+	  }
+	  Kernel & _k; vector<vector<double> > & _b; unsigned int _nelem; int _nblocks;
+	};
+
+	struct _ZeroBody {
+	  _ZeroBody(vector<vector<double> > & b, size_t len) : _b(b), _len(len) {}
+	  void operator () (int lo, int hi, int) {
+	    for (int t = lo; t < hi; ++t) memset(&_b[t][0], 0, _len * sizeof(double));
+	  }
+	  vector<vector<double> > & _b; size_t _len;
+	};
+
+	struct _TreeBody {
+	  _TreeBody(vector<vector<double> > & b, int stride, size_t len, int chunk)
+	    : _b(b), _stride(stride), _len(len), _chunk(chunk),
+	      _nchunks((int)((len + chunk - 1) / chunk)) {}
+	  void operator () (int lo, int hi, int) {
+	    for (int w = lo; w < hi; ++w) {
+	      const int dst = (w / _nchunks) * 2 * _stride;
+	      const int src = dst + _stride;
+	      if (src >= (int)_b.size()) continue;
+	      const size_t i0 = (size_t)(w % _nchunks) * _chunk;
+	      const size_t i1 = i0 + _chunk < _len ? i0 + _chunk : _len;
+	      double * __restrict__ d = &_b[dst][0];
+	      const double * __restrict__ s = &_b[src][0];
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	      for (size_t i = i0; i < i1; ++i) d[i] += s[i];
+	    }
+	  }
+	  vector<vector<double> > & _b; int _stride; size_t _len; int _chunk; int _nchunks;
+	};
+
+	struct _AddBody {
+	  _AddBody(double * f, const double * s) : _f(f), _s(s) {}
+	  void operator () (int lo, int hi, int) {
+	    for (int i = lo; i < hi; ++i) _f[i] += _s[i];
+	  }
+	  double * _f; const double * _s;
+	};
+
+	// greedy coloring, one bit mask of used colors per node
+	void _color(unsigned int nelem,
+		    const vector<unsigned int> & offsets,
+		    const vector<unsigned int> & nodes) {
+	  unsigned int nnodes = 0;
+	  for (size_t k = 0; k < nodes.size(); ++k) {
+	    if (nodes[k] + 1 > nnodes) nnodes = nodes[k] + 1;
+	  }
+
+	  unsigned int words = 1;
+	  vector<unsigned long long> masks((size_t)nnodes * words, 0ULL);
+	  vector<unsigned int> color(nelem, 0);
+	  unsigned int ncolors = 0;
+
+	  for (unsigned int e = 0; e < nelem; ++e) {
+	    unsigned int c = 0;
+	    for (;;) {
+	      const unsigned int w = c / 64;
+	      if (w >= words) break;
+	      unsigned long long used = 0ULL;
+	      for (unsigned int k = offsets[e]; k < offsets[e+1]; ++k) {
+		used |= masks[(size_t)nodes[k] * words + w];
+	      }
+	      if (~used != 0ULL) {
+		unsigned int b = 0;
+		while (used & (1ULL << b)) ++b;
+		c = w * 64 + b;
+		break;
+	      }
+	      c = (w + 1) * 64;
+	    }
+
+	    // all colors in use at the nodes of e, widen the masks
+	    if (c / 64 >= words) {
+	      vector<unsigned long long> wider((size_t)nnodes * (words + 1), 0ULL);
+	      for (unsigned int a = 0; a < nnodes; ++a) {
+		for (unsigned int w = 0; w < words; ++w) {
+		  wider[(size_t)a * (words + 1) + w] = masks[(size_t)a * words + w];
+		}
+	      }
+	      masks.swap(wider);
+	      ++words;
+	    }
+
+	    color[e] = c;
+	    if (c + 1 > ncolors) ncolors = c + 1;
+	    for (unsigned int k = offsets[e]; k < offsets[e+1]; ++k) {
+	      masks[(size_t)nodes[k] * words + c / 64] |= 1ULL << (c % 64);
+	    }
+	  }
+
+	  // bucket the elements by color, in increasing element order
+	  _colorOffsets.assign(ncolors + 1, 0);
+	  for (unsigned int e = 0; e < nelem; ++e) _colorOffsets[color[e] + 1]++;
+	  for (unsigned int c = 0; c < ncolors; ++c) _colorOffsets[c+1] += _colorOffsets[c];
+	  _colorElements.resize(nelem);
+	  vector<unsigned int> pos(_colorOffsets.begin(), _colorOffsets.end() - 1);
+	  for (unsigned int e = 0; e < nelem; ++e) _colorElements[pos[color[e]]++] = e;
+	}
+
+private:
+
+	m4extreme::Utils::TaskScheduler * _scheduler;
+	MODE _mode;
+	int _grain;
+	vector<unsigned int> _colorOffsets;
+	vector<unsigned int> _colorElements;
+	vector<vector<double> > _buffers;
+
+private:
+
+	ForceAccumulator(const ForceAccumulator &);
+	ForceAccumulator & operator = (const ForceAccumulator &);
+};
+
+}
+
+#endif // !defined(SOLVER_FORCEACCUMULATOR__INCLUDED_)
@@ -0,0 +1,408 @@
+// NodalField.h: interface for the NodalField class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_NODALFIELD__INCLUDED_)
+#define SOLVER_NODALFIELD__INCLUDED_
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include "../../Set/Manifold/Manifold.h"
+#include "../../Set/Indexed/Array/Array.h"
+#include "../../Set/Algebraic/VectorSpace/Vector/Vector.h"
+#include "../../Geometry/Search/CellSearch/ParallelCellSearch.h"
+
+#if defined(WIN32)
+#include <malloc.h>
+#endif
+
+#define M4EXTREME_NODALFIELD_ALIGNMENT 64
+
+using namespace std;
+
+namespace Solver
+{
+//////////////////////////////////////////////////////////////////////
+// Class NodalField
+//
+// Structure-of-arrays storage of the nodal fields of an explicit
+// dynamics run. Each node of the model is given a dense index in the
+// order of set<Set::Manifold::Point *> (i.e. sorted by address), and
+// its coordinates x, velocity v, acceleration a, force f and mass m
+// are stored in aligned arrays of length size()*Dim(). The number of
+// active components of a node may be less than Dim() for constrained
+// nodes; the padding components carry zero mass and stay at zero.
+//
+// The nodes are also kept in address order with their dense index,
+// so gathering from or scattering to a map<Point *, Vector> is a
+// single linear merge without any lookup, whatever the dense order.
+//
+// Renumber permutes the dense indices, e.g. along a Hilbert curve of
+// the positions (RenumberHilbert) so that the nodes of a material
+// point are close in memory; nodes allocated in mesh-file order are
+// otherwise scattered over the heap. Dense indices held elsewhere
+// (HaloExchange, ForceAccumulator graphs) must be rebuilt afterwards;
+// a ShapeTable notices the change by GetNumbering.
+//////////////////////////////////////////////////////////////////////
+
+class NodalField
+{
+public:
+
+	typedef Set::Manifold::Point dof_type;
+	typedef map<dof_type *, Set::VectorSpace::Vector> vector_type;
+	typedef map<dof_type *, double> mass_type;
+
+	NodalField() : _dim(0), _n(0), _capacity(0), _numbering(0),
+		_x(0), _v(0), _a(0), _f(0), _m(0), _minv(0) {}
+
+	NodalField(unsigned int dim) : _dim(dim), _n(0), _capacity(0), _numbering(0),
+		_x(0), _v(0), _a(0), _f(0), _m(0), _minv(0) {}
+
+	virtual ~NodalField() { _release(); }
+
+	// build the dense index of the nodes and load the fields
+	void Bind(const set<dof_type *> & x,
+		  const mass_type & m,
+		  const vector_type & v,
+		  const vector_type & a) {
+	  assert(_dim > 0);
+	  _resize(x.size());
+
+	  _dofs.assign(x.begin(), x.end());
+	  _sorted = _dofs;
+	  _slot.resize(_n);
+	  _coords.resize(_n);
+	  _ndof.resize(_n);
+	  _index.clear();
+	  ++_numbering;
+
+	  for (unsigned int i = 0; i < _n; ++i) {
+	    _slot[i] = i;
+	    dof_type * xloc = _dofs[i];
+	    _index.insert(_index.end(), make_pair(xloc, i));
+	    _coords[i] = dynamic_cast<Set::Array *>(xloc);
+	    assert(_coords[i] != NULL && xloc->size() <= _dim);
+	    _ndof[i] = xloc->size();
+	  }
+
+	  const size_t len = (size_t)_n * _dim;
+	  memset(_f, 0, len * sizeof(double));
+	  PullPositions();
+	  UpdateMass(m);
+	  _gather(v, _v);
+	  _gather(a, _a);
+	}
+
+	// number of nodes
+	unsigned int size() const { return _n; }
+	unsigned int Dim() const { return _dim; }
+
+	// changes whenever the dense indices may have changed
+	unsigned int GetNumbering() const { return _numbering; }
+
+	// move node order[j] to the dense index j; the arrays are
+	// reallocated contiguously in the new order
+	void Renumber(const vector<unsigned int> & order) {
+	  assert(order.size() == _n);
+	  vector<unsigned int> position(_n);
+	  for (unsigned int j = 0; j < _n; ++j) position[order[j]] = j;
+
+	  double ** fields[6] = { &_x, &_v, &_a, &_f, &_m, &_minv };
+	  for (int k = 0; k < 6; ++k) {
+	    const double * src = *fields[k];
+	    double * dst = _allocate((size_t)_capacity * _dim);
+	    for (unsigned int j = 0; j < _n; ++j) {
+	      memcpy(dst + (size_t)j * _dim, src + (size_t)order[j] * _dim, _dim * sizeof(double));
+	    }
+	    _deallocate(*fields[k]);
+	    *fields[k] = dst;
+	  }
+
+	  vector<dof_type *> dofs(_n);
+	  vector<Set::Array *> coords(_n);
+	  vector<unsigned int> ndof(_n);
+	  for (unsigned int j = 0; j < _n; ++j) {
+	    dofs[j] = _dofs[order[j]];
+	    coords[j] = _coords[order[j]];
+	    ndof[j] = _ndof[order[j]];
+	  }
+	  _dofs.swap(dofs);
+	  _coords.swap(coords);
+	  _ndof.swap(ndof);
+
+	  for (unsigned int k = 0; k < _n; ++k) _slot[k] = position[_slot[k]];
+	  for (map<dof_type *, unsigned int>::iterator pI = _index.begin(); pI != _index.end(); ++pI) {
+	    pI->second = position[pI->second];
+	  }
+	  ++_numbering;
+	}
+
+	// dense indices along a Hilbert curve of the current positions
+	void RenumberHilbert() {
+	  if (_n == 0) return;
+	  vector<size_t> curve;
+	  geom::cellHilbertOrder(_n, _dim, _x, _dim, curve);
+	  Renumber(vector<unsigned int>(curve.begin(), curve.end()));
+	}
+
+	// dense index of a node, -1 if the node is not bound
+	int Index(dof_type * xloc) const {
+	  map<dof_type *, unsigned int>::const_iterator pI = _index.find(xloc);
+	  return pI == _index.end() ? -1 : (int)pI->second;
+	}
+
+	dof_type * GetDof(unsigned int i) const { return _dofs[i]; }
+	const vector<dof_type *> & GetDofs() const { return _dofs; }
+	unsigned int GetNumofComponents(unsigned int i) const { return _ndof[i]; }
+
+	double * X() { return _x; }
+	double * V() { return _v; }
+	double * A() { return _a; }
+	double * F() { return _f; }
+	double * M() { return _m; }
+	const double * X() const { return _x; }
+	const double * V() const { return _v; }
+	const double * A() const { return _a; }
+	const double * F() const { return _f; }
+	const double * M() const { return _m; }
+
+	// replicate the lumped mass on the active components of each node
+	void UpdateMass(const mass_type & m) {
+	  const size_t len = (size_t)_n * _dim;
+	  memset(_m, 0, len * sizeof(double));
+	  memset(_minv, 0, len * sizeof(double));
+
+	  mass_type::const_iterator pM = m.begin();
+	  for (unsigned int k = 0; k < _n && pM != m.end(); ++k) {
+	    while (pM != m.end() && pM->first < _sorted[k]) ++pM;
+	    if (pM == m.end() || pM->first != _sorted[k]) continue;
+	    const unsigned int i = _slot[k];
+	    double * mloc = _m + (size_t)i * _dim;
+	    double * minvloc = _minv + (size_t)i * _dim;
+	    for (unsigned int j = 0; j < _ndof[i]; ++j) {
+	      mloc[j] = pM->second;
+	      minvloc[j] = pM->second > 0.0 ? 1.0 / pM->second : 0.0;
+	    }
+	  }
+	}
+
+	void SetForceToZero() {
+	  memset(_f, 0, (size_t)_n * _dim * sizeof(double));
+	}
+
+	// f += fmap (fmap is in generalized coordinates)
+	void AddForce(const vector_type & fmap) {
+	  vector_type::const_iterator pF = fmap.begin();
+	  for (unsigned int k = 0; k < _n && pF != fmap.end(); ++k) {
+	    while (pF != fmap.end() && pF->first < _sorted[k]) ++pF;
+	    if (pF == fmap.end() || pF->first != _sorted[k]) continue;
+	    const unsigned int i = _slot[k];
+	    double * floc = _f + (size_t)i * _dim;
+	    const double * q = pF->second.begin();
+	    for (unsigned int j = 0; j < pF->second.size(); ++j) floc[j] += q[j];
+	  }
+	}
+
+	// f[i] += floc
+	void AddForce(unsigned int i, const double * floc, unsigned int len) {
+	  assert(i < _n && len <= _dim);
+	  double * p = _f + (size_t)i * _dim;
+	  for (unsigned int k = 0; k < len; ++k) p[k] += floc[k];
+	}
+
+	// x = x + dt * v + 0.5 * dt^2 * a, v = v + (1 - gamma) * dt * a
+	void Predictor(double dt, double gamma) {
+	  const size_t len = (size_t)_n * _dim;
+	  const double hdt2 = 0.5 * dt * dt;
+	  const double gdt = (1.0 - gamma) * dt;
+	  double * __restrict__ x = _x;
+	  double * __restrict__ v = _v;
+	  const double * __restrict__ a = _a;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (size_t i = 0; i < len; ++i) {
+	    x[i] += dt * v[i] + hdt2 * a[i];
+	    v[i] += gdt * a[i];
+	  }
+	}
+
+	// a = -f / m, v = v + gamma * dt * a
+	void Corrector(double dt, double gamma) {
+	  const size_t len = (size_t)_n * _dim;
+	  const double gdt = gamma * dt;
+	  double * __restrict__ v = _v;
+	  double * __restrict__ a = _a;
+	  const double * __restrict__ f = _f;
+	  const double * __restrict__ minv = _minv;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (size_t i = 0; i < len; ++i) {
+	    a[i] = -f[i] * minv[i];
+	    v[i] += gdt * a[i];
+	  }
+	}
+
+	// x = x + dt * v
+	void BallisticUpdate(double dt) {
+	  const size_t len = (size_t)_n * _dim;
+	  double * __restrict__ x = _x;
+	  const double * __restrict__ v = _v;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+	  for (size_t i = 0; i < len; ++i) {
+	    x[i] += dt * v[i];
+	  }
+	}
+
+	// copy the coordinates of the nodes into x
+	void PullPositions() {
+	  for (unsigned int i = 0; i < _n; ++i) {
+	    double * xloc = _x + (size_t)i * _dim;
+	    const double * p = _coords[i]->begin();
+	    unsigned int k = 0;
+	    for (; k < _ndof[i]; ++k) xloc[k] = p[k];
+	    for (; k < _dim; ++k) xloc[k] = 0.0;
+	  }
+	}
+
+	// copy x back into the coordinates of the nodes
+	void PushPositions() const {
+	  for (unsigned int i = 0; i < _n; ++i) {
+	    const double * xloc = _x + (size_t)i * _dim;
+	    double * p = _coords[i]->begin();
+	    for (unsigned int k = 0; k < _ndof[i]; ++k) p[k] = xloc[k];
+	  }
+	}
+
+	// mirror the fields back into the map containers of the model
+	void Store(vector_type * v, vector_type * a) const {
+	  if (v != NULL) _scatter(_v, *v);
+	  if (a != NULL) _scatter(_a, *a);
+	}
+
+	void Load(const vector_type * v, const vector_type * a) {
+	  if (v != NULL) _gather(*v, _v);
+	  if (a != NULL) _gather(*a, _a);
+	}
+
+	void GetForce(vector_type & fmap) const {
+	  _scatter(_f, fmap);
+	}
+
+	// persistent buffer for models that still evaluate forces into a map
+	vector_type & GetForceBuffer() { return _fbuf; }
+
+private:
+
+	void _gather(const vector_type & src, double * dst) {
+	  memset(dst, 0, (size_t)_n * _dim * sizeof(double));
+	  vector_type::const_iterator pS = src.begin();
+	  for (unsigned int k = 0; k < _n && pS != src.end(); ++k) {
+	    while (pS != src.end() && pS->first < _sorted[k]) ++pS;
+	    if (pS == src.end() || pS->first != _sorted[k]) continue;
+	    const unsigned int i = _slot[k];
+	    double * dloc = dst + (size_t)i * _dim;
+	    const double * q = pS->second.begin();
+	    for (unsigned int j = 0; j < pS->second.size(); ++j) dloc[j] = q[j];
+	  }
+	}
+
+	void _scatter(const double * src, vector_type & dst) const {
+	  vector_type::iterator pD = dst.begin();
+	  for (unsigned int k = 0; k < _n; ++k) {
+	    while (pD != dst.end() && pD->first < _sorted[k]) ++pD;
+	    const unsigned int i = _slot[k];
+	    const double * sloc = src + (size_t)i * _dim;
+	    if (pD == dst.end() || pD->first != _sorted[k]) {
+	      pD = dst.insert(pD, make_pair(_sorted[k],
+			      Set::VectorSpace::Vector(_ndof[i])));
+	    }
+	    double * q = pD->second.begin();
+	    for (unsigned int j = 0; j < pD->second.size(); ++j) q[j] = sloc[j];
+	  }
+	}
+
+	static double * _allocate(size_t len) {
+	  if (len == 0) len = 1;
+	  void * p = NULL;
+#if defined(WIN32)
+	  p = _aligned_malloc(len * sizeof(double), M4EXTREME_NODALFIELD_ALIGNMENT);
+#else
+	  if (posix_memalign(&p, M4EXTREME_NODALFIELD_ALIGNMENT, len * sizeof(double)) != 0) p = NULL;
+#endif
+	  if (p == NULL) {
+	    cerr << "unable to allocate memory @Solver::NodalField" << endl;
+	    assert(false);
+	  }
+	  return (double *)p;
+	}
+
+	static void _deallocate(double * p) {
+	  if (p == NULL) return;
+#if defined(WIN32)
+	  _aligned_free(p);
+#else
+	  free(p);
+#endif
+	}
+
+	void _release() {
+	  _deallocate(_x); _deallocate(_v); _deallocate(_a);
+	  _deallocate(_f); _deallocate(_m); _deallocate(_minv);
+	  _x = _v = _a = _f = _m = _minv = 0;
+	  _capacity = 0;
+	}
+
+	void _resize(size_t n) {
+	  _n = (unsigned int)n;
+	  if (n <= _capacity && _x != 0) return;
+	  _release();
+	  const size_t len = n * _dim;
+	  _x = _allocate(len); _v = _allocate(len); _a = _allocate(len);
+	  _f = _allocate(len); _m = _allocate(len); _minv = _allocate(len);
+	  _capacity = n;
+	}
+
+private:
+
+	unsigned int _dim;
+	unsigned int _n;
+	size_t _capacity;
+	unsigned int _numbering;
+
+	double *_x;
+	double *_v;
+	double *_a;
+	double *_f;
+	double *_m;
+	double *_minv;
+
+	vector<dof_type *> _dofs;
+	vector<dof_type *> _sorted;
+	vector<unsigned int> _slot;
+	vector<Set::Array *> _coords;
+	vector<unsigned int> _ndof;
+	map<dof_type *, unsigned int> _index;
+	vector_type _fbuf;
+
+private:
+
+	NodalField(NodalField &);
+	void operator=(NodalField &);
+};
+
+}
+
+#endif // !defined(SOLVER_NODALFIELD__INCLUDED_)
@@ -0,0 +1,193 @@
+// Overlap.h: interface for the SplitForce and NodalExchange classes.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_OVERLAP__INCLUDED_)
+#define SOLVER_OVERLAP__INCLUDED_
+
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include "./NodalField.h"
+#include "./ForceAccumulator.h"
+#include "../../Element/MaterialPoint/ShapeTable.h"
+#include "../../Utils/Profiler/Profiler.h"
+
+using namespace std;
+
+namespace Solver
+{
+//////////////////////////////////////////////////////////////////////
+// Class NodalExchange
+//
+// Split-phase assembly of a flat nodal array across partitions.
+// Begin(f) hands over the local values of the shared nodes, End(f)
+// adds the values of the other partitions. The entries of f at the
+// shared nodes must not be modified between the two calls.
+//////////////////////////////////////////////////////////////////////
+
+class NodalExchange
+{
+public:
+
+	virtual ~NodalExchange() {}
+
+	virtual void Begin(const double * f) = 0;
+	virtual void End(double * f) = 0;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class SplitForce
+//
+// Internal forces evaluated in two parts: the BOUNDARY part covers
+// the material points that touch at least one shared node, the
+// INTERIOR part all the others, so that the shared entries of f are
+// final once the BOUNDARY part is done.
+//////////////////////////////////////////////////////////////////////
+
+class SplitForce
+{
+public:
+
+	enum PART { BOUNDARY = 0, INTERIOR = 1 };
+
+	virtual ~SplitForce() {}
+
+	// f += forces of the material points in part
+	virtual void operator () (PART part, double * f) = 0;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class PartitionedForce
+//
+// SplitForce over the elements of a kernel. The kernel is the one of
+// ForceAccumulator, kernel(e, f, tid) adds the forces of element e
+// into f; ElementForce is the kernel over the element energies of a
+// model (the material points, tractions and potentials), and the
+// elements are classified either by their shape function tables or
+// by the adjacency of the kernel. Each part may be given its own
+// accumulator; an accumulator in COLORED mode is colored with the
+// graph of its part by Partition.
+//
+// In a partitioned run the shared nodes are those of the HaloExchange
+// built by MPI_Core::buildOverlap, which also classifies the elements.
+//////////////////////////////////////////////////////////////////////
+
+template<class Kernel>
+class PartitionedForce : public SplitForce
+{
+public:
+
+	PartitionedForce(Kernel * kernel, NodalField * field,
+			 ForceAccumulator * boundary = 0,
+			 ForceAccumulator * interior = 0)
+	  : _kernel(kernel), _field(field) {
+	  _acc[BOUNDARY] = boundary;
+	  _acc[INTERIOR] = interior;
+	}
+
+	virtual ~PartitionedForce() {}
+
+	// classify the material points against the shared nodes
+	void Partition(const vector<const Element::MaterialPoint::ShapeTable *> & tables,
+		       const vector<NodalField::dof_type *> & shared) {
+	  vector<char> mark;
+	  _mark(shared, mark);
+
+	  _points[BOUNDARY].clear();
+	  _points[INTERIOR].clear();
+	  for (unsigned int e = 0; e < tables.size(); ++e) {
+	    const vector<unsigned int> & nodes = tables[e]->GetNodes();
+	    bool touches = false;
+	    for (unsigned int k = 0; k < nodes.size() && !touches; ++k) touches = mark[nodes[k]] != 0;
+	    _points[touches ? BOUNDARY : INTERIOR].push_back(e);
+	  }
+
+	  for (int p = 0; p < 2; ++p) {
+	    if (_acc[p] == 0 || _acc[p]->GetMode() != ForceAccumulator::COLORED) continue;
+	    vector<const Element::MaterialPoint::ShapeTable *> part(_points[p].size());
+	    for (unsigned int i = 0; i < _points[p].size(); ++i) part[i] = tables[_points[p][i]];
+	    _acc[p]->SetGraph(part);
+	  }
+	}
+
+	// same, with the element to dense node adjacency of the kernel
+	// (GetOffsets and GetNodes, as ElementForce has them)
+	void Partition(const vector<NodalField::dof_type *> & shared) {
+	  const vector<unsigned int> & offsets = _kernel->GetOffsets();
+	  const vector<unsigned int> & nodes = _kernel->GetNodes();
+	  const unsigned int nelem = offsets.empty() ? 0 : offsets.size() - 1;
+	  vector<char> mark;
+	  _mark(shared, mark);
+
+	  _points[BOUNDARY].clear();
+	  _points[INTERIOR].clear();
+	  for (unsigned int e = 0; e < nelem; ++e) {
+	    bool touches = false;
+	    for (unsigned int k = offsets[e]; k < offsets[e+1] && !touches; ++k) touches = mark[nodes[k]] != 0;
+	    _points[touches ? BOUNDARY : INTERIOR].push_back(e);
+	  }
+
+	  for (int p = 0; p < 2; ++p) {
+	    if (_acc[p] == 0 || _acc[p]->GetMode() != ForceAccumulator::COLORED) continue;
+	    vector<unsigned int> poff(_points[p].size() + 1, 0), pnodes;
+	    for (unsigned int i = 0; i < _points[p].size(); ++i) {
+	      const unsigned int e = _points[p][i];
+	      pnodes.insert(pnodes.end(), nodes.begin() + offsets[e], nodes.begin() + offsets[e+1]);
+	      poff[i+1] = pnodes.size();
+	    }
+	    _acc[p]->SetGraph(_points[p].size(), poff, pnodes);
+	  }
+	}
+
+	const vector<unsigned int> & GetPoints(PART part) const { return _points[part]; }
+
+	void operator () (PART part, double * f) {
+	  const vector<unsigned int> & points = _points[part];
+	  if (points.empty()) return;
+	  M4EXTREME_PROFILE_SCOPE(part == BOUNDARY ? "boundary" : "interior");
+	  M4EXTREME_PROFILE_COUNT(MPT_EVALUATIONS, points.size());
+	  _Subset body(*_kernel, &points[0]);
+	  if (_acc[part] == 0) {
+	    for (unsigned int i = 0; i < points.size(); ++i) body(i, f, 0);
+	  }
+	  else {
+	    (*_acc[part])(points.size(), body, f, _field->size(), _field->Dim());
+	  }
+	}
+
+private:
+
+	void _mark(const vector<NodalField::dof_type *> & shared, vector<char> & mark) const {
+	  mark.assign(_field->size(), 0);
+	  for (unsigned int i = 0; i < shared.size(); ++i) {
+	    const int id = _field->Index(shared[i]);
+	    if (id >= 0) mark[id] = 1;
+	  }
+	}
+
+	struct _Subset {
+	  _Subset(Kernel & k, const unsigned int * points) : _k(k), _points(points) {}
+	  void operator () (unsigned int e, double * f, int tid) { _k(_points[e], f, tid); }
+	  Kernel & _k; const unsigned int * _points;
+	};
+
+private:
+
+	Kernel * _kernel;
+	NodalField * _field;
+	ForceAccumulator * _acc[2];
+	vector<unsigned int> _points[2];
+
+private:
+
+	PartitionedForce(const PartitionedForce &);
+	PartitionedForce & operator = (const PartitionedForce &);
+};
+
+}
+
+#endif // !defined(SOLVER_OVERLAP__INCLUDED_)
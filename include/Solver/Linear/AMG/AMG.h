@@ -0,0 +1,393 @@
+// AMG.h: interface for the AMG class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_AMG__INCLUDED_)
+#define SOLVER_LINEAR_AMG__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "../Linear.h"
+#include "../Krylov/Krylov.h"
+#include "./SmoothedAggregation.h"
+#include "../../../Set/Manifold/Manifold.h"
+#include "../../../Set/Indexed/Array/Array.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class AMG
+//////////////////////////////////////////////////////////////////////
+//
+// Iterative System for large symmetric positive definite matrices:
+// conjugate gradients preconditioned by smoothed aggregation multigrid,
+// in place of a direct solver whose fill-in no longer fits, e.g.
+//
+//	AMG<DOF> LS(LSt.GetDOFs(), LSt.GetDOFPairs());
+//	LS.SetRigidBodyModes();
+//
+// The matrix is stored in compressed rows on the pattern of the key
+// pairs, both triangles, and must be assembled symmetric. A pair whose
+// transpose is not in the pattern stands for both entries, as for
+// SparseCholesky: what is added or set to it is mirrored and the
+// contributions to its transpose are dropped, so a pattern of one
+// triangle gives a symmetric matrix as well. Without a
+// near-nullspace each key is its own node and the constants are the
+// near-nullspace; for keys pair<Point *, unsigned int> (Model::DOF),
+// SetRigidBodyModes() groups the keys by point and uses the rigid
+// body modes of the point coordinates, which mechanics requires.
+//
+// The hierarchy is built at the first Solve(); a Solve() after the
+// values changed rebuilds it with the same aggregates. Solve() throws
+// if the iterations do not reach the tolerance.
+//
+template <class key>
+class AMG : public System <key>
+{
+public:
+
+//	Constructors/destructors:
+
+	AMG();
+	AMG(const set <key> &, const set <pair <key, key> > &,
+		double Tolerance = 1.0e-8, unsigned int MaxIterations = 1000);
+	virtual ~AMG();
+
+//	Accessors/mutators:
+
+	double Get(key);
+	double Get(key, key);
+	void Set(key, double);
+	void Set(key, key, double);
+
+	SmoothedAggregation &Multigrid() { return SA; }
+	unsigned int GetIterations() const { return PCG.GetIterations(); }
+	double GetResidual() const { return PCG.GetResidual(); }
+
+	// nb vectors, B[i + n*k] in key order, Node[i] the node of key i
+	void SetNearNullspace(const vector <unsigned int> &Node,
+		const vector <double> &B, unsigned int nb);
+	// for keys pair<Point *, unsigned int>
+	void SetRigidBodyModes();
+
+//	General methods:
+
+	void SetToZero1();
+	void SetToZero2();
+	void Add(key, double);
+	void Add(key, key, double);
+	void Solve();
+	double Norm();
+
+	// storage of an entry for direct assembly
+	double *Slot(key K) { return &b[KeyMap[K]]; }
+	// 0 for a pair whose transpose stands for it (dropped)
+	double *Slot(key K1, key K2) {
+		const unsigned int p = Find(K1, K2);
+		return Stored[p] ? &A.Val[p] : 0;
+	}
+
+	// values changed through Slot(), the next Solve() rebuilds
+	void Modified() { Mirror(); Ready = false; }
+
+private:
+
+	unsigned int Find(key, key);
+	unsigned int Position(unsigned int, unsigned int) const;
+	void Mirror();
+
+	unsigned int n;
+
+	map <key, unsigned int> KeyMap;
+
+	SmoothedAggregation::Matrix A;
+	vector <double> b, x;
+
+	// whether an entry is written, and the entry it is mirrored to
+	// (-1 if its transpose is in the pattern as well)
+	vector <char> Stored;
+	vector <int> Transpose;
+
+	vector <unsigned int> Node;
+	vector <double> B;
+	unsigned int nb;
+
+	KrylovSpace Space;
+	CG PCG;
+	SmoothedAggregation SA;
+	bool Built, Ready;
+
+	// y = A x for the Krylov solver
+	class MatrixOperator : public Operator {
+	public:
+		MatrixOperator(const SmoothedAggregation::Matrix &A) : A(A) {}
+		unsigned int Size() const { return A.n; }
+		void operator () (const double *x, double *y) { SmoothedAggregation::Multiply(A, x, y); }
+	private:
+		const SmoothedAggregation::Matrix &A;
+	};
+
+private:
+
+	AMG(AMG &);
+	void operator=(AMG &);
+};
+
+template <class key>
+AMG<key>::AMG() : n(0), nb(0), Space(0), PCG(Space), Built(false), Ready(false) {}
+
+template <class key>
+AMG<key>::AMG(const set <key> &Keys, const set <pair <key, key> > &KeyPairs,
+	double Tolerance, unsigned int MaxIterations)
+: n(Keys.size()), b(n, 0.0), x(n, 0.0), nb(1), Space(n),
+  PCG(Space, Tolerance, MaxIterations), Built(false), Ready(false)
+{
+	unsigned int i, k;
+	typename set <key>::const_iterator iK;
+	typename set <pair <key, key> >::const_iterator iKK;
+
+	if (n == 0) throw (0);
+
+	for (iK=Keys.begin(), i=0; iK!=Keys.end(); iK++, i++)
+		KeyMap[*iK] = i;
+
+	// pattern and its transpose, and the diagonal
+	vector <pair <unsigned int, unsigned int> > Entries;
+	Entries.reserve(2 * KeyPairs.size() + n);
+	for (i=0; i<n; i++) Entries.push_back(make_pair(i, i));
+	for (iKK=KeyPairs.begin(); iKK!=KeyPairs.end(); iKK++) {
+		const unsigned int r = KeyMap[iKK->first], c = KeyMap[iKK->second];
+		Entries.push_back(make_pair(r, c));
+		Entries.push_back(make_pair(c, r));
+	}
+	sort(Entries.begin(), Entries.end());
+	Entries.erase(unique(Entries.begin(), Entries.end()), Entries.end());
+
+	A.n = A.m = n;
+	A.Ptr.assign(n + 1, 0);
+	A.Col.resize(Entries.size());
+	for (k=0; k<Entries.size(); k++) {
+		A.Ptr[Entries[k].first + 1]++;
+		A.Col[k] = Entries[k].second;
+	}
+	for (i=0; i<n; i++) A.Ptr[i+1] += A.Ptr[i];
+	A.Val.assign(A.Col.size(), 0.0);
+
+	// the entries of the pattern, and those standing for their transpose
+	Stored.assign(A.Col.size(), 0);
+	Transpose.assign(A.Col.size(), -1);
+	for (i=0; i<n; i++) Stored[Position(i, i)] = 1;
+	for (iKK=KeyPairs.begin(); iKK!=KeyPairs.end(); iKK++)
+		Stored[Position(KeyMap[iKK->first], KeyMap[iKK->second])] = 1;
+	for (iKK=KeyPairs.begin(); iKK!=KeyPairs.end(); iKK++) {
+		const unsigned int r = KeyMap[iKK->first], c = KeyMap[iKK->second];
+		const unsigned int t = Position(c, r);
+		if (r != c && !Stored[t]) Transpose[Position(r, c)] = (int)t;
+	}
+
+	Node.resize(n);
+	for (i=0; i<n; i++) Node[i] = i;
+	B.assign(n, 1.0);
+}
+
+template <class key>
+AMG<key>::~AMG() {}
+
+// the columns of a row are sorted
+template <class key>
+unsigned int AMG<key>::Position(unsigned int i, unsigned int j) const
+{
+	const unsigned int *first = &A.Col[0] + A.Ptr[i];
+	const unsigned int *last = &A.Col[0] + A.Ptr[i + 1];
+	const unsigned int *p = lower_bound(first, last, j);
+	if (p != last && *p == j) return (unsigned int)(p - &A.Col[0]);
+	return (unsigned int)A.Col.size();
+}
+
+template <class key>
+unsigned int AMG<key>::Find(key K1, key K2)
+{
+	typename map <key, unsigned int>::const_iterator
+		i1 = KeyMap.find(K1), i2 = KeyMap.find(K2);
+	if (i1 != KeyMap.end() && i2 != KeyMap.end()) {
+		const unsigned int p = Position(i1->second, i2->second);
+		if (p < A.Col.size()) return p;
+	}
+	cout << "Solver::AMG pair is not in the pattern @" << endl;
+	throw (0);
+}
+
+// copy the entries standing for their transpose
+template <class key>
+void AMG<key>::Mirror()
+{
+	unsigned int k;
+	for (k=0; k<Transpose.size(); k++)
+		if (Transpose[k] >= 0) A.Val[Transpose[k]] = A.Val[k];
+}
+
+template <class key>
+void AMG<key>::SetNearNullspace(const vector <unsigned int> &N,
+	const vector <double> &V, unsigned int m)
+{
+	if (N.size() != n || V.size() != (size_t)n * m || m == 0) {
+		cout << "Solver::AMG near-nullspace does not match the keys @" << endl;
+		throw (0);
+	}
+	Node = N; B = V; nb = m;
+	Built = Ready = false;
+}
+
+// translations, and rotations about the centroid of the points
+template <class key>
+void AMG<key>::SetRigidBodyModes()
+{
+	typename map <key, unsigned int>::const_iterator iK;
+	map <Set::Manifold::Point *, unsigned int> Points;
+	vector <unsigned int> N(n);
+	unsigned int dim = 0, i, d;
+
+	for (iK=KeyMap.begin(); iK!=KeyMap.end(); iK++) {
+		Set::Manifold::Point *p = iK->first.first;
+		N[iK->second] = Points.insert(make_pair(p, (unsigned int)Points.size())).first->second;
+		dim = max(dim, p->size());
+	}
+	if (dim < 2 || dim > 3) {
+		SetNearNullspace(N, vector <double> (n, 1.0), 1);
+		return;
+	}
+
+	vector <double> c(dim, 0.0);
+	map <Set::Manifold::Point *, unsigned int>::const_iterator iP;
+	for (iP=Points.begin(); iP!=Points.end(); iP++) {
+		const Set::Array *x = dynamic_cast <const Set::Array *> (iP->first);
+		if (x == 0) throw (0);
+		for (d=0; d<x->size(); d++) c[d] += (*x)[d] / Points.size();
+	}
+
+	const unsigned int m = dim == 2 ? 3 : 6;
+	vector <double> V((size_t)n * m, 0.0);
+	for (iK=KeyMap.begin(); iK!=KeyMap.end(); iK++) {
+		const Set::Array *x = dynamic_cast <const Set::Array *> (iK->first.first);
+		const unsigned int k = iK->first.second;
+		i = iK->second;
+		double y[3] = {0.0, 0.0, 0.0};
+		for (d=0; d<x->size(); d++) y[d] = (*x)[d] - c[d];
+		if (k >= dim) continue;
+		V[i + (size_t)n * k] = 1.0;
+		if (dim == 2) {
+			// (-y, x)
+			V[i + (size_t)n * 2] = k == 0 ? -y[1] : y[0];
+		}
+		else {
+			// (0, -z, y), (z, 0, -x), (-y, x, 0)
+			const double r[3][3] = {{0.0, -y[2], y[1]}, {y[2], 0.0, -y[0]}, {-y[1], y[0], 0.0}};
+			for (d=0; d<3; d++) V[i + (size_t)n * (3 + d)] = r[d][k];
+		}
+	}
+	SetNearNullspace(N, V, m);
+}
+
+template <class key>
+double AMG<key>::Get(key K)
+{
+	return b[KeyMap[K]];
+}
+
+template <class key>
+double AMG<key>::Get(key K1, key K2)
+{
+	return A.Val[Find(K1, K2)];
+}
+
+template <class key>
+void AMG<key>::Set(key K, double Input)
+{
+	b[KeyMap[K]] = Input;
+}
+
+template <class key>
+void AMG<key>::Set(key K1, key K2, double Input)
+{
+	const unsigned int p = Find(K1, K2);
+	if (!Stored[p]) return;
+	A.Val[p] = Input;
+	if (Transpose[p] >= 0) A.Val[Transpose[p]] = Input;
+	Ready = false;
+}
+
+template <class key>
+void AMG<key>::SetToZero1()
+{
+	unsigned int i;
+	for (i=0; i<n; i++) b[i] = 0.0;
+}
+
+template <class key>
+void AMG<key>::SetToZero2()
+{
+	unsigned int i;
+	for (i=0; i<A.Val.size(); i++) A.Val[i] = 0.0;
+	Ready = false;
+}
+
+template <class key>
+void AMG<key>::Add(key K, double Input)
+{
+	b[KeyMap[K]] += Input;
+}
+
+template <class key>
+void AMG<key>::Add(key K1, key K2, double Input)
+{
+	const unsigned int p = Find(K1, K2);
+	if (!Stored[p]) return;
+	A.Val[p] += Input;
+	if (Transpose[p] >= 0) A.Val[Transpose[p]] += Input;
+	Ready = false;
+}
+
+template <class key>
+double AMG<key>::Norm()
+{
+	unsigned int i; double bn2 = 0.0;
+	for (i=0; i<n; i++) bn2 += b[i]*b[i];
+	return sqrt(bn2);
+}
+
+template <class key>
+void AMG<key>::Solve()
+{
+	if (!Built) SA.Setup(A, Node, B, nb);
+	else if (!Ready) SA.Update();
+	Built = Ready = true;
+
+	MatrixOperator Op(A);
+	unsigned int i;
+	for (i=0; i<n; i++) x[i] = 0.0;
+	if (!PCG.Solve(Op, &SA, &b[0], &x[0])) {
+		cout << "Solver::AMG no convergence in " << PCG.GetIterations()
+			<< " iterations, residual " << PCG.GetResidual() << " @" << endl;
+		throw (0);
+	}
+	b.swap(x);
+}
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_AMG__INCLUDED_)
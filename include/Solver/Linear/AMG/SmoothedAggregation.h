@@ -0,0 +1,655 @@
+// SmoothedAggregation.h: interface for the SmoothedAggregation class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_SMOOTHEDAGGREGATION__INCLUDED_)
+#define SOLVER_LINEAR_SMOOTHEDAGGREGATION__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+
+#include "../Krylov/Krylov.h"
+#include "../Krylov/Preconditioners.h"
+#include "../SparseCholesky/SparseLDL.h"
+#include "../../../Threads/TaskScheduler.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class SmoothedAggregation
+//////////////////////////////////////////////////////////////////////
+//
+// Smoothed aggregation algebraic multigrid (Vanek, Mandel and Brezina)
+// for symmetric positive definite matrices, as a preconditioner of the
+// Krylov solvers: operator () applies one V-cycle.
+//
+// The unknowns are grouped by node (the components of a node in
+// mechanics) and the nodes are aggregated along the strong couplings
+// of the node graph,
+//
+//	|A_ab| >= theta sqrt(|A_aa| |A_bb|),
+//
+// |.| the Frobenius norm of the node blocks. The tentative prolongator
+// restricts the near-nullspace B (e.g. the rigid body modes) to each
+// aggregate and orthonormalizes it; the coarse nodes are the aggregates
+// and B is carried to the coarse level by the R factors. The prolongator
+// is smoothed by one damped Jacobi step, P = (I - 4/3 D^{-1} A / lmax) T,
+// and the coarse matrix is the Galerkin product P^T A P. Coarsening
+// stops at CoarseSize unknowns, where a SparseLDL factorization is the
+// coarse solver; the other levels are smoothed by Chebyshev polynomials
+// in D^{-1} A, so that the cycle is symmetric.
+//
+// The strength graph, the products and all the smoothing run on the
+// process wide TaskScheduler; only the aggregation is sequential.
+// Update() rebuilds the hierarchy for new values of the same pattern
+// and keeps the aggregates and tentative prolongators.
+//
+class SmoothedAggregation : public Preconditioner
+{
+public:
+
+	// compressed sparse rows, the columns of a row sorted
+	struct Matrix {
+		Matrix() : n(0), m(0), Ptr(1, 0) {}
+		unsigned int n, m;
+		vector<unsigned int> Ptr, Col;
+		vector<double> Val;
+	};
+
+//	Constructors/destructors:
+
+	SmoothedAggregation();
+	virtual ~SmoothedAggregation();
+
+//	Accessors/mutators:
+
+	void SetStrength(double t) { Theta = t; }
+	void SetCoarseSize(unsigned int s) { CoarseSize = s; }
+	void SetMaxLevels(unsigned int l) { MaxLevels = l > 0 ? l : 1; }
+	void SetSmoother(unsigned int degree) { Degree = degree > 0 ? degree : 1; }
+
+	unsigned int NumberOfLevels() const { return (unsigned int)Levels.size(); }
+	unsigned int Size(unsigned int l) const { return Levels[l]->A->n; }
+	// sum of the nonzeros of all levels over those of the fine matrix
+	double OperatorComplexity() const;
+
+//	General methods:
+
+	// hierarchy for A, which must outlive it; Node[i] is the node of
+	// unknown i and B holds nb near-nullspace vectors, B[i + n*k]
+	void Setup(const Matrix &A, const vector<unsigned int> &Node,
+		const vector<double> &B, unsigned int nb);
+
+	// new values in A, same pattern and aggregates
+	void Update();
+
+	void Clear();
+
+	// z = one V-cycle on r from zero
+	void operator () (const double *r, double *z);
+
+	// y = A x on the TaskScheduler
+	static void Multiply(const Matrix &A, const double *x, double *y);
+	// C = A B
+	static void Multiply(const Matrix &A, const Matrix &B, Matrix &C);
+	static void Transpose(const Matrix &A, Matrix &T);
+
+private:
+
+	// operator of a level for the Chebyshev smoother
+	class LevelOperator : public Operator {
+	public:
+		LevelOperator(const Matrix *A) : A(A) {}
+		unsigned int Size() const { return A->n; }
+		void operator () (const double *x, double *y) { SmoothedAggregation::Multiply(*A, x, y); }
+	private:
+		const Matrix *A;
+	};
+
+	struct Level {
+		Level() : A(0), Op(0), S(0), Smoother(0) {}
+		~Level() { delete Smoother; delete S; delete Op; }
+		const Matrix *A;
+		Matrix Ac;		// own matrix of the coarse levels
+		Matrix T, P, R;		// prolongators to this level from the next
+		vector<double> x, b, r;
+		LevelOperator *Op;
+		KrylovSpace *S;
+		Chebyshev *Smoother;
+	};
+
+	struct SpMV {
+		const Matrix *A;
+		const double *x;
+		double *y;
+		void operator () (int lo, int hi, int) {
+			const unsigned int *Ptr = &A->Ptr[0], *Col = A->Col.empty() ? 0 : &A->Col[0];
+			const double *Val = A->Val.empty() ? 0 : &A->Val[0];
+			for (int i = lo; i < hi; i++) {
+				double s = 0.0;
+				for (unsigned int k = Ptr[i]; k < Ptr[i+1]; k++) s += Val[k] * x[Col[k]];
+				y[i] = s;
+			}
+		}
+	};
+
+	// two passes over the rows of C = A B: count, then fill; the
+	// workspaces are per thread
+	struct SpGEMM {
+		const Matrix *A, *B;
+		Matrix *C;
+		bool Fill;
+		vector< vector<unsigned int> > *Tag;
+		vector< vector<unsigned int> > *Pos;
+		vector< vector< pair<unsigned int, double> > > *Row;
+		void operator () (int lo, int hi, int tid);
+	};
+
+	struct Strength {
+		const Matrix *A;
+		const vector<unsigned int> *NodePtr, *NodeRows, *Node;
+		const vector<double> *NodeNorm;
+		double Theta;
+		vector< vector<unsigned int> > *Strong;
+		vector< vector<double> > *Acc;
+		vector< vector<unsigned int> > *List;
+		void operator () (int lo, int hi, int tid);
+	};
+
+	void Aggregate(const Matrix &, const vector<unsigned int> &Node, unsigned int NumberOfNodes,
+		double Theta, vector<unsigned int> &Agg, unsigned int &NumberOfAggregates) const;
+	bool Tentative(unsigned int n, const vector<unsigned int> &Agg, unsigned int NumberOfAggregates,
+		const vector<double> &B, unsigned int nb, Matrix &T,
+		vector<unsigned int> &CoarseNode, vector<double> &CoarseB, unsigned int &nc) const;
+	void Build(unsigned int);
+	void Coarsest();
+	void Cycle(unsigned int, const double *, double *);
+
+	static m4extreme::Utils::TaskScheduler *Scheduler();
+
+	double Theta;
+	unsigned int CoarseSize, MaxLevels, Degree;
+
+	vector<Level *> Levels;
+	SparseLDL Coarse;
+	vector<unsigned int> CoarseSlot;
+	bool Direct;
+
+private:
+
+	SmoothedAggregation(SmoothedAggregation &);
+	void operator=(SmoothedAggregation &);
+};
+
+inline SmoothedAggregation::SmoothedAggregation()
+: Theta(0.08), CoarseSize(2000), MaxLevels(12), Degree(2), Direct(false) {}
+
+inline SmoothedAggregation::~SmoothedAggregation()
+{
+	Clear();
+}
+
+inline void SmoothedAggregation::Clear()
+{
+	for (unsigned int l = 0; l < Levels.size(); l++) delete Levels[l];
+	Levels.clear();
+	CoarseSlot.clear();
+	Direct = false;
+}
+
+inline m4extreme::Utils::TaskScheduler *SmoothedAggregation::Scheduler()
+{
+	m4extreme::Utils::TaskScheduler *s = m4extreme::Utils::GetTaskScheduler();
+	if (s != 0 && (s->getNumberThreads() == 1 || s->isRunning())) s = 0;
+	return s;
+}
+
+inline double SmoothedAggregation::OperatorComplexity() const
+{
+	if (Levels.empty() || Levels[0]->A->Col.empty()) return 0.0;
+	double nnz = 0.0;
+	for (unsigned int l = 0; l < Levels.size(); l++) nnz += Levels[l]->A->Col.size();
+	return nnz / Levels[0]->A->Col.size();
+}
+
+inline void SmoothedAggregation::Multiply(const Matrix &A, const double *x, double *y)
+{
+	SpMV body;
+	body.A = &A; body.x = x; body.y = y;
+	m4extreme::Utils::TaskScheduler *s = Scheduler();
+	if (s == 0) body(0, (int)A.n, 0);
+	else s->parallel_for(0, (int)A.n, 256, body);
+}
+
+inline void SmoothedAggregation::SpGEMM::operator () (int lo, int hi, int tid)
+{
+	vector<unsigned int> &tag = (*Tag)[tid], &pos = (*Pos)[tid];
+	vector< pair<unsigned int, double> > &row = (*Row)[tid];
+	for (int i = lo; i < hi; i++) {
+		// distinct tags for the two passes of a row
+		const unsigned int t = Fill ? (unsigned int)i + A->n : (unsigned int)i;
+		if (!Fill) {
+			unsigned int count = 0;
+			for (unsigned int ka = A->Ptr[i]; ka < A->Ptr[i+1]; ka++) {
+				const unsigned int k = A->Col[ka];
+				for (unsigned int kb = B->Ptr[k]; kb < B->Ptr[k+1]; kb++)
+					if (tag[B->Col[kb]] != t) { tag[B->Col[kb]] = t; count++; }
+			}
+			C->Ptr[i+1] = count;
+			continue;
+		}
+		row.clear();
+		for (unsigned int ka = A->Ptr[i]; ka < A->Ptr[i+1]; ka++) {
+			const unsigned int k = A->Col[ka];
+			const double a = A->Val[ka];
+			for (unsigned int kb = B->Ptr[k]; kb < B->Ptr[k+1]; kb++) {
+				const unsigned int j = B->Col[kb];
+				if (tag[j] != t) {
+					tag[j] = t;
+					pos[j] = (unsigned int)row.size();
+					row.push_back(make_pair(j, 0.0));
+				}
+				row[pos[j]].second += a * B->Val[kb];
+			}
+		}
+		sort(row.begin(), row.end());
+		unsigned int c = C->Ptr[i];
+		for (unsigned int k = 0; k < row.size(); k++, c++) {
+			C->Col[c] = row[k].first;
+			C->Val[c] = row[k].second;
+		}
+	}
+}
+
+inline void SmoothedAggregation::Multiply(const Matrix &A, const Matrix &B, Matrix &C)
+{
+	m4extreme::Utils::TaskScheduler *s = Scheduler();
+	const unsigned int threads = s != 0 ? (unsigned int)s->getNumberThreads() : 1;
+	// tags start out of the range of both passes
+	vector< vector<unsigned int> > Tag(threads, vector<unsigned int>(B.m, 2 * A.n + 1));
+	vector< vector<unsigned int> > Pos(threads, vector<unsigned int>(B.m, 0));
+	vector< vector< pair<unsigned int, double> > > Row(threads);
+
+	C.n = A.n; C.m = B.m;
+	C.Ptr.assign(A.n + 1, 0);
+	SpGEMM body;
+	body.A = &A; body.B = &B; body.C = &C;
+	body.Tag = &Tag; body.Pos = &Pos; body.Row = &Row;
+
+	for (int pass = 0; pass < 2; pass++) {
+		body.Fill = pass == 1;
+		if (s == 0) body(0, (int)A.n, 0);
+		else s->parallel_for(0, (int)A.n, 64, body);
+		if (pass == 0) {
+			for (unsigned int i = 0; i < A.n; i++) C.Ptr[i+1] += C.Ptr[i];
+			C.Col.resize(C.Ptr[A.n]);
+			C.Val.resize(C.Ptr[A.n]);
+		}
+	}
+}
+
+inline void SmoothedAggregation::Transpose(const Matrix &A, Matrix &T)
+{
+	unsigned int i, k;
+	T.n = A.m; T.m = A.n;
+	T.Ptr.assign(A.m + 1, 0);
+	for (k = 0; k < A.Col.size(); k++) T.Ptr[A.Col[k] + 1]++;
+	for (i = 0; i < A.m; i++) T.Ptr[i+1] += T.Ptr[i];
+	T.Col.resize(A.Col.size());
+	T.Val.resize(A.Col.size());
+	vector<unsigned int> next(T.Ptr.begin(), T.Ptr.end() - 1);
+	// rows of A in order, so the columns of T come out sorted
+	for (i = 0; i < A.n; i++)
+		for (k = A.Ptr[i]; k < A.Ptr[i+1]; k++) {
+			const unsigned int c = next[A.Col[k]]++;
+			T.Col[c] = i;
+			T.Val[c] = A.Val[k];
+		}
+}
+
+// strong neighbors of the nodes lo ... hi-1
+inline void SmoothedAggregation::Strength::operator () (int lo, int hi, int tid)
+{
+	vector<double> &acc = (*Acc)[tid];
+	vector<unsigned int> &list = (*List)[tid];
+	for (int a = lo; a < hi; a++) {
+		list.clear();
+		for (unsigned int r = (*NodePtr)[a]; r < (*NodePtr)[a+1]; r++) {
+			const unsigned int i = (*NodeRows)[r];
+			for (unsigned int k = A->Ptr[i]; k < A->Ptr[i+1]; k++) {
+				const unsigned int b = (*Node)[A->Col[k]];
+				if (b == (unsigned int)a) continue;
+				if (acc[b] == 0.0) list.push_back(b);
+				acc[b] += A->Val[k] * A->Val[k] + 1.0e-300;
+			}
+		}
+		vector<unsigned int> &strong = (*Strong)[a];
+		strong.clear();
+		for (unsigned int k = 0; k < list.size(); k++) {
+			const unsigned int b = list[k];
+			if (sqrt(acc[b]) >= Theta * sqrt((*NodeNorm)[a] * (*NodeNorm)[b])) strong.push_back(b);
+			acc[b] = 0.0;
+		}
+		sort(strong.begin(), strong.end());
+	}
+}
+
+inline void SmoothedAggregation::Aggregate(const Matrix &A, const vector<unsigned int> &Node,
+	unsigned int nn, double theta, vector<unsigned int> &Agg, unsigned int &na) const
+{
+	const unsigned int n = A.n, None = (unsigned int)-1;
+	unsigned int i, k, a, b;
+
+	// rows of the nodes, and the norms of the diagonal blocks
+	vector<unsigned int> NodePtr(nn + 1, 0), NodeRows(n);
+	for (i = 0; i < n; i++) NodePtr[Node[i] + 1]++;
+	for (a = 0; a < nn; a++) NodePtr[a+1] += NodePtr[a];
+	vector<unsigned int> next(NodePtr.begin(), NodePtr.end() - 1);
+	for (i = 0; i < n; i++) NodeRows[next[Node[i]]++] = i;
+	vector<double> NodeNorm(nn, 0.0);
+	for (i = 0; i < n; i++)
+		for (k = A.Ptr[i]; k < A.Ptr[i+1]; k++)
+			if (Node[A.Col[k]] == Node[i]) NodeNorm[Node[i]] += A.Val[k] * A.Val[k];
+	for (a = 0; a < nn; a++) NodeNorm[a] = sqrt(NodeNorm[a]);
+
+	m4extreme::Utils::TaskScheduler *s = Scheduler();
+	const unsigned int threads = s != 0 ? (unsigned int)s->getNumberThreads() : 1;
+	vector< vector<unsigned int> > Strong(nn), List(threads);
+	vector< vector<double> > Acc(threads, vector<double>(nn, 0.0));
+	Strength body;
+	body.A = &A; body.NodePtr = &NodePtr; body.NodeRows = &NodeRows; body.Node = &Node;
+	body.NodeNorm = &NodeNorm; body.Theta = theta;
+	body.Strong = &Strong; body.Acc = &Acc; body.List = &List;
+	if (s == 0) body(0, (int)nn, 0);
+	else s->parallel_for(0, (int)nn, 64, body);
+
+	// pass 1: a node whose strong neighbors are all free forms an
+	// aggregate with them
+	Agg.assign(nn, None);
+	na = 0;
+	for (a = 0; a < nn; a++) {
+		if (Agg[a] != None || Strong[a].empty()) continue;
+		for (k = 0; k < Strong[a].size() && Agg[Strong[a][k]] == None; k++);
+		if (k < Strong[a].size()) continue;
+		Agg[a] = na;
+		for (k = 0; k < Strong[a].size(); k++) Agg[Strong[a][k]] = na;
+		na++;
+	}
+
+	// pass 2: the free nodes join the first aggregate of pass 1 among
+	// their strong neighbors
+	vector<unsigned int> Join(Agg);
+	for (a = 0; a < nn; a++) {
+		if (Agg[a] != None) continue;
+		for (k = 0; k < Strong[a].size(); k++) {
+			b = Strong[a][k];
+			if (Agg[b] != None) { Join[a] = Agg[b]; break; }
+		}
+	}
+	Agg.swap(Join);
+
+	// pass 3: the nodes left form aggregates with their free strong
+	// neighbors, or alone
+	for (a = 0; a < nn; a++) {
+		if (Agg[a] != None) continue;
+		Agg[a] = na;
+		for (k = 0; k < Strong[a].size(); k++)
+			if (Agg[Strong[a][k]] == None) Agg[Strong[a][k]] = na;
+		na++;
+	}
+}
+
+// orthonormal basis of B on each aggregate (modified Gram-Schmidt,
+// twice), the dependent vectors are dropped
+inline bool SmoothedAggregation::Tentative(unsigned int n, const vector<unsigned int> &Agg,
+	unsigned int na, const vector<double> &B, unsigned int nb, Matrix &T,
+	vector<unsigned int> &CoarseNode, vector<double> &CoarseB, unsigned int &nc) const
+{
+	unsigned int i, j, k, g, p, pass;
+
+	vector<unsigned int> AggPtr(na + 1, 0), AggRows(n);
+	for (i = 0; i < n; i++) AggPtr[Agg[i] + 1]++;
+	for (g = 0; g < na; g++) AggPtr[g+1] += AggPtr[g];
+	vector<unsigned int> next(AggPtr.begin(), AggPtr.end() - 1);
+	for (i = 0; i < n; i++) AggRows[next[Agg[i]]++] = i;
+
+	// Q of aggregate g, column major on its rows, from QStart[g];
+	// R of the kept vectors, nb values each
+	vector<unsigned int> Kept(na, 0), First(na + 1, 0);
+	vector<size_t> QStart(na + 1, 0);
+	vector<double> Q, R, v;
+	for (g = 0; g < na; g++) {
+		const unsigned int m = AggPtr[g+1] - AggPtr[g];
+		const unsigned int *rows = &AggRows[AggPtr[g]];
+		QStart[g] = Q.size();
+		const size_t r0 = R.size();
+		v.resize(m);
+		for (j = 0; j < nb; j++) {
+			for (p = 0; p < m; p++) v[p] = B[rows[p] + (size_t)n * j];
+			double norm0 = 0.0;
+			for (p = 0; p < m; p++) norm0 += v[p] * v[p];
+			norm0 = sqrt(norm0);
+			if (norm0 == 0.0) continue;
+			for (pass = 0; pass < 2; pass++)
+				for (k = 0; k < Kept[g]; k++) {
+					const double *q = &Q[QStart[g] + (size_t)m * k];
+					double h = 0.0;
+					for (p = 0; p < m; p++) h += q[p] * v[p];
+					for (p = 0; p < m; p++) v[p] -= h * q[p];
+					R[r0 + (size_t)nb * k + j] += h;
+				}
+			double norm = 0.0;
+			for (p = 0; p < m; p++) norm += v[p] * v[p];
+			norm = sqrt(norm);
+			if (Kept[g] == m || norm <= 1.0e-8 * norm0) continue;
+			for (p = 0; p < m; p++) Q.push_back(v[p] / norm);
+			R.resize(R.size() + nb, 0.0);
+			R[r0 + (size_t)nb * Kept[g] + j] = norm;
+			Kept[g]++;
+		}
+		First[g+1] = First[g] + Kept[g];
+	}
+	QStart[na] = Q.size();
+	nc = First[na];
+	if (nc == 0) return false;
+
+	CoarseNode.resize(nc);
+	CoarseB.assign((size_t)nc * nb, 0.0);
+	for (g = 0; g < na; g++)
+		for (k = 0; k < Kept[g]; k++) {
+			const unsigned int c = First[g] + k;
+			CoarseNode[c] = g;
+			for (j = 0; j < nb; j++) CoarseB[c + (size_t)nc * j] = R[(size_t)nb * c + j];
+		}
+
+	T.n = n; T.m = nc;
+	T.Ptr.assign(n + 1, 0);
+	for (i = 0; i < n; i++) T.Ptr[i+1] = T.Ptr[i] + Kept[Agg[i]];
+	T.Col.resize(T.Ptr[n]);
+	T.Val.resize(T.Ptr[n]);
+	for (g = 0; g < na; g++) {
+		const unsigned int m = AggPtr[g+1] - AggPtr[g];
+		for (p = 0; p < m; p++) {
+			const unsigned int r = AggRows[AggPtr[g] + p];
+			for (k = 0; k < Kept[g]; k++) {
+				T.Col[T.Ptr[r] + k] = First[g] + k;
+				T.Val[T.Ptr[r] + k] = Q[QStart[g] + (size_t)m * k + p];
+			}
+		}
+	}
+	return true;
+}
+
+// smoother of level l and, if there is a coarser level, the smoothed
+// prolongator and the coarse matrix
+inline void SmoothedAggregation::Build(unsigned int l)
+{
+	Level &L = *Levels[l];
+	const Matrix &A = *L.A;
+	const unsigned int n = A.n;
+	unsigned int i, k;
+
+	vector<double> D(n, 0.0);
+	for (i = 0; i < n; i++)
+		for (k = A.Ptr[i]; k < A.Ptr[i+1]; k++)
+			if (A.Col[k] == i) D[i] = A.Val[k];
+
+	if (L.Smoother == 0) {
+		L.Op = new LevelOperator(L.A);
+		L.S = new KrylovSpace(n);
+		L.Smoother = new Chebyshev(*L.S, *L.Op, &D[0], Degree);
+	}
+	else L.Smoother->Update(&D[0]);
+	L.x.resize(n); L.b.resize(n); L.r.resize(n);
+
+	if (l + 1 == Levels.size()) return;
+
+	// P = T - omega D^{-1} A T, lmax is overestimated by the smoother
+	const double omega = 4.0 / 3.0 / L.Smoother->GetMaxEigenvalue();
+	Matrix AT;
+	Multiply(A, L.T, AT);
+	Matrix &P = L.P;
+	P.n = n; P.m = L.T.m;
+	P.Ptr.assign(n + 1, 0);
+	P.Col.clear(); P.Val.clear();
+	P.Col.reserve(AT.Col.size() + L.T.Col.size());
+	P.Val.reserve(AT.Col.size() + L.T.Col.size());
+	for (i = 0; i < n; i++) {
+		const double w = D[i] != 0.0 ? omega / D[i] : 0.0;
+		unsigned int a = AT.Ptr[i], t = L.T.Ptr[i];
+		while (a < AT.Ptr[i+1] || t < L.T.Ptr[i+1]) {
+			if (t == L.T.Ptr[i+1] || (a < AT.Ptr[i+1] && AT.Col[a] < L.T.Col[t])) {
+				P.Col.push_back(AT.Col[a]); P.Val.push_back(-w * AT.Val[a]); a++;
+			}
+			else if (a == AT.Ptr[i+1] || L.T.Col[t] < AT.Col[a]) {
+				P.Col.push_back(L.T.Col[t]); P.Val.push_back(L.T.Val[t]); t++;
+			}
+			else {
+				P.Col.push_back(AT.Col[a]); P.Val.push_back(L.T.Val[t] - w * AT.Val[a]); a++; t++;
+			}
+		}
+		P.Ptr[i+1] = (unsigned int)P.Col.size();
+	}
+
+	Transpose(P, L.R);
+	Matrix AP;
+	Multiply(A, P, AP);
+	Multiply(L.R, AP, Levels[l+1]->Ac);
+}
+
+// sparse LDL^T of the coarsest matrix, the pattern is analyzed once
+inline void SmoothedAggregation::Coarsest()
+{
+	const Matrix &A = *Levels.back()->A;
+	const unsigned int n = A.n;
+	unsigned int i, k, e;
+
+	if (CoarseSlot.empty() || Coarse.Size() != n) {
+		vector<unsigned int> Row, Column;
+		for (i = 0; i < n; i++)
+			for (k = A.Ptr[i]; k < A.Ptr[i+1]; k++)
+				if (A.Col[k] <= i) { Row.push_back(i); Column.push_back(A.Col[k]); }
+		Coarse.Analyze(n, Row, Column, CoarseSlot);
+	}
+	double *a = Coarse.Values();
+	for (k = 0; k < Coarse.NumberOfValues(); k++) a[k] = 0.0;
+	for (i = 0, e = 0; i < n; i++)
+		for (k = A.Ptr[i]; k < A.Ptr[i+1]; k++)
+			if (A.Col[k] <= i) a[CoarseSlot[e++]] = A.Val[k];
+	Direct = Coarse.Factorize() == 0;
+}
+
+inline void SmoothedAggregation::Setup(const Matrix &A, const vector<unsigned int> &Node,
+	const vector<double> &B, unsigned int nb)
+{
+	Clear();
+	if (A.n == 0) return;
+	Levels.push_back(new Level);
+	Levels[0]->A = &A;
+
+	vector<unsigned int> node(Node), CoarseNode, Agg, AggUnknown;
+	vector<double> b(B), CoarseB;
+	double theta = Theta;
+	for (;;) {
+		const unsigned int l = (unsigned int)Levels.size() - 1;
+		Level &L = *Levels[l];
+		const unsigned int n = L.A->n;
+		if (n <= CoarseSize || Levels.size() >= MaxLevels) break;
+
+		unsigned int nn = 0, na = 0, nc = 0, i;
+		for (i = 0; i < n; i++) nn = max(nn, node[i] + 1);
+		Aggregate(*L.A, node, nn, theta, Agg, na);
+		AggUnknown.resize(n);
+		for (i = 0; i < n; i++) AggUnknown[i] = Agg[node[i]];
+		if (!Tentative(n, AggUnknown, na, b, nb, L.T, CoarseNode, CoarseB, nc) || nc >= n) {
+			L.T = Matrix();
+			break;
+		}
+
+		Levels.push_back(new Level);
+		Levels.back()->A = &Levels.back()->Ac;
+		Build(l);
+		node.swap(CoarseNode);
+		b.swap(CoarseB);
+		theta *= 0.5;
+	}
+	Build((unsigned int)Levels.size() - 1);
+	Coarsest();
+}
+
+inline void SmoothedAggregation::Update()
+{
+	for (unsigned int l = 0; l < Levels.size(); l++) Build(l);
+	if (!Levels.empty()) Coarsest();
+}
+
+inline void SmoothedAggregation::Cycle(unsigned int l, const double *b, double *x)
+{
+	Level &L = *Levels[l];
+	if (l + 1 == Levels.size()) {
+		if (Direct) {
+			L.S->Copy(b, x);
+			Coarse.Solve(x);
+		}
+		else {
+			// singular coarse matrix, a few smoothing steps instead
+			(*L.Smoother)(b, x);
+			for (unsigned int k = 0; k < 4; k++) L.Smoother->Smooth(b, x);
+		}
+		return;
+	}
+
+	Level &C = *Levels[l+1];
+	double *r = &L.r[0];
+	(*L.Smoother)(b, x);
+	Multiply(*L.A, x, r);
+	L.S->Axpby(1.0, b, -1.0, r);
+	Multiply(L.R, r, &C.b[0]);
+	Cycle(l + 1, &C.b[0], &C.x[0]);
+	Multiply(L.P, &C.x[0], r);
+	L.S->Axpby(1.0, r, 1.0, x);
+	L.Smoother->Smooth(b, x);
+}
+
+inline void SmoothedAggregation::operator () (const double *r, double *z)
+{
+	if (Levels.empty()) return;
+	Cycle(0, r, z);
+}
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_SMOOTHEDAGGREGATION__INCLUDED_)
@@ -0,0 +1,359 @@
+// Assembler.h: interface for the Assembler class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_ASSEMBLER__INCLUDED_)
+#define SOLVER_LINEAR_ASSEMBLER__INCLUDED_
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <iostream>
+
+#include "../Linear.h"
+#include "../Cholesky/Cholesky.h"
+#include "../SparseCholesky/SparseCholesky.h"
+#include "../AMG/AMG.h"
+#if !defined(_M4EXTREME_MPI_)
+#include "../SuperLU/CachedSuperLU.h"
+#endif
+#include "../../../Threads/TaskScheduler.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class Assembler
+//////////////////////////////////////////////////////////////////////
+//
+// Block assembly of element matrices and vectors into a System.
+//
+// Insert() registers the keys of an element once and computes its
+// scatter map, the positions of all its entries in the value arrays
+// of the system. Add() then adds a dense local matrix (column major,
+// K[i + n*j] goes to (Keys[i], Keys[j]), as System::Add) and a local
+// vector without any lookup or virtual call:
+//
+//	Assembler<DOF> A(LS);
+//	for (e...) A.Insert(dofs[e]);
+//	...
+//	LS.SetToZero1(); LS.SetToZero2();
+//	A.Assemble(element);	// element(e, K, f, tid) fills K and f
+//	LS.Solve();
+//
+// Assemble() computes and adds all the elements on the process wide
+// TaskScheduler. The elements are colored so that the elements of a
+// color share no key; the colors are assembled one after the other
+// and the elements of a color in parallel, without locks.
+//
+// The scatter maps are available for Cholesky, SparseCholesky, AMG
+// and CachedSuperLU; any other System is assembled serially through Add().
+// The maps stay valid as long as the system is not rebuilt.
+//
+template <class key>
+class Assembler
+{
+public:
+
+//	Constructors/destructors:
+
+	Assembler(System <key> &);
+	virtual ~Assembler() {}
+
+//	Accessors/mutators:
+
+	unsigned int Size() const { return (unsigned int)(Start.size() - 1); }
+	unsigned int Size(unsigned int e) const { return Start[e+1] - Start[e]; }
+	const key *Keys(unsigned int e) const { return &AllKeys[Start[e]]; }
+	unsigned int NumberOfColors() const { return ColorStart.empty() ? 0 : (unsigned int)(ColorStart.size() - 1); }
+
+//	General methods:
+
+	// register an element, returns its number
+	unsigned int Insert(const vector <key> &);
+	void Clear();
+
+	// add the local matrix K and vector f (either may be 0) of element e
+	void Add(unsigned int e, const double *K, const double *f);
+
+	// element(e, K, f, tid) fills the zeroed K and f of element e
+	template <class Element> void Assemble(Element &, bool Matrix = true, bool Vector = true);
+
+private:
+
+	enum Backend {GENERIC, CHOLESKY, SPARSECHOLESKY, MULTIGRID, SUPERLU};
+
+	// offset of an entry the system does not store; the offsets span
+	// the whole value array, n*n entries for Cholesky
+	static const ptrdiff_t None = -1 - (ptrdiff_t)(~(size_t)0 >> 1);
+
+	template <class Element> struct Body {
+		Assembler *A;
+		Element *E;
+		const unsigned int *Elements;
+		bool Matrix, Vector;
+		void operator () (int lo, int hi, int tid) {
+			vector <double> &K = A->KBuffer[tid], &f = A->fBuffer[tid];
+			for (int i = lo; i < hi; i++) {
+				const unsigned int e = Elements[i];
+				const unsigned int n = A->Size(e);
+				K.assign(n*n, 0.0); f.assign(n, 0.0);
+				(*E)(e, &K[0], &f[0], tid);
+				A->Scatter(e, Matrix ? &K[0] : 0, Vector ? &f[0] : 0);
+			}
+		}
+	};
+	template <class Element> friend struct Body;
+
+	double *Slot(key);
+	double *Slot(key, key);
+	void Modified();
+	void Scatter(unsigned int, const double *, const double *);
+	void Color();
+
+	System <key> &S;
+	Backend Kind;
+	double *Base1, *Base2;
+
+	// keys of the elements, and the offsets of their entries from
+	// Base2 (matrix) and Base1 (vector), the first entries stored
+	vector <unsigned int> Start;
+	vector <key> AllKeys;
+	vector <size_t> MatrixStart;
+	vector <ptrdiff_t> MatrixOffset;
+	vector <ptrdiff_t> VectorOffset;
+
+	// elements by color, the elements from Overflow on found no free
+	// color and are assembled serially
+	vector <unsigned int> ColorStart;
+	vector <unsigned int> ColorElements;
+	unsigned int Overflow;
+
+	vector < vector <double> > KBuffer, fBuffer;
+
+private:
+
+	Assembler(Assembler &);
+	void operator=(Assembler &);
+};
+
+template <class key>
+Assembler<key>::Assembler(System <key> &LS)
+: S(LS), Kind(GENERIC), Base1(0), Base2(0), Overflow(0)
+{
+	Clear();
+	if (dynamic_cast <Cholesky <key> *> (&S) != 0) Kind = CHOLESKY;
+	else if (dynamic_cast <SparseCholesky <key> *> (&S) != 0) Kind = SPARSECHOLESKY;
+	else if (dynamic_cast <AMG <key> *> (&S) != 0) Kind = MULTIGRID;
+#if !defined(_M4EXTREME_MPI_)
+	else if (dynamic_cast <CachedSuperLU <key> *> (&S) != 0) Kind = SUPERLU;
+#endif
+}
+
+template <class key>
+double *Assembler<key>::Slot(key K)
+{
+	switch (Kind) {
+	case CHOLESKY: return static_cast <Cholesky <key> &> (S).Slot(K);
+	case SPARSECHOLESKY: return static_cast <SparseCholesky <key> &> (S).Slot(K);
+	case MULTIGRID: return static_cast <AMG <key> &> (S).Slot(K);
+#if !defined(_M4EXTREME_MPI_)
+	case SUPERLU: return static_cast <CachedSuperLU <key> &> (S).Slot(K);
+#endif
+	default: return 0;
+	}
+}
+
+template <class key>
+double *Assembler<key>::Slot(key K1, key K2)
+{
+	switch (Kind) {
+	case CHOLESKY: return static_cast <Cholesky <key> &> (S).Slot(K1, K2);
+	case SPARSECHOLESKY: return static_cast <SparseCholesky <key> &> (S).Slot(K1, K2);
+	case MULTIGRID: return static_cast <AMG <key> &> (S).Slot(K1, K2);
+#if !defined(_M4EXTREME_MPI_)
+	case SUPERLU: return static_cast <CachedSuperLU <key> &> (S).Slot(K1, K2);
+#endif
+	default: return 0;
+	}
+}
+
+template <class key>
+void Assembler<key>::Modified()
+{
+	switch (Kind) {
+	case CHOLESKY: static_cast <Cholesky <key> &> (S).Modified(); break;
+	case SPARSECHOLESKY: static_cast <SparseCholesky <key> &> (S).Modified(); break;
+	case MULTIGRID: static_cast <AMG <key> &> (S).Modified(); break;
+#if !defined(_M4EXTREME_MPI_)
+	case SUPERLU: static_cast <CachedSuperLU <key> &> (S).Modified(); break;
+#endif
+	default: break;
+	}
+}
+
+template <class key>
+void Assembler<key>::Clear()
+{
+	Start.assign(1, 0);
+	AllKeys.clear();
+	MatrixStart.assign(1, 0);
+	MatrixOffset.clear();
+	VectorOffset.clear();
+	ColorStart.clear();
+	ColorElements.clear();
+	Overflow = 0;
+}
+
+template <class key>
+unsigned int Assembler<key>::Insert(const vector <key> &Keys)
+{
+	const unsigned int n = (unsigned int)Keys.size();
+	unsigned int i, j;
+
+	AllKeys.insert(AllKeys.end(), Keys.begin(), Keys.end());
+	Start.push_back(Start.back() + n);
+	MatrixStart.push_back(MatrixStart.back() + (size_t)n*n);
+	ColorStart.clear();
+
+	if (Kind == GENERIC) return Size() - 1;
+
+	// the value arrays of the system are contiguous, the first entry
+	// stored fixes their base
+	for (i = 0; i < n; i++) {
+		double *p = Slot(Keys[i]);
+		if (p != 0 && Base1 == 0) Base1 = p;
+		VectorOffset.push_back(p == 0 ? None : p - Base1);
+	}
+	for (j = 0; j < n; j++) {
+		for (i = 0; i < n; i++) {
+			double *p = Slot(Keys[i], Keys[j]);
+			if (p != 0 && Base2 == 0) Base2 = p;
+			MatrixOffset.push_back(p == 0 ? None : p - Base2);
+		}
+	}
+	return Size() - 1;
+}
+
+template <class key>
+void Assembler<key>::Scatter(unsigned int e, const double *K, const double *f)
+{
+	const unsigned int n = Size(e);
+	unsigned int i;
+
+	if (Kind == GENERIC) {
+		const key *k = Keys(e);
+		unsigned int j;
+		if (K != 0)
+			for (j = 0; j < n; j++)
+				for (i = 0; i < n; i++)
+					if (K[i + n*j] != 0.0) S.Add(k[i], k[j], K[i + n*j]);
+		if (f != 0)
+			for (i = 0; i < n; i++) S.Add(k[i], f[i]);
+		return;
+	}
+
+	if (K != 0) {
+		const ptrdiff_t *o = &MatrixOffset[MatrixStart[e]];
+		double * const a = Base2;
+		for (i = 0; i < n*n; i++)
+			if (o[i] != None) a[o[i]] += K[i];
+	}
+	if (f != 0) {
+		const ptrdiff_t *o = &VectorOffset[Start[e]];
+		double * const b = Base1;
+		for (i = 0; i < n; i++)
+			if (o[i] != None) b[o[i]] += f[i];
+	}
+}
+
+template <class key>
+void Assembler<key>::Add(unsigned int e, const double *K, const double *f)
+{
+	Scatter(e, K, f);
+	if (K != 0) Modified();
+}
+
+// greedy coloring, the colors in use by the elements of a key are
+// kept in a bit mask
+template <class key>
+void Assembler<key>::Color()
+{
+	const unsigned int ne = Size();
+	const unsigned int Colors = 64;
+	unsigned int e, i, c;
+
+	map <key, unsigned long long> used;
+	vector <unsigned int> color(ne);
+	vector <unsigned int> count(Colors + 1, 0);
+	for (e = 0; e < ne; e++) {
+		const key *k = Keys(e);
+		unsigned long long mask = 0;
+		for (i = 0; i < Size(e); i++) mask |= used[k[i]];
+		for (c = 0; c < Colors && (mask >> c & 1ULL); c++);
+		color[e] = c;
+		count[c]++;
+		if (c < Colors)
+			for (i = 0; i < Size(e); i++) used[k[i]] |= 1ULL << c;
+	}
+
+	vector <unsigned int> next(Colors + 1, 0);
+	ColorStart.assign(1, 0);
+	for (c = 0; c <= Colors; c++) {
+		next[c] = ColorStart.back();
+		if (c < Colors && count[c] == 0) continue;
+		ColorStart.push_back(ColorStart.back() + count[c]);
+	}
+	Overflow = ne - count[Colors];
+	ColorStart.pop_back();
+	ColorElements.resize(ne);
+	for (e = 0; e < ne; e++) ColorElements[next[color[e]]++] = e;
+}
+
+template <class key>
+template <class Element>
+void Assembler<key>::Assemble(Element &element, bool Matrix, bool Vector)
+{
+	m4extreme::Utils::TaskScheduler *scheduler = m4extreme::Utils::GetTaskScheduler();
+	if (scheduler != 0 && (scheduler->getNumberThreads() == 1 || scheduler->isRunning())) scheduler = 0;
+	if (Kind == GENERIC) scheduler = 0;
+
+	const unsigned int threads = scheduler != 0 ? (unsigned int)scheduler->getNumberThreads() : 1;
+	KBuffer.resize(threads);
+	fBuffer.resize(threads);
+
+	Body <Element> body;
+	body.A = this; body.E = &element;
+	body.Matrix = Matrix; body.Vector = Vector;
+
+	if (scheduler == 0) {
+		vector <unsigned int> all(Size());
+		for (unsigned int e = 0; e < Size(); e++) all[e] = e;
+		body.Elements = all.empty() ? 0 : &all[0];
+		body(0, (int)all.size(), 0);
+	} else {
+		if (ColorStart.empty()) Color();
+		for (unsigned int c = 0; c + 1 < ColorStart.size(); c++) {
+			body.Elements = &ColorElements[ColorStart[c]];
+			scheduler->parallel_for(0, (int)(ColorStart[c+1] - ColorStart[c]), 16, body);
+		}
+		if (Overflow < Size()) {
+			body.Elements = &ColorElements[Overflow];
+			body(0, (int)(Size() - Overflow), 0);
+		}
+	}
+	if (Matrix) Modified();
+}
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_ASSEMBLER__INCLUDED_)
@@ -48,6 +48,12 @@ public:
 	void Solve();
 	double Norm();
 
+//	Storage of an entry for direct assembly:
+
+	double *Slot(key K) { return &b[KeyMap[K]]; }
+	double *Slot(key K1, key K2) { return &a[KeyMap[K2]][KeyMap[K1]]; }
+	void Modified() {}
+
 private:
 
 	unsigned int n;
@@ -0,0 +1,381 @@
+// ElementMatrix.h: interface for the element matrix kernels.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_ELEMENTMATRIX__INCLUDED_)
+#define SOLVER_LINEAR_ELEMENTMATRIX__INCLUDED_
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <set>
+#include <cassert>
+#include <algorithm>
+
+#include "../../../Element/Element.h"
+#include "../../../Model/Static/Static.h"
+#include "../../../Model/ThermoMechanicalCoupling/TMModel.h"
+#include "../../../Threads/TaskScheduler.h"
+#include "../../ExplicitDynamics/NodalField.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class ElementMatrix
+//
+// Kernel of ElementOperator over the element tangents Element::Energy<2>
+// of a model: the matrix of every element is kept on its own, dense
+// over the Dim() values of its nodes, and kernel(e, x, y, tid) adds
+// its product into y, so the global matrix is never assembled.
+//
+// Setup records the nodes of every element as dense indices of the
+// field and must be called again whenever the supports change, like
+// ElementForce::Setup. Update evaluates the element matrices at the
+// current state, in parallel on the TaskScheduler; it is called
+// once per linear solve, the products then only read them.
+//////////////////////////////////////////////////////////////////////
+
+class ElementMatrix
+{
+public:
+
+	typedef Set::Manifold::Point dof_type;
+
+	ElementMatrix(const vector<Element::Energy<2> *> & DDE,
+		      const map<dof_type *, Set::Manifold::Map *> * Emb,
+		      NodalField * field, unsigned int ld,
+		      m4extreme::Utils::TaskScheduler * scheduler)
+	  : _DDE(DDE), _Emb(Emb), _field(field), _ld(ld), _scheduler(scheduler) {}
+
+	virtual ~ElementMatrix() {}
+
+	unsigned int size() const { return _DDE.size(); }
+	// values per node
+	unsigned int Dim() const { return _ld; }
+
+	// element to dense node adjacency, for ForceAccumulator::SetGraph
+	const vector<unsigned int> & GetOffsets() const { return _offsets; }
+	const vector<unsigned int> & GetNodes() const { return _nodes; }
+
+	void Setup() {
+	  const unsigned int nelem = _DDE.size();
+	  _offsets.assign(nelem + 1, 0);
+	  _start.assign(nelem + 1, 0);
+	  _nodes.clear();
+	  _dofs.clear();
+	  _embedded.assign(nelem, 0);
+
+	  set<dof_type *> nodes;
+	  for (unsigned int e = 0; e < nelem; ++e) {
+	    nodes = _DDE[e]->GetLocalState()->GetNodes();
+	    for (set<dof_type *>::const_iterator pN = nodes.begin(); pN != nodes.end(); ++pN) {
+	      const int id = _field->Index(*pN);
+	      if (id < 0) {
+		cerr << "node is not bound to the nodal field @Solver::Linear::ElementMatrix" << endl;
+		assert(false);
+	      }
+	      _nodes.push_back((unsigned int)id);
+	      _dofs.push_back(*pN);
+	      if (_Emb != 0) {
+		map<dof_type *, Set::Manifold::Map *>::const_iterator pE = _Emb->find(*pN);
+		if (pE != _Emb->end() && pE->second != 0) _embedded[e] = 1;
+	      }
+	      if (dynamic_cast<Set::Array *>(*pN) == 0) _embedded[e] = 1;
+	    }
+	    _offsets[e+1] = _nodes.size();
+	    const size_t m = (size_t)nodes.size() * _ld;
+	    _start[e+1] = _start[e] + m * m;
+	  }
+	  _matrix.assign(_start[nelem], 0.0);
+	}
+
+	// the element matrices at the current state
+	void Update() {
+	  m4extreme::Utils::TaskScheduler * s = _scheduler;
+	  if (s != 0 && (s->getNumberThreads() == 1 || s->isRunning())) s = 0;
+	  _reserve(s == 0 ? 1 : s->getNumberThreads());
+	  _Body body(this);
+	  if (s == 0) body(0, (int)_DDE.size(), 0);
+	  else s->parallel_for(0, (int)_DDE.size(), 16, body);
+	}
+
+	// y += K_e x
+	void operator () (unsigned int e, const double * x, double * y, int) const {
+	  const unsigned int k0 = _offsets[e], m = _offsets[e+1] - k0;
+	  const unsigned int me = m * _ld;
+	  const double * K = &_matrix[_start[e]];
+	  for (unsigned int b = 0; b < m; ++b) {
+	    const double * xb = x + (size_t)_nodes[k0 + b] * _ld;
+	    for (unsigned int j = 0; j < _ld; ++j) {
+	      const double xv = xb[j];
+	      if (xv == 0.0) continue;
+	      const double * Kc = K + (size_t)(b * _ld + j) * me;
+	      for (unsigned int a = 0; a < m; ++a) {
+		double * ya = y + (size_t)_nodes[k0 + a] * _ld;
+		for (unsigned int i = 0; i < _ld; ++i) ya[i] += Kc[a * _ld + i] * xv;
+	      }
+	    }
+	  }
+	}
+
+	// d += diagonal of K_e
+	void diagonal(unsigned int e, double * d, int) const {
+	  const unsigned int k0 = _offsets[e], m = _offsets[e+1] - k0;
+	  const unsigned int me = m * _ld;
+	  const double * K = &_matrix[_start[e]];
+	  for (unsigned int a = 0; a < m; ++a) {
+	    double * da = d + (size_t)_nodes[k0 + a] * _ld;
+	    for (unsigned int i = 0; i < _ld; ++i) {
+	      const unsigned int r = a * _ld + i;
+	      da[i] += K[r + (size_t)r * me];
+	    }
+	  }
+	}
+
+protected:
+
+	// evaluates the tangent of element e into _element(e)
+	virtual void _evaluate(unsigned int e, int tid) = 0;
+	// room for nthreads concurrent _evaluate
+	virtual void _reserve(int nthreads) = 0;
+
+	double * _element(unsigned int e) { return &_matrix[_start[e]]; }
+
+	// position of the node in element e, the nodes of an element are
+	// in address order; -1 if it is not a node of e
+	int _local(unsigned int e, dof_type * a) const {
+	  vector<dof_type *>::const_iterator first = _dofs.begin() + _offsets[e];
+	  vector<dof_type *>::const_iterator last = _dofs.begin() + _offsets[e+1];
+	  vector<dof_type *>::const_iterator p = lower_bound(first, last, a);
+	  return (p != last && *p == a) ? (int)(p - first) : -1;
+	}
+
+	vector<Element::Energy<2> *> _DDE;
+	const map<dof_type *, Set::Manifold::Map *> * _Emb;
+	NodalField * _field;
+	unsigned int _ld;
+	vector<unsigned int> _offsets;
+	vector<unsigned int> _nodes;
+	vector<dof_type *> _dofs;
+	vector<char> _embedded;
+
+private:
+
+	struct _Body {
+	  _Body(ElementMatrix * K) : K(K) {}
+	  ElementMatrix * K;
+	  void operator () (int lo, int hi, int tid) {
+	    for (int e = lo; e < hi; ++e) {
+	      double * Ke = K->_element(e);
+	      fill(Ke, &K->_matrix[0] + K->_start[e+1], 0.0);
+	      K->_evaluate(e, tid);
+	    }
+	  }
+	};
+	friend struct _Body;
+
+	m4extreme::Utils::TaskScheduler * _scheduler;
+	vector<size_t> _start;
+	vector<double> _matrix;
+
+private:
+
+	ElementMatrix(const ElementMatrix &);
+	ElementMatrix & operator = (const ElementMatrix &);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class ElementStiffness
+//
+// The element stiffness blocks H(a, b) of Element::Energy<2> in the
+// layout of the nodal field (Dim() values per node), for the Newton
+// steps of a mechanical model. The positions are read like in
+// ElementForce: the elements touching a constrained node go through
+// Embed and Submerge of the model local state. The padding components
+// of the constrained nodes carry nothing and must be passed to
+// ElementOperator::SetConstraints.
+//////////////////////////////////////////////////////////////////////
+
+class ElementStiffness : public ElementMatrix
+{
+public:
+
+	typedef map<dof_type *, Set::VectorSpace::Vector> vector_type;
+	typedef map<pair<dof_type *, dof_type *>, Set::VectorSpace::Hom> hom_type;
+
+	ElementStiffness(const vector<Element::Energy<2> *> & DDE,
+			 Model::Static::LocalState * LS,
+			 const map<dof_type *, Set::Manifold::Map *> * Emb,
+			 NodalField * field,
+			 m4extreme::Utils::TaskScheduler * scheduler = m4extreme::Utils::GetTaskScheduler())
+	  : ElementMatrix(DDE, Emb, field, field->Dim(), scheduler), _LS(LS) {
+	  Setup();
+	}
+
+	virtual ~ElementStiffness() {}
+
+protected:
+
+	void _reserve(int nthreads) {
+	  if ((int)_scratch.size() < nthreads) _scratch.resize(nthreads);
+	}
+
+	void _evaluate(unsigned int e, int tid) {
+	  assert(tid >= 0 && tid < (int)_scratch.size());
+	  _Scratch & S = _scratch[tid];
+	  const unsigned int k0 = _offsets[e], k1 = _offsets[e+1];
+
+	  S.yemb.clear();
+	  if (_embedded[e]) {
+	    S.nodes.clear();
+	    S.nodes.insert(_dofs.begin() + k0, _dofs.begin() + k1);
+	    _LS->Model::Static::LocalState::Embed(S.nodes, S.yemb);
+	  }
+	  else {
+	    for (unsigned int k = k0; k < k1; ++k) {
+	      const Set::Array * xk = dynamic_cast<Set::Array *>(_dofs[k]);
+	      S.yemb.insert(S.yemb.end(),
+			    make_pair(_dofs[k], Set::VectorSpace::Vector(xk->size(), xk->begin())));
+	    }
+	  }
+
+	  S.Ke = (*_DDE[e])(S.yemb);
+	  const hom_type * Ke = &S.Ke;
+	  if (_embedded[e]) {
+	    S.Ksub.clear();
+	    _LS->Submerge(S.Ke, S.Ksub);
+	    Ke = &S.Ksub;
+	  }
+
+	  const unsigned int me = (k1 - k0) * _ld;
+	  double * K = _element(e);
+	  for (hom_type::const_iterator pH = Ke->begin(); pH != Ke->end(); ++pH) {
+	    const int a = _local(e, pH->first.first), b = _local(e, pH->first.second);
+	    if (a < 0 || b < 0) continue;
+	    const Set::VectorSpace::Hom & h = pH->second;
+	    const unsigned int m1 = min(h.size1(), _ld), m2 = min(h.size2(), _ld);
+	    const double * p = h.begin();
+	    for (unsigned int j = 0; j < m2; ++j)
+	      for (unsigned int i = 0; i < m1; ++i)
+		K[(a * _ld + i) + (size_t)(b * _ld + j) * me] += p[i + h.size1() * j];
+	  }
+	}
+
+private:
+
+	struct _Scratch {
+	  set<dof_type *> nodes;
+	  vector_type yemb;
+	  hom_type Ke;
+	  hom_type Ksub;
+	};
+
+	Model::Static::LocalState * _LS;
+	vector<_Scratch> _scratch;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class ElementConductivity
+//
+// The element conductivities of the thermo-mechanical models, the
+// scalar Element::Energy<2> of TMCoupling, one value per node: the
+// operator of the temperature correction K dT = -r of a semi-implicit
+// step, to be solved by CG with Jacobi. The nodes hold the position
+// followed by the temperature; the elements touching a constrained
+// node go through Embed and Submerge of the TMCoupling local state.
+//
+// The ElementOperator is built with ld = 1, and a NodalExchange given
+// to it must exchange one value per node.
+//////////////////////////////////////////////////////////////////////
+
+class ElementConductivity : public ElementMatrix
+{
+public:
+
+	typedef map<dof_type *, Set::VectorSpace::Vector> vector_type;
+	typedef map<dof_type *, double> scalar_type;
+	typedef map<pair<dof_type *, dof_type *>, double> scalarset_type;
+
+	ElementConductivity(const vector<Element::Energy<2> *> & DDE,
+			    Model::MaterialPoint::TMCoupling::LocalState * LS,
+			    const map<dof_type *, Set::Manifold::Map *> * Emb,
+			    NodalField * field,
+			    m4extreme::Utils::TaskScheduler * scheduler = m4extreme::Utils::GetTaskScheduler())
+	  : ElementMatrix(DDE, Emb, field, 1, scheduler), _LS(LS) {
+	  Setup();
+	}
+
+	virtual ~ElementConductivity() {}
+
+protected:
+
+	void _reserve(int nthreads) {
+	  if ((int)_scratch.size() < nthreads) _scratch.resize(nthreads);
+	}
+
+	void _evaluate(unsigned int e, int tid) {
+	  assert(tid >= 0 && tid < (int)_scratch.size());
+	  _Scratch & S = _scratch[tid];
+	  const unsigned int k0 = _offsets[e], k1 = _offsets[e+1];
+
+	  S.yemb.clear();
+	  S.temb.clear();
+	  if (_embedded[e]) {
+	    S.nodes.clear();
+	    S.nodes.insert(_dofs.begin() + k0, _dofs.begin() + k1);
+	    _LS->Embed(S.nodes, S.yemb);
+	    _LS->Embed(S.nodes, S.temb);
+	  }
+	  else {
+	    for (unsigned int k = k0; k < k1; ++k) {
+	      const Set::Array * xk = dynamic_cast<Set::Array *>(_dofs[k]);
+	      S.yemb.insert(S.yemb.end(),
+			    make_pair(_dofs[k], Set::VectorSpace::Vector(xk->size() - 1, xk->begin())));
+	      S.temb.insert(S.temb.end(), make_pair(_dofs[k], *(xk->end() - 1)));
+	    }
+	  }
+
+	  S.Ke.clear();
+	  (*_DDE[e])(S.yemb, S.temb, S.Ke);
+	  const scalarset_type * Ke = &S.Ke;
+	  if (_embedded[e]) {
+	    S.Ksub.clear();
+	    _LS->Submerge(S.Ke, S.Ksub);
+	    Ke = &S.Ksub;
+	  }
+
+	  const unsigned int me = k1 - k0;
+	  double * K = _element(e);
+	  for (scalarset_type::const_iterator pK = Ke->begin(); pK != Ke->end(); ++pK) {
+	    const int a = _local(e, pK->first.first), b = _local(e, pK->first.second);
+	    if (a < 0 || b < 0) continue;
+	    K[a + (size_t)b * me] += pK->second;
+	  }
+	}
+
+private:
+
+	struct _Scratch {
+	  set<dof_type *> nodes;
+	  vector_type yemb;
+	  scalar_type temb;
+	  scalarset_type Ke;
+	  scalarset_type Ksub;
+	};
+
+	Model::MaterialPoint::TMCoupling::LocalState * _LS;
+	vector<_Scratch> _scratch;
+};
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_ELEMENTMATRIX__INCLUDED_)
@@ -0,0 +1,508 @@
+// Krylov.h: interface for the Krylov solvers.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_KRYLOV__INCLUDED_)
+#define SOLVER_LINEAR_KRYLOV__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "../../../Threads/TaskScheduler.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class Operator
+//
+// y = A x on flat arrays, e.g. in the layout of a NodalField. The
+// operator is never assembled into a System; see Operators.h.
+//////////////////////////////////////////////////////////////////////
+
+class Operator
+{
+public:
+
+	virtual ~Operator() {}
+
+	virtual unsigned int Size() const = 0;
+	virtual void operator () (const double * x, double * y) = 0;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class Preconditioner
+//
+// z = M^{-1} r, a fixed linear map; see Preconditioners.h.
+//////////////////////////////////////////////////////////////////////
+
+class Preconditioner
+{
+public:
+
+	virtual ~Preconditioner() {}
+
+	virtual void operator () (const double * r, double * z) = 0;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class KrylovSpace
+//
+// The vector operations of the Krylov solvers on arrays of Size()
+// entries, run on the TaskScheduler. The inner products are summed
+// per chunk of a fixed size and the chunks in order, so they do not
+// depend on the number of threads.
+//
+// On partitioned meshes the entries at shared nodes appear on several
+// partitions: SetWeights gives each entry the inverse of its
+// multiplicity and Reduce sums the partial products over the
+// partitions (see m4extreme::MPI_KrylovSpace).
+//////////////////////////////////////////////////////////////////////
+
+class KrylovSpace
+{
+public:
+
+	KrylovSpace(unsigned int n,
+		    m4extreme::Utils::TaskScheduler * scheduler = m4extreme::Utils::GetTaskScheduler())
+	  : _n(n), _scheduler(scheduler) {}
+
+	virtual ~KrylovSpace() {}
+
+	unsigned int Size() const { return _n; }
+
+	// weights of the entries in the inner products, e.g. 1/multiplicity
+	void SetWeights(const double * w) {
+	  if (w == 0) _w.clear();
+	  else _w.assign(w, w + _n);
+	}
+	const double * GetWeights() const { return _w.empty() ? 0 : &_w[0]; }
+
+	// sum count values over the partitions
+	virtual void Reduce(double * /*v*/, int /*count*/) {}
+
+	// y = a x + b y
+	void Axpby(double a, const double * x, double b, double * y) {
+	  _Loop L(this, AXPBY);
+	  L.a = a; L.b = b; L.x = x; L.y = y;
+	  _run(L);
+	}
+
+	// z = x y entrywise
+	void Multiply(const double * x, const double * y, double * z) {
+	  _Loop L(this, MULTIPLY);
+	  L.x = x; L.y = z; L.z = y;
+	  _run(L);
+	}
+
+	void Copy(const double * x, double * y) { Axpby(1.0, x, 0.0, y); }
+	void Zero(double * y) { Axpby(0.0, y, 0.0, y); }
+
+	double Dot(const double * x, const double * y) {
+	  double h;
+	  const double * X[1] = { x };
+	  Dot(1, X, y, &h);
+	  return h;
+	}
+
+	double Norm(const double * x) { return sqrt(Dot(x, x)); }
+
+	// h[k] = (V[k], y) for k < m, with one reduction
+	void Dot(unsigned int m, const double * const * V, const double * y, double * h) {
+	  const unsigned int chunks = (_n + _chunk - 1) / _chunk;
+	  _partial.assign((size_t)chunks * m, 0.0);
+	  _Loop L(this, DOT);
+	  L.m = m; L.V = V; L.x = y;
+	  _run(L);
+	  for (unsigned int k = 0; k < m; ++k) h[k] = 0.0;
+	  for (unsigned int c = 0; c < chunks; ++c)
+	    for (unsigned int k = 0; k < m; ++k) h[k] += _partial[(size_t)c * m + k];
+	  Reduce(h, (int)m);
+	}
+
+private:
+
+	enum OP { AXPBY = 0, MULTIPLY = 1, DOT = 2 };
+
+	static const unsigned int _chunk = 4096;
+
+	struct _Loop {
+	  _Loop(KrylovSpace * s, OP o) : S(s), op(o), a(0), b(0), x(0), y(0), z(0), m(0), V(0) {}
+	  KrylovSpace * S;
+	  OP op;
+	  double a, b;
+	  const double * x;
+	  double * y;
+	  const double * z;
+	  unsigned int m;
+	  const double * const * V;
+	  void operator () (int lo, int hi, int) {
+	    switch (op) {
+	    case AXPBY:
+	      if (a == 0.0 && b == 0.0) for (int i = lo; i < hi; ++i) y[i] = 0.0;
+	      else if (b == 0.0) for (int i = lo; i < hi; ++i) y[i] = a * x[i];
+	      else for (int i = lo; i < hi; ++i) y[i] = a * x[i] + b * y[i];
+	      break;
+	    case MULTIPLY:
+	      for (int i = lo; i < hi; ++i) y[i] = x[i] * z[i];
+	      break;
+	    case DOT: {
+	      const double * w = S->GetWeights();
+	      double * h = &S->_partial[(size_t)(lo / _chunk) * m];
+	      for (unsigned int k = 0; k < m; ++k) {
+		const double * __restrict__ v = V[k];
+		double s = 0.0;
+		if (w == 0) for (int i = lo; i < hi; ++i) s += v[i] * x[i];
+		else for (int i = lo; i < hi; ++i) s += w[i] * v[i] * x[i];
+		h[k] = s;
+	      }
+	      break;
+	    }
+	    }
+	  }
+	};
+	friend struct _Loop;
+
+	void _run(_Loop & L) {
+	  if (_scheduler == 0 || _scheduler->isRunning() || _n <= _chunk) {
+	    for (unsigned int lo = 0; lo < _n; lo += _chunk) L(lo, min(_n, lo + _chunk), 0);
+	  } else {
+	    _scheduler->parallel_for(0, (int)_n, (int)_chunk, L);
+	  }
+	}
+
+	unsigned int _n;
+	m4extreme::Utils::TaskScheduler * _scheduler;
+	vector<double> _w;
+	vector<double> _partial;
+
+private:
+
+	KrylovSpace(const KrylovSpace &);
+	void operator=(const KrylovSpace &);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class Krylov
+//
+// Base of the Krylov solvers. Solve(A, M, b, x) starts from the given
+// x and stops once the residual norm is below Tolerance * |b| (the
+// norm of the preconditioned residual for MINRES), or after
+// MaxIterations; M may be 0.
+//////////////////////////////////////////////////////////////////////
+
+class Krylov
+{
+public:
+
+	Krylov(KrylovSpace & S, double tolerance = 1.0e-8, unsigned int maxit = 1000)
+	  : _S(S), _tolerance(tolerance), _maxit(maxit), _iterations(0), _residual(0.0) {}
+
+	virtual ~Krylov() {}
+
+	void SetTolerance(double tolerance) { _tolerance = tolerance; }
+	void SetMaxIterations(unsigned int maxit) { _maxit = maxit; }
+
+	unsigned int GetIterations() const { return _iterations; }
+	// relative residual at exit
+	double GetResidual() const { return _residual; }
+	bool Converged() const { return _residual <= _tolerance; }
+
+	// returns true if converged
+	virtual bool Solve(Operator & A, Preconditioner * M, const double * b, double * x) = 0;
+
+protected:
+
+	void _precondition(Preconditioner * M, const double * r, double * z) {
+	  if (M == 0) _S.Copy(r, z);
+	  else (*M)(r, z);
+	}
+
+	KrylovSpace & _S;
+	double _tolerance;
+	unsigned int _maxit;
+	unsigned int _iterations;
+	double _residual;
+
+private:
+
+	Krylov(const Krylov &);
+	void operator=(const Krylov &);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class CG
+//
+// Preconditioned conjugate gradients, A and M symmetric positive
+// definite.
+//////////////////////////////////////////////////////////////////////
+
+class CG : public Krylov
+{
+public:
+
+	CG(KrylovSpace & S, double tolerance = 1.0e-8, unsigned int maxit = 1000)
+	  : Krylov(S, tolerance, maxit) {}
+
+	virtual ~CG() {}
+
+	bool Solve(Operator & A, Preconditioner * M, const double * b, double * x) {
+	  const unsigned int n = _S.Size();
+	  _r.resize(n); _z.resize(n); _p.resize(n); _q.resize(n);
+	  double * r = &_r[0], * z = &_z[0], * p = &_p[0], * q = &_q[0];
+
+	  const double bnorm = _S.Norm(b);
+	  _iterations = 0;
+	  if (bnorm == 0.0) {
+	    _S.Zero(x);
+	    _residual = 0.0;
+	    return true;
+	  }
+
+	  A(x, r);
+	  _S.Axpby(1.0, b, -1.0, r);
+	  _residual = _S.Norm(r) / bnorm;
+	  if (_residual <= _tolerance) return true;
+
+	  _precondition(M, r, z);
+	  _S.Copy(z, p);
+	  double rz = _S.Dot(r, z);
+
+	  while (_iterations < _maxit) {
+	    A(p, q);
+	    const double pq = _S.Dot(p, q);
+	    if (pq <= 0.0) break;
+	    const double alpha = rz / pq;
+	    _S.Axpby(alpha, p, 1.0, x);
+	    _S.Axpby(-alpha, q, 1.0, r);
+	    ++_iterations;
+
+	    _residual = _S.Norm(r) / bnorm;
+	    if (_residual <= _tolerance) return true;
+
+	    _precondition(M, r, z);
+	    const double rznew = _S.Dot(r, z);
+	    _S.Axpby(1.0, z, rznew / rz, p);
+	    rz = rznew;
+	  }
+	  return Converged();
+	}
+
+private:
+
+	vector<double> _r, _z, _p, _q;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class MINRES
+//
+// Preconditioned minimal residual method (Paige and Saunders), A
+// symmetric, possibly indefinite, and M symmetric positive definite.
+// The residual is the M^{-1}-norm estimate of the recurrence.
+//////////////////////////////////////////////////////////////////////
+
+class MINRES : public Krylov
+{
+public:
+
+	MINRES(KrylovSpace & S, double tolerance = 1.0e-8, unsigned int maxit = 1000)
+	  : Krylov(S, tolerance, maxit) {}
+
+	virtual ~MINRES() {}
+
+	bool Solve(Operator & A, Preconditioner * M, const double * b, double * x) {
+	  const unsigned int n = _S.Size();
+	  _r1.resize(n); _r2.resize(n); _y.resize(n); _v.resize(n);
+	  _w.resize(n); _w1.resize(n); _w2.resize(n);
+	  double * r1 = &_r1[0], * r2 = &_r2[0], * y = &_y[0], * v = &_v[0];
+	  double * w = &_w[0], * w1 = &_w1[0], * w2 = &_w2[0];
+
+	  _iterations = 0;
+	  if (_S.Norm(b) == 0.0) {
+	    _S.Zero(x);
+	    _residual = 0.0;
+	    return true;
+	  }
+
+	  A(x, r1);
+	  _S.Axpby(1.0, b, -1.0, r1);
+	  _precondition(M, r1, y);
+	  double beta1 = _S.Dot(r1, y);
+	  _precondition(M, b, v);
+	  const double bnorm = sqrt(fabs(_S.Dot(b, v)));
+	  if (beta1 <= 0.0 || bnorm == 0.0) {
+	    _residual = 0.0;
+	    return beta1 == 0.0;
+	  }
+	  beta1 = sqrt(beta1);
+	  _residual = beta1 / bnorm;
+	  if (_residual <= _tolerance) return true;
+
+	  _S.Copy(r1, r2);
+	  _S.Zero(w); _S.Zero(w2);
+	  double oldb = 0.0, beta = beta1, dbar = 0.0, epsln = 0.0;
+	  double phibar = beta1, cs = -1.0, sn = 0.0;
+
+	  while (_iterations < _maxit) {
+	    // Lanczos step
+	    _S.Axpby(1.0 / beta, y, 0.0, v);
+	    A(v, y);
+	    if (_iterations > 0) _S.Axpby(-beta / oldb, r1, 1.0, y);
+	    const double alfa = _S.Dot(v, y);
+	    _S.Axpby(-alfa / beta, r2, 1.0, y);
+	    swap(_r1, _r2); r1 = &_r1[0]; r2 = &_r2[0];
+	    _S.Copy(y, r2);
+	    _precondition(M, r2, y);
+	    oldb = beta;
+	    beta = _S.Dot(r2, y);
+	    if (beta < 0.0) break;
+	    beta = sqrt(beta);
+
+	    // QR update of the tridiagonal
+	    const double oldeps = epsln;
+	    const double delta = cs * dbar + sn * alfa;
+	    const double gbar = sn * dbar - cs * alfa;
+	    epsln = sn * beta;
+	    dbar = -cs * beta;
+	    double gamma = sqrt(gbar * gbar + beta * beta);
+	    if (gamma == 0.0) gamma = 1.0e-300;
+	    cs = gbar / gamma;
+	    sn = beta / gamma;
+	    const double phi = cs * phibar;
+	    phibar = sn * phibar;
+
+	    // w = (v - oldeps w1 - delta w2) / gamma
+	    swap(_w1, _w2); swap(_w2, _w); w = &_w[0]; w1 = &_w1[0]; w2 = &_w2[0];
+	    _S.Axpby(1.0 / gamma, v, 0.0, w);
+	    _S.Axpby(-oldeps / gamma, w1, 1.0, w);
+	    _S.Axpby(-delta / gamma, w2, 1.0, w);
+	    _S.Axpby(phi, w, 1.0, x);
+	    ++_iterations;
+
+	    _residual = phibar / bnorm;
+	    if (_residual <= _tolerance || beta == 0.0) break;
+	  }
+	  return Converged();
+	}
+
+private:
+
+	vector<double> _r1, _r2, _y, _v, _w, _w1, _w2;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class GMRES
+//
+// Restarted GMRES(m) with right preconditioning, so that the residual
+// is the true one, and classical Gram-Schmidt with one reorthogonal-
+// ization: the inner products of a step take two reductions.
+//////////////////////////////////////////////////////////////////////
+
+class GMRES : public Krylov
+{
+public:
+
+	GMRES(KrylovSpace & S, unsigned int restart = 30,
+	      double tolerance = 1.0e-8, unsigned int maxit = 1000)
+	  : Krylov(S, tolerance, maxit), _m(restart > 0 ? restart : 1) {}
+
+	virtual ~GMRES() {}
+
+	bool Solve(Operator & A, Preconditioner * M, const double * b, double * x) {
+	  const unsigned int n = _S.Size();
+	  _V.resize((size_t)(_m + 1) * n);
+	  _z.resize(n);
+	  _H.assign((size_t)(_m + 1) * _m, 0.0);
+	  _cs.resize(_m); _sn.resize(_m); _g.resize(_m + 1); _h.resize(_m + 1);
+	  vector<const double *> V(_m + 1);
+	  for (unsigned int k = 0; k <= _m; ++k) V[k] = &_V[(size_t)k * n];
+
+	  const double bnorm = _S.Norm(b);
+	  _iterations = 0;
+	  if (bnorm == 0.0) {
+	    _S.Zero(x);
+	    _residual = 0.0;
+	    return true;
+	  }
+
+	  for (;;) {
+	    double * v0 = &_V[0];
+	    A(x, v0);
+	    _S.Axpby(1.0, b, -1.0, v0);
+	    const double beta = _S.Norm(v0);
+	    _residual = beta / bnorm;
+	    if (_residual <= _tolerance || _iterations >= _maxit) break;
+	    _S.Axpby(1.0 / beta, v0, 0.0, v0);
+	    _g.assign(_m + 1, 0.0);
+	    _g[0] = beta;
+
+	    unsigned int k = 0;
+	    for (; k < _m && _iterations < _maxit; ++k) {
+	      double * w = &_V[(size_t)(k + 1) * n];
+	      _precondition(M, V[k], &_z[0]);
+	      A(&_z[0], w);
+	      double * Hk = &_H[(size_t)k * (_m + 1)];
+	      for (unsigned int pass = 0; pass < 2; ++pass) {
+		_S.Dot(k + 1, &V[0], w, &_h[0]);
+		for (unsigned int i = 0; i <= k; ++i) {
+		  Hk[i] += _h[i];
+		  _S.Axpby(-_h[i], V[i], 1.0, w);
+		}
+	      }
+	      Hk[k + 1] = _S.Norm(w);
+	      if (Hk[k + 1] > 0.0) _S.Axpby(1.0 / Hk[k + 1], w, 0.0, w);
+
+	      // Givens rotations
+	      for (unsigned int i = 0; i < k; ++i) {
+		const double t = _cs[i] * Hk[i] + _sn[i] * Hk[i + 1];
+		Hk[i + 1] = -_sn[i] * Hk[i] + _cs[i] * Hk[i + 1];
+		Hk[i] = t;
+	      }
+	      const double r = sqrt(Hk[k] * Hk[k] + Hk[k + 1] * Hk[k + 1]);
+	      _cs[k] = r == 0.0 ? 1.0 : Hk[k] / r;
+	      _sn[k] = r == 0.0 ? 0.0 : Hk[k + 1] / r;
+	      Hk[k] = r;
+	      Hk[k + 1] = 0.0;
+	      _g[k + 1] = -_sn[k] * _g[k];
+	      _g[k] = _cs[k] * _g[k];
+	      ++_iterations;
+
+	      _residual = fabs(_g[k + 1]) / bnorm;
+	      if (_residual <= _tolerance) { ++k; break; }
+	    }
+
+	    // x += M^{-1} V y with H y = g
+	    for (unsigned int i = k; i-- > 0;) {
+	      double s = _g[i];
+	      for (unsigned int j = i + 1; j < k; ++j) s -= _H[(size_t)j * (_m + 1) + i] * _g[j];
+	      _g[i] = s / _H[(size_t)i * (_m + 1) + i];
+	    }
+	    _S.Zero(&_V[(size_t)_m * n]);
+	    double * u = &_V[(size_t)_m * n];
+	    for (unsigned int i = 0; i < k; ++i) _S.Axpby(_g[i], V[i], 1.0, u);
+	    _precondition(M, u, &_z[0]);
+	    _S.Axpby(1.0, &_z[0], 1.0, x);
+	    _H.assign(_H.size(), 0.0);
+	  }
+	  return Converged();
+	}
+
+private:
+
+	unsigned int _m;
+	vector<double> _V, _z, _H, _cs, _sn, _g, _h;
+};
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_KRYLOV__INCLUDED_)
@@ -0,0 +1,151 @@
+// KrylovSystem.h: interface for the KrylovSystem class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_KRYLOVSYSTEM__INCLUDED_)
+#define SOLVER_LINEAR_KRYLOVSYSTEM__INCLUDED_
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <numeric>
+#include <iostream>
+
+#include "../Linear.h"
+#include "./Krylov.h"
+#include "./Preconditioners.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class KrylovSystem
+//
+// A System for the symmetric positive definite systems that are still
+// filled entry by entry, e.g. the conductivity of
+// TMSemiImplicitDynamics::SolvingTemperature (see
+// TMSemiImplicitDynamics::SetImplicitSolver). The entries are kept in
+// sparse rows, and Solve runs CG with Jacobi instead of a direct
+// factorization; the right hand side is overwritten by the solution,
+// as in SuperLU_V4. The pattern grows with the entries set and is
+// kept by SetToZero2.
+//////////////////////////////////////////////////////////////////////
+
+template <class key>
+class KrylovSystem : public System<key>
+{
+public:
+
+	KrylovSystem(const vector<key> & Keys, double tolerance = 1.0e-10, unsigned int maxit = 1000,
+		     m4extreme::Utils::TaskScheduler * scheduler = m4extreme::Utils::GetTaskScheduler())
+	  : _n(Keys.size()), _rows(Keys.size()), _b(Keys.size(), 0.0),
+	    _S(Keys.size(), scheduler), _cg(_S, tolerance, maxit), _A(this) {
+	  if (_n == 0) throw (0);
+	  for (unsigned int i = 0; i < _n; ++i) _KeyMap.insert(make_pair(Keys[i], i));
+	}
+
+	virtual ~KrylovSystem() {}
+
+	unsigned int GetIterations() const { return _cg.GetIterations(); }
+
+	double Get(key K) { return _b[_index(K)]; }
+
+	double Get(key K1, key K2) {
+	  const map<unsigned int, double> & row = _rows[_index(K1)];
+	  typename map<unsigned int, double>::const_iterator p = row.find(_index(K2));
+	  return p == row.end() ? 0.0 : p->second;
+	}
+
+	void Set(key K, double Input) { _b[_index(K)] = Input; }
+	void Set(key K1, key K2, double Input) { _rows[_index(K1)][_index(K2)] = Input; }
+
+	void SetToZero1() { fill(_b.begin(), _b.end(), 0.0); }
+
+	void SetToZero2() {
+	  for (unsigned int i = 0; i < _n; ++i)
+	    for (map<unsigned int, double>::iterator p = _rows[i].begin(); p != _rows[i].end(); ++p) p->second = 0.0;
+	}
+
+	void Add(key K, double Input) { _b[_index(K)] += Input; }
+	void Add(key K1, key K2, double Input) { _rows[_index(K1)][_index(K2)] += Input; }
+
+	double Norm() { return sqrt(inner_product(_b.begin(), _b.end(), _b.begin(), 0.0)); }
+
+	void Solve() {
+	  // compressed rows of the current entries
+	  _start.assign(_n + 1, 0);
+	  _column.clear();
+	  _value.clear();
+	  _diagonal.assign(_n, 0.0);
+	  for (unsigned int i = 0; i < _n; ++i) {
+	    for (map<unsigned int, double>::const_iterator p = _rows[i].begin(); p != _rows[i].end(); ++p) {
+	      if (p->second == 0.0) continue;
+	      _column.push_back(p->first);
+	      _value.push_back(p->second);
+	      if (p->first == i) _diagonal[i] = p->second;
+	    }
+	    _start[i+1] = _column.size();
+	  }
+
+	  Jacobi M(_S, &_diagonal[0]);
+	  _x.assign(_n, 0.0);
+	  if (!_cg.Solve(_A, &M, &_b[0], &_x[0])) {
+	    cout << "Solver::Linear::KrylovSystem CG did not converge, residual "
+		 << _cg.GetResidual() << " after " << _cg.GetIterations() << " iterations" << endl;
+	    throw (0);
+	  }
+	  _b.swap(_x);
+	}
+
+private:
+
+	struct _Matrix : public Operator {
+	  _Matrix(KrylovSystem * K) : K(K) {}
+	  KrylovSystem * K;
+	  unsigned int Size() const { return K->_n; }
+	  void operator () (const double * x, double * y) {
+	    for (unsigned int i = 0; i < K->_n; ++i) {
+	      double s = 0.0;
+	      for (unsigned int k = K->_start[i]; k < K->_start[i+1]; ++k) s += K->_value[k] * x[K->_column[k]];
+	      y[i] = s;
+	    }
+	  }
+	};
+	friend struct _Matrix;
+
+	unsigned int _index(key K) const {
+	  typename map<key, unsigned int>::const_iterator p = _KeyMap.find(K);
+	  if (p == _KeyMap.end()) {
+	    cout << "Solver::Linear::KrylovSystem unknown key" << endl;
+	    throw (0);
+	  }
+	  return p->second;
+	}
+
+	unsigned int _n;
+	map<key, unsigned int> _KeyMap;
+	vector<map<unsigned int, double> > _rows;
+	vector<double> _b, _x;
+	vector<unsigned int> _start, _column;
+	vector<double> _value, _diagonal;
+	KrylovSpace _S;
+	CG _cg;
+	_Matrix _A;
+
+private:
+
+	KrylovSystem(KrylovSystem &);
+	void operator=(KrylovSystem &);
+};
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_KRYLOVSYSTEM__INCLUDED_)
@@ -0,0 +1,308 @@
+// Operators.h: interface for the Krylov operators.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_OPERATORS__INCLUDED_)
+#define SOLVER_LINEAR_OPERATORS__INCLUDED_
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "./Krylov.h"
+#include "../../ExplicitDynamics/NodalField.h"
+#include "../../ExplicitDynamics/ForceAccumulator.h"
+#include "../../ExplicitDynamics/Overlap.h"
+#include "../../../Set/Manifold/Manifold.h"
+#include "../../../Set/Algebraic/VectorSpace/Category/Category.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class ElementOperator
+//
+// Matrix-free y = A x, the sum of element (or material point)
+// products computed on the fly. The kernel is called as
+// kernel(e, x, y, tid) and adds the product of element e into y; the
+// contributions are scattered by a ForceAccumulator as the internal
+// forces of an explicit step, and with a NodalExchange the entries
+// of y at the shared nodes are summed over the partitions.
+//
+// The constrained entries are taken out of the products and carry
+// the identity, so that A stays symmetric; the right hand side must
+// hold the prescribed values (usually zero increments) there.
+//
+// Diagonal() requires kernel.diagonal(e, d, tid), which adds the
+// diagonal of element e into d.
+//////////////////////////////////////////////////////////////////////
+
+template<class Kernel>
+class ElementOperator : public Operator
+{
+public:
+
+	ElementOperator(Kernel * kernel, unsigned int nelem, unsigned int n, unsigned int ld,
+			ForceAccumulator * accumulator = 0, NodalExchange * exchange = 0)
+	  : _kernel(kernel), _nelem(nelem), _n(n), _ld(ld),
+	    _accumulator(accumulator), _exchange(exchange) {}
+
+	virtual ~ElementOperator() {}
+
+	unsigned int Size() const { return _n * _ld; }
+
+	// flat indices of the constrained entries
+	void SetConstraints(const vector<unsigned int> & entries) {
+	  _constrained = entries;
+	}
+
+	void operator () (const double * x, double * y) {
+	  const double * xin = x;
+	  if (!_constrained.empty()) {
+	    _x.assign(x, x + Size());
+	    for (size_t k = 0; k < _constrained.size(); ++k) _x[_constrained[k]] = 0.0;
+	    xin = &_x[0];
+	  }
+	  memset(y, 0, Size() * sizeof(double));
+	  _Product body(_kernel, xin);
+	  _accumulate(body, y);
+	  for (size_t k = 0; k < _constrained.size(); ++k) y[_constrained[k]] = x[_constrained[k]];
+	}
+
+	void Diagonal(double * d) {
+	  memset(d, 0, Size() * sizeof(double));
+	  _Diagonal body(_kernel);
+	  _accumulate(body, d);
+	  for (size_t k = 0; k < _constrained.size(); ++k) d[_constrained[k]] = 1.0;
+	}
+
+private:
+
+	struct _Product {
+	  _Product(Kernel * k, const double * x) : k(k), x(x) {}
+	  Kernel * k;
+	  const double * x;
+	  void operator () (unsigned int e, double * y, int tid) { (*k)(e, x, y, tid); }
+	};
+
+	struct _Diagonal {
+	  _Diagonal(Kernel * k) : k(k) {}
+	  Kernel * k;
+	  void operator () (unsigned int e, double * d, int tid) { k->diagonal(e, d, tid); }
+	};
+
+	template<class Body>
+	void _accumulate(Body & body, double * y) {
+	  if (_accumulator != 0) (*_accumulator)(_nelem, body, y, _n, _ld);
+	  else for (unsigned int e = 0; e < _nelem; ++e) body(e, y, 0);
+	  if (_exchange != 0) {
+	    _exchange->Begin(y);
+	    _exchange->End(y);
+	  }
+	}
+
+	Kernel * _kernel;
+	unsigned int _nelem, _n, _ld;
+	ForceAccumulator * _accumulator;
+	NodalExchange * _exchange;
+	vector<unsigned int> _constrained;
+	vector<double> _x;
+
+private:
+
+	ElementOperator(const ElementOperator &);
+	void operator=(const ElementOperator &);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class BlockOperator
+//
+// y = A x for the node-block matrix of a second derivative, e.g.
+// Model::Energy<2>::range_type or the second part of a
+// Model::Jet<1>::range_type, in the layout of a NodalField: the
+// block (a, b) adds H(a, b) x_b into y_a. The blocks are copied once
+// into compressed rows of dense Dim() x Dim() blocks in dense node
+// order; the padding components of the constrained nodes carry the
+// identity. Blocks of nodes the field does not hold are skipped.
+//
+// The rows are multiplied in parallel on the TaskScheduler; on
+// partitioned meshes the exchange sums y over the shared nodes.
+//////////////////////////////////////////////////////////////////////
+
+class BlockOperator : public Operator
+{
+public:
+
+	typedef Set::Manifold::Point dof_type;
+	typedef map<pair<dof_type *, dof_type *>, Set::VectorSpace::Hom> hom_type;
+
+	BlockOperator(const NodalField & field, const hom_type & H,
+		      NodalExchange * exchange = 0,
+		      m4extreme::Utils::TaskScheduler * scheduler = m4extreme::Utils::GetTaskScheduler())
+	  : _exchange(exchange), _scheduler(scheduler) {
+	  Update(field, H);
+	}
+
+	virtual ~BlockOperator() {}
+
+	unsigned int Size() const { return _n * _dim; }
+	unsigned int Dim() const { return _dim; }
+
+	// new blocks, the pattern is built again
+	void Update(const NodalField & field, const hom_type & H) {
+	  _n = field.size();
+	  _dim = field.Dim();
+	  const unsigned int bb = _dim * _dim;
+
+	  vector<unsigned int> count(_n + 1, 0);
+	  vector<int> ia, ib;
+	  ia.reserve(H.size()); ib.reserve(H.size());
+	  for (hom_type::const_iterator pH = H.begin(); pH != H.end(); ++pH) {
+	    ia.push_back(field.Index(pH->first.first));
+	    ib.push_back(field.Index(pH->first.second));
+	    if (ia.back() >= 0 && ib.back() >= 0) ++count[ia.back() + 1];
+	  }
+	  // room for the diagonal block of every row
+	  for (unsigned int i = 0; i < _n; ++i) ++count[i + 1];
+	  for (unsigned int i = 0; i < _n; ++i) count[i + 1] += count[i];
+
+	  _start.assign(_n + 1, 0);
+	  _column.assign(count[_n], -1);
+	  _value.assign((size_t)count[_n] * bb, 0.0);
+	  vector<unsigned int> next(count.begin(), count.end() - 1);
+	  for (unsigned int i = 0; i < _n; ++i) _column[next[i]++] = i;
+
+	  unsigned int k = 0;
+	  for (hom_type::const_iterator pH = H.begin(); pH != H.end(); ++pH, ++k) {
+	    if (ia[k] < 0 || ib[k] < 0) continue;
+	    const unsigned int a = ia[k], b = ib[k];
+	    double * block = 0;
+	    if (a == b) block = &_value[(size_t)count[a] * bb];
+	    else {
+	      _column[next[a]] = b;
+	      block = &_value[(size_t)next[a]++ * bb];
+	    }
+	    const Set::VectorSpace::Hom & h = pH->second;
+	    const unsigned int m1 = min(h.size1(), _dim), m2 = min(h.size2(), _dim);
+	    const double * p = h.begin();
+	    for (unsigned int j = 0; j < m2; ++j)
+	      for (unsigned int i = 0; i < m1; ++i) block[i + _dim * j] += p[i + h.size1() * j];
+	  }
+
+	  // compress, the slots reserved twice for the diagonal blocks are
+	  // dropped
+	  unsigned int nnz = 0;
+	  for (unsigned int i = 0; i < _n; ++i) {
+	    const unsigned int lo = count[i];
+	    _start[i] = nnz;
+	    for (unsigned int s = lo; s < next[i]; ++s, ++nnz) {
+	      _column[nnz] = _column[s];
+	      if (nnz != s) copy(&_value[(size_t)s * bb], &_value[(size_t)(s + 1) * bb], &_value[(size_t)nnz * bb]);
+	    }
+	    double * diag = &_value[(size_t)_start[i] * bb];
+	    for (unsigned int c = field.GetNumofComponents(i); c < _dim; ++c) diag[c * (_dim + 1)] = 1.0;
+	  }
+	  _start[_n] = nnz;
+	  _column.resize(nnz);
+	  _value.resize((size_t)nnz * bb);
+	}
+
+	void operator () (const double * x, double * y) {
+	  _Body body(this, x, y);
+	  m4extreme::Utils::TaskScheduler * s = _scheduler;
+	  if (s != 0 && (s->getNumberThreads() == 1 || s->isRunning())) s = 0;
+	  if (s == 0) body(0, (int)_n, 0);
+	  else s->parallel_for(0, (int)_n, 64, body);
+	  if (_exchange != 0) {
+	    _exchange->Begin(y);
+	    _exchange->End(y);
+	  }
+	}
+
+	// the diagonal block of every node is stored first in its row
+	void Diagonal(double * d) const {
+	  const unsigned int bb = _dim * _dim;
+	  for (unsigned int i = 0; i < _n; ++i)
+	    for (unsigned int c = 0; c < _dim; ++c)
+	      d[(size_t)i * _dim + c] = _value[(size_t)_start[i] * bb + c * (_dim + 1)];
+	  _sum(d, _dim);
+	}
+
+	// column major Dim() x Dim() blocks, for BlockJacobi
+	void BlockDiagonal(double * blocks) const {
+	  const unsigned int bb = _dim * _dim;
+	  for (unsigned int i = 0; i < _n; ++i)
+	    copy(&_value[(size_t)_start[i] * bb], &_value[(size_t)_start[i] * bb] + bb, blocks + (size_t)i * bb);
+	  _sum(blocks, bb);
+	}
+
+private:
+
+	struct _Body {
+	  _Body(const BlockOperator * A, const double * x, double * y) : A(A), x(x), y(y) {}
+	  const BlockOperator * A;
+	  const double * x;
+	  double * y;
+	  void operator () (int lo, int hi, int) {
+	    const unsigned int dim = A->_dim, bb = dim * dim;
+	    for (int a = lo; a < hi; ++a) {
+	      double * __restrict__ ya = y + (size_t)a * dim;
+	      for (unsigned int i = 0; i < dim; ++i) ya[i] = 0.0;
+	      for (unsigned int s = A->_start[a]; s < A->_start[a + 1]; ++s) {
+		const double * __restrict__ h = &A->_value[(size_t)s * bb];
+		const double * __restrict__ xb = x + (size_t)A->_column[s] * dim;
+		for (unsigned int j = 0; j < dim; ++j)
+		  for (unsigned int i = 0; i < dim; ++i) ya[i] += h[i + dim * j] * xb[j];
+	      }
+	    }
+	  }
+	};
+	friend struct _Body;
+
+	// entries of the shared nodes summed over the partitions, ld
+	// values per node
+	void _sum(double * v, unsigned int ld) const {
+	  if (_exchange == 0) return;
+	  if (ld == _dim) {
+	    _exchange->Begin(v);
+	    _exchange->End(v);
+	    return;
+	  }
+	  // one component of the blocks at a time
+	  vector<double> t((size_t)_n * _dim);
+	  for (unsigned int c = 0; c < ld; c += _dim) {
+	    for (unsigned int i = 0; i < _n; ++i)
+	      for (unsigned int k = 0; k < _dim; ++k) t[(size_t)i * _dim + k] = v[(size_t)i * ld + c + k];
+	    _exchange->Begin(&t[0]);
+	    _exchange->End(&t[0]);
+	    for (unsigned int i = 0; i < _n; ++i)
+	      for (unsigned int k = 0; k < _dim; ++k) v[(size_t)i * ld + c + k] = t[(size_t)i * _dim + k];
+	  }
+	}
+
+	unsigned int _n, _dim;
+	vector<unsigned int> _start;
+	vector<int> _column;
+	vector<double> _value;
+	NodalExchange * _exchange;
+	m4extreme::Utils::TaskScheduler * _scheduler;
+
+private:
+
+	BlockOperator(const BlockOperator &);
+	void operator=(const BlockOperator &);
+};
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_OPERATORS__INCLUDED_)
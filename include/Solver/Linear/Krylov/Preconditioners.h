@@ -0,0 +1,270 @@
+// Preconditioners.h: interface for the Krylov preconditioners.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_PRECONDITIONERS__INCLUDED_)
+#define SOLVER_LINEAR_PRECONDITIONERS__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "./Krylov.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class Jacobi
+//
+// z = D^{-1} r for the diagonal D of the operator, e.g. from
+// ElementOperator::Diagonal or BlockOperator::Diagonal. Zero diagonal
+// entries are taken as one.
+//////////////////////////////////////////////////////////////////////
+
+class Jacobi : public Preconditioner
+{
+public:
+
+	Jacobi(KrylovSpace & S, const double * diagonal) : _S(S) {
+	  Update(diagonal);
+	}
+
+	virtual ~Jacobi() {}
+
+	void Update(const double * diagonal) {
+	  _dinv.resize(_S.Size());
+	  for (unsigned int i = 0; i < _S.Size(); ++i)
+	    _dinv[i] = diagonal[i] != 0.0 ? 1.0 / diagonal[i] : 1.0;
+	}
+
+	const double * GetInverse() const { return &_dinv[0]; }
+
+	void operator () (const double * r, double * z) {
+	  _S.Multiply(&_dinv[0], r, z);
+	}
+
+private:
+
+	KrylovSpace & _S;
+	vector<double> _dinv;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class BlockJacobi
+//
+// z = B^{-1} r for the block diagonal B of the operator, blocks of
+// size bs on consecutive entries (the components of a node in the
+// NodalField layout), e.g. from BlockOperator::BlockDiagonal. The
+// blocks are given column major, one after the other, and inverted
+// once by Gauss-Jordan elimination with partial pivoting; a singular
+// block is replaced by the inverse of its diagonal.
+//////////////////////////////////////////////////////////////////////
+
+class BlockJacobi : public Preconditioner
+{
+public:
+
+	BlockJacobi(KrylovSpace & S, unsigned int bs, const double * blocks,
+		    m4extreme::Utils::TaskScheduler * scheduler = m4extreme::Utils::GetTaskScheduler())
+	  : _S(S), _bs(bs), _scheduler(scheduler) {
+	  Update(blocks);
+	}
+
+	virtual ~BlockJacobi() {}
+
+	void Update(const double * blocks) {
+	  const unsigned int bs = _bs, nb = _S.Size() / bs;
+	  _binv.assign(blocks, blocks + (size_t)nb * bs * bs);
+	  vector<double> a(bs * bs);
+	  for (unsigned int k = 0; k < nb; ++k) {
+	    double * inv = &_binv[(size_t)k * bs * bs];
+	    copy(inv, inv + bs * bs, a.begin());
+	    if (!_invert(bs, &a[0], inv)) {
+	      for (unsigned int i = 0; i < bs * bs; ++i) inv[i] = 0.0;
+	      for (unsigned int i = 0; i < bs; ++i) {
+		const double d = blocks[(size_t)k * bs * bs + i * (bs + 1)];
+		inv[i * (bs + 1)] = d != 0.0 ? 1.0 / d : 1.0;
+	      }
+	    }
+	  }
+	}
+
+	void operator () (const double * r, double * z) {
+	  _Body body(this, r, z);
+	  const int nb = (int)(_S.Size() / _bs);
+	  if (_scheduler == 0 || _scheduler->getNumberThreads() == 1 || _scheduler->isRunning())
+	    body(0, nb, 0);
+	  else
+	    _scheduler->parallel_for(0, nb, 256, body);
+	}
+
+private:
+
+	struct _Body {
+	  _Body(BlockJacobi * B, const double * r, double * z) : B(B), r(r), z(z) {}
+	  BlockJacobi * B;
+	  const double * r;
+	  double * z;
+	  void operator () (int lo, int hi, int) {
+	    const unsigned int bs = B->_bs;
+	    for (int k = lo; k < hi; ++k) {
+	      const double * inv = &B->_binv[(size_t)k * bs * bs];
+	      const double * rk = r + (size_t)k * bs;
+	      double * zk = z + (size_t)k * bs;
+	      for (unsigned int i = 0; i < bs; ++i) zk[i] = 0.0;
+	      for (unsigned int j = 0; j < bs; ++j)
+		for (unsigned int i = 0; i < bs; ++i) zk[i] += inv[i + bs * j] * rk[j];
+	    }
+	  }
+	};
+	friend struct _Body;
+
+	// inv = a^{-1}, a is overwritten; false if a is singular
+	static bool _invert(unsigned int n, double * a, double * inv) {
+	  unsigned int i, j, k;
+	  double scale = 0.0;
+	  for (i = 0; i < n * n; ++i) { inv[i] = 0.0; scale = max(scale, fabs(a[i])); }
+	  for (i = 0; i < n; ++i) inv[i * (n + 1)] = 1.0;
+	  if (scale == 0.0) return false;
+	  for (k = 0; k < n; ++k) {
+	    unsigned int p = k;
+	    for (i = k + 1; i < n; ++i) if (fabs(a[i + n * k]) > fabs(a[p + n * k])) p = i;
+	    if (fabs(a[p + n * k]) <= 1.0e-14 * scale) return false;
+	    if (p != k)
+	      for (j = 0; j < n; ++j) { swap(a[k + n * j], a[p + n * j]); swap(inv[k + n * j], inv[p + n * j]); }
+	    const double d = 1.0 / a[k + n * k];
+	    for (j = 0; j < n; ++j) { a[k + n * j] *= d; inv[k + n * j] *= d; }
+	    for (i = 0; i < n; ++i) {
+	      if (i == k) continue;
+	      const double f = a[i + n * k];
+	      if (f == 0.0) continue;
+	      for (j = 0; j < n; ++j) { a[i + n * j] -= f * a[k + n * j]; inv[i + n * j] -= f * inv[k + n * j]; }
+	    }
+	  }
+	  return true;
+	}
+
+	KrylovSpace & _S;
+	unsigned int _bs;
+	m4extreme::Utils::TaskScheduler * _scheduler;
+	vector<double> _binv;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Class Chebyshev
+//
+// z = p(D^{-1} A) D^{-1} r, the Chebyshev polynomial of the given
+// degree on [lmax/ratio, lmax] (Saad, Iterative Methods, alg. 12.1).
+// lmax is estimated by a few power iterations on D^{-1} A and raised
+// by 10%. The preconditioner needs no inner product once set up and
+// only products with A, so it costs the same on any number of threads
+// or partitions; it is also the smoother of multigrid cycles.
+//////////////////////////////////////////////////////////////////////
+
+class Chebyshev : public Preconditioner
+{
+public:
+
+	Chebyshev(KrylovSpace & S, Operator & A, const double * diagonal,
+		  unsigned int degree = 3, double ratio = 30.0, unsigned int power = 10)
+	  : _S(S), _A(A), _degree(degree > 0 ? degree : 1), _ratio(ratio),
+	    _lmax(0.0), _lmin(0.0) {
+	  Update(diagonal, power);
+	}
+
+	virtual ~Chebyshev() {}
+
+	double GetMaxEigenvalue() const { return _lmax; }
+	double GetMinEigenvalue() const { return _lmin; }
+
+	// new diagonal, lmax estimated again
+	void Update(const double * diagonal, unsigned int power = 10) {
+	  const unsigned int n = _S.Size();
+	  _dinv.resize(n); _d.resize(n); _res.resize(n); _t.resize(n); _q.resize(n);
+	  for (unsigned int i = 0; i < n; ++i)
+	    _dinv[i] = diagonal[i] != 0.0 ? 1.0 / diagonal[i] : 1.0;
+
+	  // power iterations, from a pseudo-random vector so that the
+	  // oscillating modes are present from the start
+	  double * v = &_d[0], * w = &_q[0];
+	  unsigned int seed = 12345u;
+	  for (unsigned int i = 0; i < n; ++i) {
+	    seed = seed * 1103515245u + 12345u;
+	    v[i] = (double)(seed >> 8) / (double)(1u << 24) - 0.5;
+	  }
+	  double lambda = 0.0;
+	  for (unsigned int k = 0; k < max(power, 1u); ++k) {
+	    const double vnorm = _S.Norm(v);
+	    if (vnorm == 0.0) break;
+	    _S.Axpby(1.0 / vnorm, v, 0.0, v);
+	    _A(v, w);
+	    _S.Multiply(&_dinv[0], w, w);
+	    lambda = _S.Dot(v, w);
+	    swap(v, w);
+	  }
+	  _lmax = 1.1 * fabs(lambda);
+	  _lmin = _lmax / _ratio;
+	}
+
+	void operator () (const double * r, double * z) {
+	  _S.Copy(r, &_res[0]);
+	  _iterate(z);
+	}
+
+	// x += p(D^{-1} A) D^{-1} (b - A x)
+	void Smooth(const double * b, double * x) {
+	  _A(x, &_q[0]);
+	  _S.Axpby(1.0, b, -1.0, &_q[0]);
+	  _S.Copy(&_q[0], &_res[0]);
+	  _iterate(&_q[0]);
+	  _S.Axpby(1.0, &_q[0], 1.0, x);
+	}
+
+private:
+
+	// z = p(D^{-1} A) D^{-1} res, res is overwritten; z is none of
+	// the work vectors
+	void _iterate(double * z) {
+	  double * d = &_d[0], * res = &_res[0], * t = &_t[0];
+	  if (_lmax == 0.0) {
+	    _S.Multiply(&_dinv[0], res, z);
+	    return;
+	  }
+	  const double theta = 0.5 * (_lmax + _lmin), delta = 0.5 * (_lmax - _lmin);
+	  const double sigma = theta / delta;
+	  double rho = 1.0 / sigma;
+
+	  _S.Multiply(&_dinv[0], res, d);
+	  _S.Axpby(1.0 / theta, d, 0.0, d);
+	  _S.Copy(d, z);
+	  for (unsigned int k = 1; k < _degree; ++k) {
+	    _A(d, t);
+	    _S.Axpby(-1.0, t, 1.0, res);
+	    const double rhonew = 1.0 / (2.0 * sigma - rho);
+	    _S.Multiply(&_dinv[0], res, t);
+	    _S.Axpby(2.0 * rhonew / delta, t, rhonew * rho, d);
+	    _S.Axpby(1.0, d, 1.0, z);
+	    rho = rhonew;
+	  }
+	}
+
+	KrylovSpace & _S;
+	Operator & _A;
+	unsigned int _degree;
+	double _ratio, _lmax, _lmin;
+	vector<double> _dinv, _d, _res, _t, _q;
+};
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_PRECONDITIONERS__INCLUDED_)
@@ -11,11 +11,21 @@
 
 #include "./Linear.h"
 #include "./Cholesky/Cholesky.h"
+#include "./SparseCholesky/SparseCholesky.h"
 
 #if defined(_M4EXTREME_MPI_)
 #include "./SuperLU/SuperLUMPI.h"
 #else
 #include "./SuperLU/SuperLU.h"
+#include "./SuperLU/CachedSuperLU.h"
 #endif
 
+#include "./Assembler/Assembler.h"
+#include "./Krylov/Krylov.h"
+#include "./Krylov/Preconditioners.h"
+#include "./Krylov/Operators.h"
+#include "./Krylov/ElementMatrix.h"
+#include "./Krylov/KrylovSystem.h"
+#include "./AMG/AMG.h"
+
 #endif // !defined(SOLVER_LINEAR_LINLIB_H__INCLUDED_)
@@ -0,0 +1,236 @@
+// SparseCholesky.h: interface for the SparseCholesky class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_SPARSECHOLESKY__INCLUDED_)
+#define SOLVER_LINEAR_SPARSECHOLESKY__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <iostream>
+
+#include "../Linear.h"
+#include "./SparseLDL.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class SparseCholesky
+//////////////////////////////////////////////////////////////////////
+//
+// Sparse LDL^T System for symmetric matrices, e.g.
+//
+//	SparseCholesky<DOF> LS(LSt.GetDOFs(), LSt.GetDOFPairs());
+//
+// The ordering and the symbolic factorization are done once, in the
+// constructor, for the pattern of the key pairs; the system is meant to
+// be kept for as long as the pattern does not change. Solve() factors
+// the matrix again only if it was modified since the last Solve(), so
+// that several right hand sides cost one factorization.
+//
+// Only one triangle is stored: if both (K1,K2) and (K2,K1) are in the
+// pattern, the contributions to the one with the larger first key are
+// dropped, so the assembled matrix must be symmetric.
+//
+template <class key>
+class SparseCholesky : public System <key>
+{
+public:
+
+//	Constructors/destructors:
+
+	SparseCholesky();
+	SparseCholesky(const set <key> &, const set <pair <key, key> > &);
+	virtual ~SparseCholesky();
+
+//	Accessors/mutators:
+
+	double Get(key);
+	double Get(key, key);
+	void Set(key, double);
+	void Set(key, key, double);
+
+//	General methods:
+
+	void SetToZero1();
+	void SetToZero2();
+	void Add(key, double);
+	void Add(key, key, double);
+	void Solve();
+	double Norm();
+
+	const SparseLDL &Factorization() const { return LS; }
+
+	// storage of an entry for direct assembly, 0 if the entry is
+	// dropped (the other triangle)
+	double *Slot(key K) { return &b[KeyMap[K]]; }
+	double *Slot(key K1, key K2) { return Find(K1, K2, true); }
+
+	// values changed through Slot(), the next Solve() refactors
+	void Modified() { Factored = false; }
+
+private:
+
+	double *Find(key, key, bool);
+
+	unsigned int n;
+
+	map <key, unsigned int> KeyMap;
+
+	// slot of every pair in a, and whether the pair is the stored one
+	map <pair <key, key>, pair <unsigned int, bool> > KeyPairMap;
+
+	double *a;
+	vector <double> b;
+
+	SparseLDL LS;
+	bool Factored;
+
+private:
+
+	SparseCholesky(SparseCholesky &);
+	void operator=(SparseCholesky &);
+};
+
+template <class key>
+SparseCholesky<key>::SparseCholesky() : n(0), a(0), Factored(false) {}
+
+template <class key>
+SparseCholesky<key>::SparseCholesky(const set <key> &Keys,
+	const set <pair <key, key> > &KeyPairs)
+: n(Keys.size()), b(n, 0.0), Factored(false)
+{
+	unsigned int i;
+	typename set <key>::const_iterator iK;
+	typename set <pair <key, key> >::const_iterator iKK;
+
+	if (n == 0) throw (0);
+
+	for (iK=Keys.begin(), i=0; iK!=Keys.end(); iK++, i++)
+		KeyMap[*iK] = i;
+
+	vector <unsigned int> Row, Column, Slot;
+	Row.reserve(KeyPairs.size());
+	Column.reserve(KeyPairs.size());
+	for (iKK=KeyPairs.begin(); iKK!=KeyPairs.end(); iKK++) {
+		Row.push_back(KeyMap[iKK->first]);
+		Column.push_back(KeyMap[iKK->second]);
+	}
+
+	LS.Analyze(n, Row, Column, Slot);
+	a = LS.Values();
+
+	for (iKK=KeyPairs.begin(), i=0; iKK!=KeyPairs.end(); iKK++, i++) {
+		const bool Stored = Row[i] <= Column[i]
+			|| KeyPairs.find(make_pair(iKK->second, iKK->first)) == KeyPairs.end();
+		KeyPairMap[*iKK] = make_pair(Slot[i], Stored);
+	}
+}
+
+template <class key>
+SparseCholesky<key>::~SparseCholesky() {}
+
+template <class key>
+double *SparseCholesky<key>::Find(key K1, key K2, bool Write)
+{
+	typename map <pair <key, key>, pair <unsigned int, bool> >::const_iterator
+		iKK = KeyPairMap.find(make_pair(K1, K2));
+	if (iKK == KeyPairMap.end()) {
+		cout << "Solver::SparseCholesky pair is not in the pattern @" << endl;
+		throw (0);
+	}
+	if (Write && !iKK->second.second) return 0;
+	return a + iKK->second.first;
+}
+
+template <class key>
+double SparseCholesky<key>::Get(key K)
+{
+	return b[KeyMap[K]];
+}
+
+template <class key>
+double SparseCholesky<key>::Get(key K1, key K2)
+{
+	return *Find(K1, K2, false);
+}
+
+template <class key>
+void SparseCholesky<key>::Set(key K, double Input)
+{
+	b[KeyMap[K]] = Input;
+}
+
+template <class key>
+void SparseCholesky<key>::Set(key K1, key K2, double Input)
+{
+	double *aij = Find(K1, K2, true);
+	if (aij != 0) *aij = Input;
+	Factored = false;
+}
+
+template <class key>
+void SparseCholesky<key>::SetToZero1()
+{
+	unsigned int i;
+	for (i=0; i<n; i++) b[i] = 0.0;
+}
+
+template <class key>
+void SparseCholesky<key>::SetToZero2()
+{
+	unsigned int i, nnz = LS.NumberOfValues();
+	for (i=0; i<nnz; i++) a[i] = 0.0;
+	Factored = false;
+}
+
+template <class key>
+void SparseCholesky<key>::Add(key K, double Input)
+{
+	b[KeyMap[K]] += Input;
+}
+
+template <class key>
+void SparseCholesky<key>::Add(key K1, key K2, double Input)
+{
+	double *aij = Find(K1, K2, true);
+	if (aij != 0) *aij += Input;
+	Factored = false;
+}
+
+template <class key>
+double SparseCholesky<key>::Norm()
+{
+	unsigned int i; double bn2 = 0.0;
+	for (i=0; i<n; i++) bn2 += b[i]*b[i];
+	return sqrt(bn2);
+}
+
+template <class key>
+void SparseCholesky<key>::Solve()
+{
+	if (!Factored) {
+		if (LS.Factorize() != 0) {
+			cout << "Solver::SparseCholesky zero pivot in factorization @" << endl;
+			throw (0);
+		}
+		Factored = true;
+	}
+	LS.Solve(&b[0]);
+}
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_SPARSECHOLESKY__INCLUDED_)
@@ -0,0 +1,774 @@
+// SparseLDL.h: interface for the SparseLDL class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#if !defined(SOLVER_LINEAR_SPARSELDL__INCLUDED_)
+#define SOLVER_LINEAR_SPARSELDL__INCLUDED_
+
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <utility>
+
+#include "../../../Threads/TaskScheduler.h"
+
+using namespace std;
+
+namespace Solver
+{
+namespace Linear
+{
+//////////////////////////////////////////////////////////////////////
+// Class SparseLDL
+//////////////////////////////////////////////////////////////////////
+//
+// Supernodal multifrontal LDL^T factorization of a sparse symmetric
+// matrix, on indices 0 ... n-1.
+//
+// Analyze() runs once per sparsity pattern: a nested dissection
+// ordering (level set separators of the adjacency graph, minimum
+// degree on the small parts), the elimination tree, its postorder, the
+// column counts and the supernodes with their row structures.
+// Factorize() may then be called any number of times with new values
+// in Values(). The supernodes are factored level by level of the
+// supernodal elimination tree: the nodes of a level are independent and
+// are factored in parallel on the process wide TaskScheduler, and the
+// few large separators near the root, which are alone on their level,
+// update their Schur complement in parallel instead.
+//
+// No pivoting is done, the matrix must be symmetric and strongly
+// regular (e.g. positive definite).
+//
+class SparseLDL
+{
+public:
+
+//	Constructors/destructors:
+
+	SparseLDL() : n(0), Info(0) {}
+	virtual ~SparseLDL() {}
+
+//	Accessors/mutators:
+
+	unsigned int Size() const { return n; }
+	unsigned int NumberOfSupernodes() const { return (unsigned int)SuperStart.size() - 1; }
+	size_t FactorSize() const { return Lp.empty() ? 0 : Lp.back(); }
+
+	// lower triangle of the permuted matrix, one slot per entry of
+	// the pattern, (i,j) and (j,i) share the slot
+	double *Values() { return Ax.empty() ? 0 : &Ax[0]; }
+	unsigned int NumberOfValues() const { return (unsigned int)Ax.size(); }
+
+	// new to old numbering of the unknowns
+	const vector<unsigned int> &Permutation() const { return Perm; }
+
+//	General methods:
+
+	// symbolic analysis of the pattern with the entries (Row[k], Column[k]),
+	// on return Slot[k] is the position of the kth entry in Values()
+	void Analyze(unsigned int, const vector<unsigned int> &Row,
+		const vector<unsigned int> &Column, vector<unsigned int> &Slot);
+
+	// numeric factorization, returns 0 or 1 + the (old) index of a zero pivot
+	unsigned int Factorize();
+
+	// overwrite b with the solution of A x = b
+	void Solve(double *b) const;
+
+private:
+
+	struct Graph {
+		vector<unsigned int> xadj;
+		vector<unsigned int> adj;
+	};
+
+	struct FactorNodes {
+		SparseLDL *LDL;
+		const unsigned int *Nodes;
+		void operator () (int lo, int hi, int tid) {
+			for (int i = lo; i < hi; ++i) LDL->FactorNode(Nodes[i], tid, 0);
+		}
+	};
+	friend struct FactorNodes;
+
+	// F(j:m, j) -= F(j:m, p0:p1) D F(j, p0:p1)^T for the columns j of
+	// the packed lower front, four columns at a time
+	struct SchurUpdate {
+		double *F;
+		const double *D;
+		unsigned int m, p0, p1;
+		void operator () (int lo, int hi, int) {
+			int j = lo;
+			for (; j + 4 <= hi; j += 4) Update4((unsigned int)j);
+			for (; j < hi; ++j) Update1((unsigned int)j);
+		}
+		void Update1(unsigned int j) {
+			double * __restrict__ Fj = F + Offset(m, j) - j;
+			for (unsigned int p = p0; p < p1; ++p) {
+				const double * __restrict__ Fp = F + Offset(m, p) - p;
+				const double t = Fp[j] * D[p];
+				if (t == 0.0) continue;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+				for (unsigned int i = j; i < m; ++i) Fj[i] -= Fp[i] * t;
+			}
+		}
+		void Update4(unsigned int j) {
+			double * __restrict__ F0 = F + Offset(m, j) - j;
+			double * __restrict__ F1 = F + Offset(m, j + 1) - (j + 1);
+			double * __restrict__ F2 = F + Offset(m, j + 2) - (j + 2);
+			double * __restrict__ F3 = F + Offset(m, j + 3) - (j + 3);
+			for (unsigned int p = p0; p < p1; ++p) {
+				const double * __restrict__ Fp = F + Offset(m, p) - p;
+				const double t0 = Fp[j] * D[p], t1 = Fp[j + 1] * D[p];
+				const double t2 = Fp[j + 2] * D[p], t3 = Fp[j + 3] * D[p];
+				if (t0 == 0.0 && t1 == 0.0 && t2 == 0.0 && t3 == 0.0) continue;
+				F0[j] -= Fp[j] * t0;
+				F0[j + 1] -= Fp[j + 1] * t0; F1[j + 1] -= Fp[j + 1] * t1;
+				F0[j + 2] -= Fp[j + 2] * t0; F1[j + 2] -= Fp[j + 2] * t1;
+				F2[j + 2] -= Fp[j + 2] * t2;
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+				for (unsigned int i = j + 3; i < m; ++i) {
+					const double x = Fp[i];
+					F0[i] -= x * t0; F1[i] -= x * t1;
+					F2[i] -= x * t2; F3[i] -= x * t3;
+				}
+			}
+		}
+	};
+
+	// offset of column j in a packed lower m x m matrix
+	static size_t Offset(size_t m, size_t j) { return j * m - j * (j - 1) / 2; }
+
+	void Order(const Graph &, vector<unsigned int> &) const;
+	void Dissect(const Graph &, vector<unsigned int> &, int, int &,
+		vector<int> &, vector<int> &, vector<unsigned int> &) const;
+	unsigned int Levels(const Graph &, unsigned int, int &, vector<int> &,
+		vector<unsigned int> &, vector<unsigned int> &) const;
+	void MinimumDegree(const Graph &, const vector<unsigned int> &,
+		vector<unsigned int> &) const;
+	void Pattern(const vector<unsigned int> &, const vector<unsigned int> &,
+		const vector<unsigned int> &, vector<unsigned int> &);
+	void EliminationTree(vector<int> &, vector<unsigned int> &, vector<unsigned int> &) const;
+	void Symbolic();
+	void FactorNode(unsigned int, int, m4extreme::Utils::TaskScheduler *);
+
+	unsigned int n;
+
+	// permutation, new to old and old to new
+	vector<unsigned int> Perm;
+	vector<unsigned int> IPerm;
+
+	// permuted lower triangle in compressed columns
+	vector<unsigned int> Ap;
+	vector<unsigned int> Ai;
+	vector<double> Ax;
+
+	// supernodes: columns [SuperStart[s], SuperStart[s+1]), rows
+	// Ri[Rp[s]] ... Ri[Rp[s+1]-1], parent and children
+	vector<unsigned int> SuperStart;
+	vector<unsigned int> Rp;
+	vector<unsigned int> Ri;
+	vector<int> SuperParent;
+	vector<unsigned int> ChildPtr;
+	vector<unsigned int> Child;
+
+	// supernodes by level of the supernodal tree
+	vector<unsigned int> LevelPtr;
+	vector<unsigned int> LevelNodes;
+
+	// factor: packed lower trapezoidal block of each supernode, unit
+	// diagonal, and the pivots
+	vector<size_t> Lp;
+	vector<double> Lx;
+	vector<double> D;
+
+	// contribution blocks waiting for the parent, and scratch
+	vector< vector<double> > Update;
+	vector< vector<unsigned int> > Local;
+	volatile unsigned int Info;
+
+private:
+
+	SparseLDL(SparseLDL &);
+	void operator=(SparseLDL &);
+};
+
+inline void SparseLDL::Analyze(unsigned int Size, const vector<unsigned int> &Row,
+	const vector<unsigned int> &Column, vector<unsigned int> &Slot)
+{
+	n = Size;
+
+	// adjacency graph of the pattern
+	Graph G;
+	vector<unsigned int> degree(n + 1, 0);
+	unsigned int k, i, j;
+	for (k = 0; k < Row.size(); k++) {
+		if (Row[k] == Column[k]) continue;
+		degree[Row[k]]++; degree[Column[k]]++;
+	}
+	G.xadj.assign(n + 1, 0);
+	for (i = 0; i < n; i++) G.xadj[i + 1] = G.xadj[i] + degree[i];
+	G.adj.resize(G.xadj[n]);
+	for (i = 0; i < n; i++) degree[i] = G.xadj[i];
+	for (k = 0; k < Row.size(); k++) {
+		if (Row[k] == Column[k]) continue;
+		G.adj[degree[Row[k]]++] = Column[k];
+		G.adj[degree[Column[k]]++] = Row[k];
+	}
+	unsigned int q = 0;
+	for (i = 0; i < n; i++) {
+		const unsigned int first = q;
+		sort(G.adj.begin() + G.xadj[i], G.adj.begin() + G.xadj[i + 1]);
+		for (k = G.xadj[i]; k < G.xadj[i + 1]; k++)
+			if (q == first || G.adj[q - 1] != G.adj[k]) G.adj[q++] = G.adj[k];
+		G.xadj[i] = first;
+	}
+	G.xadj[n] = q;
+	G.adj.resize(q);
+
+	// fill reducing ordering, then postorder of its elimination tree
+	// so that the supernodes are contiguous
+	Order(G, Perm);
+	IPerm.resize(n);
+	for (i = 0; i < n; i++) IPerm[Perm[i]] = i;
+	Pattern(Row, Column, IPerm, Slot);
+
+	vector<int> parent;
+	vector<unsigned int> rp, ri;
+	EliminationTree(parent, rp, ri);
+	vector<unsigned int> head(n, n), next(n, n), post;
+	post.reserve(n);
+	for (j = n; j-- > 0;) {
+		if (parent[j] < 0) continue;
+		next[j] = head[parent[j]];
+		head[parent[j]] = j;
+	}
+	vector<unsigned int> stack;
+	for (j = 0; j < n; j++) {
+		if (parent[j] >= 0) continue;
+		stack.push_back(j);
+		while (!stack.empty()) {
+			const unsigned int p = stack.back();
+			if (head[p] == n) {
+				stack.pop_back();
+				post.push_back(p);
+			} else {
+				stack.push_back(head[p]);
+				head[p] = next[head[p]];
+			}
+		}
+	}
+	vector<unsigned int> perm(n);
+	for (i = 0; i < n; i++) perm[i] = Perm[post[i]];
+	Perm.swap(perm);
+	for (i = 0; i < n; i++) IPerm[Perm[i]] = i;
+	Pattern(Row, Column, IPerm, Slot);
+
+	Symbolic();
+}
+
+// nested dissection of every connected component
+inline void SparseLDL::Order(const Graph &G, vector<unsigned int> &order) const
+{
+	order.clear();
+	order.reserve(n);
+	vector<int> label(n, 0), local(n, 0);
+	vector<unsigned int> V(n);
+	for (unsigned int i = 0; i < n; i++) V[i] = i;
+	int labels = 1;
+	Dissect(G, V, 0, labels, label, local, order);
+}
+
+// breadth first search from root; returns the number of levels, the
+// vertices in visit order and the start of each level in it
+inline unsigned int SparseLDL::Levels(const Graph &G, unsigned int root, int &stamp,
+	vector<int> &mark, vector<unsigned int> &visit, vector<unsigned int> &start) const
+{
+	const int s = ++stamp;
+	visit.clear(); start.clear();
+	visit.push_back(root); mark[root] = s;
+	start.push_back(0);
+	size_t front = 0;
+	while (front < visit.size()) {
+		const size_t end = visit.size();
+		for (; front < end; front++) {
+			const unsigned int v = visit[front];
+			for (unsigned int k = G.xadj[v]; k < G.xadj[v + 1]; k++) {
+				const unsigned int u = G.adj[k];
+				if (mark[u] == s) continue;
+				mark[u] = s;
+				visit.push_back(u);
+			}
+		}
+		start.push_back((unsigned int)end);
+	}
+	return (unsigned int)start.size() - 1;
+}
+
+inline void SparseLDL::Dissect(const Graph &G, vector<unsigned int> &V, int lab, int &labels,
+	vector<int> &label, vector<int> &local, vector<unsigned int> &order) const
+{
+	const unsigned int Leaf = 64;
+	if (V.size() <= Leaf) {
+		MinimumDegree(G, V, order);
+		return;
+	}
+
+	// subgraph induced by V, in the numbering of V
+	Graph H;
+	unsigned int i, k, l;
+	for (i = 0; i < V.size(); i++) local[V[i]] = (int)i;
+	H.xadj.assign(V.size() + 1, 0);
+	for (i = 0; i < V.size(); i++) {
+		const unsigned int v = V[i];
+		for (k = G.xadj[v]; k < G.xadj[v + 1]; k++)
+			if (label[G.adj[k]] == lab) H.adj.push_back((unsigned int)local[G.adj[k]]);
+		H.xadj[i + 1] = (unsigned int)H.adj.size();
+	}
+
+	vector<int> mark(V.size(), 0);
+	int stamp = 0;
+	vector<unsigned int> visit, start;
+	unsigned int levels = Levels(H, 0, stamp, mark, visit, start);
+
+	// connected components are ordered one after the other
+	if (visit.size() < V.size()) {
+		vector<int> comp(V.size(), -1);
+		int ncomp = 0;
+		for (unsigned int r = 0; r < V.size(); r++) {
+			if (comp[r] >= 0) continue;
+			Levels(H, r, stamp, mark, visit, start);
+			for (i = 0; i < visit.size(); i++) comp[visit[i]] = ncomp;
+			ncomp++;
+		}
+		vector< vector<unsigned int> > parts(ncomp);
+		for (i = 0; i < V.size(); i++) parts[comp[i]].push_back(V[i]);
+		for (int c = 0; c < ncomp; c++) {
+			const int sub = labels++;
+			for (i = 0; i < parts[c].size(); i++) label[parts[c][i]] = sub;
+			Dissect(G, parts[c], sub, labels, label, local, order);
+		}
+		return;
+	}
+
+	// pseudo peripheral root: restart from a vertex of least degree in
+	// the last level while the number of levels grows
+	vector<unsigned int> visit2, start2;
+	for (int it = 0; it < 8; it++) {
+		unsigned int best = visit[start[levels - 1]];
+		for (i = start[levels - 1]; i < start[levels]; i++) {
+			const unsigned int v = visit[i];
+			if (H.xadj[v + 1] - H.xadj[v] < H.xadj[best + 1] - H.xadj[best]) best = v;
+		}
+		const unsigned int levels2 = Levels(H, best, stamp, mark, visit2, start2);
+		if (levels2 <= levels) break;
+		levels = levels2;
+		visit.swap(visit2); start.swap(start2);
+	}
+
+	if (levels < 3) {
+		if (V.size() <= 16 * Leaf) {
+			MinimumDegree(G, V, order);
+		} else {
+			for (i = 0; i < V.size(); i++) order.push_back(V[i]);
+		}
+		return;
+	}
+
+	// separator: the level that halves the vertices, or a smaller one
+	// that still leaves at least a third on either side
+	unsigned int sep = 1;
+	while (sep < levels - 2 && start[sep + 1] < V.size() / 2) sep++;
+	for (l = 1; l + 1 < levels; l++) {
+		if (3 * start[l] < V.size() || 3 * (V.size() - start[l + 1]) < V.size()) continue;
+		if (start[l + 1] - start[l] < start[sep + 1] - start[sep]) sep = l;
+	}
+
+	vector<int> side(V.size(), 0);
+	for (l = 0; l < levels; l++)
+		for (i = start[l]; i < start[l + 1]; i++)
+			side[visit[i]] = l < sep ? 0 : (l > sep ? 1 : 2);
+
+	// a separator vertex without neighbor beyond the separator joins
+	// the first part
+	for (i = start[sep]; i < start[sep + 1]; i++) {
+		const unsigned int v = visit[i];
+		bool beyond = false;
+		for (k = H.xadj[v]; k < H.xadj[v + 1] && !beyond; k++)
+			beyond = side[H.adj[k]] == 1;
+		if (!beyond) side[v] = 0;
+	}
+
+	vector<unsigned int> A, B, S;
+	for (i = 0; i < V.size(); i++) {
+		if (side[i] == 0) A.push_back(V[i]);
+		else if (side[i] == 1) B.push_back(V[i]);
+		else S.push_back(V[i]);
+	}
+	const int la = labels++, lb = labels++;
+	for (i = 0; i < A.size(); i++) label[A[i]] = la;
+	for (i = 0; i < B.size(); i++) label[B[i]] = lb;
+	for (i = 0; i < S.size(); i++) label[S[i]] = -1;
+	vector<unsigned int>().swap(V);
+	vector<unsigned int>().swap(H.adj);
+	Dissect(G, A, la, labels, label, local, order);
+	Dissect(G, B, lb, labels, label, local, order);
+	for (i = 0; i < S.size(); i++) order.push_back(S[i]);
+}
+
+// minimum degree on the explicit elimination graph of a small part
+inline void SparseLDL::MinimumDegree(const Graph &G, const vector<unsigned int> &V,
+	vector<unsigned int> &order) const
+{
+	const unsigned int m = (unsigned int)V.size();
+	vector<unsigned int> sorted(V);
+	sort(sorted.begin(), sorted.end());
+	vector< set<unsigned int> > E(m);
+	vector<bool> done(m, false);
+	unsigned int i, k, step;
+	for (i = 0; i < m; i++) {
+		const unsigned int v = sorted[i];
+		for (k = G.xadj[v]; k < G.xadj[v + 1]; k++) {
+			vector<unsigned int>::const_iterator u =
+				lower_bound(sorted.begin(), sorted.end(), G.adj[k]);
+			if (u != sorted.end() && *u == G.adj[k]) E[i].insert((unsigned int)(u - sorted.begin()));
+		}
+	}
+	for (step = 0; step < m; step++) {
+		unsigned int v = m;
+		for (i = 0; i < m; i++)
+			if (!done[i] && (v == m || E[i].size() < E[v].size())) v = i;
+		done[v] = true;
+		order.push_back(sorted[v]);
+		// the neighbors of v become a clique
+		set<unsigned int>::const_iterator a, b;
+		for (a = E[v].begin(); a != E[v].end(); a++) {
+			E[*a].erase(v);
+			for (b = E[v].begin(); b != E[v].end(); b++)
+				if (*b != *a) E[*a].insert(*b);
+		}
+		E[v].clear();
+	}
+}
+
+// permuted lower triangle of the pattern, with the diagonal
+inline void SparseLDL::Pattern(const vector<unsigned int> &Row, const vector<unsigned int> &Column,
+	const vector<unsigned int> &iperm, vector<unsigned int> &Slot)
+{
+	unsigned int i, j, k;
+	vector< pair<unsigned int, unsigned int> > entries;
+	entries.reserve(Row.size() + n);
+	for (j = 0; j < n; j++) entries.push_back(make_pair(j, j));
+	for (k = 0; k < Row.size(); k++) {
+		i = iperm[Row[k]]; j = iperm[Column[k]];
+		entries.push_back(i > j ? make_pair(j, i) : make_pair(i, j));
+	}
+	sort(entries.begin(), entries.end());
+	entries.erase(unique(entries.begin(), entries.end()), entries.end());
+
+	Ap.assign(n + 1, 0);
+	Ai.resize(entries.size());
+	for (k = 0; k < entries.size(); k++) {
+		Ap[entries[k].first + 1]++;
+		Ai[k] = entries[k].second;
+	}
+	for (j = 0; j < n; j++) Ap[j + 1] += Ap[j];
+	Ax.assign(entries.size(), 0.0);
+
+	Slot.resize(Row.size());
+	for (k = 0; k < Row.size(); k++) {
+		i = iperm[Row[k]]; j = iperm[Column[k]];
+		if (i < j) swap(i, j);
+		Slot[k] = (unsigned int)(lower_bound(Ai.begin() + Ap[j], Ai.begin() + Ap[j + 1], i) - Ai.begin());
+	}
+}
+
+// elimination tree (Liu), and the strictly lower rows of the pattern
+inline void SparseLDL::EliminationTree(vector<int> &parent, vector<unsigned int> &rp,
+	vector<unsigned int> &ri) const
+{
+	unsigned int i, j, p;
+	rp.assign(n + 1, 0);
+	for (j = 0; j < n; j++)
+		for (p = Ap[j] + 1; p < Ap[j + 1]; p++) rp[Ai[p] + 1]++;
+	for (i = 0; i < n; i++) rp[i + 1] += rp[i];
+	ri.resize(rp[n]);
+	vector<unsigned int> next(rp.begin(), rp.end() - 1);
+	for (j = 0; j < n; j++)
+		for (p = Ap[j] + 1; p < Ap[j + 1]; p++) ri[next[Ai[p]]++] = j;
+
+	parent.assign(n, -1);
+	vector<int> ancestor(n, -1);
+	for (i = 0; i < n; i++) {
+		for (p = rp[i]; p < rp[i + 1]; p++) {
+			int r = (int)ri[p];
+			while (r != -1 && r < (int)i) {
+				const int up = ancestor[r];
+				ancestor[r] = (int)i;
+				if (up == -1) parent[r] = (int)i;
+				r = up;
+			}
+		}
+	}
+}
+
+// column counts, supernodes and their row structures
+inline void SparseLDL::Symbolic()
+{
+	vector<int> parent;
+	vector<unsigned int> rp, ri;
+	EliminationTree(parent, rp, ri);
+	unsigned int i, j, p, s;
+
+	// column counts from the row subtrees
+	vector<unsigned int> count(n, 1), children(n, 0);
+	vector<int> mark(n, -1);
+	for (i = 0; i < n; i++) {
+		mark[i] = (int)i;
+		for (p = rp[i]; p < rp[i + 1]; p++) {
+			for (j = ri[p]; mark[j] != (int)i; j = (unsigned int)parent[j]) {
+				count[j]++;
+				mark[j] = (int)i;
+			}
+		}
+		if (parent[i] >= 0) children[parent[i]]++;
+	}
+
+	// fundamental supernodes, relaxed: a narrow supernode also takes
+	// in its parent column if that adds few explicit zeros
+	const unsigned int Relaxed = 16;
+	SuperStart.clear();
+	size_t sum = 0;
+	for (j = 0; j < n; j++) {
+		bool merge = false;
+		if (j > 0 && parent[j - 1] == (int)j) {
+			const size_t f = SuperStart.back(), w = j - f + 1;
+			const size_t m = count[j] + (w - 1);
+			const size_t total = w * m - w * (w - 1) / 2;
+			const size_t zeros = total - (sum + count[j]);
+			merge = (children[j] == 1 && count[j - 1] == count[j] + 1)
+				|| (w <= Relaxed && 10 * zeros <= total);
+		}
+		if (!merge) {
+			SuperStart.push_back(j);
+			sum = 0;
+		}
+		sum += count[j];
+	}
+	SuperStart.push_back(n);
+	const unsigned int ns = (unsigned int)SuperStart.size() - 1;
+
+	vector<unsigned int> super(n);
+	for (s = 0; s < ns; s++)
+		for (j = SuperStart[s]; j < SuperStart[s + 1]; j++) super[j] = s;
+	SuperParent.assign(ns, -1);
+	for (s = 0; s < ns; s++) {
+		const int up = parent[SuperStart[s + 1] - 1];
+		if (up >= 0) SuperParent[s] = (int)super[up];
+	}
+	ChildPtr.assign(ns + 1, 0);
+	for (s = 0; s < ns; s++)
+		if (SuperParent[s] >= 0) ChildPtr[SuperParent[s] + 1]++;
+	for (s = 0; s < ns; s++) ChildPtr[s + 1] += ChildPtr[s];
+	Child.resize(ChildPtr[ns]);
+	vector<unsigned int> next(ChildPtr.begin(), ChildPtr.end() - 1);
+	for (s = 0; s < ns; s++)
+		if (SuperParent[s] >= 0) Child[next[SuperParent[s]]++] = s;
+
+	// row structures: the columns of the supernode, the rows of A
+	// below them and the rows of the children below their columns
+	Rp.assign(ns + 1, 0);
+	Ri.clear();
+	mark.assign(n, -1);
+	vector<unsigned int> below;
+	for (s = 0; s < ns; s++) {
+		const unsigned int f = SuperStart[s], l = SuperStart[s + 1];
+		below.clear();
+		for (j = f; j < l; j++) {
+			Ri.push_back(j);
+			mark[j] = (int)s;
+		}
+		for (j = f; j < l; j++)
+			for (p = Ap[j]; p < Ap[j + 1]; p++)
+				if (mark[Ai[p]] != (int)s) {
+					mark[Ai[p]] = (int)s;
+					below.push_back(Ai[p]);
+				}
+		for (p = ChildPtr[s]; p < ChildPtr[s + 1]; p++) {
+			const unsigned int c = Child[p];
+			for (i = Rp[c] + (SuperStart[c + 1] - SuperStart[c]); i < Rp[c + 1]; i++)
+				if (mark[Ri[i]] != (int)s) {
+					mark[Ri[i]] = (int)s;
+					below.push_back(Ri[i]);
+				}
+		}
+		sort(below.begin(), below.end());
+		Ri.insert(Ri.end(), below.begin(), below.end());
+		Rp[s + 1] = (unsigned int)Ri.size();
+	}
+
+	// levels of the supernodal tree, leaves first
+	vector<unsigned int> level(ns, 0);
+	unsigned int height = 0;
+	for (s = 0; s < ns; s++) {
+		if (SuperParent[s] >= 0)
+			level[SuperParent[s]] = max(level[SuperParent[s]], level[s] + 1);
+		height = max(height, level[s] + 1);
+	}
+	LevelPtr.assign(height + 1, 0);
+	for (s = 0; s < ns; s++) LevelPtr[level[s] + 1]++;
+	for (i = 0; i < height; i++) LevelPtr[i + 1] += LevelPtr[i];
+	LevelNodes.resize(ns);
+	next.assign(LevelPtr.begin(), LevelPtr.end() - 1);
+	for (s = 0; s < ns; s++) LevelNodes[next[level[s]]++] = s;
+
+	Lp.assign(ns + 1, 0);
+	for (s = 0; s < ns; s++) {
+		const size_t w = SuperStart[s + 1] - SuperStart[s], m = Rp[s + 1] - Rp[s];
+		Lp[s + 1] = Lp[s] + Offset(m, w);
+	}
+	Lx.assign(Lp[ns], 0.0);
+	D.assign(n, 0.0);
+	Update.assign(ns, vector<double>());
+}
+
+// factor the columns of a supernode and leave its contribution to the
+// ancestors in Update
+inline void SparseLDL::FactorNode(unsigned int s, int tid, m4extreme::Utils::TaskScheduler *scheduler)
+{
+	const unsigned int f = SuperStart[s], w = SuperStart[s + 1] - f;
+	const unsigned int m = Rp[s + 1] - Rp[s];
+	const unsigned int *R = &Ri[Rp[s]];
+	unsigned int *loc = &Local[tid][0];
+	unsigned int i, j, k, p;
+	for (i = 0; i < m; i++) loc[R[i]] = i;
+
+	// assemble the front from A and the contributions of the children
+	vector<double> F(Offset(m, m), 0.0);
+	for (k = 0; k < w; k++) {
+		double *Fk = &F[Offset(m, k)] - k;
+		for (p = Ap[f + k]; p < Ap[f + k + 1]; p++) Fk[loc[Ai[p]]] += Ax[p];
+	}
+	for (p = ChildPtr[s]; p < ChildPtr[s + 1]; p++) {
+		const unsigned int c = Child[p];
+		const unsigned int wc = SuperStart[c + 1] - SuperStart[c];
+		const unsigned int mc = Rp[c + 1] - Rp[c] - wc;
+		const unsigned int *Rc = &Ri[Rp[c] + wc];
+		const double *U = Update[c].empty() ? 0 : &Update[c][0];
+		for (j = 0; j < mc; j++) {
+			const unsigned int lj = loc[Rc[j]];
+			double *Fj = &F[Offset(m, lj)] - lj;
+			const double *Uj = U + Offset(mc, j) - j;
+			for (i = j; i < mc; i++) Fj[loc[Rc[i]]] += Uj[i];
+		}
+		vector<double>().swap(Update[c]);
+	}
+
+	// LDL^T of the pivot columns in blocks; each block updates the
+	// columns to its right, the Schur complement last
+	const unsigned int Block = 32;
+	double *d = &D[f];
+	SchurUpdate schur;
+	schur.F = &F[0]; schur.D = d; schur.m = m;
+	for (unsigned int kb = 0; kb < w; kb += Block) {
+		const unsigned int ke = min(w, kb + Block);
+		for (k = kb; k < ke; k++) {
+			schur.p0 = kb; schur.p1 = k;
+			schur.Update1(k);
+			double *Fk = &F[Offset(m, k)];
+			d[k] = Fk[0];
+			if (d[k] == 0.0) {
+				Info = Perm[f + k] + 1;
+				continue;
+			}
+			const double inv = 1.0 / d[k];
+			for (i = 1; i < m - k; i++) Fk[i] *= inv;
+		}
+		schur.p0 = kb; schur.p1 = ke;
+		if (scheduler != 0 && m - ke >= 128) {
+			scheduler->parallel_for((int)ke, (int)m, 8, schur);
+		} else {
+			schur((int)ke, (int)m, 0);
+		}
+	}
+
+	copy(F.begin(), F.begin() + Offset(m, w), Lx.begin() + Lp[s]);
+	if (m > w) vector<double>(F.begin() + Offset(m, w), F.end()).swap(Update[s]);
+}
+
+inline unsigned int SparseLDL::Factorize()
+{
+	m4extreme::Utils::TaskScheduler *scheduler = m4extreme::Utils::GetTaskScheduler();
+	if (scheduler != 0 && (scheduler->getNumberThreads() == 1 || scheduler->isRunning())) scheduler = 0;
+	const unsigned int threads = scheduler != 0 ? (unsigned int)scheduler->getNumberThreads() : 1;
+	Local.resize(threads);
+	for (unsigned int t = 0; t < threads; t++) Local[t].resize(n);
+
+	Info = 0;
+	for (unsigned int l = 0; l + 1 < LevelPtr.size(); l++) {
+		const unsigned int first = LevelPtr[l], count = LevelPtr[l + 1] - first;
+		if (scheduler != 0 && count >= threads) {
+			// independent supernodes of a level in parallel
+			FactorNodes body;
+			body.LDL = this; body.Nodes = &LevelNodes[first];
+			scheduler->parallel_for(0, (int)count, 1, body);
+		} else {
+			// few large supernodes, parallel Schur complements
+			for (unsigned int i = 0; i < count; i++) FactorNode(LevelNodes[first + i], 0, scheduler);
+		}
+	}
+	return Info;
+}
+
+inline void SparseLDL::Solve(double *b) const
+{
+	const unsigned int ns = (unsigned int)SuperStart.size() - 1;
+	vector<double> x(n);
+	unsigned int i, k, s;
+	for (i = 0; i < n; i++) x[i] = b[Perm[i]];
+
+	// L y = b
+	for (s = 0; s < ns; s++) {
+		const unsigned int f = SuperStart[s], w = SuperStart[s + 1] - f;
+		const unsigned int m = Rp[s + 1] - Rp[s];
+		const unsigned int *R = &Ri[Rp[s]];
+		const double *L = &Lx[Lp[s]];
+		for (k = 0; k < w; k++) {
+			const double *Lk = L + Offset(m, k) - k;
+			const double xk = x[f + k];
+			if (xk == 0.0) continue;
+			for (i = k + 1; i < m; i++) x[R[i]] -= Lk[i] * xk;
+		}
+	}
+	for (i = 0; i < n; i++) x[i] /= D[i];
+
+	// L^T x = y
+	for (s = ns; s-- > 0;) {
+		const unsigned int f = SuperStart[s], w = SuperStart[s + 1] - f;
+		const unsigned int m = Rp[s + 1] - Rp[s];
+		const unsigned int *R = &Ri[Rp[s]];
+		const double *L = &Lx[Lp[s]];
+		for (k = w; k-- > 0;) {
+			const double *Lk = L + Offset(m, k) - k;
+			double xk = x[f + k];
+			for (i = k + 1; i < m; i++) xk -= Lk[i] * x[R[i]];
+			x[f + k] = xk;
+		}
+	}
+	for (i = 0; i < n; i++) b[Perm[i]] = x[i];
+}
+
+}
+
+}
+
+#endif // !defined(SOLVER_LINEAR_SPARSELDL__INCLUDED_)
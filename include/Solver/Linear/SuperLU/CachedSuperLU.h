@@ -0,0 +1,462 @@
+// CachedSuperLU.h: interface for the CachedSuperLU class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC 
+// All rights reserved
+// see file License.txt for license details
+
+#if !defined(SOLVER_LINEAR_CACHEDSUPERLU__INCLUDED_)
+#define SOLVER_LINEAR_CACHEDSUPERLU__INCLUDED_
+
+#pragma once
+
+#include <math.h> 
+#include <stdlib.h> 
+#include <vector>
+
+#include <iostream>
+
+using namespace std;
+
+#include "SRC/slu_ddefs.h"
+#include "SRC/slu_util.h" 
+#include "Solver/Linear/Linear.h"
+#include "Solver/Linear/SuperLU/SuperLUPattern.h"
+
+
+namespace Solver {
+  namespace Linear {
+
+    //
+    // SuperLU_V4 for a system solved again and again on one pattern,
+    // e.g. the TMSemiImplicit temperature system between remeshing
+    // events: the ordering comes from the SuperLUPattern cache, the
+    // values are factored again only after they changed, with
+    // SamePattern_SameRowPerm where SuperLU allows it, and Slot() gives
+    // the storage of an entry for direct assembly. It is a class of its
+    // own because SuperLU_V4<Set::Manifold::Point*> is instantiated in
+    // the compiled solver library.
+    //
+    template <class key>
+      class CachedSuperLU : public System <key> {
+    public:
+
+      //      Constructors/destructors:
+
+      // SymMode = 1 for a symmetric pattern; MulRhs != 0 keeps L and U
+      // in memory between solves, so that repeated solves with unchanged
+      // values skip the factorization
+      CachedSuperLU();
+      CachedSuperLU(const set<key> &, const set<pair <key, key> > &, const int = 0, const int = 0);
+      CachedSuperLU(const vector<key> &, const int = 0, const int = 0);
+      virtual ~CachedSuperLU();
+
+      //      Accessors/mutators:
+
+      double Get(key);
+      double Get(key, key);
+      void Set(key, double);
+      void Set(key, key, double);
+
+      //      General methods:
+
+      void SetToZero1();
+      void SetToZero2();
+      void Add(key, double);
+      void Add(key, key, double);
+      void Solve();
+      double Norm();
+
+      // several right hand sides with one factorization
+      void Solve(double *, const int);
+      unsigned int Index(key K) { return KeyMap[K]; }
+
+      // storage of an entry for direct assembly, 0 if not in the pattern
+      double *Slot(key K) {
+	typename map<key, unsigned int>::const_iterator iK = KeyMap.find(K);
+	return iK == KeyMap.end() ? 0 : b + iK->second;
+      }
+      double *Slot(key K1, key K2) {
+	typename map<pair<key, key>, unsigned int>::const_iterator
+	  iKK = KeyPairMap.find(make_pair(K2, K1));
+	return iKK == KeyPairMap.end() ? 0 : a + iKK->second;
+      }
+
+      // values changed through Slot(), the next Solve() refactors
+      void Modified() {
+	if (options.Fact == FACTORED) options.Fact = SamePattern_SameRowPerm;
+      }
+
+    private:
+
+      void Analyze(const int);
+      void Factorize();
+      void Release();
+
+      unsigned int n;
+      unsigned int nnz;
+
+      map<key, unsigned int> KeyMap;
+      map<pair<key, key>, unsigned int> KeyPairMap;
+
+      SuperMatrix A;
+      SuperMatrix AC;
+      SuperMatrix L;
+      SuperMatrix U;
+      SuperMatrix B;
+      int panel_size;
+      int relax;
+      int many_rhs;
+      double *a;
+      double *b;
+      int *Row;
+      int *Column;
+      int *PermutationRow;
+      int *PermutationColumn;
+      int *etree;
+
+      superlu_options_t options;
+      SuperLUStat_t stat;
+
+    private:
+
+      CachedSuperLU(CachedSuperLU &);
+      void operator=(CachedSuperLU &);
+    };
+
+    template <class key>
+      CachedSuperLU<key>::CachedSuperLU() {
+      a = 0;
+      b = 0;
+      Row = 0;
+      Column = 0;
+      PermutationRow = 0;
+      PermutationColumn = 0;
+      many_rhs = 0;
+
+      dCreate_CompCol_Matrix(&A, 0, 0, 0, a, Row, Column, SLU_NC, SLU_D, SLU_GE);
+      dCreate_Dense_Matrix(&B, 0, 1, b, 0, SLU_DN, SLU_D, SLU_GE);
+      L.Store = 0;
+      U.Store = 0;
+    }
+
+    template <class key>
+      CachedSuperLU<key>::CachedSuperLU(const set<key> &Keys,
+			    const set<pair<key, key> > &KeyPairs, const int SymMode, const int MulRhs) : many_rhs(MulRhs) {
+      unsigned int i, j, npp;
+      key K1, K2, K3;
+      pair <key, key> KK;
+      typename std::set <key>::const_iterator iK;
+      typename std::set <pair <key, key> >::const_iterator iKK;
+
+      n = (unsigned int) Keys.size();
+      npp = n + 1;
+      nnz = (unsigned int) KeyPairs.size();
+
+      if (n == 0) throw (0);
+
+      a = (double *) malloc(nnz * sizeof (double));
+      b = (double *) malloc(n * sizeof (double));
+      Row = (int *) malloc(nnz * sizeof (int));
+      Column = (int *) malloc(npp * sizeof (int));
+
+      for (i = 0; i < nnz; i++) {
+	a[i] = 0.0;
+	Row[i] = 0;
+      }
+
+      for (i = 0; i < n; i++) b[i] = 0.0;
+
+      for (i = 0; i < npp; i++) Column[i] = 0;
+
+      for (iK = Keys.begin(), i = 0; iK != Keys.end(); iK++, i++) KeyMap[*iK] = i;
+
+      j = 0;
+      Column[0] = 0;
+      K3 = *(Keys.begin());
+
+      for (iKK = KeyPairs.begin(), i = 0; iKK != KeyPairs.end(); iKK++, i++) {
+	KK = *iKK;
+	K2 = KK.first;
+	K1 = KK.second;
+	Row[i] = KeyMap[K1];
+	KeyPairMap[KK] = i;
+	if (K2 != K3) {
+	  K3 = K2;
+	  j++;
+	  Column[j] = i;
+	}
+      }
+
+      Column[n] = nnz;
+
+      PermutationRow = new int [n];
+      PermutationColumn = new int [n];
+
+      dCreate_CompCol_Matrix(&A, n, n, nnz, a, Row, Column, SLU_NC, SLU_D, SLU_GE);
+      dCreate_Dense_Matrix(&B, n, 1, b, n, SLU_DN, SLU_D, SLU_GE);
+      Analyze(SymMode);
+    }
+
+    //
+    //
+    //
+    template <class key>
+      CachedSuperLU<key>::CachedSuperLU(const vector<key> &Keys,
+				  const int SymMode, const int MulRhs) 
+      : many_rhs(MulRhs) {
+      unsigned int i, j, npp;
+      key K1, K2;
+
+      n = (unsigned int) Keys.size();
+      npp = n + 1;
+      nnz = n*n;
+
+      if (n == 0) throw (0);
+
+      a = (double *) malloc(nnz * sizeof (double));
+      b = (double *) malloc(n * sizeof (double));
+      Row = (int *) malloc(nnz * sizeof (int));
+      Column = (int *) malloc(npp * sizeof (int));
+
+      for (i = 0; i < nnz; ++i) {
+	a[i] = 0.0;
+	Row[i] = 0;
+      }
+
+      for (i = 0; i < n; ++i) b[i] = 0.0;
+
+      for (i = 0; i < npp; ++i) Column[i] = 0;
+
+      for (i = 0; i < n; ++i) {
+	KeyMap.insert( make_pair(Keys[i], i) );
+      }
+
+      int count = 0;
+      for ( i = 0; i < n; ++i ) {
+	Column[i] = count;
+	K1 = Keys[i];
+	for ( j = 0; j < n; ++j ) {
+	  K2 = Keys[j];
+	  Row[count] = j;
+	  KeyPairMap[make_pair(K2, K1)] = count;
+	  ++count;
+	}
+      }
+
+      Column[n] = nnz;
+
+      PermutationRow = new int [n];
+      PermutationColumn = new int [n];
+
+      dCreate_CompCol_Matrix(&A, n, n, nnz, a, Row, Column, SLU_NC, SLU_D, SLU_GE);
+      dCreate_Dense_Matrix(&B, n, 1, b, n, SLU_DN, SLU_D, SLU_GE);
+      Analyze(SymMode);
+    }
+
+    //
+    // ordering and elimination tree of the pattern, from the cache if
+    // the pattern was analyzed before
+    //
+    template <class key>
+      void CachedSuperLU<key>::Analyze(const int SymMode) {
+      L.Store = 0;
+      U.Store = 0;
+      panel_size = sp_ienv(1);
+      relax = sp_ienv(2);
+      StatInit(&stat);
+      etree = intMalloc(A.ncol);
+      options.IterRefine = NOREFINE;
+      options.Trans = NOTRANS;
+      if (SymMode != 1) {
+	options.SymmetricMode = NO;
+	options.DiagPivotThresh = 1.0;
+	options.ColPerm = COLAMD;
+      } else {
+	options.SymmetricMode = YES;
+	options.DiagPivotThresh = 0.001;
+	options.ColPerm = MMD_AT_PLUS_A;
+      }
+
+      if (SuperLUPattern::Find(SymMode, n, nnz, Column, Row, PermutationColumn, etree)) {
+	// the ordering is postordered already, only AC is set up
+	options.Fact = FACTORED;
+	sp_preorder(&options, &A, PermutationColumn, etree, &AC);
+      } else {
+	options.Fact = DOFACT;
+	get_perm_c(2, &A, PermutationColumn);
+	sp_preorder(&options, &A, PermutationColumn, etree, &AC);
+	SuperLUPattern::Insert(SymMode, n, nnz, Column, Row, PermutationColumn, etree);
+      }
+      options.Fact = SamePattern;
+    }
+
+    //
+    //
+    //
+    template <class key>
+      CachedSuperLU<key>::~CachedSuperLU() {
+      if (SuperLUPattern::Factorizer() == this) SuperLUPattern::Factorizer() = 0;
+      SUPERLU_FREE(etree);
+      StatFree(&stat);
+      SUPERLU_FREE(b);
+      if (U.Store != 0) Destroy_CompCol_Matrix(&U);
+      if (L.Store != 0) Destroy_SuperNode_Matrix(&L);
+      Destroy_SuperMatrix_Store(&B);
+      Destroy_CompCol_Matrix(&A);
+      Destroy_CompCol_Permuted(&AC);
+
+      delete [] PermutationColumn;
+      delete [] PermutationRow;
+
+      KeyPairMap.clear();
+      KeyMap.clear();
+    }
+
+    template <class key>
+      double CachedSuperLU<key>::Get(key K) {
+      return b[KeyMap[K]];
+    }
+
+    template <class key>
+      double CachedSuperLU<key>::Get(key K1, key K2) {
+      return a[KeyPairMap[make_pair(K2, K1)]];
+    }
+
+    template <class key>
+      void CachedSuperLU<key>::Set(key K, double Input) {
+      b[KeyMap[K]] = Input;
+    }
+
+    template <class key>
+      void CachedSuperLU<key>::Set(key K1, key K2, double Input) {
+      a[KeyPairMap[make_pair(K2, K1)]] = Input;
+      Modified();
+    }
+
+    template <class key>
+      void CachedSuperLU<key>::SetToZero1() {
+      unsigned int i;
+      for (i = 0; i < n; i++) b[i] = 0.0;
+    }
+
+    template <class key>
+      void CachedSuperLU<key>::SetToZero2() {
+      unsigned int i;
+      for (i = 0; i < nnz; i++) a[i] = 0.0;
+      Modified();
+    }
+
+    template <class key>
+      void CachedSuperLU<key>::Add(key K, double Input) {
+      b[KeyMap[K]] += Input;
+    }
+
+    template <class key>
+      double CachedSuperLU<key>::Norm() {
+      unsigned int i;
+      double N = 0.0;
+      for (i = 0; i < n; i++) N += b[i] * b[i];
+      return sqrt(N);
+    }
+
+    template <class key>
+      void CachedSuperLU<key>::Add(key K1, key K2, double Input) {
+      a[KeyPairMap[make_pair(K2, K1)]] += Input;
+      Modified();
+    }
+
+    //
+    // numeric factorization of the current values: the first one with
+    // the cached ordering, the following ones reuse the row permutation
+    // and the storage of L and U (SamePattern_SameRowPerm), SuperLU
+    // still pivots where the old pivot became too small. The reuse
+    // needs the static expanders of SuperLU to be those of this system,
+    // i.e. no other system factored in between; otherwise L and U are
+    // freed and the factorization starts over with SamePattern
+    //
+    template <class key>
+      void CachedSuperLU<key>::Factorize() {
+      int info = 0;
+      int lwork = 0;
+
+      if (options.Fact == SamePattern_SameRowPerm
+	  && (L.Store == 0 || U.Store == 0 || SuperLUPattern::Factorizer() != this))
+	options.Fact = SamePattern;
+
+      if (options.Fact != SamePattern_SameRowPerm) {
+	if (U.Store != 0) Destroy_CompCol_Matrix(&U);
+	U.Store = 0;
+	if (L.Store != 0) Destroy_SuperNode_Matrix(&L);
+	L.Store = 0;
+      }
+
+      dgstrf(&options, &AC, relax, panel_size, etree, NULL,
+	     lwork, PermutationColumn, PermutationRow, &L, &U, &stat, &info);
+      SuperLUPattern::Factorizer() = this;
+
+      if (info != 0) {
+	cout << "Solver::CachedSuperLU error in factorization @" << endl;
+	dPrint_Dense_Matrix("AC", &AC);
+	throw (0);
+      }
+
+      options.Fact = FACTORED;
+    }
+
+    //
+    // with MulRhs == 0 the factors are not kept between solves, which
+    // saves the memory of L and U at the price of a factorization per
+    // Solve; otherwise they are kept until the values change
+    //
+    template <class key>
+      void CachedSuperLU<key>::Release() {
+      if (many_rhs != 0) return;
+      if (U.Store != 0) Destroy_CompCol_Matrix(&U);
+      U.Store = 0;
+      if (L.Store != 0) Destroy_SuperNode_Matrix(&L);
+      L.Store = 0;
+      options.Fact = SamePattern;
+    }
+
+    template <class key>
+      void CachedSuperLU<key>::Solve() {
+      int info = 0;
+      trans_t trans = NOTRANS;
+
+      if (options.Fact != FACTORED) Factorize();
+
+      dgstrs(trans, &L, &U, PermutationColumn, PermutationRow, &B, &stat, &info);
+
+      if (info != 0) {
+	cout << "Solver::CachedSuperLU error in solution @" << endl;
+	throw (0);
+      }
+
+      Release();
+    }
+
+    //
+    // X holds nrhs right hand sides of n entries each, in the order of
+    // Index(), and is overwritten by the solutions
+    //
+    template <class key>
+      void CachedSuperLU<key>::Solve(double *X, const int nrhs) {
+      int info = 0;
+      trans_t trans = NOTRANS;
+      SuperMatrix BX;
+
+      if (options.Fact != FACTORED) Factorize();
+
+      dCreate_Dense_Matrix(&BX, n, nrhs, X, n, SLU_DN, SLU_D, SLU_GE);
+      dgstrs(trans, &L, &U, PermutationColumn, PermutationRow, &BX, &stat, &info);
+      Destroy_SuperMatrix_Store(&BX);
+
+      if (info != 0) {
+	cout << "Solver::CachedSuperLU error in solution @" << endl;
+	throw (0);
+      }
+
+      Release();
+    }
+  }
+}
+#endif // !defined(SOLVER_LINEAR_CACHEDSUPERLU__INCLUDED_)
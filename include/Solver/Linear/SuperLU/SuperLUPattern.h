@@ -0,0 +1,104 @@
+// SuperLUPattern.h: interface for the SuperLUPattern class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+
+#if !defined(SOLVER_LINEAR_SUPERLUPATTERN__INCLUDED_)
+#define SOLVER_LINEAR_SUPERLUPATTERN__INCLUDED_
+
+#pragma once
+
+#include <list>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace Solver {
+  namespace Linear {
+
+    //
+    // Column orderings and elimination trees of the sparsity patterns
+    // analyzed last, shared by all the CachedSuperLU systems of the
+    // process. A system built again for a pattern that is in the cache,
+    // e.g. after the DOF set was touched without remeshing, skips
+    // get_perm_c and the elimination tree. The patterns are hashed in
+    // index space, so that the keys themselves may change.
+    //
+    class SuperLUPattern {
+    public:
+
+      // copy the ordering and elimination tree of the pattern, false if unknown
+      static bool Find(int SymMode, int n, int nnz, const int *Column, const int *Row,
+		       int *perm_c, int *etree) {
+	const unsigned long long h = Hash(SymMode, n, nnz, Column, Row);
+	list<Entry> &C = Cache();
+	for (list<Entry>::iterator it = C.begin(); it != C.end(); it++) {
+	  if (it->hash != h || it->SymMode != SymMode || (int) it->etree.size() != n
+	      || (int) it->Row.size() != nnz
+	      || !equal(it->Column.begin(), it->Column.end(), Column)
+	      || !equal(it->Row.begin(), it->Row.end(), Row)) continue;
+	  copy(it->perm_c.begin(), it->perm_c.end(), perm_c);
+	  copy(it->etree.begin(), it->etree.end(), etree);
+	  C.splice(C.begin(), C, it);
+	  return true;
+	}
+	return false;
+      }
+
+      // remember the ordering and elimination tree of a pattern
+      static void Insert(int SymMode, int n, int nnz, const int *Column, const int *Row,
+			 const int *perm_c, const int *etree) {
+	list<Entry> &C = Cache();
+	C.push_front(Entry());
+	Entry &E = C.front();
+	E.hash = Hash(SymMode, n, nnz, Column, Row);
+	E.SymMode = SymMode;
+	E.Column.assign(Column, Column + n + 1);
+	E.Row.assign(Row, Row + nnz);
+	E.perm_c.assign(perm_c, perm_c + n);
+	E.etree.assign(etree, etree + n);
+	while (C.size() > Capacity) C.pop_back();
+      }
+
+      static void Clear() { Cache().clear(); }
+
+      // the system that ran dgstrf last: SuperLU 4.x keeps the expanders
+      // of the last factorization in static storage, so only this system
+      // may refactor with SamePattern_SameRowPerm
+      static const void *&Factorizer() {
+	static const void *owner = 0;
+	return owner;
+      }
+
+    private:
+
+      static const size_t Capacity = 4;
+
+      struct Entry {
+	unsigned long long hash;
+	int SymMode;
+	vector<int> Column, Row, perm_c, etree;
+      };
+
+      // most recently used first
+      static list<Entry> &Cache() {
+	static list<Entry> C;
+	return C;
+      }
+
+      // FNV-1a
+      static unsigned long long Hash(int SymMode, int n, int nnz, const int *Column, const int *Row) {
+	unsigned long long h = 14695981039346656037ULL;
+	h = (h ^ (unsigned int) SymMode) * 1099511628211ULL;
+	h = (h ^ (unsigned int) n) * 1099511628211ULL;
+	for (int i = 0; i <= n; i++) h = (h ^ (unsigned int) Column[i]) * 1099511628211ULL;
+	for (int i = 0; i < nnz; i++) h = (h ^ (unsigned int) Row[i]) * 1099511628211ULL;
+	return h;
+      }
+    };
+
+  }
+}
+
+#endif // !defined(SOLVER_LINEAR_SUPERLUPATTERN__INCLUDED_)
@@ -90,6 +90,22 @@ namespace Solver
     const vector<double> & GetNodalDT() const;
     const double & GetMaxDT() const;
 
+#ifndef _M4EXTREME_MPI_
+    // the nodes of the temperature system of SolvingTemperature
+    const vector<Set::Manifold::Point *> & GetTemperatureNodes() const { return _Keys; }
+
+    // replaces the linear system of SolvingTemperature, by default a
+    // dense SuperLU_V4 over GetTemperatureNodes(), e.g. by a
+    // Linear::KrylovSystem over the same nodes; returns the previous
+    // one, which the caller deletes. S is not deleted by the destructor.
+    Solver::Linear::System<Set::Manifold::Point *> *
+    SetImplicitSolver(Solver::Linear::System<Set::Manifold::Point *> * S) {
+      Solver::Linear::System<Set::Manifold::Point *> * previous = _ImplicitSolver;
+      _ImplicitSolver = S;
+      return previous;
+    }
+#endif
+
     void operator ++ ();
     void DynamicRelaxation();
     double SolvingTemperature ();
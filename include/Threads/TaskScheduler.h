@@ -0,0 +1,365 @@
+// TaskScheduler.h: interface for the TaskScheduler class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_UTILS_THREADS_TASKSCHEDULER_H
+#define _M4EXTREME_UTILS_THREADS_TASKSCHEDULER_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <cassert>
+#include <vector>
+
+/**
+* The TaskScheduler class runs
+*     parallel_for(begin, end, grain, fn)
+* on a pool of threads with work stealing. The range is cut into
+* chunks of grain items and dealt out to the threads in contiguous
+* blocks. A thread takes chunks from the front of its own block and,
+* once the block is exhausted, steals the back half of the block of
+* another thread. The front and back of a block are packed into one
+* word that is only ever updated by compare-and-swap, so neither
+* taking nor stealing needs a lock, and a few expensive items no longer
+* leave the other threads idle at the barrier.
+*
+* The calling thread takes part in the work as thread 0. The functor
+* is called as fn(lo, hi, tid) on the half-open range [lo, hi).
+*
+* A parallel_for called from within the body of another one on the
+* same scheduler runs serially on the calling thread, with its tid; a
+* parallel_for called from an unrelated thread while one is running
+* waits for it to finish.
+*/
+
+namespace m4extreme {
+
+	namespace Utils {
+
+		/**
+		* classes defined in this header file
+		*/
+
+		class TaskScheduler;
+
+		/**
+		* TaskScheduler
+		*/
+
+		class TaskScheduler {
+
+		public:
+
+			/**
+			* type erased body of a parallel_for
+			*/
+
+			class Task {
+			public:
+				virtual ~Task() {}
+				virtual void operator () (int lo, int hi, int tid) = 0;
+			};
+
+		private:
+
+			template<class F>
+			class FunctorTask : public Task {
+			public:
+				FunctorTask(F & fn) : _fn(fn) {}
+				void operator () (int lo, int hi, int tid) { _fn(lo, hi, tid); }
+			private:
+				F & _fn;
+			};
+
+			class FunctionTask : public Task {
+			public:
+				FunctionTask(void (*fn)(int, int, int, void *), void * arg) :
+				_fn(fn), _arg(arg) {}
+				void operator () (int lo, int hi, int tid) { _fn(lo, hi, tid, _arg); }
+			private:
+				void (*_fn)(int, int, int, void *);
+				void * _arg;
+			};
+
+			/**
+			* block of chunks owned by a thread, [front, back) packed
+			* in one word and padded to a cache line
+			*/
+
+			struct Slot {
+				volatile unsigned long long range;
+				char pad[64 - sizeof(unsigned long long)];
+			};
+
+			struct Worker {
+				TaskScheduler * scheduler;
+				int tid;
+			};
+
+		public:
+
+			/**
+			* constructor
+			*/
+
+			TaskScheduler(int numberThreads) :
+			_numberThreads(numberThreads > 0 ? numberThreads : 1),
+			_slots(_numberThreads), _workers(_numberThreads),
+			_threads(_numberThreads), _task(0), _begin(0), _end(0),
+			_grain(1), _generation(0), _finished(0), _shutdown(false),
+			_running(0) {
+				pthread_mutex_init(&_mutex, NULL);
+				pthread_cond_init(&_start, NULL);
+				for (int i = 0; i < _numberThreads; ++i) {
+					_slots[i].range = 0;
+					_workers[i].scheduler = this;
+					_workers[i].tid = i;
+				}
+				for (int i = 1; i < _numberThreads; ++i) {
+					pthread_create(&_threads[i], NULL, _run, &_workers[i]);
+				}
+			}
+
+			/**
+			* destructor
+			*/
+
+			~TaskScheduler() {
+				pthread_mutex_lock(&_mutex);
+				_shutdown = true;
+				pthread_cond_broadcast(&_start);
+				pthread_mutex_unlock(&_mutex);
+				for (int i = 1; i < _numberThreads; ++i) {
+					pthread_join(_threads[i], NULL);
+				}
+				pthread_cond_destroy(&_start);
+				pthread_mutex_destroy(&_mutex);
+			}
+
+			/**
+			* access the number of threads
+			*/
+
+			int getNumberThreads() const { return _numberThreads; }
+
+			/**
+			* true while a parallel_for is in progress, the body of a
+			* parallel_for may test it to run nested loops serially
+			*/
+
+			bool isRunning() const { return _running != 0; }
+
+			/**
+			* run fn(lo, hi, tid) over [begin, end) in chunks of grain
+			*/
+
+			template<class F>
+			void parallel_for(int begin, int end, int grain, F & fn) {
+				FunctorTask<F> task(fn);
+				run(begin, end, grain, task);
+			}
+
+			void parallel_for(int begin, int end, int grain,
+				void (*fn)(int, int, int, void *), void * arg) {
+				FunctionTask task(fn, arg);
+				run(begin, end, grain, task);
+			}
+
+			void run(int begin, int end, int grain, Task & task) {
+				if (end <= begin) return;
+				if (grain < 1) grain = 1;
+
+				const unsigned int nchunks = (unsigned int)((end - begin + grain - 1) / grain);
+				if (_numberThreads == 1 || nchunks == 1) {
+					task(begin, end, 0);
+					return;
+				}
+
+				// parallel_for does not nest, a nested loop runs on the
+				// calling thread
+				if (_current() == this) {
+					task(begin, end, _currentTid());
+					return;
+				}
+				while (!__sync_bool_compare_and_swap(&_running, 0, 1)) sched_yield();
+
+				// initial static partition of the chunks
+				for (int i = 0; i < _numberThreads; ++i) {
+					const unsigned int front = (unsigned int)(((unsigned long long)nchunks * i) / _numberThreads);
+					const unsigned int back = (unsigned int)(((unsigned long long)nchunks * (i + 1)) / _numberThreads);
+					_slots[i].range = _pack(front, back);
+				}
+				_task = &task;
+				_begin = begin;
+				_end = end;
+				_grain = grain;
+				_finished = 0;
+
+				pthread_mutex_lock(&_mutex);
+				++_generation;
+				pthread_cond_broadcast(&_start);
+				pthread_mutex_unlock(&_mutex);
+
+				_work(0);
+
+				while (__sync_fetch_and_add(&_finished, 0) < _numberThreads) sched_yield();
+				_task = 0;
+				__sync_lock_release(&_running);
+			}
+
+		private:
+
+			static unsigned long long _pack(unsigned int front, unsigned int back) {
+				return ((unsigned long long)front << 32) | back;
+			}
+
+			static unsigned int _front(unsigned long long r) { return (unsigned int)(r >> 32); }
+			static unsigned int _back(unsigned long long r) { return (unsigned int)(r & 0xffffffffULL); }
+
+			void _execute(unsigned int chunk, int tid) {
+				const int lo = _begin + (int)chunk * _grain;
+				const int hi = lo + _grain < _end ? lo + _grain : _end;
+				(*_task)(lo, hi, tid);
+			}
+
+			// take the front chunk of the own block
+			bool _pop(int tid, unsigned int & chunk) {
+				volatile unsigned long long & r = _slots[tid].range;
+				for (;;) {
+					const unsigned long long old = r;
+					const unsigned int front = _front(old), back = _back(old);
+					if (front >= back) return false;
+					if (__sync_bool_compare_and_swap(&r, old, _pack(front + 1, back))) {
+						chunk = front;
+						return true;
+					}
+				}
+			}
+
+			// steal the back half of the block of another thread; the
+			// first stolen chunk is returned, the rest becomes the own
+			// block. Returns false once every block is empty.
+			bool _steal(int tid, unsigned int & chunk) {
+				for (;;) {
+					bool busy = false;
+					for (int k = 1; k < _numberThreads; ++k) {
+						const int victim = (tid + k) % _numberThreads;
+						volatile unsigned long long & r = _slots[victim].range;
+						const unsigned long long old = r;
+						const unsigned int front = _front(old), back = _back(old);
+						if (front >= back) continue;
+						busy = true;
+						const unsigned int mid = front + (back - front) / 2;
+						if (__sync_bool_compare_and_swap(&r, old, _pack(front, mid))) {
+							chunk = mid;
+							__sync_lock_test_and_set(&_slots[tid].range, _pack(mid + 1, back));
+							return true;
+						}
+					}
+					if (!busy) return false;
+				}
+			}
+
+			// the scheduler whose task the calling thread is running
+			static TaskScheduler *& _current() {
+				static __thread TaskScheduler * current = 0;
+				return current;
+			}
+
+			static int & _currentTid() {
+				static __thread int tid = 0;
+				return tid;
+			}
+
+			void _work(int tid) {
+				TaskScheduler * const outer = _current();
+				const int outerTid = _currentTid();
+				_current() = this;
+				_currentTid() = tid;
+				unsigned int chunk;
+				for (;;) {
+					if (_pop(tid, chunk) || _steal(tid, chunk)) {
+						_execute(chunk, tid);
+					}
+					else {
+						break;
+					}
+				}
+				_current() = outer;
+				_currentTid() = outerTid;
+				__sync_fetch_and_add(&_finished, 1);
+			}
+
+			static void * _run(void * arg) {
+				Worker * w = static_cast<Worker *>(arg);
+				TaskScheduler * s = w->scheduler;
+				unsigned long long seen = 0;
+				for (;;) {
+					pthread_mutex_lock(&s->_mutex);
+					while (s->_generation == seen && !s->_shutdown) {
+						pthread_cond_wait(&s->_start, &s->_mutex);
+					}
+					if (s->_shutdown) {
+						pthread_mutex_unlock(&s->_mutex);
+						break;
+					}
+					seen = s->_generation;
+					pthread_mutex_unlock(&s->_mutex);
+					s->_work(w->tid);
+				}
+				return NULL;
+			}
+
+		private:
+
+			int                     _numberThreads;
+			std::vector<Slot>       _slots;
+			std::vector<Worker>     _workers;
+			std::vector<pthread_t>  _threads;
+			Task *                  _task;
+			int                     _begin;
+			int                     _end;
+			int                     _grain;
+			unsigned long long      _generation;
+			volatile int            _finished;
+			bool                    _shutdown;
+			volatile int            _running;
+			pthread_mutex_t         _mutex;
+			pthread_cond_t          _start;
+
+		private:
+
+			TaskScheduler(const TaskScheduler &);
+			TaskScheduler & operator = (const TaskScheduler &);
+		};
+
+		/**
+		* process wide scheduler, same life cycle as the ThreadMonitor
+		*/
+
+		inline TaskScheduler *& _taskSchedulerInstance() {
+			static TaskScheduler * instance = 0;
+			return instance;
+		}
+
+		inline void CreateTaskScheduler(int numberThreads) {
+			if (_taskSchedulerInstance() == 0) {
+				_taskSchedulerInstance() = new TaskScheduler(numberThreads);
+			}
+		}
+
+		inline void DestroyTaskScheduler() {
+			delete _taskSchedulerInstance();
+			_taskSchedulerInstance() = 0;
+		}
+
+		inline TaskScheduler * GetTaskScheduler() {
+			return _taskSchedulerInstance();
+		}
+
+	}
+
+}
+
+#endif /* _M4EXTREME_UTILS_THREADS_TASKSCHEDULER_H */
@@ -0,0 +1,627 @@
+// Profiler.h: interface for the Profiler class.
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_UTILS_PROFILER_H
+#define _M4EXTREME_UTILS_PROFILER_H
+
+#include <pthread.h>
+#include <time.h>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(_M4EXTREME_MPI_)
+#include "mpi.h"
+#endif
+
+/**
+* The Profiler class accumulates the wall time of named regions and a
+* few event counters, per thread and per step:
+*
+*     m4extreme::Utils::CreateProfiler();
+*     m4extreme::Utils::GetProfiler()->SetOutput("profile.csv");
+*     for (...) {
+*         {
+*             M4EXTREME_PROFILE_SCOPE("step");
+*             ...
+*         }
+*         m4extreme::Utils::GetProfiler()->EndStep(step);
+*     }
+*
+* Regions nest, a region entered inside another one is its child and is
+* reported under its path, e.g. step/force/sync. Each thread keeps its
+* own tree of regions and its own counters, so that neither timing nor
+* counting takes a lock; a region entered on a worker thread is a root
+* of the tree of that thread. Counted are the material point
+* evaluations, the neighbor queries, the Newton iterations of the
+* max-ent shape functions and the MPI messages and bytes of the halo
+* exchange.
+*
+* On Linux the cycles, instructions and cache misses of the regions are
+* read from perf_event_open when EnableHardwareCounters is called; the
+* counters read as zero where the kernel refuses them.
+*
+* EndStep collects the trees and counters of all threads, so it must be
+* called by the main thread while the workers are idle, e.g. between
+* two parallel_for. With _M4EXTREME_MPI_ it is collective and reports
+* the min, average and max over the ranks; rank 0 writes one record per
+* step, as CSV rows
+*     step,name,metric,min,avg,max
+* or as a line of JSON.
+*
+* The macros compile to nothing unless _M4EXTREME_PROFILE_ is defined,
+* and otherwise cost a test on the profiler instance when it is not
+* created or disabled.
+*/
+
+#if defined(_M4EXTREME_PROFILE_)
+#define M4EXTREME_PROFILE_CONCAT_(a, b) a##b
+#define M4EXTREME_PROFILE_NAME_(line) M4EXTREME_PROFILE_CONCAT_(_m4extreme_profile_, line)
+#define M4EXTREME_PROFILE_SCOPE(name) \
+	m4extreme::Utils::ScopedTimer M4EXTREME_PROFILE_NAME_(__LINE__)(name)
+#define M4EXTREME_PROFILE_COUNT(counter, n) \
+	m4extreme::Utils::Profiler::Count(m4extreme::Utils::Profiler::counter, n)
+#else
+#define M4EXTREME_PROFILE_SCOPE(name)
+#define M4EXTREME_PROFILE_COUNT(counter, n)
+#endif
+
+namespace m4extreme {
+
+	namespace Utils {
+
+		/**
+		* classes defined in this header file
+		*/
+
+		class Profiler;
+		class ScopedTimer;
+
+		inline Profiler *& _profilerInstance() {
+			static Profiler * instance = 0;
+			return instance;
+		}
+
+		inline Profiler * GetProfiler() {
+			return _profilerInstance();
+		}
+
+		/**
+		* Profiler
+		*/
+
+		class Profiler {
+
+		public:
+
+			enum COUNTER {
+				MPT_EVALUATIONS = 0,
+				NEIGHBOR_QUERIES,
+				NEWTON_ITERATIONS,
+				MPI_MESSAGES,
+				MPI_BYTES,
+				NUM_COUNTERS
+			};
+
+			enum HARDWARE {
+				CYCLES = 0,
+				INSTRUCTIONS,
+				CACHE_MISSES,
+				NUM_HARDWARE
+			};
+
+			enum FORMAT { CSV = 0, JSON = 1 };
+
+		private:
+
+			/**
+			* node of the region tree of a thread, the children of a
+			* node are linked through sibling
+			*/
+
+			struct Region {
+				const char * name;
+				int parent;
+				int child;
+				int sibling;
+				unsigned long long calls;
+				double seconds;
+				double start;
+				unsigned long long hardware[NUM_HARDWARE];
+				unsigned long long hardwareStart[NUM_HARDWARE];
+			};
+
+			/**
+			* state of a thread, only ever written by that thread
+			*/
+
+			struct Thread {
+				std::vector<Region> regions;
+				int current;
+				unsigned long long counters[NUM_COUNTERS];
+				int perf;       // leader of the perf event group, -1 if none
+				int perfOther[NUM_HARDWARE - 1];
+				bool perfTried;
+			};
+
+			// the metrics of a region, in the order of _metricName
+			enum { CALLS = 0, SECONDS, NUM_METRICS = SECONDS + 1 + NUM_HARDWARE };
+
+		public:
+
+			/**
+			* constructor
+			*/
+
+			Profiler() : _enabled(true), _hardware(false), _format(CSV),
+			_output(0), _serial(++_serials()) {
+				pthread_mutex_init(&_mutex, NULL);
+			}
+
+			/**
+			* destructor
+			*/
+
+			~Profiler() {
+				for (size_t i = 0; i < _threads.size(); ++i) {
+					_closeHardware(*_threads[i]);
+					delete _threads[i];
+				}
+				delete _output;
+				pthread_mutex_destroy(&_mutex);
+			}
+
+			void Enable(bool enabled) { _enabled = enabled; }
+			bool IsEnabled() const { return _enabled; }
+
+			/**
+			* read the hardware counters of the regions, Linux only; to
+			* be called before the first region
+			*/
+
+			void EnableHardwareCounters(bool enabled = true) { _hardware = enabled; }
+
+			/**
+			* where rank 0 writes the records of the steps
+			*/
+
+			void SetOutput(const char * filename, FORMAT format = CSV) {
+				_filename = filename;
+				_format = format;
+				delete _output;
+				_output = 0;
+			}
+
+			/**
+			* region entry and exit of the calling thread; Leave closes
+			* the innermost region
+			*/
+
+			void Enter(const char * name) {
+				Thread & t = _thread();
+				std::vector<Region> & R = t.regions;
+				int k = R[t.current].child;
+				while (k >= 0 && R[k].name != name && strcmp(R[k].name, name) != 0) {
+					k = R[k].sibling;
+				}
+				if (k < 0) {
+					k = _newRegion(t, name);
+				}
+				t.current = k;
+				Region & r = R[k];
+				++r.calls;
+				if (t.perf >= 0) _readHardware(t, r.hardwareStart);
+				r.start = Time();
+			}
+
+			void Leave() {
+				const double now = Time();
+				Thread & t = _thread();
+				assert(t.current > 0);
+				Region & r = t.regions[t.current];
+				r.seconds += now - r.start;
+				if (t.perf >= 0) {
+					unsigned long long hw[NUM_HARDWARE];
+					_readHardware(t, hw);
+					for (int i = 0; i < NUM_HARDWARE; ++i) {
+						r.hardware[i] += hw[i] - r.hardwareStart[i];
+					}
+				}
+				t.current = r.parent;
+			}
+
+			/**
+			* counter += n on the calling thread
+			*/
+
+			static void Count(COUNTER counter, unsigned long long n) {
+				Profiler * p = GetProfiler();
+				if (p != 0 && p->_enabled) {
+					p->_thread().counters[counter] += n;
+				}
+			}
+
+			/**
+			* reports and resets the regions and counters of all the
+			* threads; collective with _M4EXTREME_MPI_
+			*/
+
+			void EndStep(int step) {
+				std::map<std::string, std::vector<double> > local;
+				std::vector<double> counters(NUM_COUNTERS + 1, 0.0);
+
+				pthread_mutex_lock(&_mutex);
+				for (size_t i = 0; i < _threads.size(); ++i) {
+					_collect(*_threads[i], local, counters);
+				}
+				pthread_mutex_unlock(&_mutex);
+
+				// bytes per message, as a ratio of the rank
+				counters[NUM_COUNTERS] = counters[MPI_MESSAGES] > 0.0 ?
+					counters[MPI_BYTES] / counters[MPI_MESSAGES] : 0.0;
+
+				int rank = 0, size = 1;
+				_merge(local, rank, size);
+
+				// one row per path, metrics of the regions then the counters
+				const size_t np = _paths.size();
+				std::vector<double> values(np * NUM_METRICS + counters.size(), 0.0);
+				for (size_t k = 0; k < np; ++k) {
+					std::map<std::string, std::vector<double> >::const_iterator pL = local.find(_paths[k]);
+					if (pL == local.end()) continue;
+					for (int m = 0; m < NUM_METRICS; ++m) values[k * NUM_METRICS + m] = pL->second[m];
+				}
+				for (size_t c = 0; c < counters.size(); ++c) values[np * NUM_METRICS + c] = counters[c];
+
+				std::vector<double> vmin(values), vmax(values), vsum(values);
+#if defined(_M4EXTREME_MPI_)
+				if (size > 1) {
+					const int n = values.size();
+					MPI_Reduce(&values[0], &vmin[0], n, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+					MPI_Reduce(&values[0], &vmax[0], n, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+					MPI_Reduce(&values[0], &vsum[0], n, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+				}
+#endif
+				if (rank != 0 || _filename.empty()) return;
+
+				if (_output == 0) {
+					_output = new std::ofstream(_filename.c_str());
+					if (!_output->good()) {
+						std::cerr << "failed to open " << _filename << " @Profiler" << std::endl;
+					}
+					else if (_format == CSV) {
+						*_output << "step,name,metric,min,avg,max" << std::endl;
+					}
+				}
+				if (!_output->good()) return;
+
+				const int nm = _hardware ? NUM_METRICS : SECONDS + 1;
+				std::ostream & os = *_output;
+				if (_format == JSON) os << "{\"step\":" << step << ",\"ranks\":" << size << ",\"regions\":{";
+				bool first = true;
+				for (size_t k = 0; k < np; ++k) {
+					// regions not entered in this step on any rank
+					if (vmax[k * NUM_METRICS + CALLS] == 0.0) continue;
+					if (_format == JSON) os << (first ? "" : ",") << "\"" << _paths[k] << "\":{";
+					first = false;
+					for (int m = 0; m < nm; ++m) {
+						const size_t i = k * NUM_METRICS + m;
+						_write(os, step, _paths[k], _metricName(m), m > 0, vmin[i], vsum[i] / size, vmax[i]);
+					}
+					if (_format == JSON) os << "}";
+				}
+				if (_format == JSON) os << "},\"counters\":{";
+				for (size_t c = 0; c < counters.size(); ++c) {
+					const size_t i = np * NUM_METRICS + c;
+					_write(os, step, "counters", _counterName(c), c > 0, vmin[i], vsum[i] / size, vmax[i]);
+				}
+				if (_format == JSON) os << "}}" << std::endl;
+				os.flush();
+			}
+
+			/**
+			* monotonic wall clock in seconds
+			*/
+
+			static double Time() {
+				struct timespec t;
+				clock_gettime(CLOCK_MONOTONIC, &t);
+				return t.tv_sec + 1.0e-9 * t.tv_nsec;
+			}
+
+		private:
+
+			static unsigned long long & _serials() {
+				static unsigned long long serials = 0;
+				return serials;
+			}
+
+			/**
+			* state of the calling thread for this profiler, created on
+			* first use
+			*/
+
+			Thread & _thread() {
+				static __thread Thread * thread = 0;
+				static __thread unsigned long long serial = 0;
+				if (thread == 0 || serial != _serial) {
+					thread = new Thread;
+					serial = _serial;
+					Region root;
+					memset(&root, 0, sizeof(Region));
+					root.name = "";
+					root.parent = root.child = root.sibling = -1;
+					thread->regions.push_back(root);
+					thread->current = 0;
+					for (int i = 0; i < NUM_COUNTERS; ++i) thread->counters[i] = 0;
+					thread->perf = -1;
+					thread->perfTried = false;
+					pthread_mutex_lock(&_mutex);
+					_threads.push_back(thread);
+					pthread_mutex_unlock(&_mutex);
+				}
+				if (_hardware && !thread->perfTried) _openHardware(*thread);
+				return *thread;
+			}
+
+			int _newRegion(Thread & t, const char * name) {
+				std::vector<Region> & R = t.regions;
+				Region r;
+				memset(&r, 0, sizeof(Region));
+				r.name = name;
+				r.parent = t.current;
+				r.child = -1;
+				r.sibling = R[t.current].child;
+				R.push_back(r);
+				const int k = R.size() - 1;
+				R[t.current].child = k;
+				return k;
+			}
+
+			std::string _path(const Thread & t, int k) const {
+				std::string path = t.regions[k].name;
+				for (k = t.regions[k].parent; k > 0; k = t.regions[k].parent) {
+					path = std::string(t.regions[k].name) + "/" + path;
+				}
+				return path;
+			}
+
+			void _collect(Thread & t, std::map<std::string, std::vector<double> > & local,
+				std::vector<double> & counters) {
+				for (size_t k = 1; k < t.regions.size(); ++k) {
+					Region & r = t.regions[k];
+					if (r.calls == 0) continue;
+					std::vector<double> & v = local[_path(t, k)];
+					v.resize(NUM_METRICS, 0.0);
+					v[CALLS] += r.calls;
+					v[SECONDS] += r.seconds;
+					for (int i = 0; i < NUM_HARDWARE; ++i) v[SECONDS + 1 + i] += r.hardware[i];
+					r.calls = 0;
+					r.seconds = 0.0;
+					for (int i = 0; i < NUM_HARDWARE; ++i) r.hardware[i] = 0;
+				}
+				for (int i = 0; i < NUM_COUNTERS; ++i) {
+					counters[i] += t.counters[i];
+					t.counters[i] = 0;
+				}
+			}
+
+			/**
+			* adds the new paths to _paths, in the same order on all
+			* ranks; the names are exchanged only in the steps where
+			* some rank met a new region
+			*/
+
+			void _merge(const std::map<std::string, std::vector<double> > & local, int & rank, int & size) {
+				std::vector<std::string> fresh;
+				std::map<std::string, std::vector<double> >::const_iterator pL;
+				for (pL = local.begin(); pL != local.end(); ++pL) {
+					if (_known.find(pL->first) == _known.end()) fresh.push_back(pL->first);
+				}
+
+				rank = 0;
+				size = 1;
+#if defined(_M4EXTREME_MPI_)
+				int initialized = 0;
+				MPI_Initialized(&initialized);
+				if (initialized) {
+					MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+					MPI_Comm_size(MPI_COMM_WORLD, &size);
+				}
+				if (size > 1) {
+					int mine = fresh.size(), any = 0;
+					MPI_Allreduce(&mine, &any, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+					if (any == 0) return;
+
+					std::string packed;
+					for (size_t i = 0; i < fresh.size(); ++i) packed += fresh[i] + '\0';
+					int length = packed.size();
+					std::vector<int> lengths(size), offsets(size + 1, 0);
+					MPI_Allgather(&length, 1, MPI_INT, &lengths[0], 1, MPI_INT, MPI_COMM_WORLD);
+					for (int r = 0; r < size; ++r) offsets[r + 1] = offsets[r] + lengths[r];
+					std::vector<char> all(offsets[size] + 1, '\0');
+					MPI_Allgatherv(const_cast<char *>(packed.data()), length, MPI_CHAR,
+						&all[0], &lengths[0], &offsets[0], MPI_CHAR, MPI_COMM_WORLD);
+
+					fresh.clear();
+					for (int i = 0; i < offsets[size]; i += strlen(&all[i]) + 1) {
+						fresh.push_back(std::string(&all[i]));
+					}
+				}
+#endif
+				bool added = false;
+				for (size_t i = 0; i < fresh.size(); ++i) {
+					added = _known.insert(fresh[i]).second || added;
+				}
+				if (added) _paths.assign(_known.begin(), _known.end());
+			}
+
+			void _write(std::ostream & os, int step, const std::string & name, const char * metric,
+				bool comma, double vmin, double vavg, double vmax) const {
+				if (_format == CSV) {
+					os << step << "," << name << "," << metric << ","
+						<< vmin << "," << vavg << "," << vmax << std::endl;
+				}
+				else {
+					os << (comma ? "," : "") << "\"" << metric << "\":["
+						<< vmin << "," << vavg << "," << vmax << "]";
+				}
+			}
+
+			static const char * _metricName(int m) {
+				static const char * names[NUM_METRICS] = {
+					"calls", "seconds", "cycles", "instructions", "cache_misses"
+				};
+				return names[m];
+			}
+
+			static const char * _counterName(int c) {
+				static const char * names[NUM_COUNTERS + 1] = {
+					"mpt_evaluations", "neighbor_queries", "newton_iterations",
+					"mpi_messages", "mpi_bytes", "mpi_bytes_per_message"
+				};
+				return names[c];
+			}
+
+			/**
+			* one perf event group per thread, counting in user space
+			* on the calling thread only
+			*/
+
+			void _openHardware(Thread & t) {
+				t.perfTried = true;
+#if defined(__linux__)
+				static const unsigned long long config[NUM_HARDWARE] = {
+					PERF_COUNT_HW_CPU_CYCLES,
+					PERF_COUNT_HW_INSTRUCTIONS,
+					PERF_COUNT_HW_CACHE_MISSES
+				};
+				int fd[NUM_HARDWARE];
+				for (int i = 0; i < NUM_HARDWARE; ++i) {
+					struct perf_event_attr pe;
+					memset(&pe, 0, sizeof(pe));
+					pe.type = PERF_TYPE_HARDWARE;
+					pe.size = sizeof(pe);
+					pe.config = config[i];
+					pe.disabled = i == 0 ? 1 : 0;
+					pe.exclude_kernel = 1;
+					pe.exclude_hv = 1;
+					pe.read_format = PERF_FORMAT_GROUP;
+					fd[i] = syscall(__NR_perf_event_open, &pe, 0, -1, i == 0 ? -1 : fd[0], 0);
+					if (fd[i] < 0) {
+						for (int j = 0; j < i; ++j) close(fd[j]);
+						static bool warned = false;
+						if (!warned) {
+							std::cerr << "hardware counters are not available @Profiler" << std::endl;
+							warned = true;
+						}
+						return;
+					}
+				}
+				ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+				ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+				t.perf = fd[0];
+				for (int i = 1; i < NUM_HARDWARE; ++i) t.perfOther[i - 1] = fd[i];
+#endif
+			}
+
+			void _readHardware(const Thread & t, unsigned long long * hw) const {
+#if defined(__linux__)
+				unsigned long long buffer[1 + NUM_HARDWARE];
+				if (read(t.perf, buffer, sizeof(buffer)) == (ssize_t)sizeof(buffer)) {
+					for (int i = 0; i < NUM_HARDWARE; ++i) hw[i] = buffer[1 + i];
+					return;
+				}
+#endif
+				for (int i = 0; i < NUM_HARDWARE; ++i) hw[i] = 0;
+			}
+
+			void _closeHardware(Thread & t) {
+#if defined(__linux__)
+				if (t.perf < 0) return;
+				for (int i = 1; i < NUM_HARDWARE; ++i) close(t.perfOther[i - 1]);
+				close(t.perf);
+				t.perf = -1;
+#endif
+			}
+
+		private:
+
+			bool                        _enabled;
+			bool                        _hardware;
+			FORMAT                      _format;
+			std::string                 _filename;
+			std::ofstream *             _output;
+			unsigned long long          _serial;
+			std::vector<Thread *>       _threads;
+			std::set<std::string>       _known;     // paths met so far on any rank
+			std::vector<std::string>    _paths;     // _known, as reported
+			pthread_mutex_t             _mutex;
+
+		private:
+
+			Profiler(const Profiler &);
+			Profiler & operator = (const Profiler &);
+		};
+
+		/**
+		* times the enclosing scope as a region of the current one
+		*/
+
+		class ScopedTimer {
+		public:
+
+			ScopedTimer(const char * name) : _profiler(GetProfiler()) {
+				if (_profiler != 0 && _profiler->IsEnabled()) _profiler->Enter(name);
+				else _profiler = 0;
+			}
+
+			~ScopedTimer() {
+				if (_profiler != 0) _profiler->Leave();
+			}
+
+		private:
+
+			Profiler * _profiler;
+
+		private:
+
+			ScopedTimer(const ScopedTimer &);
+			ScopedTimer & operator = (const ScopedTimer &);
+		};
+
+		/**
+		* process wide profiler, same life cycle as the TaskScheduler
+		*/
+
+		inline void CreateProfiler() {
+			if (_profilerInstance() == 0) {
+				_profilerInstance() = new Profiler();
+			}
+		}
+
+		inline void DestroyProfiler() {
+			delete _profilerInstance();
+			_profilerInstance() = 0;
+		}
+
+	}
+
+}
+
+#endif /* _M4EXTREME_UTILS_PROFILER_H */
@@ -344,16 +344,55 @@ namespace m4extreme {
 
   //-----------------------------------------------------------------------
   //
-  // get data field from pModel
+  // the values read from pModel by _get_data, before any field is
+  // derived from them
+  //
+  //------------------------------------------------------------------------
+  struct _model_data {
+    int dim;
+    map<Geometry::Cell*, Set::VectorSpace::Vector> velocity;
+    map<Geometry::Cell*, double> status, mass;
+    map<Geometry::Cell*, double> temperature, volume, jacobian, mpt_status;
+    map<Geometry::Cell*, Set::VectorSpace::Hom> cauchy;
+#if defined(_M4EXTREME_AV_)
+    map<Geometry::Cell*, Set::VectorSpace::Hom> av_stress, av_deformation;
+#endif
+  };
+
+  inline void _fetch_data(int index,
+			  m4extreme::MEMPModelBuilder * pModel,
+			  _model_data & raw) {
+    raw.dim = pModel->_DIM;
+
+    pModel->GetNodeData(raw.velocity, m4extreme::MEMPModelBuilder::VELOCITY);
+    pModel->GetNodeData(index, raw.status, m4extreme::MEMPModelBuilder::STATUS);
+    pModel->GetNodeData(index, raw.mass, m4extreme::MEMPModelBuilder::MASS);
+
+    pModel->GetQPData(index, raw.temperature, m4extreme::MEMPModelBuilder::TEMPERATURE);
+    pModel->GetQPData(index, raw.volume, m4extreme::MEMPModelBuilder::WEIGHT);
+    pModel->GetQPData(index, raw.jacobian, m4extreme::MEMPModelBuilder::JACOBIAN);
+    pModel->GetQPData(index, raw.mpt_status, m4extreme::MEMPModelBuilder::STATUS);
+    pModel->GetQPData(index, raw.cauchy, m4extreme::MEMPModelBuilder::CAUCHY_STRESS);
+
+#if defined(_M4EXTREME_AV_)
+    pModel->GetQPData(index, raw.av_stress, m4extreme::MEMPModelBuilder::AV_STRESS);
+    pModel->GetQPData(index, raw.av_deformation, m4extreme::MEMPModelBuilder::AV_DEFORMATION);
+#endif
+
+    return;
+  }
+
+  //-----------------------------------------------------------------------
+  //
+  // get data field from the values of pModel, raw is emptied
   //
   //------------------------------------------------------------------------  
-  inline void _get_data(int index,
-		 m4extreme::MEMPModelBuilder * pModel,
+  inline void _get_data(_model_data & raw,
 		 map<string, map<Geometry::Cell*, double>* > & nodal_field, 
 		 map<string, map<Geometry::Cell*, double>* > & mpt_field,
 		 map<string, map<Geometry::Cell*, Set::VectorSpace::Vector>* > & nodal_vectorfield) {
 
-    int dim = pModel->_DIM;
+    int dim = raw.dim;
     assert(dim == 2 || dim == 3);
 
     nodal_field.insert( make_pair("status",    new map<Geometry::Cell*, double>) );
@@ -361,12 +400,12 @@ namespace m4extreme {
     nodal_vectorfield.insert( make_pair("velocity", new map<Geometry::Cell*, Set::VectorSpace::Vector>) );
 
 
-    pModel->GetNodeData(*nodal_vectorfield["velocity"], m4extreme::MEMPModelBuilder::VELOCITY);
-    pModel->GetNodeData(index, *nodal_field["status"], m4extreme::MEMPModelBuilder::STATUS);
-    pModel->GetNodeData(index, *nodal_field["mass"], m4extreme::MEMPModelBuilder::MASS);
+    nodal_vectorfield["velocity"]->swap(raw.velocity);
+    nodal_field["status"]->swap(raw.status);
+    nodal_field["mass"]->swap(raw.mass);
       
     // mpt field
-    map<Geometry::Cell*, Set::VectorSpace::Hom> mpt_cauchy;
+    map<Geometry::Cell*, Set::VectorSpace::Hom> & mpt_cauchy = raw.cauchy;
     map<Geometry::Cell*, Set::VectorSpace::Hom>::iterator mpt_pC;
 
     mpt_field.insert( make_pair("temperature",  new map<Geometry::Cell*, double>) );
@@ -412,14 +451,13 @@ namespace m4extreme {
     }
 #endif
 
-    pModel->GetQPData(index, *mpt_field["temperature"], m4extreme::MEMPModelBuilder::TEMPERATURE);
-    pModel->GetQPData(index, *mpt_field["volume"], m4extreme::MEMPModelBuilder::WEIGHT);
-    pModel->GetQPData(index, *mpt_field["jacobian"], m4extreme::MEMPModelBuilder::JACOBIAN);
+    mpt_field["temperature"]->swap(raw.temperature);
+    mpt_field["volume"]->swap(raw.volume);
+    mpt_field["jacobian"]->swap(raw.jacobian);
  
     mpt_field.insert( make_pair("status", new map<Geometry::Cell*, double>) );
-    pModel->GetQPData(index, *mpt_field["status"], m4extreme::MEMPModelBuilder::STATUS);
+    mpt_field["status"]->swap(raw.mpt_status);
     
-    pModel->GetQPData(index, mpt_cauchy, m4extreme::MEMPModelBuilder::CAUCHY_STRESS);      
     for (mpt_pC = mpt_cauchy.begin(); mpt_pC != mpt_cauchy.end(); mpt_pC++) {
       Set::VectorSpace::Hom & sigma = mpt_pC->second;
       mpt_field["s11"]->insert( make_pair(mpt_pC->first, sigma[0][0]) );
@@ -578,8 +616,7 @@ namespace m4extreme {
     }
 
 #if defined(_M4EXTREME_AV_)
-    pModel->GetQPData(index, mpt_cauchy, m4extreme::MEMPModelBuilder::AV_STRESS);      
-    for (mpt_pC = mpt_cauchy.begin(); mpt_pC != mpt_cauchy.end(); mpt_pC++) {
+    for (mpt_pC = raw.av_stress.begin(); mpt_pC != raw.av_stress.end(); mpt_pC++) {
       Set::VectorSpace::Hom & sigma = mpt_pC->second;
       mpt_field["av_s11"]->insert( make_pair(mpt_pC->first, sigma[0][0]) );
       mpt_field["av_s22"]->insert( make_pair(mpt_pC->first, sigma[1][1]) );
@@ -592,8 +629,7 @@ namespace m4extreme {
       }
     }
 
-    pModel->GetQPData(index, mpt_cauchy, m4extreme::MEMPModelBuilder::AV_DEFORMATION);      
-    for (mpt_pC = mpt_cauchy.begin(); mpt_pC != mpt_cauchy.end(); mpt_pC++) {
+    for (mpt_pC = raw.av_deformation.begin(); mpt_pC != raw.av_deformation.end(); mpt_pC++) {
       Set::VectorSpace::Hom & sigma = mpt_pC->second;
       mpt_field["av_d11"]->insert( make_pair(mpt_pC->first, sigma[0][0]) );
       mpt_field["av_d22"]->insert( make_pair(mpt_pC->first, sigma[1][1]) );
@@ -607,6 +643,27 @@ namespace m4extreme {
     }
 #endif
 
+    mpt_cauchy.clear();
+#if defined(_M4EXTREME_AV_)
+    raw.av_stress.clear();
+    raw.av_deformation.clear();
+#endif
+    return;
+  }
+
+  //-----------------------------------------------------------------------
+  //
+  // get data field from pModel
+  //
+  //------------------------------------------------------------------------  
+  inline void _get_data(int index,
+		 m4extreme::MEMPModelBuilder * pModel,
+		 map<string, map<Geometry::Cell*, double>* > & nodal_field, 
+		 map<string, map<Geometry::Cell*, double>* > & mpt_field,
+		 map<string, map<Geometry::Cell*, Set::VectorSpace::Vector>* > & nodal_vectorfield) {
+    _model_data raw;
+    _fetch_data(index, pModel, raw);
+    _get_data(raw, nodal_field, mpt_field, nodal_vectorfield);
     return;
   }
 
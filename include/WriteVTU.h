@@ -0,0 +1,658 @@
+//
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_WRITEVTUFILE_H_
+#define _M4EXTREME_WRITEVTUFILE_H_
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+
+#include "Factory/MEMPModelBuilder.h"
+#include "WriteVTK.h"
+
+#if defined(_M4EXTREME_ZLIB_)
+#include <zlib.h>
+#endif
+
+#if defined(_M4EXTREME_MPI_)
+#include "mpi.h"
+#endif
+
+namespace m4extreme {
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // XML unstructured grid (.vtu) writer. The geometry and the fields are
+  // flattened into contiguous arrays when they are added and written as
+  // one appended data block, raw binary or base64, optionally compressed
+  // with zlib (compile with _M4EXTREME_ZLIB_ and link -lz). In a parallel
+  // run each rank writes its own piece and rank 0 writes the .pvtu index
+  // (WriteParallel, compile with _M4EXTREME_MPI_).
+  //
+  // StageGeometry and StageModelData only copy the positions, the cell
+  // vertices and the values read from the model, Build then does the
+  // flattening and the derived fields, so that the two may run on
+  // different threads.
+  //
+  // The cell types, vertex ordering and the replacement of bad numbers
+  // by zero are the same as in WriteVTKFile.
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  class VTUWriter {
+
+  public:
+    typedef map<Geometry::Cell *, Set::Euclidean::Orthonormal::Point> point_type;
+    typedef map<Geometry::Cell *, double> scalar_type;
+    typedef map<Geometry::Cell *, Set::VectorSpace::Vector> vector_type;
+    typedef map<Geometry::Cell *, Set::VectorSpace::Hom> tensor_type;
+
+    enum ENCODING { RAW = 0, BASE64 = 1 };
+    enum SHAPE { SCALAR = 1, VECTOR = 3, TENSOR = 9 };
+
+  public:
+
+    VTUWriter(ENCODING encoding = RAW, bool compress = false) :
+      _encoding(encoding), _compress(compress), _blocksize(1 << 16),
+      _type(0), _stagedGeometry(false), _stagedModel(false) {
+#if !defined(_M4EXTREME_ZLIB_)
+      if ( _compress ) {
+	std::cerr << "compiled without _M4EXTREME_ZLIB_, data is written uncompressed @VTUWriter" << std::endl;
+	_compress = false;
+      }
+#endif
+    }
+
+    virtual ~VTUWriter() {}
+
+    void Clear() {
+      _nodeIndex.clear();
+      _elements.clear();
+      _geometry.clear();
+      _pointData.clear();
+      _cellData.clear();
+      _stagedNodes.clear();
+      _stagedX.clear();
+      _stagedVertices.clear();
+      _stagedOffsets.clear();
+      _stagedGeometry = false;
+      _stagedModel = false;
+      return;
+    }
+
+    //
+    // geometry, same as _write_geometry of WriteVTK.h
+    //
+    void SetGeometry(const point_type & P, Geometry::CellComplex * solid, int elementType) {
+      StageGeometry(P, solid, elementType);
+      _buildGeometry();
+      return;
+    }
+
+    //
+    // copy the node positions and the vertices of every cell now, the
+    // geometry is built by Build without reading the cell complex
+    //
+    void StageGeometry(const point_type & P, Geometry::CellComplex * solid, int elementType) {
+      Clear();
+
+      _stagedNodes.reserve(P.size());
+      _stagedX.resize(3 * P.size(), 0.0);
+      double * xloc = _stagedX.empty() ? NULL : &_stagedX[0];
+      for ( point_type::const_iterator pP = P.begin(); pP != P.end(); ++pP, xloc += 3 ) {
+	const Set::Euclidean::Orthonormal::Point & x = pP->second;
+	for ( int k = 0; k < x.size() && k < 3; ++k ) xloc[k] = x[k];
+	_stagedNodes.push_back(pP->first);
+      }
+
+      int cell_dim = solid->size() - 1;
+      const set<Geometry::Cell*> & emloc = (*solid)[cell_dim];
+      _elements.assign(emloc.begin(), emloc.end());
+
+      _stagedOffsets.reserve(_elements.size() + 1);
+      _stagedOffsets.push_back(0);
+      for ( size_t e = 0; e < _elements.size(); ++e ) {
+	set<Geometry::Cell *> v_set;
+	m4extreme::getVertices(_elements[e], v_set);
+	_stagedVertices.insert(_stagedVertices.end(), v_set.begin(), v_set.end());
+	_stagedOffsets.push_back(_stagedVertices.size());
+      }
+
+      _type = elementType;
+      _stagedGeometry = true;
+      return;
+    }
+
+    //
+    // read the values of the default fields of WriteVTKFile now, the
+    // fields are derived from them by Build
+    //
+    void StageModelData(int index, MEMPModelBuilder * pModel) {
+      _fetch_data(index, pModel, _model);
+      _stagedModel = true;
+      return;
+    }
+
+    //
+    // build what was staged, touches neither the model nor the positions
+    //
+    void Build() {
+      if ( _stagedGeometry ) _buildGeometry();
+      if ( _stagedModel ) {
+	_addModelData(_model);
+	_stagedModel = false;
+      }
+      return;
+    }
+
+    int GetNumofPoints() const { return _nodeIndex.size(); }
+    int GetNumofCells() const { return _elements.size(); }
+
+    //
+    // point data keyed by the nodes of the geometry
+    //
+    void AddPointData(const string & name, const scalar_type & data) {
+      _pointData.push_back(_Array());
+      _fill(_pointData.back(), name, data, _nodes());
+    }
+
+    void AddPointData(const string & name, const vector_type & data) {
+      _pointData.push_back(_Array());
+      _fill(_pointData.back(), name, data, _nodes());
+    }
+
+    void AddPointData(const string & name, const tensor_type & data) {
+      _pointData.push_back(_Array());
+      _fill(_pointData.back(), name, data, _nodes());
+    }
+
+    //
+    // cell data keyed by the material points (top dimensional cells)
+    //
+    void AddCellData(const string & name, const scalar_type & data) {
+      _cellData.push_back(_Array());
+      _fill(_cellData.back(), name, data, _elements);
+    }
+
+    void AddCellData(const string & name, const vector_type & data) {
+      _cellData.push_back(_Array());
+      _fill(_cellData.back(), name, data, _elements);
+    }
+
+    void AddCellData(const string & name, const tensor_type & data) {
+      _cellData.push_back(_Array());
+      _fill(_cellData.back(), name, data, _elements);
+    }
+
+    void AddPointData(const map< std::string, scalar_type* > & fields) {
+      for ( map< std::string, scalar_type* >::const_iterator pF = fields.begin(); pF != fields.end(); ++pF ) {
+	if ( pF->second != NULL ) AddPointData(pF->first, *pF->second);
+      }
+    }
+
+    void AddPointData(const map< std::string, vector_type* > & fields) {
+      for ( map< std::string, vector_type* >::const_iterator pF = fields.begin(); pF != fields.end(); ++pF ) {
+	if ( pF->second != NULL ) AddPointData(pF->first, *pF->second);
+      }
+    }
+
+    void AddCellData(const map< std::string, scalar_type* > & fields) {
+      for ( map< std::string, scalar_type* >::const_iterator pF = fields.begin(); pF != fields.end(); ++pF ) {
+	if ( pF->second != NULL ) AddCellData(pF->first, *pF->second);
+      }
+    }
+
+    void AddCellData(const map< std::string, vector_type* > & fields) {
+      for ( map< std::string, vector_type* >::const_iterator pF = fields.begin(); pF != fields.end(); ++pF ) {
+	if ( pF->second != NULL ) AddCellData(pF->first, *pF->second);
+      }
+    }
+
+    //
+    // any MEMPModelBuilder::DATA_TYPE of body index, the shape tells
+    // which of GetQPData/GetNodeData applies
+    //
+    void AddModelData(int index, MEMPModelBuilder * pModel, const string & name,
+		      MEMPModelBuilder::DATA_TYPE type, SHAPE shape, bool isNodalData) {
+      if ( isNodalData ) {
+	switch ( shape ) {
+	case SCALAR: { scalar_type data; pModel->GetNodeData(index, data, type); AddPointData(name, data); } break;
+	case VECTOR: { vector_type data; pModel->GetNodeData(data, type); AddPointData(name, data); } break;
+	case TENSOR: { tensor_type data; pModel->GetNodeData(index, data, type); AddPointData(name, data); } break;
+	}
+      }
+      else {
+	switch ( shape ) {
+	case SCALAR: { scalar_type data; pModel->GetQPData(index, data, type); AddCellData(name, data); } break;
+	case VECTOR: { vector_type data; pModel->GetQPData(index, data, type); AddCellData(name, data); } break;
+	case TENSOR: { tensor_type data; pModel->GetQPData(index, data, type); AddCellData(name, data); } break;
+	}
+      }
+      return;
+    }
+
+    //
+    // the default fields of WriteVTKFile
+    //
+    void AddModelData(int index, MEMPModelBuilder * pModel) {
+      _model_data raw;
+      _fetch_data(index, pModel, raw);
+      _addModelData(raw);
+      return;
+    }
+
+    //
+    // write the piece
+    //
+    void Write(const char * name) const {
+      std::ofstream ofs(name, std::ofstream::binary);
+      if (ofs.fail()) {
+	std::cerr << "could not open the file" << name << ". Abort writing!" << std::endl;
+	assert(false);
+      }
+
+      // encode every array first, the offsets depend on the encoded sizes
+      vector<const _Array *> arrays;
+      for ( int i = 0; i < _pointData.size(); ++i ) arrays.push_back(&_pointData[i]);
+      for ( int i = 0; i < _cellData.size(); ++i ) arrays.push_back(&_cellData[i]);
+      for ( int i = 0; i < _geometry.size(); ++i ) arrays.push_back(&_geometry[i]);
+
+      vector< vector<char> > blocks(arrays.size());
+      vector<unsigned long long> offsets(arrays.size() + 1, 0);
+      for ( int i = 0; i < arrays.size(); ++i ) {
+	_encode(arrays[i]->data, blocks[i]);
+	offsets[i+1] = offsets[i] + blocks[i].size();
+      }
+
+      std::ostringstream xml;
+      xml << "<?xml version=\"1.0\"?>" << std::endl;
+      _header(xml, "UnstructuredGrid");
+      xml << "  <UnstructuredGrid>" << std::endl
+	  << "    <Piece NumberOfPoints=\"" << GetNumofPoints()
+	  << "\" NumberOfCells=\"" << GetNumofCells() << "\">" << std::endl;
+
+      int k = 0;
+      xml << "      <PointData>" << std::endl;
+      for ( int i = 0; i < _pointData.size(); ++i, ++k ) _declare(xml, *arrays[k], offsets[k]);
+      xml << "      </PointData>" << std::endl;
+      xml << "      <CellData>" << std::endl;
+      for ( int i = 0; i < _cellData.size(); ++i, ++k ) _declare(xml, *arrays[k], offsets[k]);
+      xml << "      </CellData>" << std::endl;
+      if ( !_geometry.empty() ) {
+	xml << "      <Points>" << std::endl;
+	_declare(xml, *arrays[k], offsets[k]); ++k;
+	xml << "      </Points>" << std::endl;
+	xml << "      <Cells>" << std::endl;
+	for ( int i = 1; i < _geometry.size(); ++i, ++k ) _declare(xml, *arrays[k], offsets[k]);
+	xml << "      </Cells>" << std::endl;
+      }
+      xml << "    </Piece>" << std::endl
+	  << "  </UnstructuredGrid>" << std::endl
+	  << "  <AppendedData encoding=\"" << (_encoding == RAW ? "raw" : "base64") << "\">" << std::endl
+	  << "_";
+
+      const string head = xml.str();
+      ofs.write(head.data(), head.size());
+      for ( int i = 0; i < blocks.size(); ++i ) {
+	if ( !blocks[i].empty() ) ofs.write(&blocks[i][0], blocks[i].size());
+      }
+      ofs << std::endl << "  </AppendedData>" << std::endl << "</VTKFile>" << std::endl;
+
+      ofs.close();
+      return;
+    }
+
+    //
+    // index of the pieces, the fields are the ones of this writer
+    //
+    void WritePVTU(const char * name, const vector<string> & pieces) const {
+      std::ofstream ofs(name);
+      if (ofs.fail()) {
+	std::cerr << "could not open the file" << name << ". Abort writing!" << std::endl;
+	assert(false);
+      }
+
+      ofs << "<?xml version=\"1.0\"?>" << std::endl;
+      _header(ofs, "PUnstructuredGrid");
+      ofs << "  <PUnstructuredGrid GhostLevel=\"0\">" << std::endl;
+      ofs << "    <PPointData>" << std::endl;
+      for ( int i = 0; i < _pointData.size(); ++i ) _pdeclare(ofs, _pointData[i]);
+      ofs << "    </PPointData>" << std::endl;
+      ofs << "    <PCellData>" << std::endl;
+      for ( int i = 0; i < _cellData.size(); ++i ) _pdeclare(ofs, _cellData[i]);
+      ofs << "    </PCellData>" << std::endl;
+      ofs << "    <PPoints>" << std::endl
+	  << "      <PDataArray type=\"Float64\" NumberOfComponents=\"3\"/>" << std::endl
+	  << "    </PPoints>" << std::endl;
+      for ( int i = 0; i < pieces.size(); ++i ) {
+	ofs << "    <Piece Source=\"" << pieces[i] << "\"/>" << std::endl;
+      }
+      ofs << "  </PUnstructuredGrid>" << std::endl << "</VTKFile>" << std::endl;
+
+      ofs.close();
+      return;
+    }
+
+    //
+    // piece rank of size: writes basename_<rank>.vtu and, on rank 0,
+    // basename.pvtu; makes no MPI call
+    //
+    void WritePiece(const string & basename, int rank, int size) const {
+      std::ostringstream piece;
+      piece << basename << "_" << rank << ".vtu";
+      Write(piece.str().c_str());
+
+      if ( rank == 0 ) {
+	// the pieces are referenced relative to the .pvtu file
+	string::size_type slash = basename.find_last_of('/');
+	string local = slash == string::npos ? basename : basename.substr(slash + 1);
+	vector<string> pieces(size);
+	for ( int r = 0; r < size; ++r ) {
+	  std::ostringstream ploc;
+	  ploc << local << "_" << r << ".vtu";
+	  pieces[r] = ploc.str();
+	}
+	WritePVTU((basename + ".pvtu").c_str(), pieces);
+      }
+
+      return;
+    }
+
+#if defined(_M4EXTREME_MPI_)
+    void WriteParallel(const string & basename, MPI_Comm comm = MPI_COMM_WORLD) const {
+      int rank = 0, size = 1;
+      MPI_Comm_rank(comm, &rank);
+      MPI_Comm_size(comm, &size);
+      WritePiece(basename, rank, size);
+      return;
+    }
+#endif
+
+  private:
+
+    void _buildGeometry() {
+      _geometry.resize(4);
+      _Array & points = _geometry[0];
+      _init(points, "Points", "Float64", 3);
+      if ( !_stagedX.empty() ) _append(points, &_stagedX[0], _stagedX.size());
+
+      _nodeIndex.clear();
+      for ( size_t i = 0; i < _stagedNodes.size(); ++i ) {
+	_nodeIndex.insert(_nodeIndex.end(), make_pair(_stagedNodes[i], (int)i));
+      }
+
+      _Array & connectivity = _geometry[1];
+      _Array & offsets = _geometry[2];
+      _Array & types = _geometry[3];
+      _init(connectivity, "connectivity", "Int64", 1);
+      _init(offsets, "offsets", "Int64", 1);
+      _init(types, "types", "UInt8", 1);
+
+      long long offset = 0;
+      const unsigned char type = (unsigned char)_type;
+      map<Geometry::Cell*, int>::const_iterator pI;
+      for ( size_t e = 0; e + 1 < _stagedOffsets.size(); ++e ) {
+	for ( size_t k = _stagedOffsets[e]; k < _stagedOffsets[e+1]; ++k ) {
+	  long long id = (pI=_nodeIndex.find(_stagedVertices[k])) != _nodeIndex.end() ? pI->second : 0;
+	  _append(connectivity, &id, 1);
+	}
+	offset = _stagedOffsets[e+1];
+	_append(offsets, &offset, 1);
+	_append(types, &type, 1);
+      }
+
+      vector<Geometry::Cell *>().swap(_stagedNodes);
+      vector<double>().swap(_stagedX);
+      vector<Geometry::Cell *>().swap(_stagedVertices);
+      vector<size_t>().swap(_stagedOffsets);
+      _stagedGeometry = false;
+      return;
+    }
+
+    void _addModelData(_model_data & raw) {
+      map<string, scalar_type* > nodal_field, mpt_field;
+      map<string, vector_type* > nodal_vectorfield;
+      _get_data(raw, nodal_field, mpt_field, nodal_vectorfield);
+
+      AddPointData(nodal_field);
+      AddPointData(nodal_vectorfield);
+      AddCellData(mpt_field);
+
+      for ( map<string, scalar_type* >::iterator pF = nodal_field.begin(); pF != nodal_field.end(); ++pF ) delete pF->second;
+      for ( map<string, vector_type* >::iterator pF = nodal_vectorfield.begin(); pF != nodal_vectorfield.end(); ++pF ) delete pF->second;
+      for ( map<string, scalar_type* >::iterator pF = mpt_field.begin(); pF != mpt_field.end(); ++pF ) delete pF->second;
+      return;
+    }
+
+    struct _Array {
+      string name;
+      string type;
+      int ncomp;
+      vector<char> data;
+    };
+
+    static void _init(_Array & a, const string & name, const string & type, int ncomp) {
+      a.name = name;
+      a.type = type;
+      a.ncomp = ncomp;
+      a.data.clear();
+    }
+
+    template<typename T>
+    static void _append(_Array & a, const T * v, int n) {
+      const char * p = reinterpret_cast<const char *>(v);
+      a.data.insert(a.data.end(), p, p + n * sizeof(T));
+    }
+
+    vector<Geometry::Cell *> _nodes() const {
+      vector<Geometry::Cell *> nodes(_nodeIndex.size());
+      for ( map<Geometry::Cell*, int>::const_iterator pI = _nodeIndex.begin(); pI != _nodeIndex.end(); ++pI ) {
+	nodes[pI->second] = pI->first;
+      }
+      return nodes;
+    }
+
+    static void _fill(_Array & a, const string & name, const scalar_type & data,
+		      const vector<Geometry::Cell *> & keys) {
+      _init(a, name, "Float64", 1);
+      a.data.reserve(keys.size() * sizeof(double));
+      scalar_type::const_iterator pD;
+      for ( int i = 0; i < keys.size(); ++i ) {
+	double value = 0.0;
+	if ( (pD=data.find(keys[i])) != data.end() && !isabadnumber(pD->second) ) value = pD->second;
+	_append(a, &value, 1);
+      }
+    }
+
+    static void _fill(_Array & a, const string & name, const vector_type & data,
+		      const vector<Geometry::Cell *> & keys) {
+      _init(a, name, "Float64", 3);
+      a.data.reserve(3 * keys.size() * sizeof(double));
+      vector_type::const_iterator pD;
+      for ( int i = 0; i < keys.size(); ++i ) {
+	double value[3] = { 0.0, 0.0, 0.0 };
+	if ( (pD=data.find(keys[i])) != data.end() && !isabadvector(pD->second) ) {
+	  for ( int k = 0; k < pD->second.size() && k < 3; ++k ) value[k] = pD->second[k];
+	}
+	_append(a, value, 3);
+      }
+    }
+
+    static void _fill(_Array & a, const string & name, const tensor_type & data,
+		      const vector<Geometry::Cell *> & keys) {
+      _init(a, name, "Float64", 9);
+      a.data.reserve(9 * keys.size() * sizeof(double));
+      tensor_type::const_iterator pD;
+      for ( int i = 0; i < keys.size(); ++i ) {
+	double value[9] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if ( (pD=data.find(keys[i])) != data.end() ) {
+	  const Set::VectorSpace::Hom & A = pD->second;
+	  for ( int r = 0; r < A.size1() && r < 3; ++r ) {
+	    for ( int c = 0; c < A.size2() && c < 3; ++c ) {
+	      const double v = A[c][r];
+	      value[3*r + c] = isabadnumber(v) ? 0.0 : v;
+	    }
+	  }
+	}
+	_append(a, value, 9);
+      }
+    }
+
+    static const char * _byteOrder() {
+      const unsigned int one = 1;
+      return *reinterpret_cast<const unsigned char *>(&one) == 1 ? "LittleEndian" : "BigEndian";
+    }
+
+    void _header(std::ostream & os, const char * type) const {
+      os << "<VTKFile type=\"" << type << "\" version=\"1.0\" byte_order=\""
+	 << _byteOrder() << "\" header_type=\"UInt64\"";
+      if ( _compress ) os << " compressor=\"vtkZLibDataCompressor\"";
+      os << ">" << std::endl;
+    }
+
+    static void _declare(std::ostream & os, const _Array & a, unsigned long long offset) {
+      os << "        <DataArray type=\"" << a.type << "\"";
+      if ( a.name != "Points" ) os << " Name=\"" << a.name << "\"";
+      os << " NumberOfComponents=\"" << a.ncomp << "\" format=\"appended\" offset=\""
+	 << offset << "\"/>" << std::endl;
+    }
+
+    static void _pdeclare(std::ostream & os, const _Array & a) {
+      os << "      <PDataArray type=\"" << a.type << "\" Name=\"" << a.name
+	 << "\" NumberOfComponents=\"" << a.ncomp << "\"/>" << std::endl;
+    }
+
+    //
+    // header and data of one array; with compression the header is
+    // [#blocks, block size, last block size, compressed sizes...]
+    //
+    void _encode(const vector<char> & data, vector<char> & block) const {
+      vector<unsigned long long> header;
+      vector<char> body;
+
+      if ( !_compress ) {
+	header.push_back(data.size());
+	_emit(header, data.empty() ? NULL : &data[0], data.size(), block);
+	return;
+      }
+
+#if defined(_M4EXTREME_ZLIB_)
+      const unsigned long long nbytes = data.size();
+      const unsigned long long nblocks = (nbytes + _blocksize - 1) / _blocksize;
+      header.push_back(nblocks);
+      header.push_back(_blocksize);
+      header.push_back(nbytes % _blocksize);
+
+      vector<Bytef> buffer(compressBound(_blocksize));
+      for ( unsigned long long b = 0; b < nblocks; ++b ) {
+	const unsigned long long lo = b * _blocksize;
+	const unsigned long long len = lo + _blocksize < nbytes ? _blocksize : nbytes - lo;
+	uLongf clen = buffer.size();
+	if ( compress2(&buffer[0], &clen, reinterpret_cast<const Bytef *>(&data[lo]), len,
+		       Z_DEFAULT_COMPRESSION) != Z_OK ) {
+	  std::cerr << "zlib compression failed @VTUWriter" << std::endl;
+	  assert(false);
+	}
+	header.push_back(clen);
+	body.insert(body.end(), (char *)&buffer[0], (char *)&buffer[0] + clen);
+      }
+#endif
+
+      _emit(header, body.empty() ? NULL : &body[0], body.size(), block);
+      return;
+    }
+
+    void _emit(const vector<unsigned long long> & header, const char * body, size_t len,
+	       vector<char> & block) const {
+      const char * h = reinterpret_cast<const char *>(&header[0]);
+      const size_t hlen = header.size() * sizeof(unsigned long long);
+      block.clear();
+      if ( _encoding == RAW ) {
+	block.reserve(hlen + len);
+	block.insert(block.end(), h, h + hlen);
+	if ( len > 0 ) block.insert(block.end(), body, body + len);
+      }
+      else {
+	// the header and the data are encoded separately
+	_base64(h, hlen, block);
+	_base64(body, len, block);
+      }
+      return;
+    }
+
+    static void _base64(const char * in, size_t len, vector<char> & out) {
+      static const char table[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+      const unsigned char * p = reinterpret_cast<const unsigned char *>(in);
+      out.reserve(out.size() + 4 * ((len + 2) / 3));
+      size_t i = 0;
+      for ( ; i + 2 < len; i += 3 ) {
+	const unsigned int w = (p[i] << 16) | (p[i+1] << 8) | p[i+2];
+	out.push_back(table[(w >> 18) & 63]);
+	out.push_back(table[(w >> 12) & 63]);
+	out.push_back(table[(w >> 6) & 63]);
+	out.push_back(table[w & 63]);
+      }
+      if ( i < len ) {
+	const unsigned int w = (p[i] << 16) | (i + 1 < len ? p[i+1] << 8 : 0);
+	out.push_back(table[(w >> 18) & 63]);
+	out.push_back(table[(w >> 12) & 63]);
+	out.push_back(i + 1 < len ? table[(w >> 6) & 63] : '=');
+	out.push_back('=');
+      }
+    }
+
+  private:
+    ENCODING _encoding;
+    bool _compress;
+    unsigned long long _blocksize;
+
+    map<Geometry::Cell*, int> _nodeIndex;
+    vector<Geometry::Cell *> _elements;
+    vector<_Array> _geometry;   // points, connectivity, offsets, types
+    vector<_Array> _pointData;
+    vector<_Array> _cellData;
+
+    // copied by StageGeometry and StageModelData, consumed by Build
+    int _type;
+    vector<Geometry::Cell *> _stagedNodes;
+    vector<double> _stagedX;
+    vector<Geometry::Cell *> _stagedVertices;
+    vector<size_t> _stagedOffsets;
+    _model_data _model;
+    bool _stagedGeometry;
+    bool _stagedModel;
+
+  private:
+    VTUWriter(const VTUWriter &);
+    VTUWriter & operator = (const VTUWriter &);
+  }; // end_of_VTUWriter
+
+  /**************************************************************************************/
+  // data field obtained from pModel, binary XML counterpart of WriteVTKFile
+  /*************************************************************************************/
+
+  inline void WriteVTUFile(int index,
+			   const map<Geometry::Cell *, Set::Euclidean::Orthonormal::Point> & P,
+			   Geometry::CellComplex* solid,
+			   const char * name,
+			   m4extreme::MEMPModelBuilder * pModel,
+			   int elementType,
+			   VTUWriter::ENCODING encoding = VTUWriter::RAW,
+			   bool compress = false) {
+    VTUWriter writer(encoding, compress);
+    writer.SetGeometry(P, solid, elementType);
+    writer.AddModelData(index, pModel);
+    writer.Write(name);
+    return;
+  }
+
+}
+
+#endif
@@ -0,0 +1,369 @@
+//
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_MPI_HALOEXCHANGE_
+#define _M4EXTREME_MPI_HALOEXCHANGE_
+
+#include <cassert>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+
+#include "mpi.h"
+
+#include "Solver/ExplicitDynamics/Overlap.h"
+#include "Utils/Profiler/Profiler.h"
+
+#define TAG_HALO_SETUP        3456
+#define TAG_HALO_EXCHANGE     4567
+
+namespace m4extreme {
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Neighbor-only exchange of nodal data. Each pair of neighboring ranks
+  // agrees once on the list of nodes they share, sorted by global id, so
+  // that a message is just the packed values of that list. The messages
+  // go through persistent point-to-point requests on pre-sized buffers;
+  // no global id is sent and no map lookup is done per step, and the
+  // traffic only grows with the partition surface.
+  //
+  // Setup is collective over the neighbors only: the neighbor relation
+  // given to it must be symmetric, as the overlaps of the range boxes of
+  // MPI_Core are, so no message involves all the ranks. Begin/End split
+  // the exchange so that local work can be done while the messages are
+  // in flight, e.g. the interior material points of
+  // Solver::FlatExplicitDynamics::SetOverlap. The object holds
+  // persistent requests and must be destroyed before MPI_Finalize.
+  //
+  // Gather is the sparse counterpart for data keyed by global ids, used
+  // by the mpi_synchronizeDOFData calls that are given the exchange.
+  // The shared lists refer to local nodes: the exchange must be set up
+  // again (MPI_Core::buildHaloExchange) after the nodes changed, i.e.
+  // after MPI_Core::update() or a rebalance.
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  class HaloExchange : public Solver::NodalExchange {
+
+  public:
+    typedef Set::Manifold::Point dof_type;
+    typedef Set::VectorSpace::Vector vector_type;
+    typedef std::map<dof_type*, vector_type> vectorset_type;
+
+  public:
+
+    HaloExchange(MPI_Comm comm = MPI_COMM_WORLD) :
+      _comm(comm), _rank(0), _ld(0), _active(false) {
+      MPI_Comm_rank(_comm, &_rank);
+    }
+
+    virtual ~HaloExchange() {
+      _freeRequests();
+    }
+
+    //
+    // agree with the neighbors on the shared nodes; neighbors must be
+    // symmetric (rank r lists this rank if this rank lists r) and
+    // candidates[r] are the local nodes that may be shared with the
+    // neighbor r (e.g. the shadow nodes of the communication map of
+    // MPI_Core), candidates of other ranks are ignored
+    //
+    void Setup(const std::vector<int> & neighbors,
+	       const std::map<int, std::vector<dof_type*> > & candidates,
+	       const std::map<dof_type*, int> & idmap,
+	       const std::map<int, dof_type*> & dofmap) {
+
+      _freeRequests();
+      _neighbors.clear();
+      _ids.clear();
+      _dofs.clear();
+      _index.clear();
+
+      for ( size_t i = 0; i < neighbors.size(); ++i ) {
+	if ( neighbors[i] != _rank ) _neighbors.push_back(neighbors[i]);
+      }
+      std::sort(_neighbors.begin(), _neighbors.end());
+      _neighbors.erase(std::unique(_neighbors.begin(), _neighbors.end()), _neighbors.end());
+
+      const int nn = _neighbors.size();
+      std::vector< std::vector<int> > cand(nn), recv(nn);
+
+      // round 1: exchange the global ids of the candidates
+      for ( int k = 0; k < nn; ++k ) {
+	std::map<int, std::vector<dof_type*> >::const_iterator pC = candidates.find(_neighbors[k]);
+	if ( pC != candidates.end() ) {
+	  std::map<dof_type*, int>::const_iterator pid;
+	  for ( size_t i = 0; i < pC->second.size(); ++i ) {
+	    if ( (pid=idmap.find(pC->second[i])) != idmap.end() ) cand[k].push_back(pid->second);
+	  }
+	}
+	std::sort(cand[k].begin(), cand[k].end());
+	cand[k].erase(std::unique(cand[k].begin(), cand[k].end()), cand[k].end());
+      }
+      _exchange(cand, recv, MPI_INT);
+
+      // round 2: send back the ids of the neighbor that exist locally
+      std::vector< std::vector<int> > found(nn), confirmed(nn);
+      for ( int k = 0; k < nn; ++k ) {
+	for ( size_t i = 0; i < recv[k].size(); ++i ) {
+	  if ( dofmap.find(recv[k][i]) != dofmap.end() ) found[k].push_back(recv[k][i]);
+	}
+      }
+      _exchange(found, confirmed, MPI_INT);
+
+      // the shared list is the union, identical on both sides
+      _offsets.assign(nn + 1, 0);
+      for ( int k = 0; k < nn; ++k ) {
+	std::vector<int> shared;
+	std::set_union(found[k].begin(), found[k].end(),
+		       confirmed[k].begin(), confirmed[k].end(),
+		       std::back_inserter(shared));
+	for ( size_t i = 0; i < shared.size(); ++i ) {
+	  _ids.push_back(shared[i]);
+	  _dofs.push_back(dofmap.find(shared[i])->second);
+	}
+	_offsets[k+1] = _ids.size();
+      }
+
+      return;
+    }
+
+    int GetNumofNeighbors() const { return _neighbors.size(); }
+    const std::vector<int> & GetNeighbors() const { return _neighbors; }
+    const std::vector<dof_type*> & GetSharedNodes() const { return _dofs; }
+    int GetNumofSharedEntries() const { return _ids.size(); }
+
+    //
+    // resolve the shared nodes into the dense indices of a nodal field
+    // and size the buffers for field.Dim() values per node
+    //
+    void Bind(const Solver::NodalField & field) {
+      _index.resize(_dofs.size());
+      for ( size_t i = 0; i < _dofs.size(); ++i ) {
+	int id = field.Index(_dofs[i]);
+	if ( id < 0 ) {
+	  cerr << "shared node is not bound to the nodal field @HaloExchange" << endl;
+	  assert(false);
+	}
+	_index[i] = id;
+      }
+      _initRequests(field.Dim());
+      return;
+    }
+
+    //
+    // pack src (ld values per dense index) and start the messages
+    //
+    void Begin(const double * src) {
+      assert( !_active && _index.size() == _dofs.size() );
+      const int n = _index.size();
+      for ( int i = 0; i < n; ++i ) {
+	const double * sloc = src + (size_t)_index[i] * _ld;
+	double * bloc = &_sendbuf[(size_t)i * _ld];
+	for ( int k = 0; k < _ld; ++k ) bloc[k] = sloc[k];
+      }
+      _start();
+      return;
+    }
+
+    //
+    // complete the messages and add the contributions of the neighbors
+    //
+    void End(double * dst) {
+      _wait();
+      const int n = _index.size();
+      for ( int i = 0; i < n; ++i ) {
+	double * dloc = dst + (size_t)_index[i] * _ld;
+	const double * bloc = &_recvbuf[(size_t)i * _ld];
+	for ( int k = 0; k < _ld; ++k ) dloc[k] += bloc[k];
+      }
+      return;
+    }
+
+    // f = f + sum of the contributions of the neighbors
+    void Assemble(double * f) {
+      Begin(f);
+      End(f);
+      return;
+    }
+
+    //
+    // assemble nodal data stored in a map, dim values per node
+    //
+    void Assemble(unsigned int dim, vectorset_type & data) {
+      if ( _ld != (int)dim || (_requests.empty() && !_neighbors.empty()) ) {
+	_initRequests(dim);
+      }
+
+      const int n = _dofs.size();
+      vectorset_type::iterator pD;
+      for ( int i = 0; i < n; ++i ) {
+	double * bloc = &_sendbuf[(size_t)i * _ld];
+	for ( int k = 0; k < _ld; ++k ) bloc[k] = 0.0;
+	if ( (pD=data.find(_dofs[i])) != data.end() ) {
+	  const double * q = pD->second.begin();
+	  for ( int k = 0; k < pD->second.size(); ++k ) bloc[k] = q[k];
+	}
+      }
+
+      _start();
+      _wait();
+
+      for ( int i = 0; i < n; ++i ) {
+	if ( (pD=data.find(_dofs[i])) != data.end() ) {
+	  double * q = pD->second.begin();
+	  const double * bloc = &_recvbuf[(size_t)i * _ld];
+	  for ( int k = 0; k < pD->second.size(); ++k ) q[k] += bloc[k];
+	}
+      }
+
+      return;
+    }
+
+    //
+    // records of nid global ids and nval values: the records whose ids
+    // are all shared with a neighbor are sent to it, rids/rvals are the
+    // records received from the neighbors
+    //
+    template<typename T>
+    void Gather(int nid, int nval, const std::vector<int> & ids, const std::vector<T> & vals,
+		MPI_Datatype type, std::vector<int> & rids, std::vector<T> & rvals) {
+      const int nn = _neighbors.size();
+      const int nrec = nid > 0 ? ids.size() / nid : 0;
+      std::vector< std::vector<int> > outids(nn), inids;
+      std::vector< std::vector<T> > outvals(nn), invals;
+
+      for ( int k = 0; k < nn; ++k ) {
+	std::vector<int>::const_iterator first = _ids.begin() + _offsets[k];
+	std::vector<int>::const_iterator last = _ids.begin() + _offsets[k+1];
+	if ( first == last ) continue;
+	for ( int r = 0; r < nrec; ++r ) {
+	  bool shared = true;
+	  for ( int j = 0; j < nid && shared; ++j ) {
+	    shared = std::binary_search(first, last, ids[r * nid + j]);
+	  }
+	  if ( !shared ) continue;
+	  outids[k].insert(outids[k].end(), ids.begin() + r * nid, ids.begin() + (r + 1) * nid);
+	  outvals[k].insert(outvals[k].end(), vals.begin() + r * nval, vals.begin() + (r + 1) * nval);
+	}
+      }
+      _exchange(outids, inids, MPI_INT);
+      _exchange(outvals, invals, type);
+
+      rids.clear();
+      rvals.clear();
+      for ( int k = 0; k < nn; ++k ) {
+	rids.insert(rids.end(), inids[k].begin(), inids[k].end());
+	rvals.insert(rvals.end(), invals[k].begin(), invals[k].end());
+      }
+      return;
+    }
+
+  private:
+
+    template<typename T>
+    void _exchange(const std::vector< std::vector<T> > & out,
+		   std::vector< std::vector<T> > & in, MPI_Datatype type) {
+      const int nn = _neighbors.size();
+      std::vector<int> outsize(nn), insize(nn);
+      std::vector<MPI_Request> req(2*nn);
+
+      for ( int k = 0; k < nn; ++k ) {
+	outsize[k] = out[k].size();
+	MPI_Irecv(&insize[k], 1, MPI_INT, _neighbors[k], TAG_HALO_SETUP, _comm, &req[k]);
+	MPI_Isend(&outsize[k], 1, MPI_INT, _neighbors[k], TAG_HALO_SETUP, _comm, &req[nn+k]);
+      }
+      if ( nn > 0 ) MPI_Waitall(2*nn, &req.front(), MPI_STATUSES_IGNORE);
+
+      in.assign(nn, std::vector<T>());
+      int count = 0;
+      for ( int k = 0; k < nn; ++k ) {
+	in[k].resize(insize[k]);
+	if ( insize[k] > 0 ) {
+	  MPI_Irecv(&in[k].front(), insize[k], type, _neighbors[k],
+		    TAG_HALO_SETUP + 1, _comm, &req[count++]);
+	}
+	if ( outsize[k] > 0 ) {
+	  MPI_Isend(const_cast<T*>(&out[k].front()), outsize[k], type, _neighbors[k],
+		    TAG_HALO_SETUP + 1, _comm, &req[count++]);
+	}
+      }
+      if ( count > 0 ) MPI_Waitall(count, &req.front(), MPI_STATUSES_IGNORE);
+
+      return;
+    }
+
+    void _initRequests(int ld) {
+      _freeRequests();
+      _ld = ld;
+      const size_t len = _ids.size() * (size_t)_ld;
+      _sendbuf.assign(len > 0 ? len : 1, 0.0);
+      _recvbuf.assign(len > 0 ? len : 1, 0.0);
+
+      for ( int k = 0; k < (int)_neighbors.size(); ++k ) {
+	const int count = (_offsets[k+1] - _offsets[k]) * _ld;
+	if ( count == 0 ) continue;
+	MPI_Request r;
+	MPI_Recv_init(&_recvbuf[(size_t)_offsets[k] * _ld], count, MPI_DOUBLE,
+		      _neighbors[k], TAG_HALO_EXCHANGE, _comm, &r);
+	_requests.push_back(r);
+	MPI_Send_init(&_sendbuf[(size_t)_offsets[k] * _ld], count, MPI_DOUBLE,
+		      _neighbors[k], TAG_HALO_EXCHANGE, _comm, &r);
+	_requests.push_back(r);
+      }
+
+      return;
+    }
+
+    void _freeRequests() {
+      assert( !_active );
+      for ( size_t i = 0; i < _requests.size(); ++i ) {
+	if ( _requests[i] != MPI_REQUEST_NULL ) MPI_Request_free(&_requests[i]);
+      }
+      _requests.clear();
+      return;
+    }
+
+    void _start() {
+      if ( !_requests.empty() ) MPI_Startall(_requests.size(), &_requests.front());
+      M4EXTREME_PROFILE_COUNT(MPI_MESSAGES, _requests.size() / 2);
+      M4EXTREME_PROFILE_COUNT(MPI_BYTES, _sendbuf.size() * sizeof(double));
+      _active = true;
+      return;
+    }
+
+    void _wait() {
+      assert( _active );
+      if ( !_requests.empty() ) MPI_Waitall(_requests.size(), &_requests.front(), MPI_STATUSES_IGNORE);
+      _active = false;
+      return;
+    }
+
+  private:
+    MPI_Comm _comm;
+    int _rank;
+    int _ld;
+    bool _active;
+
+    std::vector<int> _neighbors;
+    std::vector<int> _offsets;       // shared entries of neighbor k: [_offsets[k], _offsets[k+1])
+    std::vector<int> _ids;           // global ids of the shared entries
+    std::vector<dof_type*> _dofs;    // local nodes of the shared entries
+    std::vector<int> _index;         // dense indices in the bound nodal field
+    std::vector<double> _sendbuf;
+    std::vector<double> _recvbuf;
+    std::vector<MPI_Request> _requests;
+
+  private:
+    HaloExchange(const HaloExchange &);
+    HaloExchange & operator = (const HaloExchange &);
+  }; // end_of_HaloExchange
+
+} // end_of_m4extreme
+
+#endif
@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_MPI_KRYLOVSPACE_
+#define _M4EXTREME_MPI_KRYLOVSPACE_
+
+#include <vector>
+
+#include "mpi.h"
+
+#include "Solver/ExplicitDynamics/Overlap.h"
+#include "Solver/Linear/Krylov/Krylov.h"
+
+namespace m4extreme {
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Vector space of the Krylov solvers on a partitioned mesh. The arrays
+  // are the local nodal arrays, with the values at the shared nodes
+  // consistent over the partitions, as left by a HaloExchange of the
+  // operator. The inner products weight the shared entries by the
+  // inverse of the number of partitions holding them, found once by
+  // exchanging a vector of ones, and sum the local products with a
+  // single MPI_Allreduce; a GMRES step with several inner products still
+  // takes one reduction per Gram-Schmidt pass.
+  //
+  // The constructor is collective over the ranks of the exchange.
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  class MPI_KrylovSpace : public Solver::Linear::KrylovSpace {
+
+  public:
+
+    MPI_KrylovSpace(unsigned int n, Solver::NodalExchange & exchange,
+		    MPI_Comm comm = MPI_COMM_WORLD,
+		    Utils::TaskScheduler * scheduler = Utils::GetTaskScheduler()) :
+      Solver::Linear::KrylovSpace(n, scheduler), _comm(comm) {
+      std::vector<double> w(n, 1.0);
+      if (n > 0) {
+	exchange.Begin(&w[0]);
+	exchange.End(&w[0]);
+      }
+      for (unsigned int i = 0; i < n; ++i) w[i] = w[i] > 0.0 ? 1.0 / w[i] : 0.0;
+      SetWeights(n > 0 ? &w[0] : 0);
+    }
+
+    virtual ~MPI_KrylovSpace() {}
+
+    void Reduce(double * v, int count) {
+      MPI_Allreduce(MPI_IN_PLACE, v, count, MPI_DOUBLE, MPI_SUM, _comm);
+    }
+
+  private:
+
+    MPI_Comm _comm;
+  };
+
+}
+
+#endif
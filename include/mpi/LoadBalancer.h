@@ -0,0 +1,209 @@
+//
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_MPI_LOADBALANCER_
+#define _M4EXTREME_MPI_LOADBALANCER_
+
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <time.h>
+
+#include "mpi.h"
+
+#define TAG_LOAD_DIFFUSION    5678
+
+namespace m4extreme {
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Diffusive load balancing from the measured time of each rank. The
+  // caller brackets the work to balance, e.g. the force loop, with
+  // Start/Stop; the time of a step is smoothed exponentially so that a
+  // single slow step does not move anything.
+  //
+  // Plan is collective. Balancing is armed when the largest smoothed time
+  // exceeds the mean by the upper threshold and disarmed when it falls
+  // below the lower one, and two plans are at least a given number of
+  // calls apart; this hysteresis keeps the partition still while a
+  // moving hotspot (a projectile, a crack tip) crosses a boundary. An
+  // armed plan runs a few sweeps of first or second order diffusion
+  //
+  //   f_ij^k = (beta - 1) f_ij^(k-1) + beta alpha_ij (y_i^(k-1) - y_j^(k-1)),
+  //   y_i^k  = y_i^(k-1) - sum_j f_ij^k,  alpha_ij = 1 / (1 + max(d_i, d_j)),
+  //
+  // on the rank graph, beta = 1 being the first order scheme, with
+  // messages to the neighbors only; the accumulated flows F_ij are what
+  // rank i sends to rank j. The outflow of a rank is capped at a fraction
+  // of its load so that migrations come in bounded batches, and is
+  // returned as fractions of the local load; MPI_Core::rebalance turns
+  // them into boundary material points.
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  class LoadBalancer {
+
+  public:
+
+    LoadBalancer(MPI_Comm comm = MPI_COMM_WORLD) :
+      _comm(comm), _rank(0), _upper(1.1), _lower(1.03), _beta(1.0), _batch(0.05),
+      _smoothing(0.2), _sweeps(10), _interval(20), _calls(0), _samples(0),
+      _load(0.0), _start(0.0), _armed(false), _imbalance(1.0) {
+      MPI_Comm_rank(_comm, &_rank);
+    }
+
+    virtual ~LoadBalancer() {}
+
+    // balance above upper, stop below lower (ratios of the largest to
+    // the mean time)
+    void SetThresholds(double upper, double lower) {
+      assert( upper >= lower && lower >= 1.0 );
+      _upper = upper;
+      _lower = lower;
+    }
+
+    // 1 for the first order scheme, in (1, 2) for the second order one
+    void SetOrder(double beta) {
+      assert( beta >= 1.0 && beta < 2.0 );
+      _beta = beta;
+    }
+
+    // the largest fraction of the local load sent in one plan
+    void SetBatch(double fraction) { _batch = fraction; }
+
+    // weight of the latest step in the smoothed time
+    void SetSmoothing(double weight) { _smoothing = weight; }
+
+    void SetSweeps(int sweeps) { _sweeps = sweeps; }
+
+    // the least number of Plan calls between two migrations
+    void SetInterval(int interval) { _interval = interval; }
+
+    void Start() { _start = Time(); }
+    void Stop() { Sample(Time() - _start); }
+
+    // a measured step time
+    void Sample(double seconds) {
+      _load = _samples == 0 ? seconds : (1.0 - _smoothing) * _load + _smoothing * seconds;
+      ++_samples;
+    }
+
+    double GetLoad() const { return _load; }
+    double GetImbalance() const { return _imbalance; }
+    bool IsArmed() const { return _armed; }
+
+    //
+    // collective; true on all ranks or on none, when a migration is due,
+    // outflow[r] being then the fraction of the local load to send to
+    // rank r, possibly none. neighbors are the ranks sharing nodes with
+    // this one, e.g. the overlaps of MPI_Core or HaloExchange::GetNeighbors
+    //
+    bool Plan(const std::vector<int> & neighbors, std::map<int, double> & outflow) {
+      outflow.clear();
+
+      double load = _load, maxload = 0.0, sumload = 0.0;
+      MPI_Allreduce(&load, &maxload, 1, MPI_DOUBLE, MPI_MAX, _comm);
+      MPI_Allreduce(&load, &sumload, 1, MPI_DOUBLE, MPI_SUM, _comm);
+
+      int size = 0;
+      MPI_Comm_size(_comm, &size);
+      const double mean = sumload / size;
+      _imbalance = mean > 0.0 ? maxload / mean : 1.0;
+
+      if ( _imbalance > _upper ) _armed = true;
+      else if ( _imbalance < _lower ) _armed = false;
+
+      if ( ++_calls < _interval || !_armed ) return false;
+      _calls = 0;
+
+      _setupNeighbors(neighbors);
+      const int nn = _neighbors.size();
+
+      // diffusion sweeps, the degrees ride along with the loads
+      std::vector<double> flow(nn, 0.0), total(nn, 0.0), theirs(2*nn);
+      double mine[2] = { _load, (double)nn };
+      std::vector<MPI_Request> req(2*nn);
+
+      for ( int s = 0; s < _sweeps; ++s ) {
+	for ( int k = 0; k < nn; ++k ) {
+	  MPI_Irecv(&theirs[2*k], 2, MPI_DOUBLE, _neighbors[k], TAG_LOAD_DIFFUSION, _comm, &req[k]);
+	  MPI_Isend(&mine[0], 2, MPI_DOUBLE, _neighbors[k], TAG_LOAD_DIFFUSION, _comm, &req[nn+k]);
+	}
+	if ( nn > 0 ) MPI_Waitall(2*nn, &req.front(), MPI_STATUSES_IGNORE);
+
+	double y = mine[0];
+	for ( int k = 0; k < nn; ++k ) {
+	  const double alpha = 1.0 / (1.0 + (mine[1] > theirs[2*k+1] ? mine[1] : theirs[2*k+1]));
+	  flow[k] = (_beta - 1.0) * flow[k] + _beta * alpha * (mine[0] - theirs[2*k]);
+	  total[k] += flow[k];
+	  y -= flow[k];
+	}
+	mine[0] = y;
+      }
+
+      // bounded batch, below a percent of the mean a move is not worth it
+      double out = 0.0;
+      for ( int k = 0; k < nn; ++k ) {
+	if ( total[k] > 0.01 * mean ) out += total[k];
+      }
+      if ( out > 0.0 && _load > 0.0 ) {
+	const double scale = out > _batch * _load ? _batch * _load / out : 1.0;
+	for ( int k = 0; k < nn; ++k ) {
+	  if ( total[k] > 0.01 * mean ) outflow[_neighbors[k]] = scale * total[k] / _load;
+	}
+      }
+
+      // the measured times are stale once the points have moved
+      _samples = 0;
+
+      return true;
+    }
+
+    // monotonic wall clock in seconds
+    static double Time() {
+      struct timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      return t.tv_sec + 1.0e-9 * t.tv_nsec;
+    }
+
+  private:
+
+    // the neighbor relation must be symmetric for the messages to match,
+    // as the range-box overlaps of MPI_Core and the neighbors of
+    // HaloExchange are; no collective is needed to agree on it
+    void _setupNeighbors(const std::vector<int> & neighbors) {
+      _neighbors.clear();
+      for ( size_t i = 0; i < neighbors.size(); ++i ) {
+	if ( neighbors[i] != _rank ) _neighbors.push_back(neighbors[i]);
+      }
+      std::sort(_neighbors.begin(), _neighbors.end());
+      _neighbors.erase(std::unique(_neighbors.begin(), _neighbors.end()), _neighbors.end());
+
+      return;
+    }
+
+  private:
+    MPI_Comm _comm;
+    int _rank;
+    double _upper, _lower;           // hysteresis on the imbalance
+    double _beta;                    // order of the diffusion
+    double _batch;                   // largest outflow per plan, fraction of the load
+    double _smoothing;
+    int _sweeps, _interval, _calls, _samples;
+    double _load, _start;
+    bool _armed;
+    double _imbalance;
+    std::vector<int> _neighbors;
+
+  private:
+    LoadBalancer(const LoadBalancer &);
+    LoadBalancer & operator = (const LoadBalancer &);
+  }; // end_of_LoadBalancer
+
+} // end_of_m4extreme
+
+#endif
@@ -21,6 +21,8 @@
 #include "mpi.h"
 
 #include "Factory/Builder.h"
+#include "HaloExchange.h"
+#include "LoadBalancer.h"
 
 #define MAX_MPT_SIZE          4096
 #define TAG_NODES_ASSEMBLE    123
@@ -412,6 +414,42 @@ namespace m4extreme {
       
       return;
     }
+
+
+    inline MPI_Datatype mpi_datatype(const int *) { return MPI_INT; }
+    inline MPI_Datatype mpi_datatype(const double *) { return MPI_DOUBLE; }
+
+    // same layout as mpi_allGatherData, but only the records shared with
+    // the neighbors of halo are exchanged, the local records come first;
+    // returns false if there is no exchange
+    template<typename T>
+    bool mpi_neighborGatherData(HaloExchange * halo,
+				int id_dim,
+				int val_dim,
+				const vector<int> & ids,
+				const vector<T> & vals,
+				int & total_counter,
+				int *& recv_ids,
+				T *& recv_data) {
+      if ( halo == NULL ) return false;
+
+      const int nid = val_dim < id_dim ? id_dim / val_dim : 1;
+      const int nval = val_dim < id_dim ? 1 : val_dim / id_dim;
+      vector<int> rids;
+      vector<T> rvals;
+      halo->Gather(nid, nval, ids, vals, mpi_datatype((const T *)NULL), rids, rvals);
+
+      total_counter = ids.size() + rids.size();
+      const size_t ndata = vals.size() + rvals.size();
+      recv_ids = (int*)malloc((total_counter > 0 ? total_counter : 1) * sizeof(int));
+      recv_data = (T*)malloc((ndata > 0 ? ndata : 1) * sizeof(T));
+      std::copy(ids.begin(), ids.end(), recv_ids);
+      std::copy(rids.begin(), rids.end(), recv_ids + ids.size());
+      std::copy(vals.begin(), vals.end(), recv_data);
+      std::copy(rvals.begin(), rvals.end(), recv_data + vals.size());
+
+      return true;
+    }
 	
     // collect data and save them locally (assuming the data can not be duplicated locally)
     template<typename T>
@@ -506,7 +544,8 @@ namespace m4extreme {
     void mpi_synchronizeDOFData(int numofTasks,				
 				map<int, double> & DOFdata,				
 				bool assembling = true,
-				map<int, double> * globalData = NULL) {
+				map<int, double> * globalData = NULL,
+				HaloExchange * halo = NULL) {
 
       if ( (globalData==NULL) && !assembling ) return;
       
@@ -524,7 +563,10 @@ namespace m4extreme {
       int total_counter = 0;
       int *recv_ids = NULL;
       double *recv_data = NULL;
-      mpi_allGatherData(numofTasks, 1, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      if ( globalData != NULL ||
+	   !mpi_neighborGatherData(halo, 1, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data) ) {
+	mpi_allGatherData(numofTasks, 1, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      }
       
       // clean the local data
       dof_ids.clear();
@@ -568,7 +610,8 @@ namespace m4extreme {
 				const map<int, Set::Manifold::Point*> & dofs,
 				map<Set::Manifold::Point*, T> & DOFdata,			
 				bool assembling = true,
-				map<int, T> * globalData = NULL) {
+				map<int, T> * globalData = NULL,
+				HaloExchange * halo = NULL) {
 
       if ( (globalData==NULL) && !assembling ) return;
       
@@ -592,7 +635,10 @@ namespace m4extreme {
       int total_counter = 0;
       int *recv_ids = NULL;
       T *recv_data = NULL;
-      mpi_allGatherData(numofTasks, 1, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      if ( globalData != NULL ||
+	   !mpi_neighborGatherData(halo, 1, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data) ) {
+	mpi_allGatherData(numofTasks, 1, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      }
       
       // clean the local data
       dof_ids.clear();
@@ -642,7 +688,8 @@ namespace m4extreme {
     				const map<int, Set::Manifold::Point*> & dofs,
     				map<std::pair<Set::Manifold::Point*, Set::Manifold::Point*>, double> & DOFdata,
     				bool assembling = true,
-    				map<std::pair<int, int>, double> * globalData = NULL) {
+    				map<std::pair<int, int>, double> * globalData = NULL,
+				HaloExchange * halo = NULL) {
 
       if ( (globalData==NULL) && !assembling ) return;
       
@@ -667,7 +714,10 @@ namespace m4extreme {
       int total_counter = 0;
       int *recv_ids = NULL;
       double *recv_data = NULL;
-      mpi_allGatherData(numofTasks, 2, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      if ( globalData != NULL ||
+	   !mpi_neighborGatherData(halo, 2, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data) ) {
+	mpi_allGatherData(numofTasks, 2, 1, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      }
       
       // clean the local data
       dof_ids.clear();
@@ -720,7 +770,8 @@ namespace m4extreme {
 				const map<int, Set::Manifold::Point*> & dofs,
 				map<Set::Manifold::Point*, T> & DOFdata,	
 				int flag = 0, //0: synchronize; 1: assembling (add); 2: dissembling (subtract)
-				map<int, T> * globalData = NULL) {
+				map<int, T> * globalData = NULL,
+				HaloExchange * halo = NULL) {
 
       if ( (globalData==NULL) && (flag==0) ) return;
       
@@ -757,8 +808,14 @@ namespace m4extreme {
       int *recv_dims = NULL;
       double *recv_data = NULL;
 
-      mpi_allGatherData(numofTasks, 1, 1, dof_ids, dof_dims, total_counter, recv_ids_tmp, recv_dims);
-      mpi_allGatherData(numofTasks, 1, DIM, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      if ( globalData != NULL ||
+	   !mpi_neighborGatherData(halo, 1, 1, dof_ids, dof_dims, total_counter, recv_ids_tmp, recv_dims) ) {
+	mpi_allGatherData(numofTasks, 1, 1, dof_ids, dof_dims, total_counter, recv_ids_tmp, recv_dims);
+	mpi_allGatherData(numofTasks, 1, DIM, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      }
+      else {
+	mpi_neighborGatherData(halo, 1, DIM, dof_ids, dof_vals, total_counter, recv_ids, recv_data);
+      }
       
       /* // clean the local data */
       /* dof_ids.clear(); */
@@ -943,6 +1000,35 @@ namespace m4extreme {
 	  return;
 	}
 
+	// set up a neighbor-only exchange from the communication map, to be
+	// given to mpi_synchronizeDOFData when assembling into the local
+	// data; collective. The exchange refers to the local nodes, build it
+	// again after update() or a rebalance
+	void buildHaloExchange(HaloExchange & halo) {
+	  _constructCommunicationMap();
+	  halo.Setup(_overlaps, _shadowNodes, *_idmap, *_dofmap);
+	  return;
+	}
+
+	// wire the overlapped force evaluation of a partitioned run: build
+	// the exchange, bind it to field and classify the elements
+	// of split against its shared nodes, e.g.
+	//	Solver::ElementForce kernel(DE, LS, &Emb, &field, nthreads);
+	//	Solver::PartitionedForce<Solver::ElementForce> split(&kernel, &field);
+	//	core.buildOverlap(halo, field, split);
+	//	dynamics.SetOverlap(&split, &halo);
+	// with DE from MEMPModelBuilder::GetElementForces and dynamics a
+	// Solver::FlatExplicitDynamics. Collective; call again after
+	// update(), rebalance() or a new kernel.Setup()
+	template<class Kernel>
+	void buildOverlap(HaloExchange & halo, Solver::NodalField & field,
+			  Solver::PartitionedForce<Kernel> & split) {
+	  buildHaloExchange(halo);
+	  halo.Bind(field);
+	  split.Partition(halo.GetSharedNodes());
+	  return;
+	}
+
 	void resetPotentialNodes(const vector<int> & localPNIDs) {
 	  int total_counter = 0;
 	  int *recv_data = NULL;
@@ -993,6 +1079,8 @@ namespace m4extreme {
 	  return;
 	}
 
+	// migrates material points and nodes, a HaloExchange built before
+	// must be built again with buildHaloExchange() or buildOverlap()
 	void rebalance(double criterion, double local_cost) { // criterion: critical relative standard deviation
 
 	    // note:GetComputationalCost function couldn't provide an accurate measurement of the 
@@ -1042,6 +1130,86 @@ namespace m4extreme {
 	    return;
 	}
 
+	// diffusive rebalancing from the measured time of the ranks, see
+	// LoadBalancer; collective. The material points sent to a neighbor
+	// are taken layer by layer from the shared nodes inward, so that
+	// the boundary moves and the partitions stay compact. As with the
+	// other rebalance, a HaloExchange must be built again afterwards.
+	void rebalance(LoadBalancer & balancer) {
+
+	    if ( _cm_recv.empty() ) {
+	      _constructCommunicationMap();
+	    }
+
+	    map<int, double> outflow;
+	    if ( !balancer.Plan(_overlaps, outflow) ) return;
+
+	    vector<COST_TYPE> costs;
+	    _pModel->GetComputationalCost(costs);
+
+	    double local_cost = 0.0;
+	    for ( int i = 0; i < costs.size(); ++i ) {
+	      for ( COST_TYPE::const_iterator pc = costs[i].begin(); pc != costs[i].end(); ++pc ) {
+		local_cost += pc->second;
+	      }
+	    }
+
+	    // nodes of the candidates
+	    typedef Element::MaterialPoint::LocalState LS_type;
+	    map<LS_type*, set<dof_type*> > support;
+	    map<LS_type*, int> body;
+	    for ( int i = 0; i < costs.size(); ++i ) {
+	      for ( COST_TYPE::const_iterator pc = costs[i].begin(); pc != costs[i].end(); ++pc ) {
+		pc->first->GetNodes(support[pc->first]);
+		body[pc->first] = i;
+	      }
+	    }
+
+	    _immigrants.clear();
+	    for ( map<int, double>::const_iterator pO = outflow.begin(); pO != outflow.end(); ++pO ) {
+	      const int r = pO->first;
+	      double target = pO->second * local_cost;
+
+	      map<int, vector<dof_type*> >::const_iterator pS = _shadowNodes.find(r);
+	      if ( pS == _shadowNodes.end() ) continue;
+
+	      vector< vector<LS_type*> > & moving = _immigrants[r];
+	      moving.resize(costs.size());
+
+	      set<dof_type*> front(pS->second.begin(), pS->second.end());
+	      while ( target > 0.0 && !front.empty() && !support.empty() ) {
+		set<dof_type*> next;
+		map<LS_type*, set<dof_type*> >::iterator pL = support.begin();
+		while ( pL != support.end() && target > 0.0 ) {
+		  bool touches = false;
+		  for ( set<dof_type*>::const_iterator pn = pL->second.begin(); pn != pL->second.end(); ++pn ) {
+		    if ( front.count(*pn) ) { touches = true; break; }
+		  }
+		  if ( !touches ) { ++pL; continue; }
+
+		  const int k = body[pL->first];
+		  moving[k].push_back(pL->first);
+		  target -= costs[k].find(pL->first)->second;
+		  next.insert(pL->second.begin(), pL->second.end());
+		  support.erase(pL++);
+		}
+		front.swap(next);
+	      }
+	    }
+
+	    _migrateNodes();
+
+	    for ( int i = 0; i < costs.size(); ++i ) _migrateMpts(i);
+
+	    // recontruct the lumped mass data structure
+	    _pModel->ComputeLumpedMass();
+
+	    // the shared nodes moved with the boundary
+	    _constructCommunicationMap();
+
+	    return;
+	}
+
 	// Instrument tools
 
 	// Get the total strain energy of all the bodies in the computational domain
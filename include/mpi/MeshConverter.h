@@ -0,0 +1,69 @@
+//
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_MESH_CONVERTER_
+#define _M4EXTREME_MESH_CONVERTER_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mpi/Partitioner.h"
+#include "Geometry/GeneralGeometry/Femap2m4extreme/FemapFileConverter.h"
+#include "Geometry/GeneralGeometry/Hypermesh2m4extreme/HypermeshFileConverter.h"
+#include "Geometry/GeneralGeometry/Ansys2m4extreme/AnsysFileConverter.h"
+
+using namespace std;
+
+namespace m4extreme {
+
+  //
+  // partitions eureka mesh files, one per body, into np parts along a
+  // Hilbert curve and writes them to the binary MeshFile out
+  //
+  template<int dim> int MeshFileConverter(const vector<string> & filenames,
+					  const char * out, int np = 1, bool hasGroups = false) {
+    HilbertPartitioner<dim> partitioner(hasGroups);
+    partitioner.setBinaryOutput(out);
+    for ( int i = 0; i < filenames.size(); ++i ) {
+      partitioner.push_back(filenames[i]);
+    }
+
+    return partitioner(np);
+  }
+
+  //
+  // the converters of Geometry/GeneralGeometry followed by
+  // MeshFileConverter, through a temporary eureka file next to out
+  //
+  template<int dim> int FemapToMeshFile(const char * in, const char * out, int np = 1,
+					bool hasGroups = true, int type = 0) {
+    string tmpfile = string(out) + ".eureka";
+    FemapFileConverter(dim, in, tmpfile.c_str(), type);
+    int status = MeshFileConverter<dim>(vector<string>(1, tmpfile), out, np, hasGroups);
+    remove(tmpfile.c_str());
+    return status;
+  }
+
+  template<int dim> int HypermeshToMeshFile(const char * in, const char * out, int np = 1) {
+    string tmpfile = string(out) + ".eureka";
+    HypermeshFileConverter(dim, dim+1, in, tmpfile.c_str());
+    int status = MeshFileConverter<dim>(vector<string>(1, tmpfile), out, np, true);
+    remove(tmpfile.c_str());
+    return status;
+  }
+
+  template<int dim> int AnsysToMeshFile(const char * in, const char * out, int np = 1) {
+    string tmpfile = string(out) + ".eureka";
+    AnsysFileConverter(dim, dim+1, in, tmpfile.c_str());
+    int status = MeshFileConverter<dim>(vector<string>(1, tmpfile), out, np, true);
+    remove(tmpfile.c_str());
+    return status;
+  }
+
+}
+
+#endif //end of _M4EXTREME_MESH_CONVERTER_
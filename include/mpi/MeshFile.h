@@ -0,0 +1,330 @@
+//
+// Copyright (c) 2017-2018 Extreme Computation Technology and Solutions, LLC
+// All rights reserved
+// see file License.txt for license details
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _M4EXTREME_MESH_FILE_
+#define _M4EXTREME_MESH_FILE_
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Geometry/GeneralGeometry/GeneralGeometry.h"
+
+using namespace std;
+
+namespace m4extreme {
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Binary mesh container written by Partitioner::dump when a binary
+  // output is set, in place of the init_<body>_<part>.dat files. All
+  // blocks are in the byte order of the writer:
+  //
+  //   header     MeshFileHeader
+  //   nodes      double[numofNodes * dim]           global coordinates
+  //   elements   int[numofElms * nodesPerElement]   global connectivity
+  //   roots      int[numofElms]                     body of each element
+  //   parts      MeshFilePart[numofParts * numofBodies], part major
+  //   slices     for every part and body, contiguous: the coordinates,
+  //              the node ids, the element ids (positions in the
+  //              global blocks) and the connectivity, i.e. the content
+  //              of its init file
+  //   groups     int count, then per group int type (7 nodes,
+  //              8 elements), int length, the name, int size, the ids
+  //
+  // A rank maps the file and copies its own slices only, so the pages of
+  // the other partitions are never read; readGeometry builds the
+  // geometry of a body straight from its slice, in place of parsing the
+  // init file at startup.
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  struct MeshFileHeader {
+    char magic[8];
+    int version;
+    int dim;
+    int nodesPerElement;
+    int numofBodies;
+    int numofParts;
+    int hasGroups;
+    long long numofNodes;
+    long long numofElms;
+    long long nodes, elements, roots, parts, groups;
+  };
+
+  struct MeshFilePart {
+    long long offset;
+    long long numofNodes;
+    long long numofElms;
+  };
+
+  static const char _M4EXTREME_MESH_FILE_MAGIC_[8] = { 'M', '4', 'X', 'M', 'E', 'S', 'H', '\0' };
+
+  //
+  // sequential writer, the offsets of the blocks are patched in the
+  // header once they are known
+  //
+  class MeshFileWriter {
+  public:
+
+    MeshFileWriter(const char * filename) : _offset(0) {
+      _fp = fopen(filename, "wb");
+      if ( _fp != NULL ) setvbuf(_fp, NULL, _IOFBF, 1 << 22);
+    }
+
+    ~MeshFileWriter() { close(); }
+
+    bool good() const { return _fp != NULL; }
+    long long tell() const { return _offset; }
+
+    void write(const void * p, size_t bytes) {
+      if ( bytes > 0 && fwrite(p, 1, bytes, _fp) != bytes ) {
+	cerr << "failed to write the mesh file" << endl;
+	assert(false);
+      }
+      _offset += bytes;
+    }
+
+    // pad to a multiple of 8 bytes
+    void align() {
+      static const char zeros[8] = { 0 };
+      if ( _offset % 8 != 0 ) write(zeros, 8 - _offset % 8);
+    }
+
+    void patch(long long offset, const void * p, size_t bytes) {
+      fflush(_fp);
+      fseeko(_fp, offset, SEEK_SET);
+      fwrite(p, 1, bytes, _fp);
+      fseeko(_fp, _offset, SEEK_SET);
+    }
+
+    void close() {
+      if ( _fp != NULL ) fclose(_fp);
+      _fp = NULL;
+    }
+
+  private:
+    FILE * _fp;
+    long long _offset;
+
+  private:
+    MeshFileWriter(const MeshFileWriter &);
+    MeshFileWriter & operator=(const MeshFileWriter &);
+  };
+
+  //
+  // read access to a mesh file through a read-only memory map
+  //
+  class MeshFile {
+  public:
+
+    MeshFile() : _fd(-1), _base(NULL), _size(0) {}
+    MeshFile(const char * filename) : _fd(-1), _base(NULL), _size(0) { open(filename); }
+    ~MeshFile() { close(); }
+
+    // false if the file cannot be mapped or is not a mesh file
+    bool open(const char * filename) {
+      close();
+      _fd = ::open(filename, O_RDONLY);
+      if ( _fd < 0 ) return false;
+
+      struct stat st;
+      if ( fstat(_fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshFileHeader) ) {
+	close();
+	return false;
+      }
+
+      _size = st.st_size;
+      void * base = mmap(NULL, _size, PROT_READ, MAP_SHARED, _fd, 0);
+      if ( base == MAP_FAILED ) {
+	close();
+	return false;
+      }
+      _base = (const char *)base;
+
+      memcpy(&_header, _base, sizeof(MeshFileHeader));
+      if ( memcmp(_header.magic, _M4EXTREME_MESH_FILE_MAGIC_, 8) != 0 || _header.version != 1 ) {
+	close();
+	return false;
+      }
+      return true;
+    }
+
+    void close() {
+      if ( _base != NULL ) munmap((void *)_base, _size);
+      if ( _fd >= 0 ) ::close(_fd);
+      _base = NULL;
+      _fd = -1;
+      _size = 0;
+    }
+
+    bool is_open() const { return _base != NULL; }
+
+    const MeshFileHeader & getHeader() const { return _header; }
+    int getDimension() const { return _header.dim; }
+    int getNumofBodies() const { return _header.numofBodies; }
+    int getNumofParts() const { return _header.numofParts; }
+    long long getNumofNodes() const { return _header.numofNodes; }
+    long long getNumofElements() const { return _header.numofElms; }
+    bool hasGroups() const { return _header.hasGroups != 0; }
+
+    const MeshFilePart getPart(int part, int body) const {
+      assert( is_open() && part >= 0 && part < _header.numofParts &&
+	      body >= 0 && body < _header.numofBodies );
+      MeshFilePart P;
+      _copy(_header.parts + (long long)(part * _header.numofBodies + body) * sizeof(MeshFilePart), 1, &P);
+      return P;
+    }
+
+    // the nodes and elements of a body on a part, as its init file:
+    // global node ids and their coordinates, element ids and their
+    // connectivity in global node ids
+    void read(int part, int body,
+	      vector<int> & nodeIds, vector<double> & x,
+	      vector<int> & elementIds, vector<int> & connectivity) const {
+      const MeshFilePart P = getPart(part, body);
+      const int dim = _header.dim, npe = _header.nodesPerElement;
+      x.resize(P.numofNodes * dim);
+      nodeIds.resize(P.numofNodes);
+      elementIds.resize(P.numofElms);
+      connectivity.resize(P.numofElms * npe);
+
+      long long offset = P.offset;
+      offset = _copy(offset, x.size(), x.empty() ? NULL : &x[0]);
+      offset = _copy(offset, nodeIds.size(), nodeIds.empty() ? NULL : &nodeIds[0]);
+      offset = _copy(offset, elementIds.size(), elementIds.empty() ? NULL : &elementIds[0]);
+      _copy(offset, connectivity.size(), connectivity.empty() ? NULL : &connectivity[0]);
+      return;
+    }
+
+    // the whole mesh
+    void readNodes(vector<double> & x) const {
+      x.resize(_header.numofNodes * _header.dim);
+      _copy(_header.nodes, x.size(), x.empty() ? NULL : &x[0]);
+    }
+
+    void readElements(vector<int> & connectivity, vector<int> & roots) const {
+      connectivity.resize(_header.numofElms * _header.nodesPerElement);
+      roots.resize(_header.numofElms);
+      _copy(_header.elements, connectivity.size(), connectivity.empty() ? NULL : &connectivity[0]);
+      _copy(_header.roots, roots.size(), roots.empty() ? NULL : &roots[0]);
+    }
+
+    void readGroups(map<string, vector<int> > & nodeGroups,
+		    map<string, vector<int> > & elementGroups) const {
+      nodeGroups.clear();
+      elementGroups.clear();
+      if ( !is_open() || _header.groups == 0 ) return;
+
+      int count = 0, type = 0, length = 0, size = 0;
+      long long offset = _copy(_header.groups, 1, &count);
+      for ( int i = 0; i < count; ++i ) {
+	offset = _copy(offset, 1, &type);
+	offset = _copy(offset, 1, &length);
+	_check(offset, length);
+	string name(_base + offset, length);
+	offset += length;
+	offset = _copy(offset, 1, &size);
+	vector<int> & ids = (type == 7 ? nodeGroups : elementGroups)[name];
+	ids.resize(size);
+	offset = _copy(offset, size, ids.empty() ? NULL : &ids[0]);
+      }
+    }
+
+    // the geometry of a body on a part, as GeneralGeometry reads it from
+    // init_<body>_<part>.dat (and groups.dat); owned by the caller
+    Geometry::Solid::Mesh::GeneralGeometry * readGeometry(int part, int body, int flag = 0) const {
+      typedef Geometry::Solid::Mesh::GeneralGeometry::point_type point_type;
+      vector<int> nodeIds, elementIds, connectivity;
+      vector<double> x;
+      read(part, body, nodeIds, x, elementIds, connectivity);
+
+      const int dim = _header.dim, npe = _header.nodesPerElement;
+      map<unsigned int, point_type> nodes;
+      for ( size_t i = 0; i < nodeIds.size(); ++i ) {
+	point_type xloc(dim);
+	for ( int k = 0; k < dim; ++k ) xloc[k] = x[i * dim + k];
+	nodes.insert(make_pair((unsigned int)nodeIds[i], xloc));
+      }
+
+      map<unsigned int, vector<unsigned int> > elements;
+      for ( size_t i = 0; i < elementIds.size(); ++i ) {
+	elements.insert(make_pair((unsigned int)elementIds[i],
+				  vector<unsigned int>(connectivity.begin() + i * npe,
+						       connectivity.begin() + (i + 1) * npe)));
+      }
+
+      map<string, vector<int> > nodeGroups, elementGroups;
+      readGroups(nodeGroups, elementGroups);
+
+      return new Geometry::Solid::Mesh::GeneralGeometry(dim, nodes, elements,
+							nodeGroups, elementGroups, flag);
+    }
+
+    // a slice in the format of the init files of Partitioner::dump
+    void writeASCII(int part, int body, ostream & os) const {
+      vector<int> nodeIds, elementIds, connectivity;
+      vector<double> x;
+      read(part, body, nodeIds, x, elementIds, connectivity);
+
+      const int dim = _header.dim, npe = _header.nodesPerElement;
+      os << dim << " " << npe << " " << nodeIds.size() << " " << elementIds.size() << std::endl;
+      for ( size_t i = 0; i < nodeIds.size(); ++i ) {
+	os << nodeIds[i] << " ";
+	for ( int k = 0; k < dim; ++k ) os << x[i * dim + k] << " ";
+	os << std::endl;
+      }
+      for ( size_t i = 0; i < elementIds.size(); ++i ) {
+	if ( _header.hasGroups ) os << elementIds[i] << " ";
+	for ( int k = 0; k < npe; ++k ) os << connectivity[i * npe + k] << " ";
+	os << std::endl;
+      }
+    }
+
+  private:
+
+    // a corrupted file cannot be read past, the run stops
+    void _check(long long offset, long long bytes) const {
+      if ( offset < 0 || bytes < 0 || (unsigned long long)offset > _size
+	   || (unsigned long long)bytes > _size - offset ) {
+	cerr << "corrupted mesh file" << endl;
+	abort();
+      }
+    }
+
+    // copies n values at offset, returns the offset past them
+    template<typename T>
+    long long _copy(long long offset, size_t n, T * p) const {
+      const size_t bytes = n * sizeof(T);
+      _check(offset, bytes);
+      if ( bytes > 0 ) memcpy(p, _base + offset, bytes);
+      return offset + bytes;
+    }
+
+  private:
+    int _fd;
+    const char * _base;
+    size_t _size;
+    MeshFileHeader _header;
+
+  private:
+    MeshFile(const MeshFile &);
+    MeshFile & operator=(const MeshFile &);
+  };
+
+}
+
+#endif //end of _M4EXTREME_MESH_FILE_
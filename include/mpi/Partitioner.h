@@ -16,6 +16,9 @@
 #include <map>
 #include <stdlib.h>
 
+#include "Geometry/Search/CellSearch/ParallelCellSearch.h"
+#include "mpi/MeshFile.h"
+
 #if defined(_M4EXTREME_METIS_)
 extern "C" {
 #include "metis.h"
@@ -89,6 +92,10 @@ namespace m4extreme {
       vector< _NODE<dim> > & getNodes() { return _nodes; }
       vector< _ELEMENT<dim> > & getElements() { return _elements; }
 
+      // write the partitions to a single binary MeshFile instead of the
+      // init_<body>_<part>.dat and groups.dat files of the output directory
+      void setBinaryOutput(const char * filename) { _binaryfile = filename == NULL ? "" : filename; }
+
       const int getNumofBodies() const { return _numofBodies; }
       const map<string, vector<int> > & getNodeGroups() const { return _node_groups; }
       const map<string, vector<int> > & getElementGroups() const { return _solid_groups; }
@@ -115,10 +122,11 @@ namespace m4extreme {
     
   protected:
       void dump(int);
+      void dumpBinary(int);
       void insert(int, const _ELEMENT<dim> *);
         
   protected:
-      string _destdir;
+      string _destdir, _binaryfile;
       bool _hasGroups;
       int _numofBodies;
       vector< _NODE<dim> > _nodes;      
@@ -179,6 +187,85 @@ namespace m4extreme {
     double _cx, _cy, _r2, _z;
   };
 
+  //
+  // cost of an element for the weighted partitioners, e.g. from the
+  // number of neighbors or the material state of its material point
+  //
+  template<int dim> class ElementCost {
+  public:
+    virtual ~ElementCost() {}
+    virtual double operator()(const _ELEMENT<dim> &, const vector< _NODE<dim> > &) const = 0;
+  };
+
+  //
+  // Orders the elements along the Hilbert curve through their centroids
+  // and cuts the curve into np pieces of equal weight, so the partitions
+  // are compact and balanced without METIS. The weights are, in order of
+  // precedence, those given to setWeights() in the order the elements
+  // were pushed (e.g. the costs of MEMPModelBuilder::GetComputationalCost
+  // body by body), those of the cost model, or 1 per element. The curve
+  // and the prefix sum of the weights along it run on the task scheduler.
+  //
+  template<int dim> class
+    HilbertPartitioner : public Partitioner<dim> {
+  public:
+    HilbertPartitioner(bool hasGroups, const char* outdir=NULL)
+      : Partitioner<dim>(hasGroups, outdir), _cost(NULL) {}
+
+    void setWeights(const vector<double> & weights) { _weights = weights; }
+    void setCostModel(const ElementCost<dim> * cost) { _cost = cost; }
+
+    // computes the partition without writing it
+    void partition(int np);
+    int operator()(int np);
+
+    const vector<int> & getPartition() const { return _part; }
+    const vector<double> & getPartitionWeights() const { return _part_weights; }
+
+  private:
+    // sum of the weights of each block of the curve
+    struct _BlockSum {
+      const vector<size_t> & order; const vector<double> & w;
+      size_t n, nb; double * sums;
+      _BlockSum(const vector<size_t> & o, const vector<double> & w_, size_t nb_, double * s)
+	: order(o), w(w_), n(o.size()), nb(nb_), sums(s) {}
+      void operator()(size_t lo, size_t hi) {
+	for ( size_t b = lo; b < hi; ++b ) {
+	  double sum = 0.0;
+	  for ( size_t j = b * n / nb; j < (b+1) * n / nb; ++j ) sum += w[order[j]];
+	  sums[b] = sum;
+	}
+      }
+    };
+
+    // the part of an element is that of the midpoint of its weight
+    // interval along the curve
+    struct _BlockCut {
+      const vector<size_t> & order; const vector<double> & w;
+      size_t n, nb; const double * offsets; double scale; int np; int * part;
+      _BlockCut(const vector<size_t> & o, const vector<double> & w_, size_t nb_,
+		const double * off, double sc, int np_, int * p)
+	: order(o), w(w_), n(o.size()), nb(nb_), offsets(off), scale(sc), np(np_), part(p) {}
+      void operator()(size_t lo, size_t hi) {
+	for ( size_t b = lo; b < hi; ++b ) {
+	  double prefix = offsets[b];
+	  for ( size_t j = b * n / nb; j < (b+1) * n / nb; ++j ) {
+	    const double wj = w[order[j]];
+	    int p = (int)((prefix + 0.5 * wj) * scale);
+	    part[order[j]] = p < 0 ? 0 : (p < np ? p : np - 1);
+	    prefix += wj;
+	  }
+	}
+      }
+    };
+
+  private:
+    vector<double> _weights;
+    const ElementCost<dim> * _cost;
+    vector<int> _part;
+    vector<double> _part_weights;
+  };
+
 #if defined(_M4EXTREME_METIS_)
   template<int dim> class 
     MetisPartitioner : public Partitioner<dim> {
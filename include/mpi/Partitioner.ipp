@@ -260,6 +260,12 @@ namespace m4extreme {
     void Partitioner<dim>::dump(int np) {
         
         assert ( _elementsets != NULL && _nodesets != NULL );
+
+	if ( !_binaryfile.empty() ) {
+	  dumpBinary(np);
+	  return;
+	}
+
         char buf[_M4EXTREME_MAX_BUF_SIZE_];
         ofstream ofs[_numofBodies];
 
@@ -356,6 +362,136 @@ namespace m4extreme {
         return;
     }
 
+  template <int dim>
+    void Partitioner<dim>::dumpBinary(int np) {
+
+    assert ( _elementsets != NULL && _nodesets != NULL );
+
+    MeshFileWriter writer(_binaryfile.c_str());
+    if ( !writer.good() ) {
+      std::cerr << "couldnot open output file " << _binaryfile << std::endl;
+      assert(false);
+    }
+
+    const long long numofNodes = _nodes.size(), numofElms = _elements.size();
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(MeshFileHeader));
+    memcpy(header.magic, _M4EXTREME_MESH_FILE_MAGIC_, 8);
+    header.version = 1;
+    header.dim = dim;
+    header.nodesPerElement = dim+1;
+    header.numofBodies = _numofBodies;
+    header.numofParts = np;
+    header.hasGroups = _hasGroups ? 1 : 0;
+    header.numofNodes = numofNodes;
+    header.numofElms = numofElms;
+    writer.write(&header, sizeof(MeshFileHeader));
+
+    /**
+     * global blocks
+     */
+    vector<double> x;
+    vector<int> ids;
+
+    header.nodes = writer.tell();
+    x.resize(numofNodes * dim);
+    for ( long long i = 0; i < numofNodes; ++i ) {
+      for ( int k = 0; k < dim; ++k ) x[i*dim+k] = _nodes[i]._x[k];
+    }
+    writer.write(x.empty() ? NULL : &x[0], x.size() * sizeof(double));
+
+    header.elements = writer.tell();
+    ids.resize(numofElms * (dim+1));
+    for ( long long i = 0; i < numofElms; ++i ) {
+      for ( int k = 0; k < dim+1; ++k ) ids[i*(dim+1)+k] = _elements[i]._ids[k];
+    }
+    writer.write(ids.empty() ? NULL : &ids[0], ids.size() * sizeof(int));
+
+    header.roots = writer.tell();
+    ids.resize(numofElms);
+    for ( long long i = 0; i < numofElms; ++i ) ids[i] = _elements[i]._root;
+    writer.write(ids.empty() ? NULL : &ids[0], ids.size() * sizeof(int));
+    writer.align();
+
+    /**
+     * the part table is patched once the slices are written
+     */
+    header.parts = writer.tell();
+    vector<MeshFilePart> parts(np * _numofBodies);
+    writer.write(&parts[0], parts.size() * sizeof(MeshFilePart));
+
+    for (int i = 0; i < np; ++i) {
+      for (int j = 0; j < _numofBodies; ++j) {
+	const set<int> & nodesloc = _nodesets[i][j];
+	const vector<const _ELEMENT<dim>*> & elmsloc = _elementsets[i][j];
+
+	MeshFilePart & P = parts[i * _numofBodies + j];
+	P.offset = writer.tell();
+	P.numofNodes = nodesloc.size();
+	P.numofElms = elmsloc.size();
+
+	x.resize(nodesloc.size() * dim);
+	ids.resize(nodesloc.size());
+	std::set<int>::const_iterator pn;
+	int count = 0;
+	for (pn = nodesloc.begin(); pn != nodesloc.end(); pn++, ++count) {
+	  ids[count] = *pn;
+	  for ( int k=0; k<dim; ++k ) x[count*dim+k] = _nodes[*pn]._x[k];
+	}
+	writer.write(x.empty() ? NULL : &x[0], x.size() * sizeof(double));
+	writer.write(ids.empty() ? NULL : &ids[0], ids.size() * sizeof(int));
+
+	ids.resize(elmsloc.size() * (dim+2));
+	int * elmids = ids.empty() ? NULL : &ids[0];
+	int * conn = elmids + elmsloc.size();
+	for (int k = 0; k < elmsloc.size(); k++) {
+	  elmids[k] = elmsloc[k] - &_elements[0];
+	  for ( int l=0; l<dim+1; ++l ) conn[k*(dim+1)+l] = elmsloc[k]->_ids[l];
+	}
+	writer.write(elmids, ids.size() * sizeof(int));
+	writer.align();
+      }
+
+      delete [] _nodesets[i];
+      delete [] _elementsets[i];
+    }
+
+    delete [] _nodesets;
+    delete [] _elementsets;
+
+    _elementsets = NULL;
+    _nodesets = NULL;
+
+    /**
+     * groups, as in groups.dat
+     */
+    if ( _hasGroups ) {
+      header.groups = writer.tell();
+      int count = _node_groups.size() + _solid_groups.size();
+      writer.write(&count, sizeof(int));
+      for ( int type = 7; type <= 8; ++type ) {
+	const map<string, vector<int> > & groups = type == 7 ? _node_groups : _solid_groups;
+	map<string, vector<int> >::const_iterator pG;
+	for ( pG = groups.begin(); pG != groups.end(); pG++ ) {
+	  const vector<int> & entities = pG->second;
+	  int length = pG->first.size(), size = entities.size();
+	  writer.write(&type, sizeof(int));
+	  writer.write(&length, sizeof(int));
+	  writer.write(pG->first.c_str(), length);
+	  writer.write(&size, sizeof(int));
+	  writer.write(entities.empty() ? NULL : &entities[0], size * sizeof(int));
+	}
+      }
+    }
+
+    writer.patch(header.parts, &parts[0], parts.size() * sizeof(MeshFilePart));
+    writer.patch(0, &header, sizeof(MeshFileHeader));
+    writer.close();
+
+    return;
+  }
+
   template <int dim>
   void Partitioner<dim>::insert(int part, const _ELEMENT<dim> * pEloc) {
     assert(_nodesets[part] != NULL && _elementsets[part] != NULL);
@@ -911,9 +1047,89 @@ namespace m4extreme {
     return 0;
   }
 
+  template <int dim>
+  void HilbertPartitioner<dim>::partition(int np) {
+
+    assert(Partitioner<dim>::_numofBodies > 0 && np > 0);
+
+    const vector< _NODE<dim> > & nodes = Partitioner<dim>::_nodes;
+    const vector< _ELEMENT<dim> > & elements = Partitioner<dim>::_elements;
+    const size_t numofElms = elements.size();
+
+    vector<double> w(numofElms, 1.0);
+    if ( !_weights.empty() ) {
+      assert( _weights.size() == numofElms );
+      w = _weights;
+    }
+    else if ( _cost != NULL ) {
+      for ( size_t i = 0; i < numofElms; ++i ) {
+	w[i] = (*_cost)(elements[i], nodes);
+      }
+    }
+
+    vector<double> xc(numofElms * dim, 0.0);
+    const double Na = 1.0 / (double)(dim + 1);
+    for ( size_t i = 0; i < numofElms; ++i ) {
+      const int * ids = elements[i]._ids;
+      for ( int k = 0; k < dim + 1; ++k ) {
+	for ( int d = 0; d < dim; ++d ) {
+	  xc[i * dim + d] += Na * nodes[ids[k]]._x[d];
+	}
+      }
+    }
+
+    vector<size_t> order;
+    geom::cellHilbertOrder(numofElms, dim, numofElms > 0 ? &xc[0] : NULL, dim, order);
+
+    // prefix sum of the weights along the curve, by blocks
+    const size_t nb = geom::cellSearchBlocks(numofElms);
+    vector<double> offsets(nb + 1, 0.0);
+    {
+      _BlockSum sum(order, w, nb, &offsets[1]);
+      geom::cellSearchFor(nb, 1, sum);
+    }
+    for ( size_t b = 0; b < nb; ++b ) offsets[b+1] += offsets[b];
+
+    const double total = offsets[nb];
+    _part.assign(numofElms, 0);
+    if ( numofElms > 0 ) {
+      _BlockCut cut(order, w, nb, &offsets[0], total > 0.0 ? np / total : 0.0, np, &_part[0]);
+      geom::cellSearchFor(nb, 1, cut);
+    }
+
+    _part_weights.assign(np, 0.0);
+    for ( size_t i = 0; i < numofElms; ++i ) {
+      _part_weights[_part[i]] += w[i];
+    }
+
+    return;
+  }
+
+  template <int dim>
+  int HilbertPartitioner<dim>::operator()(int np) {
+
+    partition(np);
+
+    Partitioner<dim>::_nodesets = new set<int>*[np];
+    Partitioner<dim>::_elementsets = new vector<const _ELEMENT<dim>*>*[np];
+
+    for ( int i = 0; i < np; ++i ) {
+      Partitioner<dim>::_nodesets[i] = new set<int>[Partitioner<dim>::_numofBodies];
+      Partitioner<dim>::_elementsets[i] = new vector<const _ELEMENT<dim>*>[Partitioner<dim>::_numofBodies];
+    }
+
+    for ( size_t i = 0; i < _part.size(); ++i ) {
+      Partitioner<dim>::insert(_part[i], &Partitioner<dim>::_elements[i]);
+    }
+
+    Partitioner<dim>::dump(np);
+
+    return 0;
+  }
+
   template<int dim> int partitioning(const std::vector<std::string> & filenames, 
 				     int np, int flag, double perc, int quantity, bool hasGroups,
-				     const char* destdir="./data") {
+				     const char* destdir) {
     
     m4extreme::Partitioner<dim> * partitioner = NULL;
     
@@ -935,6 +1151,9 @@ namespace m4extreme {
     case 4:
       partitioner = new m4extreme::QuantitivePartitioner<dim>(hasGroups, quantity);
       break;
+    case 5:
+      partitioner = new m4extreme::HilbertPartitioner<dim>(hasGroups, destdir);
+      break;
     default:
       cerr << "no partitioning algorithm has been selected. Abort." << endl;
       assert(false);